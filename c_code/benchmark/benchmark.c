@@ -0,0 +1,754 @@
+/*
+ * Copyright (c) 2024 by Rock de Vocht
+ *
+ * All rights reserved. No part of this publication may be reproduced, distributed, or
+ * transmitted in any form or by any means, including photocopying, recording, or other
+ * electronic or mechanical methods, without the prior written permission of the publisher,
+ * except in the case of brief quotations embodied in critical reviews and certain other
+ * noncommercial uses permitted by copyright law.
+ *
+ */
+
+/**
+ * benchmark suite for the IntIntHashMap, IntObjHashMap and StringHashSet
+ *
+ * every run is repeatable (seeded random numbers) and each (structure, workload, distribution, size)
+ * combination is measured twice from a fresh map:
+ *   pass 1 - batches of operations are timed as a whole, this gives us ops/sec
+ *   pass 2 - each operation is timed by itself, this gives us the p50/p99/p999 latencies
+ *            and the time spent inside the grow functions (any add that changed allocatedSize)
+ *
+ * keys are generated outside the timed regions, so string formatting and random number
+ * generation don't show up in the numbers.
+ *
+ * usage: c_code_benchmark [--sizes 1024,65536,...] [--ops n] [--seed n] [--theta 0.99]
+ *                         [--structures iihm,iihm_grouped,iihm_interleaved,iohm,iohm_inline,strset] [--workloads insert,lookup_hit,...]
+ *                         [--distributions seq,uniform,zipf] [--incremental n] [--allocator default|huge]
+ *                         [--csv results.csv] [--label name]
+ *
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../model/int_int_hash_map.h"
+#include "../model/int_obj_hash_map.h"
+#include "../model/string_hash_set.h"
+
+// how many operations we prepare (untimed) and then execute (timed) at a time
+#define BENCH_BATCH_SIZE 4096
+// the size every map starts out with, so the insert workloads have to grow
+#define BENCH_INITIAL_SIZE 1024
+// number of structures (adapters) we can measure
+#define BENCH_NUM_TARGETS 6
+// maximum size of a generated string key
+#define BENCH_MAX_STRING 64
+// latency histogram: 32 sub-buckets per power of two (~3% precision), up to 2^40 ns
+#define BENCH_HIST_SUB_BITS 5
+#define BENCH_HIST_SIZE (41 << BENCH_HIST_SUB_BITS)
+
+// the different operations a workload can issue
+enum BenchOpType { OP_ADD, OP_CONTAINS, OP_REMOVE };
+
+// the different key distributions
+enum BenchDistribution { DIST_SEQUENTIAL, DIST_UNIFORM, DIST_ZIPF, DIST_COUNT };
+const char* distributionNames[DIST_COUNT] = {"seq", "uniform", "zipf"};
+
+// the different workloads
+enum BenchWorkload { WL_INSERT, WL_LOOKUP_HIT, WL_LOOKUP_MISS, WL_MIXED_INSERT, WL_MIXED_LOOKUP, WL_CHURN, WL_COUNT };
+const char* workloadNames[WL_COUNT] = {"insert", "lookup_hit", "lookup_miss", "mixed_insert", "mixed_lookup", "churn"};
+
+
+/**
+ * a key as handed to a structure, either an int or a string
+ */
+typedef struct {
+    int intKey;
+    const char* strKey;
+} BenchKey;
+
+
+/**
+ * adapter so the workloads don't need to know which structure they are measuring
+ */
+typedef struct {
+    const char* name;
+    // 1 if this structure takes string keys
+    int stringKeys;
+    void* (*create)(int initialSize);
+    void (*destroy)(void* map);
+    int (*add)(void* map, BenchKey* key);
+    int (*contains)(void* map, BenchKey* key);
+    int (*remove)(void* map, BenchKey* key);
+    // current capacity, used to detect growth
+    long (*allocated)(void* map);
+    // number of items inside the map
+    long (*size)(void* map);
+    // bytes allocated by the map
+    double (*bytes)(void* map);
+} BenchTarget;
+
+
+/**
+ * the measurement of one run
+ */
+typedef struct {
+    long ops;
+    double seconds;
+    uint64_t histogram[BENCH_HIST_SIZE];
+    uint64_t latencyCount;
+    uint64_t maxNs;
+    long growCount;
+    uint64_t growNs;
+    double bytesPerEntry;
+} BenchResult;
+
+
+/**
+ * the command line settings
+ */
+typedef struct {
+    long sizes[64];
+    int numSizes;
+    long ops;
+    uint64_t seed;
+    double theta;
+    int structures[BENCH_NUM_TARGETS];
+    int workloads[WL_COUNT];
+    int distributions[DIST_COUNT];
+    const char* csvPath;
+    const char* label;
+} BenchConfig;
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// helpers: time, random numbers and key generation
+
+// current monotonic time in nano-seconds
+static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// splitmix64 - a small, fast and seedable random number generator
+static inline uint64_t bench_random(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// random double in [0, 1)
+static inline double bench_random_double(uint64_t* state) {
+    return (double)(bench_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// bijective 32 bit mix (murmur3 finalizer) - distinct indexes give distinct "random" keys
+static inline uint32_t bench_mix32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x85EBCA6BU;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35U;
+    x ^= x >> 16;
+    return x;
+}
+
+// turn a key index into the actual int key for a distribution
+static inline int bench_int_key(int distribution, long index) {
+    if (distribution == DIST_SEQUENTIAL)
+        return (int)index;
+    return (int)bench_mix32((uint32_t)index);
+}
+
+
+/**
+ * zipfian generator (Gray et al, as used by YCSB) over the ranks [0, n)
+ * rank 0 is the most popular, ranks are scrambled to key indexes by the caller
+ */
+typedef struct {
+    long n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+    double halfPowTheta;
+} Zipf;
+
+void zipf_init(Zipf* z, long n, double theta) {
+    double zeta2 = 1.0 + pow(0.5, theta);
+    z->n = n;
+    z->theta = theta;
+    z->zetan = 0.0;
+    for (long i = 1; i <= n; i++)
+        z->zetan += 1.0 / pow((double)i, theta);
+    z->alpha = 1.0 / (1.0 - theta);
+    z->eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+    z->halfPowTheta = 1.0 + pow(0.5, theta);
+}
+
+long zipf_next(Zipf* z, uint64_t* state) {
+    double u = bench_random_double(state);
+    double uz = u * z->zetan;
+    if (uz < 1.0) return 0;
+    if (uz < z->halfPowTheta) return 1;
+    long rank = (long)((double)z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+    return rank >= z->n ? z->n - 1 : rank;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// adapters for each data structure
+
+// chains migrated per operation while resizing, 0 = resize all at once (--incremental)
+static int benchIncrementalStep = 0;
+// where the maps get their memory from, NULL = the default allocator (--allocator)
+static const HashAllocator* benchAllocator = NULL;
+
+static void* iihm_bench_create(int initialSize) {
+    IntIntHashMap* map = iihm_create_with_allocator(initialSize, 0, INT_INT_HASHMAP_ENGINE_CHAINED, benchAllocator);
+    iihm_set_incremental_resize(map, benchIncrementalStep);
+    return map;
+}
+static void* iihm_grouped_bench_create(int initialSize) {
+    return iihm_create_with_allocator(initialSize, 0, INT_INT_HASHMAP_ENGINE_GROUPED, benchAllocator);
+}
+static void* iihm_interleaved_bench_create(int initialSize) {
+    return iihm_create_with_allocator(initialSize, 0, INT_INT_HASHMAP_ENGINE_INTERLEAVED, benchAllocator);
+}
+static void iihm_bench_destroy(void* map) { iihm_free((IntIntHashMap*)map); }
+static int iihm_bench_add(void* map, BenchKey* key) { return iihm_add((IntIntHashMap*)map, key->intKey, key->intKey); }
+static int iihm_bench_contains(void* map, BenchKey* key) { return iihm_contains((IntIntHashMap*)map, key->intKey); }
+static int iihm_bench_remove(void* map, BenchKey* key) { return iihm_remove((IntIntHashMap*)map, key->intKey); }
+static long iihm_bench_allocated(void* map) { return ((IntIntHashMap*)map)->allocatedSize; }
+static long iihm_bench_size(void* map) { return ((IntIntHashMap*)map)->size; }
+static double iihm_bench_bytes(void* map) {
+    IntIntHashMap* data = (IntIntHashMap*)map;
+    if (data->engine == INT_INT_HASHMAP_ENGINE_GROUPED) // control byte, key and value per slot
+        return (double)sizeof(IntIntHashMap) + (1.0 + 2.0 * sizeof(int)) * data->allocatedSize;
+    if (data->engine == INT_INT_HASHMAP_ENGINE_INTERLEAVED) // first and an entry per slot
+        return (double)sizeof(IntIntHashMap) + (sizeof(int) + sizeof(IntIntEntry)) * (double)data->allocatedSize;
+    // first, keySet, valueSet and next
+    return (double)sizeof(IntIntHashMap) + 4.0 * sizeof(int) * data->allocatedSize;
+}
+
+// the objects stored inside the int -> obj map, it doesn't matter what they point to
+static int benchObject = 0;
+
+static void* iohm_bench_create(int initialSize) {
+    IntObjHashMap* map = iohm_create_with_allocator(initialSize, 0, 0, benchAllocator);
+    iohm_set_incremental_resize(map, benchIncrementalStep);
+    return map;
+}
+static void iohm_bench_destroy(void* map) { iohm_free((IntObjHashMap*)map); }
+static int iohm_bench_add(void* map, BenchKey* key) { return iohm_add((IntObjHashMap*)map, key->intKey, &benchObject); }
+static int iohm_bench_contains(void* map, BenchKey* key) { return iohm_get((IntObjHashMap*)map, key->intKey) != NULL; }
+static int iohm_bench_remove(void* map, BenchKey* key) { return iohm_remove((IntObjHashMap*)map, key->intKey); }
+static long iohm_bench_allocated(void* map) { return ((IntObjHashMap*)map)->allocatedSize; }
+static long iohm_bench_size(void* map) { return ((IntObjHashMap*)map)->size; }
+static double iohm_bench_bytes(void* map) {
+    // first, keySet, next and the valueSet pointers
+    return (double)sizeof(IntObjHashMap) + (3.0 * sizeof(int) + sizeof(void*)) * ((IntObjHashMap*)map)->allocatedSize;
+}
+
+// the record stored inline by the iohm_inline target, a typical small fixed size value
+typedef struct {
+    int id;
+    int count;
+    double values[3];
+} BenchRecord;
+
+static void* iohm_inline_bench_create(int initialSize) {
+    IntObjHashMap* map = iohm_create_with_allocator(initialSize, 0, sizeof(BenchRecord), benchAllocator);
+    iohm_set_incremental_resize(map, benchIncrementalStep);
+    return map;
+}
+static int iohm_inline_bench_add(void* map, BenchKey* key) {
+    BenchRecord record = {key->intKey, 1, {0.0, 0.0, 0.0}};
+    return iohm_add((IntObjHashMap*)map, key->intKey, &record);
+}
+static int iohm_inline_bench_contains(void* map, BenchKey* key) {
+    BenchRecord* record = iohm_get((IntObjHashMap*)map, key->intKey);
+    return record != NULL && record->id == key->intKey; // reads the value, as a caller would
+}
+static double iohm_inline_bench_bytes(void* map) {
+    // first, keySet, next and the inline records
+    return (double)sizeof(IntObjHashMap) + (3.0 * sizeof(int) + sizeof(BenchRecord)) * ((IntObjHashMap*)map)->allocatedSize;
+}
+
+static void* str_bench_create(int initialSize) {
+    StringHashSet* map = str_hashset_create_with_allocator(initialSize, benchAllocator);
+    str_hashset_set_incremental_resize(map, benchIncrementalStep);
+    return map;
+}
+static void str_bench_destroy(void* map) { str_hashset_free((StringHashSet*)map); }
+static int str_bench_add(void* map, BenchKey* key) { return str_hashset_add((StringHashSet*)map, key->strKey); }
+static int str_bench_contains(void* map, BenchKey* key) { return str_hashset_contains((StringHashSet*)map, key->strKey); }
+static int str_bench_remove(void* map, BenchKey* key) { return str_hashset_remove((StringHashSet*)map, key->strKey); }
+static long str_bench_allocated(void* map) { return ((StringHashSet*)map)->allocatedSize; }
+static long str_bench_size(void* map) { return ((StringHashSet*)map)->size; }
+static double str_bench_bytes(void* map) {
+    // first, intHash1, intHash2 and next
+    return (double)sizeof(StringHashSet) + 4.0 * sizeof(int) * ((StringHashSet*)map)->allocatedSize;
+}
+
+const char* targetNames[BENCH_NUM_TARGETS] = {"iihm", "iihm_grouped", "iihm_interleaved", "iohm", "iohm_inline",
+                                              "strset"};
+
+BenchTarget targets[BENCH_NUM_TARGETS] = {
+        {"iihm", 0, iihm_bench_create, iihm_bench_destroy, iihm_bench_add, iihm_bench_contains,
+         iihm_bench_remove, iihm_bench_allocated, iihm_bench_size, iihm_bench_bytes},
+        {"iihm_grouped", 0, iihm_grouped_bench_create, iihm_bench_destroy, iihm_bench_add, iihm_bench_contains,
+         iihm_bench_remove, iihm_bench_allocated, iihm_bench_size, iihm_bench_bytes},
+        {"iihm_interleaved", 0, iihm_interleaved_bench_create, iihm_bench_destroy, iihm_bench_add,
+         iihm_bench_contains, iihm_bench_remove, iihm_bench_allocated, iihm_bench_size, iihm_bench_bytes},
+        {"iohm", 0, iohm_bench_create, iohm_bench_destroy, iohm_bench_add, iohm_bench_contains,
+         iohm_bench_remove, iohm_bench_allocated, iohm_bench_size, iohm_bench_bytes},
+        {"iohm_inline", 0, iohm_inline_bench_create, iohm_bench_destroy, iohm_inline_bench_add,
+         iohm_inline_bench_contains, iohm_bench_remove, iohm_bench_allocated, iohm_bench_size, iohm_inline_bench_bytes},
+        {"strset", 1, str_bench_create, str_bench_destroy, str_bench_add, str_bench_contains,
+         str_bench_remove, str_bench_allocated, str_bench_size, str_bench_bytes},
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// batches: a list of operations with their keys prepared up front
+
+typedef struct {
+    int count;
+    int type[BENCH_BATCH_SIZE];
+    long index[BENCH_BATCH_SIZE];
+    BenchKey keys[BENCH_BATCH_SIZE];
+    char strings[BENCH_BATCH_SIZE][BENCH_MAX_STRING];
+} BenchBatch;
+
+// turn the key indexes of a batch into keys for the target
+void batch_prepare_keys(BenchBatch* batch, BenchTarget* target, int distribution) {
+    for (int i = 0; i < batch->count; i++) {
+        int key = bench_int_key(distribution, batch->index[i]);
+        batch->keys[i].intKey = key;
+        if (target->stringKeys) {
+            // url like strings, similar to what the unit tests use
+            snprintf(batch->strings[i], BENCH_MAX_STRING, "https://dataset.rock.co.nz/doc-%u/%u.html",
+                     (unsigned)key % 1000, (unsigned)key);
+            batch->keys[i].strKey = batch->strings[i];
+        } else {
+            batch->keys[i].strKey = NULL;
+        }
+    }
+}
+
+// execute a single operation of a batch
+static inline int batch_execute(BenchTarget* target, void* map, BenchBatch* batch, int i) {
+    switch (batch->type[i]) {
+        case OP_ADD: return target->add(map, &batch->keys[i]);
+        case OP_CONTAINS: return target->contains(map, &batch->keys[i]);
+        default: return target->remove(map, &batch->keys[i]);
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// latency histogram
+
+static inline int hist_bucket(uint64_t ns) {
+    if (ns < (1u << BENCH_HIST_SUB_BITS)) return (int)ns;
+    int msb = 63 - __builtin_clzll(ns);
+    int shift = msb - BENCH_HIST_SUB_BITS;
+    int bucket = ((shift + 1) << BENCH_HIST_SUB_BITS) + (int)((ns >> shift) & ((1u << BENCH_HIST_SUB_BITS) - 1));
+    return bucket < BENCH_HIST_SIZE ? bucket : BENCH_HIST_SIZE - 1;
+}
+
+// the (upper) value represented by a histogram bucket
+static uint64_t hist_value(int bucket) {
+    if (bucket < (1 << BENCH_HIST_SUB_BITS)) return (uint64_t)bucket;
+    int shift = (bucket >> BENCH_HIST_SUB_BITS) - 1;
+    uint64_t sub = (uint64_t)(bucket & ((1 << BENCH_HIST_SUB_BITS) - 1));
+    return (((uint64_t)1 << BENCH_HIST_SUB_BITS) + sub + 1) << shift;
+}
+
+uint64_t hist_percentile(BenchResult* result, double percentile) {
+    if (result->latencyCount == 0) return 0;
+    uint64_t target = (uint64_t)ceil(percentile * (double)result->latencyCount);
+    uint64_t seen = 0;
+    for (int i = 0; i < BENCH_HIST_SIZE; i++) {
+        seen += result->histogram[i];
+        if (seen >= target) return hist_value(i);
+    }
+    return hist_value(BENCH_HIST_SIZE - 1);
+}
+
+// the cost of reading the clock twice, subtracted from every single operation timing
+static uint64_t timerOverhead = 0;
+
+void calibrate_timer() {
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 10000; i++) {
+        uint64_t t0 = now_ns();
+        uint64_t t1 = now_ns();
+        if (t1 - t0 < best) best = t1 - t0;
+    }
+    timerOverhead = best;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// workloads
+
+/**
+ * the state of a running workload, it produces the operations batch by batch
+ */
+typedef struct {
+    int workload;
+    int distribution;
+    long size;       // number of keys in the steady state
+    long ops;        // number of operations to issue
+    long issued;     // number of operations issued so far
+    long nextNew;    // next never seen key index
+    long oldest;     // oldest live key index (churn)
+    uint64_t random;
+    Zipf* zipf;
+} WorkloadState;
+
+// pick the index of an existing key [0, live) according to the distribution
+static inline long pick_existing(WorkloadState* state, long live) {
+    if (state->distribution == DIST_SEQUENTIAL)
+        return state->issued % live;
+    if (state->distribution == DIST_ZIPF)
+        // scramble the rank so the popular keys aren't all next to each other
+        return (long)(bench_mix32((uint32_t)zipf_next(state->zipf, &state->random)) % (uint32_t)live);
+    return (long)(bench_random(&state->random) % (uint64_t)live);
+}
+
+// the number of keys loaded (untimed) before the workload starts
+long workload_preload(int workload, long size) {
+    switch (workload) {
+        case WL_INSERT: return 0;
+        case WL_MIXED_INSERT: return size / 2;
+        default: return size;
+    }
+}
+
+// number of operations a workload issues
+long workload_ops(int workload, long size, long ops) {
+    if (workload == WL_INSERT) return size; // insert exactly the table size
+    return ops > 0 ? ops : (size > 1000000 ? size : 1000000);
+}
+
+// fill the next batch of operations, returns 0 when the workload is done
+int workload_next_batch(WorkloadState* state, BenchBatch* batch) {
+    batch->count = 0;
+    while (batch->count < BENCH_BATCH_SIZE && state->issued < state->ops) {
+        int i = batch->count;
+        switch (state->workload) {
+            case WL_INSERT:
+                batch->type[i] = OP_ADD;
+                // zipf inserts repeat the popular keys (updates), the others insert each key once
+                batch->index[i] = state->distribution == DIST_ZIPF ? pick_existing(state, state->size) : state->nextNew++;
+                break;
+            case WL_LOOKUP_HIT:
+                batch->type[i] = OP_CONTAINS;
+                batch->index[i] = pick_existing(state, state->size);
+                break;
+            case WL_LOOKUP_MISS:
+                // indexes at or above size were never inserted
+                batch->type[i] = OP_CONTAINS;
+                batch->index[i] = state->size + pick_existing(state, state->size);
+                break;
+            case WL_MIXED_INSERT: // 90% inserts, 10% lookups of existing keys
+            case WL_MIXED_LOOKUP: { // 10% inserts, 90% lookups of existing keys
+                int insertPercentage = state->workload == WL_MIXED_INSERT ? 90 : 10;
+                if ((long)(bench_random(&state->random) % 100) < insertPercentage) {
+                    batch->type[i] = OP_ADD;
+                    batch->index[i] = state->nextNew++;
+                } else {
+                    batch->type[i] = OP_CONTAINS;
+                    batch->index[i] = pick_existing(state, state->nextNew);
+                }
+                break;
+            }
+            default: // churn: a sliding window of live keys, remove the oldest then add a new one
+                if (state->issued % 2 == 0) {
+                    batch->type[i] = OP_REMOVE;
+                    batch->index[i] = state->oldest++;
+                } else {
+                    batch->type[i] = OP_ADD;
+                    batch->index[i] = state->nextNew++;
+                }
+                break;
+        }
+        state->issued++;
+        batch->count++;
+    }
+    return batch->count > 0;
+}
+
+
+/**
+ * run a workload once from a fresh map
+ * @param timeEachOp 0 for the throughput pass, 1 for the latency pass
+ */
+void run_pass(BenchTarget* target, int workload, int distribution, long size, long ops, uint64_t seed,
+              Zipf* zipf, int timeEachOp, BenchResult* result, BenchBatch* batch) {
+    void* map = target->create(BENCH_INITIAL_SIZE);
+    if (map == NULL) {
+        fprintf(stderr, "error: could not create %s\n", target->name);
+        exit(1);
+    }
+
+    WorkloadState state;
+    memset(&state, 0, sizeof(state));
+    state.workload = workload;
+    state.distribution = distribution;
+    state.size = size;
+    state.random = seed;
+    state.zipf = zipf;
+
+    // preload (untimed)
+    long preload = workload_preload(workload, size);
+    state.ops = preload;
+    state.workload = WL_INSERT;
+    int savedDistribution = state.distribution;
+    state.distribution = DIST_SEQUENTIAL; // preload inserts each key index exactly once
+    while (workload_next_batch(&state, batch)) {
+        batch_prepare_keys(batch, target, distribution);
+        for (int i = 0; i < batch->count; i++)
+            target->add(map, &batch->keys[i]);
+    }
+    state.workload = workload;
+    state.distribution = savedDistribution;
+    state.issued = 0;
+    state.ops = ops;
+
+    // the measured operations
+    uint64_t checksum = 0; // stops the compiler from optimizing the calls away
+    while (workload_next_batch(&state, batch)) {
+        batch_prepare_keys(batch, target, distribution);
+        if (timeEachOp) {
+            for (int i = 0; i < batch->count; i++) {
+                long allocatedBefore = target->allocated(map);
+                uint64_t t0 = now_ns();
+                checksum += batch_execute(target, map, batch, i);
+                uint64_t t1 = now_ns();
+                uint64_t ns = t1 - t0 > timerOverhead ? t1 - t0 - timerOverhead : 0;
+                result->histogram[hist_bucket(ns)]++;
+                result->latencyCount++;
+                if (ns > result->maxNs) result->maxNs = ns;
+                if (target->allocated(map) != allocatedBefore) {
+                    result->growCount++;
+                    result->growNs += ns;
+                }
+            }
+        } else {
+            uint64_t t0 = now_ns();
+            for (int i = 0; i < batch->count; i++)
+                checksum += batch_execute(target, map, batch, i);
+            result->seconds += (double)(now_ns() - t0) / 1e9;
+            result->ops += batch->count;
+        }
+    }
+    if (checksum == UINT64_MAX) printf(" ");
+
+    if (!timeEachOp) {
+        long items = target->size(map);
+        result->bytesPerEntry = items > 0 ? target->bytes(map) / (double)items : 0.0;
+    }
+    target->destroy(map);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// reporting
+
+void print_header() {
+    printf("%-12s %-13s %-8s %12s %12s %14s %9s %9s %9s %11s %6s %10s %8s\n",
+           "struct", "workload", "dist", "size", "ops", "ops/sec", "p50(ns)", "p99(ns)", "p999(ns)", "max(ns)",
+           "grows", "grow(ms)", "B/entry");
+}
+
+void report(BenchConfig* config, FILE* csv, BenchTarget* target, int workload, int distribution, long size,
+            BenchResult* result) {
+    double opsPerSec = result->seconds > 0 ? (double)result->ops / result->seconds : 0.0;
+    uint64_t p50 = hist_percentile(result, 0.50);
+    uint64_t p99 = hist_percentile(result, 0.99);
+    uint64_t p999 = hist_percentile(result, 0.999);
+    double growMs = (double)result->growNs / 1e6;
+    printf("%-12s %-13s %-8s %12ld %12ld %14.0f %9llu %9llu %9llu %11llu %6ld %10.2f %8.2f\n",
+           target->name, workloadNames[workload], distributionNames[distribution], size, result->ops, opsPerSec,
+           (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999,
+           (unsigned long long)result->maxNs, result->growCount, growMs, result->bytesPerEntry);
+    fflush(stdout);
+    if (csv != NULL) {
+        fprintf(csv, "%s,%s,%s,%s,%ld,%ld,%.6f,%.0f,%llu,%llu,%llu,%llu,%ld,%.3f,%.3f\n",
+                config->label, target->name, workloadNames[workload], distributionNames[distribution], size,
+                result->ops, result->seconds, opsPerSec,
+                (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999,
+                (unsigned long long)result->maxNs, result->growCount, growMs, result->bytesPerEntry);
+        fflush(csv);
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// command line parsing
+
+// parse a comma separated list of names into flags, returns 0 on an unknown name
+int parse_names(const char* list, const char** names, int count, int* flags) {
+    for (int i = 0; i < count; i++) flags[i] = 0;
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%s", list);
+    for (char* token = strtok(buf, ","); token != NULL; token = strtok(NULL, ",")) {
+        int found = 0;
+        for (int i = 0; i < count; i++) {
+            if (strcmp(token, names[i]) == 0) {
+                flags[i] = 1;
+                found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "error: unknown name \"%s\"\n", token);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void usage() {
+    fprintf(stderr, "usage: c_code_benchmark [options]\n"
+                    "  --sizes a,b,c      table sizes (entries), default 1024,16384,262144,4194304\n"
+                    "  --ops n            operations per non-insert run, default max(size, 1000000)\n"
+                    "  --seed n           random seed, default 42\n"
+                    "  --theta t          zipf skew, default 0.99\n"
+                    "  --structures list  iihm,iihm_grouped,iihm_interleaved,iohm,iohm_inline,strset\n"
+                    "  --workloads list   insert,lookup_hit,lookup_miss,mixed_insert,mixed_lookup,churn\n"
+                    "  --distributions l  seq,uniform,zipf\n"
+                    "  --csv path         append machine readable results to path\n"
+                    "  --incremental n    resize incrementally, migrating n chains per operation\n"
+                    "  --allocator name   default (calloc / realloc / free) or huge (2MB aligned huge pages)\n"
+                    "  --label name       label for the csv rows (e.g. a git commit)\n");
+}
+
+int parse_args(int argc, char** argv, BenchConfig* config) {
+    memset(config, 0, sizeof(BenchConfig));
+    long defaultSizes[4] = {1024, 16384, 262144, 4194304};
+    for (int i = 0; i < 4; i++) config->sizes[i] = defaultSizes[i];
+    config->numSizes = 4;
+    config->seed = 42;
+    config->theta = 0.99;
+    config->label = "local";
+    for (int i = 0; i < BENCH_NUM_TARGETS; i++) config->structures[i] = 1;
+    for (int i = 0; i < WL_COUNT; i++) config->workloads[i] = 1;
+    for (int i = 0; i < DIST_COUNT; i++) config->distributions[i] = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL) {
+            usage();
+            return 0;
+        }
+        if (strcmp(arg, "--sizes") == 0) {
+            char buf[512];
+            snprintf(buf, sizeof(buf), "%s", value);
+            config->numSizes = 0;
+            for (char* token = strtok(buf, ","); token != NULL && config->numSizes < 64; token = strtok(NULL, ","))
+                config->sizes[config->numSizes++] = atol(token);
+        } else if (strcmp(arg, "--ops") == 0) {
+            config->ops = atol(value);
+        } else if (strcmp(arg, "--seed") == 0) {
+            config->seed = strtoull(value, NULL, 10);
+        } else if (strcmp(arg, "--theta") == 0) {
+            config->theta = atof(value);
+        } else if (strcmp(arg, "--structures") == 0) {
+            if (!parse_names(value, targetNames, BENCH_NUM_TARGETS, config->structures)) return 0;
+        } else if (strcmp(arg, "--workloads") == 0) {
+            if (!parse_names(value, workloadNames, WL_COUNT, config->workloads)) return 0;
+        } else if (strcmp(arg, "--distributions") == 0) {
+            if (!parse_names(value, distributionNames, DIST_COUNT, config->distributions)) return 0;
+        } else if (strcmp(arg, "--csv") == 0) {
+            config->csvPath = value;
+        } else if (strcmp(arg, "--incremental") == 0) {
+            benchIncrementalStep = atoi(value);
+        } else if (strcmp(arg, "--allocator") == 0) {
+            if (strcmp(value, "huge") == 0) {
+                benchAllocator = &hash_allocator_huge;
+            } else if (strcmp(value, "default") != 0) {
+                fprintf(stderr, "error: unknown allocator \"%s\"\n", value);
+                return 0;
+            }
+        } else if (strcmp(arg, "--label") == 0) {
+            config->label = value;
+        } else {
+            usage();
+            return 0;
+        }
+        i++;
+    }
+    return 1;
+}
+
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if (!parse_args(argc, argv, &config))
+        return 1;
+
+#ifndef __OPTIMIZE__
+    fprintf(stderr, "warning: benchmark built without optimization, use -DCMAKE_BUILD_TYPE=Release\n");
+#endif
+
+    FILE* csv = NULL;
+    if (config.csvPath != NULL) {
+        csv = fopen(config.csvPath, "a");
+        if (csv == NULL) {
+            fprintf(stderr, "error: could not open %s\n", config.csvPath);
+            return 1;
+        }
+        if (ftell(csv) == 0) // new file, write the header first
+            fprintf(csv, "label,structure,workload,distribution,size,ops,seconds,ops_per_sec,"
+                         "p50_ns,p99_ns,p999_ns,max_ns,grow_count,grow_ms,bytes_per_entry\n");
+    }
+
+    calibrate_timer();
+    BenchBatch* batch = (BenchBatch*) malloc(sizeof(BenchBatch));
+    BenchResult* result = (BenchResult*) malloc(sizeof(BenchResult));
+    if (batch == NULL || result == NULL) return 1;
+
+    print_header();
+    for (int s = 0; s < config.numSizes; s++) {
+        long size = config.sizes[s];
+        if (size <= 0 || size > 0x3FFFFFFF) {
+            fprintf(stderr, "warning: skipping unsupported size %ld\n", size);
+            continue;
+        }
+        // the zipf constants only depend on the size, compute them once
+        Zipf zipf;
+        if (config.distributions[DIST_ZIPF])
+            zipf_init(&zipf, size, config.theta);
+
+        for (int t = 0; t < BENCH_NUM_TARGETS; t++) {
+            if (!config.structures[t]) continue;
+            for (int w = 0; w < WL_COUNT; w++) {
+                if (!config.workloads[w]) continue;
+                for (int d = 0; d < DIST_COUNT; d++) {
+                    if (!config.distributions[d]) continue;
+                    // the churn window always moves through the keys in order
+                    if (w == WL_CHURN && d == DIST_ZIPF) continue;
+                    long ops = workload_ops(w, size, config.ops);
+                    memset(result, 0, sizeof(BenchResult));
+                    run_pass(&targets[t], w, d, size, ops, config.seed, &zipf, 0, result, batch);
+                    run_pass(&targets[t], w, d, size, ops, config.seed, &zipf, 1, result, batch);
+                    report(&config, csv, &targets[t], w, d, size, result);
+                }
+            }
+        }
+    }
+
+    free(batch);
+    free(result);
+    if (csv != NULL) fclose(csv);
+    return 0;
+}
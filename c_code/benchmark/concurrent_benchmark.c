@@ -0,0 +1,459 @@
+/*
+ * Copyright (c) 2024 by Rock de Vocht
+ *
+ * All rights reserved. No part of this publication may be reproduced, distributed, or
+ * transmitted in any form or by any means, including photocopying, recording, or other
+ * electronic or mechanical methods, without the prior written permission of the publisher,
+ * except in the case of brief quotations embodied in critical reviews and certain other
+ * noncommercial uses permitted by copyright law.
+ *
+ */
+
+/**
+ * multi-threaded throughput benchmark for the thread safe structures
+ *
+ * for every thread count a fresh structure is filled by all threads at once (insert), then all threads
+ * run a mix of lookups and adds over the same keys (mixed).  the throughput of each run is reported with
+ * its speed-up over the single threaded run, so the scaling of a structure can be read off directly.
+ * "strset_locked" is a StringHashSet behind one global mutex, the baseline the sharded set replaces, and
+ * "iihm_locked" an IntIntHashMap counting behind one global mutex, the baseline of the lock free map.
+ * for the int maps an add counts the key (adds 1 to its value).
+ * "iihm_rehash" isn't a thread safe structure: it times the one add that makes an IntIntHashMap of --keys
+ * entries grow, with the re-chaining of its table split over the threads (iihm_set_parallel_resize()).
+ *
+ * keys are generated up front, the threads only pick them with their own seeded random numbers.
+ *
+ * usage: c_code_concurrent_benchmark [--threads 1,2,4,...] [--keys n] [--ops n] [--lookups pct]
+ *                                    [--shards n] [--seed n]
+ *                                    [--structures strset_locked,strset_sharded,iihm_locked,iihm_concurrent,iihm_rehash]
+ *
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../model/string_hash_set.h"
+#include "../model/concurrent_string_hash_set.h"
+#include "../model/int_int_hash_map.h"
+#include "../model/concurrent_int_int_hash_map.h"
+
+// number of structures (adapters) we can measure
+#define CBENCH_NUM_TARGETS 4
+// maximum size of a generated string key
+#define CBENCH_MAX_STRING 64
+// the most threads a run can use
+#define CBENCH_MAX_THREADS 256
+
+
+/**
+ * adapter so the runs don't need to know which structure they are measuring
+ */
+typedef struct {
+    const char* name;
+    void* (*create)(int initialSize);
+    void (*destroy)(void* map);
+    // the key is picked by its index, each adapter turns that into its own kind of key
+    int (*add)(void* map, long index);
+    int (*contains)(void* map, long index);
+} ConcurrentBenchTarget;
+
+
+/**
+ * the command line settings
+ */
+typedef struct {
+    int threads[64];
+    int numThreads;
+    long keys;
+    long ops;
+    int lookupPercent;
+    uint64_t seed;
+    int structures[CBENCH_NUM_TARGETS];
+    // time the parallel re-chaining of a growing IntIntHashMap (iihm_rehash)
+    int rehash;
+} ConcurrentBenchConfig;
+
+
+// the string keys every thread picks from
+static char (*benchKeys)[CBENCH_MAX_STRING] = NULL;
+// shards of the sharded set (--shards)
+static int benchShards = 64;
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// helpers: time and random numbers
+
+// current monotonic time in nano-seconds
+static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// splitmix64 - a small, fast and seedable random number generator
+static inline uint64_t bench_random(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// bijective 32 bit mix (murmur3 finalizer) - distinct indexes give distinct "random" int keys
+static inline int bench_int_key(long index) {
+    uint32_t x = (uint32_t)index;
+    x ^= x >> 16;
+    x *= 0x85EBCA6BU;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35U;
+    x ^= x >> 16;
+    return (int)x;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// adapters for each data structure
+
+// a StringHashSet behind one global lock
+typedef struct {
+    pthread_mutex_t lock;
+    StringHashSet* set;
+} LockedStringHashSet;
+
+static void* locked_bench_create(int initialSize) {
+    LockedStringHashSet* map = (LockedStringHashSet*) calloc(1, sizeof(LockedStringHashSet));
+    pthread_mutex_init(&map->lock, NULL);
+    map->set = str_hashset_create(initialSize);
+    return map;
+}
+static void locked_bench_destroy(void* map) {
+    LockedStringHashSet* locked = (LockedStringHashSet*)map;
+    str_hashset_free(locked->set);
+    pthread_mutex_destroy(&locked->lock);
+    free(locked);
+}
+static int locked_bench_add(void* map, long index) {
+    LockedStringHashSet* locked = (LockedStringHashSet*)map;
+    pthread_mutex_lock(&locked->lock);
+    int added = str_hashset_add(locked->set, benchKeys[index]);
+    pthread_mutex_unlock(&locked->lock);
+    return added;
+}
+static int locked_bench_contains(void* map, long index) {
+    LockedStringHashSet* locked = (LockedStringHashSet*)map;
+    pthread_mutex_lock(&locked->lock);
+    int found = str_hashset_contains(locked->set, benchKeys[index]);
+    pthread_mutex_unlock(&locked->lock);
+    return found;
+}
+
+static void* sharded_bench_create(int initialSize) { return cstr_hashset_create(initialSize, benchShards); }
+static void sharded_bench_destroy(void* map) { cstr_hashset_free((ConcurrentStringHashSet*)map); }
+static int sharded_bench_add(void* map, long index) {
+    return cstr_hashset_add((ConcurrentStringHashSet*)map, benchKeys[index]);
+}
+static int sharded_bench_contains(void* map, long index) {
+    return cstr_hashset_contains((ConcurrentStringHashSet*)map, benchKeys[index]);
+}
+
+// an IntIntHashMap behind one global lock
+typedef struct {
+    pthread_mutex_t lock;
+    IntIntHashMap* map;
+} LockedIntIntHashMap;
+
+static void* iihm_locked_bench_create(int initialSize) {
+    LockedIntIntHashMap* map = (LockedIntIntHashMap*) calloc(1, sizeof(LockedIntIntHashMap));
+    pthread_mutex_init(&map->lock, NULL);
+    map->map = iihm_create(initialSize);
+    return map;
+}
+static void iihm_locked_bench_destroy(void* map) {
+    LockedIntIntHashMap* locked = (LockedIntIntHashMap*)map;
+    iihm_free(locked->map);
+    pthread_mutex_destroy(&locked->lock);
+    free(locked);
+}
+static int iihm_locked_bench_add(void* map, long index) {
+    LockedIntIntHashMap* locked = (LockedIntIntHashMap*)map;
+    int key = bench_int_key(index);
+    pthread_mutex_lock(&locked->lock);
+    int count = iihm_get(locked->map, key);
+    iihm_add(locked->map, key, count + 1);
+    pthread_mutex_unlock(&locked->lock);
+    return count;
+}
+static int iihm_locked_bench_contains(void* map, long index) {
+    LockedIntIntHashMap* locked = (LockedIntIntHashMap*)map;
+    pthread_mutex_lock(&locked->lock);
+    int count = iihm_get(locked->map, bench_int_key(index));
+    pthread_mutex_unlock(&locked->lock);
+    return count;
+}
+
+static void* ciihm_bench_create(int initialSize) { return ciihm_create(initialSize); }
+static void ciihm_bench_destroy(void* map) { ciihm_free((ConcurrentIntIntHashMap*)map); }
+static int ciihm_bench_add(void* map, long index) {
+    return ciihm_fetch_add((ConcurrentIntIntHashMap*)map, bench_int_key(index), 1);
+}
+static int ciihm_bench_contains(void* map, long index) {
+    return ciihm_get((ConcurrentIntIntHashMap*)map, bench_int_key(index));
+}
+
+const char* concurrentTargetNames[CBENCH_NUM_TARGETS] = {"strset_locked", "strset_sharded", "iihm_locked",
+                                                         "iihm_concurrent"};
+
+ConcurrentBenchTarget concurrentTargets[CBENCH_NUM_TARGETS] = {
+        {"strset_locked", locked_bench_create, locked_bench_destroy, locked_bench_add, locked_bench_contains},
+        {"strset_sharded", sharded_bench_create, sharded_bench_destroy, sharded_bench_add, sharded_bench_contains},
+        {"iihm_locked", iihm_locked_bench_create, iihm_locked_bench_destroy, iihm_locked_bench_add,
+         iihm_locked_bench_contains},
+        {"iihm_concurrent", ciihm_bench_create, ciihm_bench_destroy, ciihm_bench_add, ciihm_bench_contains},
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// threads
+
+/**
+ * what one thread of a run does
+ */
+typedef struct {
+    ConcurrentBenchTarget* target;
+    void* map;
+    pthread_barrier_t* start;
+    // insert: the keys first..last-1, mixed: ops random keys
+    long first;
+    long last;
+    long ops;
+    long keys;
+    int lookupPercent;
+    uint64_t seed;
+    // sum of the return values, so the work can't be optimized away
+    long checksum;
+} ConcurrentBenchThread;
+
+static void* insert_thread(void* arg) {
+    ConcurrentBenchThread* work = (ConcurrentBenchThread*)arg;
+    pthread_barrier_wait(work->start);
+    for (long i = work->first; i < work->last; i++)
+        work->checksum += work->target->add(work->map, i);
+    return NULL;
+}
+
+static void* mixed_thread(void* arg) {
+    ConcurrentBenchThread* work = (ConcurrentBenchThread*)arg;
+    uint64_t state = work->seed;
+    pthread_barrier_wait(work->start);
+    for (long i = 0; i < work->ops; i++) {
+        uint64_t r = bench_random(&state);
+        long index = (long)((r >> 8) % (uint64_t)work->keys);
+        if ((int)(r & 0xFF) * 100 < work->lookupPercent * 256)
+            work->checksum += work->target->contains(work->map, index);
+        else
+            work->checksum += work->target->add(work->map, index);
+    }
+    return NULL;
+}
+
+
+/**
+ * run fn on numThreads threads at once
+ * @return the wall clock seconds from the moment they were all released until the last one finished
+ */
+double run_threads(void* (*fn)(void*), ConcurrentBenchThread* work, int numThreads) {
+    pthread_t threads[CBENCH_MAX_THREADS];
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, (unsigned)numThreads + 1);
+    for (int t = 0; t < numThreads; t++) {
+        work[t].start = &start;
+        pthread_create(&threads[t], NULL, fn, &work[t]);
+    }
+    pthread_barrier_wait(&start); // release them all at the same time
+    uint64_t begin = now_ns();
+    for (int t = 0; t < numThreads; t++)
+        pthread_join(threads[t], NULL);
+    double seconds = (double)(now_ns() - begin) / 1e9;
+    pthread_barrier_destroy(&start);
+    return seconds;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// command line parsing
+
+void usage() {
+    fprintf(stderr, "usage: c_code_concurrent_benchmark [options]\n"
+                    "  --threads a,b,c    thread counts, default 1,2,4,8,16,32,64\n"
+                    "  --keys n           number of distinct keys, default 1000000\n"
+                    "  --ops n            operations per mixed run (split over the threads), default 10000000\n"
+                    "  --lookups pct      percentage of lookups in the mixed run, default 90\n"
+                    "  --shards n         shards of the sharded structures, default 64\n"
+                    "  --structures list  strset_locked,strset_sharded,iihm_locked,iihm_concurrent,iihm_rehash\n"
+                    "  --seed n           random seed, default 42\n");
+}
+
+int parse_args(int argc, char** argv, ConcurrentBenchConfig* config) {
+    memset(config, 0, sizeof(ConcurrentBenchConfig));
+    int defaultThreads[7] = {1, 2, 4, 8, 16, 32, 64};
+    for (int i = 0; i < 7; i++) config->threads[i] = defaultThreads[i];
+    config->numThreads = 7;
+    config->keys = 1000000;
+    config->ops = 10000000;
+    config->lookupPercent = 90;
+    config->seed = 42;
+    for (int i = 0; i < CBENCH_NUM_TARGETS; i++) config->structures[i] = 1;
+    config->rehash = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value == NULL) {
+            usage();
+            return 0;
+        }
+        if (strcmp(arg, "--threads") == 0) {
+            char buf[512];
+            snprintf(buf, sizeof(buf), "%s", value);
+            config->numThreads = 0;
+            for (char* token = strtok(buf, ","); token != NULL && config->numThreads < 64; token = strtok(NULL, ",")) {
+                int threads = atoi(token);
+                if (threads > 0 && threads <= CBENCH_MAX_THREADS)
+                    config->threads[config->numThreads++] = threads;
+            }
+        } else if (strcmp(arg, "--keys") == 0) {
+            config->keys = atol(value);
+        } else if (strcmp(arg, "--ops") == 0) {
+            config->ops = atol(value);
+        } else if (strcmp(arg, "--lookups") == 0) {
+            config->lookupPercent = atoi(value);
+        } else if (strcmp(arg, "--shards") == 0) {
+            benchShards = atoi(value);
+        } else if (strcmp(arg, "--seed") == 0) {
+            config->seed = strtoull(value, NULL, 10);
+        } else if (strcmp(arg, "--structures") == 0) {
+            for (int t = 0; t < CBENCH_NUM_TARGETS; t++) config->structures[t] = 0;
+            config->rehash = 0;
+            char buf[512];
+            snprintf(buf, sizeof(buf), "%s", value);
+            for (char* token = strtok(buf, ","); token != NULL; token = strtok(NULL, ",")) {
+                int found = strcmp(token, "iihm_rehash") == 0;
+                if (found) config->rehash = 1;
+                for (int t = 0; t < CBENCH_NUM_TARGETS; t++) {
+                    if (strcmp(token, concurrentTargetNames[t]) == 0) {
+                        config->structures[t] = 1;
+                        found = 1;
+                    }
+                }
+                if (!found) {
+                    fprintf(stderr, "error: unknown structure \"%s\"\n", token);
+                    return 0;
+                }
+            }
+        } else {
+            usage();
+            return 0;
+        }
+        i++;
+    }
+    if (config->keys <= 0 || config->keys > 0x3FFFFFFF || config->ops <= 0) {
+        usage();
+        return 0;
+    }
+    return 1;
+}
+
+
+int main(int argc, char** argv) {
+    ConcurrentBenchConfig config;
+    if (!parse_args(argc, argv, &config))
+        return 1;
+
+#ifndef __OPTIMIZE__
+    fprintf(stderr, "warning: benchmark built without optimization, use -DCMAKE_BUILD_TYPE=Release\n");
+#endif
+
+    // url like keys, similar to what the unit tests use
+    benchKeys = malloc((size_t)config.keys * CBENCH_MAX_STRING);
+    ConcurrentBenchThread* work = calloc(CBENCH_MAX_THREADS, sizeof(ConcurrentBenchThread));
+    if (benchKeys == NULL || work == NULL) return 1;
+    for (long i = 0; i < config.keys; i++)
+        snprintf(benchKeys[i], CBENCH_MAX_STRING, "https://dataset.rock.co.nz/doc-%d/%d.html", (int)(i % 1000), (int)i);
+
+    printf("%-16s %-8s %8s %12s %14s %8s\n", "structure", "workload", "threads", "ops", "ops/sec", "speedup");
+    for (int s = 0; s < CBENCH_NUM_TARGETS; s++) {
+        if (!config.structures[s]) continue;
+        ConcurrentBenchTarget* target = &concurrentTargets[s];
+        double baseInsert = 0.0, baseMixed = 0.0;
+        for (int r = 0; r < config.numThreads; r++) {
+            int numThreads = config.threads[r];
+            void* map = target->create(1024);
+
+            // insert: every thread adds its own part of the keys
+            for (int t = 0; t < numThreads; t++) {
+                memset(&work[t], 0, sizeof(ConcurrentBenchThread));
+                work[t].target = target;
+                work[t].map = map;
+                work[t].first = config.keys * t / numThreads;
+                work[t].last = config.keys * (t + 1) / numThreads;
+            }
+            double seconds = run_threads(insert_thread, work, numThreads);
+            double insertRate = (double)config.keys / seconds;
+            if (baseInsert == 0.0) baseInsert = insertRate;
+            printf("%-16s %-8s %8d %12ld %14.0f %7.2fx\n", target->name, "insert", numThreads, config.keys,
+                   insertRate, insertRate / baseInsert);
+
+            // mixed: lookups and adds of random keys
+            for (int t = 0; t < numThreads; t++) {
+                work[t].ops = config.ops / numThreads;
+                work[t].keys = config.keys;
+                work[t].lookupPercent = config.lookupPercent;
+                work[t].seed = config.seed + (uint64_t)t * 0x9E3779B97F4A7C15ULL;
+            }
+            seconds = run_threads(mixed_thread, work, numThreads);
+            double mixedRate = (double)(config.ops / numThreads * numThreads) / seconds;
+            if (baseMixed == 0.0) baseMixed = mixedRate;
+            printf("%-16s %-8s %8d %12ld %14.0f %7.2fx\n", target->name, "mixed", numThreads,
+                   config.ops / numThreads * numThreads, mixedRate, mixedRate / baseMixed);
+            fflush(stdout);
+            target->destroy(map);
+        }
+    }
+
+    if (config.rehash) {
+        int* keys = malloc(config.keys * sizeof(int));
+        int* values = calloc(config.keys, sizeof(int));
+        if (keys == NULL || values == NULL) return 1;
+        for (long i = 0; i < config.keys; i++)
+            keys[i] = bench_int_key(i);
+        double baseGrow = 0.0;
+        for (int r = 0; r < config.numThreads; r++) {
+            int numThreads = config.threads[r];
+            IntIntHashMap* map = iihm_build(keys, values, (int)config.keys, numThreads, IIHM_BUILD_LAST_WINS);
+            if (map == NULL) return 1;
+            iihm_set_parallel_resize(map, numThreads, 1);
+            // fill up (untimed) until the next add has to grow the map
+            long next = config.keys;
+            while (map->size + 1 < map->allocatedSize)
+                iihm_add(map, bench_int_key(next++), 0);
+            int entries = map->size;
+            uint64_t begin = now_ns();
+            iihm_add(map, bench_int_key(next), 0);
+            double seconds = (double)(now_ns() - begin) / 1e9;
+            double growRate = (double)entries / seconds;
+            if (baseGrow == 0.0) baseGrow = growRate;
+            printf("%-16s %-8s %8d %12d %14.0f %7.2fx\n", "iihm_rehash", "grow", numThreads, entries,
+                   growRate, growRate / baseGrow);
+            fflush(stdout);
+            iihm_free(map);
+        }
+        free(keys);
+        free(values);
+    }
+
+    free(work);
+    free(benchKeys);
+    return 0;
+}
@@ -3,9 +3,33 @@
 // declared in string_hash_set_test.c
 // these are the unit tests we can run
 void string_hash_set_tests();
+// declared in int_int_hash_map_test.c
+void int_int_hash_map_tests();
+// declared in int_obj_hash_map_test.c
+void int_obj_hash_map_tests();
+// declared in int64_int64_hash_map_test.c
+void int64_int64_hash_map_tests();
+// declared in hash_alloc_test.c
+void hash_alloc_tests();
+// declared in string_interner_test.c
+void string_interner_tests();
+// declared in string_cuckoo_filter_test.c
+void string_cuckoo_filter_tests();
+// declared in concurrent_string_hash_set_test.c
+void concurrent_string_hash_set_tests();
+// declared in concurrent_int_int_hash_map_test.c
+void concurrent_int_int_hash_map_tests();
 
 // we just run the unit tests - this is to be used as a library
 int main() {
     string_hash_set_tests();
+    int_int_hash_map_tests();
+    int_obj_hash_map_tests();
+    int64_int64_hash_map_tests();
+    hash_alloc_tests();
+    string_interner_tests();
+    string_cuckoo_filter_tests();
+    concurrent_string_hash_set_tests();
+    concurrent_int_int_hash_map_tests();
     return 0;
 }
@@ -0,0 +1,365 @@
+/*
+ * Copyright (c) 2024 by Rock de Vocht
+ *
+ * All rights reserved. No part of this publication may be reproduced, distributed, or
+ * transmitted in any form or by any means, including photocopying, recording, or other
+ * electronic or mechanical methods, without the prior written permission of the publisher,
+ * except in the case of brief quotations embodied in critical reviews and certain other
+ * noncommercial uses permitted by copyright law.
+ *
+ */
+
+/**
+ * partitioning and compaction for the bulk build fns., parallel clear and re-chain of whole tables
+ * (see bulk_build.h)
+ *
+ */
+
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bulk_build.h"
+#include "int_hash.h"
+
+
+// partitions per thread, more than one so a thread with a crowded partition doesn't hold up the rest
+#define BULK_PARTITIONS_PER_THREAD 4
+// the most partitions used
+#define BULK_MAX_PARTITIONS 4096
+
+
+// what a thread started by bulk_run() runs
+typedef struct {
+    void (*fn)(void* arg, int thread);
+    void* arg;
+    int thread;
+} BulkThread;
+
+
+static void* bulk_thread(void* arg) {
+    BulkThread* work = (BulkThread*)arg;
+    work->fn(work->arg, work->thread);
+    return NULL;
+}
+
+
+/**
+ * run fn(arg, thread) for thread = 0 .. nthreads - 1 at the same time and wait for all of them,
+ * thread 0 runs on the calling thread - a thread that can't be started runs on the calling thread afterwards
+ */
+void bulk_run(int nthreads, void (*fn)(void* arg, int thread), void* arg) {
+    if (nthreads <= 1) {
+        fn(arg, 0);
+        return;
+    }
+    pthread_t* threads = malloc(nthreads * sizeof(pthread_t));
+    BulkThread* work = malloc(nthreads * sizeof(BulkThread));
+    int* started = calloc(nthreads, sizeof(int));
+    if (threads == NULL || work == NULL || started == NULL) { // no memory for threads, do it all here
+        for (int t = 0; t < nthreads; t++)
+            fn(arg, t);
+    } else {
+        for (int t = 1; t < nthreads; t++) {
+            work[t].fn = fn;
+            work[t].arg = arg;
+            work[t].thread = t;
+            started[t] = pthread_create(&threads[t], NULL, bulk_thread, &work[t]) == 0;
+        }
+        fn(arg, 0);
+        for (int t = 1; t < nthreads; t++) {
+            if (started[t])
+                pthread_join(threads[t], NULL);
+            else
+                fn(arg, t);
+        }
+    }
+    free(threads);
+    free(work);
+    free(started);
+}
+
+
+// the state shared by the threads of bulk_partition()
+typedef struct {
+    BulkPartitions* partitions;
+    const uint32_t* buckets;
+    int n;
+    int nthreads;
+    // counts[thread * numPartitions + p]: entries of partition p in the thread's part of the input,
+    // turned into the position the thread writes its next entry of p to
+    int* counts;
+} BulkPartitionWork;
+
+
+// the part of the input thread t looks at
+static void bulk_range(int n, int nthreads, int t, int* from, int* to) {
+    *from = (int)((long)n * t / nthreads);
+    *to = (int)((long)n * (t + 1) / nthreads);
+}
+
+
+// count the entries of every partition in thread t's part of the input
+static void bulk_count(void* arg, int t) {
+    BulkPartitionWork* work = (BulkPartitionWork*)arg;
+    int from, to;
+    bulk_range(work->n, work->nthreads, t, &from, &to);
+    int* counts = work->counts + (long)t * work->partitions->numPartitions;
+    int shift = work->partitions->bucketShift;
+    for (int i = from; i < to; i++)
+        counts[work->buckets[i] >> shift] += 1;
+}
+
+
+// write the indexes of thread t's part of the input to their partitions
+static void bulk_scatter(void* arg, int t) {
+    BulkPartitionWork* work = (BulkPartitionWork*)arg;
+    int from, to;
+    bulk_range(work->n, work->nthreads, t, &from, &to);
+    int* position = work->counts + (long)t * work->partitions->numPartitions;
+    int* order = work->partitions->order;
+    int shift = work->partitions->bucketShift;
+    for (int i = from; i < to; i++)
+        order[position[work->buckets[i] >> shift]++] = i;
+}
+
+
+/**
+ * radix partition the input by the top bits of its buckets: every thread counts, then scatters, its own part
+ * of the input, so within a partition the indexes stay in input order
+ * @param buckets the bucket of each of the n inputs, < 2^bucketBits
+ * @return 1 on success, 0 if out of memory
+ */
+int bulk_partition(BulkPartitions* partitions, const uint32_t* buckets, int n, int bucketBits, int nthreads) {
+    memset(partitions, 0, sizeof(BulkPartitions));
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > n) nthreads = n > 0 ? n : 1;
+    int partitionBits = 0;
+    while ((1 << partitionBits) < nthreads * BULK_PARTITIONS_PER_THREAD &&
+           (1 << partitionBits) < BULK_MAX_PARTITIONS && partitionBits < bucketBits)
+        partitionBits += 1;
+    int numPartitions = 1 << partitionBits;
+    partitions->numPartitions = numPartitions;
+    partitions->bucketShift = bucketBits - partitionBits;
+    partitions->starts = calloc(numPartitions + 1, sizeof(int));
+    partitions->used = calloc(numPartitions, sizeof(int));
+    partitions->newStarts = calloc(numPartitions, sizeof(int));
+    partitions->order = malloc((n > 0 ? n : 1) * sizeof(int));
+    BulkPartitionWork work = {partitions, buckets, n, nthreads, calloc((long)nthreads * numPartitions, sizeof(int))};
+    if (partitions->starts == NULL || partitions->used == NULL || partitions->newStarts == NULL ||
+            partitions->order == NULL || work.counts == NULL) {
+        free(work.counts);
+        bulk_free(partitions);
+        return 0;
+    }
+    bulk_run(nthreads, bulk_count, &work);
+    // partition by partition, thread by thread: where each thread starts writing each partition
+    int position = 0;
+    for (int p = 0; p < numPartitions; p++) {
+        partitions->starts[p] = position;
+        for (int t = 0; t < nthreads; t++) {
+            int count = work.counts[(long)t * numPartitions + p];
+            work.counts[(long)t * numPartitions + p] = position;
+            position += count;
+        }
+    }
+    partitions->starts[numPartitions] = position;
+    bulk_run(nthreads, bulk_scatter, &work);
+    free(work.counts);
+    return 1;
+}
+
+
+// the state shared by the threads of bulk_compact()
+typedef struct {
+    BulkPartitions* partitions;
+    int* first;
+    int* next;
+    int* newStarts;
+    int nthreads;
+} BulkCompactWork;
+
+
+// point the links of the partitions of thread t at the slots their entries are about to move to
+static void bulk_relink(void* arg, int t) {
+    BulkCompactWork* work = (BulkCompactWork*)arg;
+    BulkPartitions* partitions = work->partitions;
+    for (int p = t; p < partitions->numPartitions; p += work->nthreads) {
+        int delta = partitions->starts[p] - work->newStarts[p];
+        if (delta == 0) continue;
+        int bucketFrom = p << partitions->bucketShift;
+        int bucketTo = (p + 1) << partitions->bucketShift;
+        for (int b = bucketFrom; b < bucketTo; b++) {
+            if (work->first[b] != BULK_NO_ENTRY)
+                work->first[b] -= delta;
+        }
+        int slotTo = partitions->starts[p] + partitions->used[p];
+        for (int i = partitions->starts[p]; i < slotTo; i++) {
+            if (work->next[i] != BULK_NO_ENTRY)
+                work->next[i] -= delta;
+        }
+    }
+}
+
+
+/**
+ * close the gaps the duplicates left between the partitions: the links of each partition only point into
+ * its own slots, so they are all shifted by the same amount (in parallel), then the slots are moved down
+ * in partition order - a partition only ever moves over slots already moved out of the way
+ * @return the number of entries kept
+ */
+int bulk_compact(BulkPartitions* partitions, int* first, int* next, int* array1, int* array2, int nthreads) {
+    int numPartitions = partitions->numPartitions;
+    int* newStarts = partitions->newStarts;
+    int size = 0;
+    for (int p = 0; p < numPartitions; p++) {
+        newStarts[p] = size;
+        size += partitions->used[p];
+    }
+    if (size == partitions->starts[numPartitions])
+        return size; // no duplicates, nothing to move
+    BulkCompactWork work = {partitions, first, next, newStarts, nthreads < 1 ? 1 : nthreads};
+    if (work.nthreads > numPartitions) work.nthreads = numPartitions;
+    bulk_run(work.nthreads, bulk_relink, &work);
+    for (int p = 0; p < numPartitions; p++) {
+        int from = partitions->starts[p];
+        int to = newStarts[p];
+        size_t bytes = (size_t)partitions->used[p] * sizeof(int);
+        if (from == to || bytes == 0) continue;
+        memmove(next + to, next + from, bytes);
+        memmove(array1 + to, array1 + from, bytes);
+        memmove(array2 + to, array2 + from, bytes);
+    }
+    return size;
+}
+
+
+// the state shared by the threads of bulk_fill()
+typedef struct {
+    int* array;
+    int n;
+    int value;
+    int nthreads;
+} BulkFillWork;
+
+
+// set thread t's part of array[0 .. n) to value
+static void bulk_fill_range(void* arg, int t) {
+    BulkFillWork* work = (BulkFillWork*)arg;
+    int from, to;
+    bulk_range(work->n, work->nthreads, t, &from, &to);
+    for (int i = from; i < to; i++)
+        work->array[i] = work->value;
+}
+
+
+/**
+ * set the n ints of array to value, split over nthreads threads
+ */
+void bulk_fill(int* array, int n, int value, int nthreads) {
+    if (nthreads <= 1 || n < nthreads) {
+        for (int i = 0; i < n; i++)
+            array[i] = value;
+        return;
+    }
+    BulkFillWork work = {array, n, value, nthreads};
+    bulk_run(nthreads, bulk_fill_range, &work);
+}
+
+
+// the state shared by the threads of bulk_rehash()
+typedef struct {
+    BulkPartitions* partitions;
+    uint32_t* buckets;
+    int* first;
+    int* next;
+    const int* keys;
+    int size;
+    uint32_t mask;
+    uint32_t seed;
+    int hashKeys;
+    int nthreads;
+} BulkRehashWork;
+
+
+// work out the bucket of thread t's part of the entries
+static void bulk_rehash_buckets(void* arg, int t) {
+    BulkRehashWork* work = (BulkRehashWork*)arg;
+    int from, to;
+    bulk_range(work->size, work->nthreads, t, &from, &to);
+    for (int i = from; i < to; i++) {
+        uint32_t hash = work->hashKeys ? int_hash(work->keys[i], work->seed) : (uint32_t)work->keys[i];
+        work->buckets[i] = hash & work->mask;
+    }
+}
+
+
+// clear the buckets of thread t's partitions and chain their entries in, in the order of the entries - no
+// other thread touches these buckets, so the chains come out the same as when one thread does all of them
+static void bulk_rehash_partitions(void* arg, int t) {
+    BulkRehashWork* work = (BulkRehashWork*)arg;
+    BulkPartitions* partitions = work->partitions;
+    for (int p = t; p < partitions->numPartitions; p += work->nthreads) {
+        int bucketFrom = p << partitions->bucketShift;
+        int bucketTo = (p + 1) << partitions->bucketShift;
+        for (int b = bucketFrom; b < bucketTo; b++)
+            work->first[b] = BULK_NO_ENTRY;
+        for (int k = partitions->starts[p]; k < partitions->starts[p + 1]; k++) {
+            int i = partitions->order[k];
+            uint32_t b = work->buckets[i];
+            work->next[i] = work->first[b];
+            work->first[b] = i;
+        }
+    }
+}
+
+
+/**
+ * re-build the first[] buckets and next[] chains of the (packed) entries 0..size-1, every entry goes to the
+ * front of its chain.  with nthreads > 1 the entries are radix partitioned by bucket (bulk_partition()), so
+ * every thread owns a range of first[] and clears and chains it with plain stores - this needs two ints per
+ * entry of extra memory while it runs, without that it is done on the calling thread
+ */
+void bulk_rehash(int* first, int* next, const int* keys, int size, int allocatedSize, uint32_t seed, int hashKeys,
+                 int nthreads) {
+    uint32_t mask = (uint32_t)(allocatedSize - 1);
+    BulkPartitions partitions;
+    uint32_t* buckets = nthreads <= 1 || size < nthreads ? NULL : malloc((size_t)size * sizeof(uint32_t));
+    if (buckets != NULL) {
+        int bucketBits = 0;
+        while ((1 << bucketBits) < allocatedSize)
+            bucketBits += 1;
+        BulkRehashWork work = {&partitions, buckets, first, next, keys, size, mask, seed, hashKeys, nthreads};
+        bulk_run(nthreads, bulk_rehash_buckets, &work);
+        if (bulk_partition(&partitions, buckets, size, bucketBits, nthreads)) {
+            if (work.nthreads > partitions.numPartitions) work.nthreads = partitions.numPartitions;
+            bulk_run(work.nthreads, bulk_rehash_partitions, &work);
+            bulk_free(&partitions);
+            free(buckets);
+            return;
+        }
+        free(buckets); // out of memory, do it all here
+    }
+    for (int i = 0; i < allocatedSize; i++)
+        first[i] = BULK_NO_ENTRY;
+    for (int i = 0; i < size; i++) {
+        uint32_t hash = hashKeys ? int_hash(keys[i], seed) : (uint32_t)keys[i];
+        next[i] = first[hash & mask];
+        first[hash & mask] = i;
+    }
+}
+
+
+/**
+ * free the arrays of partitions
+ */
+void bulk_free(BulkPartitions* partitions) {
+    free(partitions->starts);
+    free(partitions->order);
+    free(partitions->used);
+    free(partitions->newStarts);
+    partitions->starts = NULL;
+    partitions->order = NULL;
+    partitions->used = NULL;
+    partitions->newStarts = NULL;
+}
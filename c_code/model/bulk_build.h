@@ -0,0 +1,64 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#ifndef C_CODE_BULK_BUILD_H
+#define C_CODE_BULK_BUILD_H
+
+#include <stdint.h>
+
+/**
+ * helpers for building a chained structure (first[] -> next[] chains over dense entries) from a whole
+ * array of input at once, see iihm_build() and str_hashset_build()
+ *
+ * the input is radix partitioned by the top bits of its bucket, so every partition owns a contiguous range
+ * of first[] buckets and can be filled by one thread without any locking.  partition p's entries are
+ * written to the dense slots starting at starts[p]; once the duplicates are dropped bulk_compact()
+ * closes the gaps between the partitions so the entries end up in 0..size-1 again.
+ *
+ * bulk_fill() and bulk_rehash() are the parallel versions of the loops that clear and re-chain a whole
+ * table, used by the structures once a table is big enough (see iihm_set_parallel_resize()).  bulk_rehash()
+ * partitions the entries the same way, so every thread chains its own buckets with plain stores.
+ */
+
+// marks an empty bucket and the end of a chain, the same value as the maps' own markers
+#define BULK_NO_ENTRY (-1)
+
+// tables with fewer buckets than this are cleared / re-chained by one thread unless told otherwise
+#define BULK_PARALLEL_MIN_SIZE (1 << 20)
+
+typedef struct {
+    // number of partitions (a power of 2)
+    int numPartitions;
+    // log2 of the number of buckets a partition owns
+    int bucketShift;
+    // partition p has the input indexes order[starts[p] .. starts[p + 1]), in input order
+    int* starts;
+    int* order;
+    // partition p kept used[p] entries (filled in by the caller), in slots starts[p] .. starts[p] + used[p]
+    int* used;
+    // where bulk_compact() moves the entries of partition p to
+    int* newStarts;
+} BulkPartitions;
+
+// fn. to run fn(arg, thread) for thread = 0 .. nthreads - 1 at the same time, thread 0 on the calling thread
+void bulk_run(int nthreads, void (*fn)(void* arg, int thread), void* arg);
+
+// fn. to group the n input indexes by the partition of buckets[i] (out of 2^bucketBits), returns 1 on success
+int bulk_partition(BulkPartitions* partitions, const uint32_t* buckets, int n, int bucketBits, int nthreads);
+
+// fn. to move the kept entries of every partition together into 0..size-1, returns the size
+int bulk_compact(BulkPartitions* partitions, int* first, int* next, int* array1, int* array2, int nthreads);
+
+// fn. to set the n ints of array to value with nthreads threads
+void bulk_fill(int* array, int n, int value, int nthreads);
+
+// fn. to re-build first[] / next[] for the entries 0..size-1 with nthreads threads, entry i goes into bucket
+// int_hash(keys[i], seed) (or keys[i] itself if hashKeys is 0) masked to the power of 2 allocatedSize
+void bulk_rehash(int* first, int* next, const int* keys, int size, int allocatedSize, uint32_t seed, int hashKeys,
+                 int nthreads);
+
+// fn. to free the arrays of partitions
+void bulk_free(BulkPartitions* partitions);
+
+#endif //C_CODE_BULK_BUILD_H
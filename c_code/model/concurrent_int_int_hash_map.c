@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2024 by Rock de Vocht
+ *
+ * All rights reserved. No part of this publication may be reproduced, distributed, or
+ * transmitted in any form or by any means, including photocopying, recording, or other
+ * electronic or mechanical methods, without the prior written permission of the publisher,
+ * except in the case of brief quotations embodied in critical reviews and certain other
+ * noncommercial uses permitted by copyright law.
+ *
+ */
+
+/**
+ * a lock free int -> int hash map, for counting in many threads at once
+ *
+ * every slot has a 64 bit key word and a 64 bit value word, both only ever change by compare-and-swap:
+ * a key is claimed by swapping an empty key word for the key, a value is set or added to by swapping
+ * the value word.  keys are never removed, so a key can't be further along its probe sequence than
+ * the first empty slot.
+ *
+ * growing is cooperative: the thread that takes a table past 3/4 full hangs a table of twice the size
+ * off it (resizeTo), after which every operation on the old table migrates a chunk of it first.
+ * migrating a slot seals it - an empty key word becomes CIIHM_KEY_MOVED, a value word gets
+ * CIIHM_VALUE_MOVED - so nothing can change it in the old table anymore, then copies the value and marks
+ * it CIIHM_VALUE_COPIED.  an operation that runs into a sealed value copies it itself before it carries
+ * on in the new table, so a key's value is only ever changed in one table.  once every slot is migrated
+ * the new table becomes the one new operations start in.  old tables can still be read by threads that
+ * started in them, so they are only freed with the map (together they are smaller than the newest one).
+ *
+ */
+
+
+#include <stdlib.h>
+#include "concurrent_int_int_hash_map.h"
+#include "int_hash.h"
+
+
+// key word: the key is present (so key 0 isn't the empty key word 0)
+#define CIIHM_KEY_PRESENT ((int64_t)1 << 32)
+// key word: an empty slot sealed by a resize
+#define CIIHM_KEY_MOVED ((int64_t)1 << 33)
+// value word: the value has been set
+#define CIIHM_VALUE_SET ((int64_t)1 << 32)
+// value word: sealed by a resize, the value can't change in this table anymore
+#define CIIHM_VALUE_MOVED ((int64_t)1 << 33)
+// value word: the (sealed) value has been copied into the next table
+#define CIIHM_VALUE_COPIED ((int64_t)1 << 34)
+
+// number of slots a thread migrates at a time while helping a resize
+#define CIIHM_RESIZE_CHUNK 1024
+
+// the different updates ciihm_update() can do
+#define CIIHM_OP_INSERT 0
+#define CIIHM_OP_ADD 1
+#define CIIHM_OP_COPY 2
+
+
+// the key word of key
+static inline int64_t ciihm_key_word(int key) {
+    return (int64_t)(uint32_t)key | CIIHM_KEY_PRESENT;
+}
+
+// the value word of a set value
+static inline int64_t ciihm_value_word(uint32_t value) {
+    return (int64_t)value | CIIHM_VALUE_SET;
+}
+
+// the value inside a value word
+static inline int ciihm_value(int64_t word) {
+    return (int)(uint32_t)word;
+}
+
+
+/**
+ * allocate an empty table of capacity (a power of 2) slots
+ */
+static ConcurrentIntIntTable* ciihm_allocate_table(int capacity) {
+    ConcurrentIntIntTable* table = (ConcurrentIntIntTable*) calloc(1, sizeof(ConcurrentIntIntTable));
+    if (table == NULL) return NULL; // failed?
+    table->keySet = calloc(capacity, sizeof(_Atomic int64_t));
+    table->valueSet = calloc(capacity, sizeof(_Atomic int64_t));
+    if (table->keySet == NULL || table->valueSet == NULL) { // out of memory
+        free(table->keySet);
+        free(table->valueSet);
+        free(table);
+        return NULL;
+    }
+    table->allocatedSize = capacity;
+    atomic_init(&table->used, 0);
+    atomic_init(&table->resizeTo, NULL);
+    atomic_init(&table->resizeClaimed, 0);
+    atomic_init(&table->resizeMigrated, 0);
+    return table;
+}
+
+
+/**
+ * create a new map for (at least) initialSize keys
+ */
+ConcurrentIntIntHashMap* ciihm_create(int initialSize) {
+    ConcurrentIntIntHashMap* data = (ConcurrentIntIntHashMap*) calloc(1, sizeof(ConcurrentIntIntHashMap));
+    if (data == NULL) return NULL; // failed?
+    // room for initialSize keys before the first resize (at 3/4 full), worked out in 64 bits so it can't overflow
+    int64_t slots = (int64_t)initialSize + initialSize / 3 + 1;
+    if (slots > INT_HASH_MAX_CAPACITY) slots = INT_HASH_MAX_CAPACITY;
+    data->tables = ciihm_allocate_table(int_hash_capacity((int)slots));
+    if (data->tables == NULL) {
+        free(data);
+        return NULL;
+    }
+    atomic_init(&data->table, data->tables);
+    atomic_init(&data->size, 0);
+    return data;
+}
+
+
+/**
+ * free the map and all its tables
+ */
+void ciihm_free(ConcurrentIntIntHashMap* data) {
+    if (data == NULL) return; // no data, don't de-allocate
+    ConcurrentIntIntTable* table = data->tables;
+    while (table != NULL) {
+        ConcurrentIntIntTable* next = atomic_load(&table->resizeTo);
+        free(table->keySet);
+        free(table->valueSet);
+        free(table);
+        table = next;
+    }
+    free(data);
+}
+
+
+/**
+ * make sure table is being resized
+ * @return the table it is being resized to, NULL if it can't grow (out of memory or too big)
+ */
+static ConcurrentIntIntTable* ciihm_start_resize(ConcurrentIntIntTable* table) {
+    ConcurrentIntIntTable* next = atomic_load(&table->resizeTo);
+    if (next != NULL || table->allocatedSize >= INT_HASH_MAX_CAPACITY)
+        return next; // already started, or can't grow
+    ConcurrentIntIntTable* fresh = ciihm_allocate_table(table->allocatedSize * 2);
+    if (fresh == NULL) return NULL;
+    if (!atomic_compare_exchange_strong(&table->resizeTo, &next, fresh)) {
+        free(fresh->keySet); // another thread started it first
+        free(fresh->valueSet);
+        free(fresh);
+        return next;
+    }
+    return fresh;
+}
+
+
+static int ciihm_update(ConcurrentIntIntHashMap* data, ConcurrentIntIntTable* table, int key, int op, int value,
+                        int* previous);
+
+
+/**
+ * migrate slot i of table into next: seal it, copy its value and mark it copied
+ * any number of threads can do this for the same slot at the same time
+ */
+static void ciihm_migrate_slot(ConcurrentIntIntHashMap* data, ConcurrentIntIntTable* table,
+                               ConcurrentIntIntTable* next, int i) {
+    int64_t key = atomic_load(&table->keySet[i]);
+    while (key == 0) { // an empty slot, seal it so no key can be added here anymore
+        if (atomic_compare_exchange_weak(&table->keySet[i], &key, CIIHM_KEY_MOVED))
+            return;
+    }
+    if (key == CIIHM_KEY_MOVED)
+        return; // already sealed
+    int64_t value = atomic_load(&table->valueSet[i]);
+    while ((value & CIIHM_VALUE_MOVED) == 0) { // seal the value
+        if (atomic_compare_exchange_weak(&table->valueSet[i], &value, value | CIIHM_VALUE_MOVED))
+            value |= CIIHM_VALUE_MOVED;
+    }
+    if (value & CIIHM_VALUE_COPIED)
+        return; // someone else finished it
+    if (value & CIIHM_VALUE_SET) { // a claimed key without a value has nothing to copy
+        int ignored;
+        ciihm_update(data, next, ciihm_value(key), CIIHM_OP_COPY, ciihm_value(value), &ignored);
+    }
+    atomic_compare_exchange_strong(&table->valueSet[i], &value, value | CIIHM_VALUE_COPIED);
+}
+
+
+/**
+ * move data->table on past every table that is fully migrated - the resize of a newer table can finish before
+ * the one of the table data->table points at, so one step from the table that just finished isn't enough
+ */
+static void ciihm_advance(ConcurrentIntIntHashMap* data) {
+    ConcurrentIntIntTable* table = atomic_load(&data->table);
+    while (atomic_load(&table->resizeMigrated) == table->allocatedSize) {
+        ConcurrentIntIntTable* next = atomic_load(&table->resizeTo);
+        if (atomic_compare_exchange_strong(&data->table, &table, next))
+            table = next; // (a failed exchange re-reads where another thread moved it to)
+    }
+}
+
+
+/**
+ * migrate the next chunk of table (being resized), the table after it takes over when all of it is done
+ */
+static void ciihm_help_resize(ConcurrentIntIntHashMap* data, ConcurrentIntIntTable* table) {
+    if (atomic_load(&table->resizeClaimed) >= table->allocatedSize)
+        return; // all handed out already
+    int start = atomic_fetch_add(&table->resizeClaimed, CIIHM_RESIZE_CHUNK);
+    if (start >= table->allocatedSize)
+        return;
+    int end = start + CIIHM_RESIZE_CHUNK < table->allocatedSize ? start + CIIHM_RESIZE_CHUNK : table->allocatedSize;
+    ConcurrentIntIntTable* next = atomic_load(&table->resizeTo);
+    for (int i = start; i < end; i++)
+        ciihm_migrate_slot(data, table, next, i);
+    if (atomic_fetch_add(&table->resizeMigrated, end - start) + (end - start) == table->allocatedSize)
+        ciihm_advance(data); // every slot is done, new operations start in the new table
+}
+
+
+/**
+ * insert (CIIHM_OP_INSERT), add to (CIIHM_OP_ADD) or copy during a resize (CIIHM_OP_COPY) the value of key,
+ * starting in table and following it to the tables it is being resized to
+ * @param previous receives the value before the update (0 if the key wasn't there)
+ * @return 1 if the key got its first value, 0 if it already had one, -1 if the map is out of memory
+ */
+static int ciihm_update(ConcurrentIntIntHashMap* data, ConcurrentIntIntTable* table, int key, int op, int value,
+                        int* previous) {
+    int64_t keyWord = ciihm_key_word(key);
+    uint32_t hash = int_hash(key, data->seed);
+    while (table != NULL) {
+        if (op != CIIHM_OP_COPY && atomic_load(&table->resizeTo) != NULL)
+            ciihm_help_resize(data, table); // everybody pitches in
+        uint32_t mask = (uint32_t)table->allocatedSize - 1;
+        uint32_t i = hash & mask;
+        int slot = -1;
+        for (int probe = 0; probe < table->allocatedSize; probe++, i = (i + 1) & mask) {
+            int64_t word = atomic_load(&table->keySet[i]);
+            while (word == 0) { // empty: claim it, or seal it if this table is being resized
+                if (atomic_load(&table->resizeTo) == NULL) {
+                    if (atomic_compare_exchange_weak(&table->keySet[i], &word, keyWord)) {
+                        int used = atomic_fetch_add(&table->used, 1) + 1;
+                        if (used >= table->allocatedSize - table->allocatedSize / 4)
+                            ciihm_start_resize(table);
+                        word = keyWord;
+                    }
+                } else {
+                    atomic_compare_exchange_weak(&table->keySet[i], &word, CIIHM_KEY_MOVED);
+                }
+            }
+            if (word == keyWord) {
+                slot = (int)i;
+                break;
+            }
+            if (word == CIIHM_KEY_MOVED)
+                break; // the key isn't in this table, and can't be added to it anymore
+        }
+
+        if (slot >= 0) {
+            int64_t current = atomic_load(&table->valueSet[slot]);
+            while ((current & CIIHM_VALUE_MOVED) == 0) {
+                int64_t update;
+                if ((current & CIIHM_VALUE_SET) == 0)
+                    update = ciihm_value_word((uint32_t)value); // the first value
+                else if (op == CIIHM_OP_ADD)
+                    update = ciihm_value_word((uint32_t)ciihm_value(current) + (uint32_t)value); // wraps around
+                else { // insert and copy leave an existing value alone
+                    *previous = ciihm_value(current);
+                    return 0;
+                }
+                if (atomic_compare_exchange_weak(&table->valueSet[slot], &current, update)) {
+                    if ((current & CIIHM_VALUE_SET) == 0) {
+                        if (op != CIIHM_OP_COPY) atomic_fetch_add(&data->size, 1);
+                        *previous = 0;
+                        return 1;
+                    }
+                    *previous = ciihm_value(current);
+                    return 0;
+                }
+            }
+            // sealed by a resize: copy it over before using the next table, so the value lives in one place
+            ciihm_migrate_slot(data, table, atomic_load(&table->resizeTo), slot);
+            table = atomic_load(&table->resizeTo);
+        } else {
+            // not in this table and no room for it: it goes into the table this one is being resized to
+            table = ciihm_start_resize(table);
+        }
+    }
+    *previous = 0;
+    return -1; // out of memory
+}
+
+
+/**
+ * add key with value if the key isn't in the map yet
+ * @return 1 if it was added, 0 if the key was already there (its value isn't changed), -1 if out of memory
+ */
+int ciihm_insert_if_absent(ConcurrentIntIntHashMap* data, int key, int value) {
+    if (data == NULL) return 0;
+    int previous;
+    return ciihm_update(data, atomic_load(&data->table), key, CIIHM_OP_INSERT, value, &previous);
+}
+
+
+/**
+ * add delta to the value of key, a key that isn't in the map yet is added with value delta
+ * (the delta is lost if the map is out of memory)
+ * @return the value before the add (0 for a new key)
+ */
+int ciihm_fetch_add(ConcurrentIntIntHashMap* data, int key, int delta) {
+    if (data == NULL) return 0;
+    int previous;
+    ciihm_update(data, atomic_load(&data->table), key, CIIHM_OP_ADD, delta, &previous);
+    return previous;
+}
+
+
+/**
+ * find key without writing anything, at most one probe sequence per table
+ * @return 1 if found (its value is in *value), otherwise 0
+ */
+static int ciihm_find(ConcurrentIntIntHashMap* data, int key, int* value) {
+    int64_t keyWord = ciihm_key_word(key);
+    uint32_t hash = int_hash(key, data->seed);
+    ConcurrentIntIntTable* table = atomic_load(&data->table);
+    while (table != NULL) {
+        uint32_t mask = (uint32_t)table->allocatedSize - 1;
+        uint32_t i = hash & mask;
+        int probe = 0;
+        int64_t word = 0;
+        for (; probe < table->allocatedSize; probe++, i = (i + 1) & mask) {
+            word = atomic_load(&table->keySet[i]);
+            if (word == keyWord || word == 0 || word == CIIHM_KEY_MOVED)
+                break;
+        }
+        if (word == 0)
+            return 0; // an empty slot: the key was never added
+        if (word == keyWord) {
+            int64_t current = atomic_load(&table->valueSet[i]);
+            if ((current & CIIHM_VALUE_COPIED) == 0) {
+                if (current & CIIHM_VALUE_SET) {
+                    *value = ciihm_value(current); // still the current value, even when sealed
+                    return 1;
+                }
+                if ((current & CIIHM_VALUE_MOVED) == 0)
+                    return 0; // claimed, but it has no value yet
+            }
+        }
+        // moved on to the next table
+        table = atomic_load(&table->resizeTo);
+    }
+    return 0;
+}
+
+
+/**
+ * get the value of key
+ * @return the value, or 0 if the key isn't in the map (use ciihm_contains() to tell the two apart)
+ */
+int ciihm_get(ConcurrentIntIntHashMap* data, int key) {
+    int value = 0;
+    if (data != NULL)
+        ciihm_find(data, key, &value);
+    return value;
+}
+
+
+/**
+ * is key inside the map (does it exist)
+ * @return 0 if not found, otherwise 1
+ */
+int ciihm_contains(ConcurrentIntIntHashMap* data, int key) {
+    int value;
+    return data != NULL && ciihm_find(data, key, &value);
+}
+
+
+/**
+ * the number of keys in the map, a snapshot that can be out of date by the time it returns
+ */
+long ciihm_size(ConcurrentIntIntHashMap* data) {
+    return data != NULL ? atomic_load(&data->size) : 0;
+}
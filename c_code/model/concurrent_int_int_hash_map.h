@@ -0,0 +1,74 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#ifndef C_CODE_CONCURRENT_INT_INT_HASH_MAP_H
+#define C_CODE_CONCURRENT_INT_INT_HASH_MAP_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * one table of a ConcurrentIntIntHashMap, open addressing with linear probing
+ * keys are never removed, a table is only ever replaced by a table twice its size
+ */
+struct STRUCT_ConcurrentIntIntTable {
+    // a key per slot: 0 is empty, CIIHM_KEY_MOVED is an empty slot sealed by a resize,
+    // anything else is the key (low 32 bits) with CIIHM_KEY_PRESENT set
+    _Atomic int64_t* keySet;
+    // a value per slot: the value (low 32 bits) and its CIIHM_VALUE_* state bits, 0 is not set yet
+    _Atomic int64_t* valueSet;
+    // how many slots (a power of 2)
+    int allocatedSize;
+    // how many slots have a key, a resize starts once 3/4 of them do
+    atomic_int used;
+    // the table this one is being migrated to, NULL if it isn't being resized
+    _Atomic(struct STRUCT_ConcurrentIntIntTable*) resizeTo;
+    // resizing: slots handed out to the threads helping with the migration
+    atomic_int resizeClaimed;
+    // resizing: slots migrated, the new table takes over when they all are
+    atomic_int resizeMigrated;
+};
+
+typedef struct STRUCT_ConcurrentIntIntTable ConcurrentIntIntTable;
+
+/**
+ * a lock free int -> int hash map for counting from many threads at once
+ * every int can be a key, keys can't be removed
+ */
+struct STRUCT_ConcurrentIntIntHashMap {
+    // the table new operations start in
+    _Atomic(ConcurrentIntIntTable*) table;
+    // the first table, all tables are linked from it through resizeTo (freed with the map)
+    ConcurrentIntIntTable* tables;
+    // how many keys have a value
+    atomic_long size;
+    // mixed into the hash of every key (see int_hash.h)
+    uint32_t seed;
+};
+
+// define a nice name for the data structure
+typedef struct STRUCT_ConcurrentIntIntHashMap ConcurrentIntIntHashMap;
+
+// fn. to create a new lock free int-int hash map for (at least) initialSize keys
+ConcurrentIntIntHashMap* ciihm_create(int initialSize);
+
+// fn. to de-allocate the hash map (not safe to call while other threads use the map)
+void ciihm_free(ConcurrentIntIntHashMap* data);
+
+// fn. to add key with value if it isn't in the map yet, returns 1 if it was added, 0 if it existed, -1 out of memory
+int ciihm_insert_if_absent(ConcurrentIntIntHashMap* data, int key, int value);
+
+// fn. to add delta to the value of key (a missing key counts as 0) and return the value before the add
+int ciihm_fetch_add(ConcurrentIntIntHashMap* data, int key, int delta);
+
+// fn. to get the value of key (0 if not found), wait free
+int ciihm_get(ConcurrentIntIntHashMap* data, int key);
+
+// fn. to check if the map contains key, returns 1 if it does, wait free
+int ciihm_contains(ConcurrentIntIntHashMap* data, int key);
+
+// fn. to get the number of keys in the map
+long ciihm_size(ConcurrentIntIntHashMap* data);
+
+#endif //C_CODE_CONCURRENT_INT_INT_HASH_MAP_H
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2024 by Rock de Vocht
+ *
+ * All rights reserved. No part of this publication may be reproduced, distributed, or
+ * transmitted in any form or by any means, including photocopying, recording, or other
+ * electronic or mechanical methods, without the prior written permission of the publisher,
+ * except in the case of brief quotations embodied in critical reviews and certain other
+ * noncommercial uses permitted by copyright law.
+ *
+ */
+
+/**
+ * a thread safe String hash set made of independent StringHashSet shards
+ *
+ * a string is hashed once (str_hashset_hash()), the top bits of the hash pick its shard and the whole
+ * hash is handed to that shard's StringHashSet.  every shard has a read/write lock: any number of
+ * contains() calls can run on a shard at the same time, an add() or remove() only blocks the one shard
+ * it changes.  the shards never resize incrementally - that would make contains() write to the shard -
+ * so each shard grows (or shrinks) all at once, but only by the size of that one shard.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "concurrent_string_hash_set.h"
+
+
+// the shard of a string with the given hash
+static inline StringHashSetShard* cstr_hashset_shard(ConcurrentStringHashSet* data, uint64_t hash) {
+    if (data->shardBits == 0) return data->shards;
+    return data->shards + (hash >> (64 - data->shardBits));
+}
+
+
+/**
+ * clear the hash set - remove all data from every shard
+ */
+void cstr_hashset_clear(ConcurrentStringHashSet* data) {
+    if (data == NULL) // not set - just return
+        return;
+    for (int i = 0; i < data->numShards; i++) {
+        pthread_rwlock_wrlock(&data->shards[i].lock);
+        str_hashset_clear(data->shards[i].set);
+        pthread_rwlock_unlock(&data->shards[i].lock);
+    }
+}
+
+
+/**
+ * free all the data allocated by the ConcurrentStringHashSet
+ */
+void cstr_hashset_free(ConcurrentStringHashSet* data) {
+    if (data == NULL) return; // no data, don't de-allocate
+    if (data->shards != NULL) {
+        for (int i = 0; i < data->numShards; i++) {
+            str_hashset_free(data->shards[i].set);
+            pthread_rwlock_destroy(&data->shards[i].lock);
+        }
+        free(data->shards);
+    }
+    free(data);
+}
+
+
+/**
+ * create a new hash set for initialSize strings, split over numShards shards (rounded up to a power of 2)
+ */
+ConcurrentStringHashSet* cstr_hashset_create(int initialSize, int numShards) {
+    // allocate the main structure
+    ConcurrentStringHashSet* data = (ConcurrentStringHashSet*) calloc(1, sizeof(ConcurrentStringHashSet));
+    if (data == NULL) return NULL; // failed?
+    data->numShards = 1;
+    while (data->numShards < numShards && data->numShards < CONCURRENT_STRING_HASHSET_MAX_SHARDS) {
+        data->numShards *= 2;
+        data->shardBits += 1;
+    }
+    // cache line aligned shards
+    data->shards = aligned_alloc(64, (size_t)data->numShards * sizeof(StringHashSetShard));
+    if (data->shards == NULL) {
+        free(data);
+        return NULL;
+    }
+    memset(data->shards, 0, (size_t)data->numShards * sizeof(StringHashSetShard));
+    int shardSize = initialSize / data->numShards;
+    for (int i = 0; i < data->numShards; i++) {
+        pthread_rwlock_init(&data->shards[i].lock, NULL);
+        data->shards[i].set = str_hashset_create(shardSize);
+        if (data->shards[i].set == NULL) { // out of memory
+            data->numShards = i + 1;
+            cstr_hashset_free(data);
+            return NULL;
+        }
+    }
+    // done - return the new data structure
+    return data;
+}
+
+
+/**
+ * the number of strings in the set, a snapshot that can be out of date by the time it returns
+ * if other threads are changing the set
+ */
+long cstr_hashset_size(ConcurrentStringHashSet* data) {
+    if (data == NULL) return 0;
+    long size = 0;
+    for (int i = 0; i < data->numShards; i++) {
+        pthread_rwlock_rdlock(&data->shards[i].lock);
+        size += data->shards[i].set->size;
+        pthread_rwlock_unlock(&data->shards[i].lock);
+    }
+    return size;
+}
+
+
+/**
+ * add a string by its str_hashset_hash() value into the set
+ * @return true if a new item was added, false if the item already existed
+ */
+int cstr_hashset_add_hashed(ConcurrentStringHashSet* data, uint64_t hash) {
+    if (data == NULL) return 0;
+    StringHashSetShard* shard = cstr_hashset_shard(data, hash);
+    pthread_rwlock_wrlock(&shard->lock);
+    int added = str_hashset_add_hashed(shard->set, hash);
+    pthread_rwlock_unlock(&shard->lock);
+    return added;
+}
+
+
+/**
+ * add the len bytes at str (don't have to be '\0' terminated) into the set
+ * @return true if a new item was added, false if the item already existed
+ */
+int cstr_hashset_add_n(ConcurrentStringHashSet* data, const char* str, size_t len) {
+    // can't add empty str
+    if (str == NULL || len == 0)
+        return 0;
+    return cstr_hashset_add_hashed(data, str_hashset_hash(str, len));
+}
+
+
+/**
+ * add a new string into the set
+ * @return true if a new item was added, false if the item already existed
+ */
+int cstr_hashset_add(ConcurrentStringHashSet* data, const char* str) {
+    if (str == NULL) return 0;
+    return cstr_hashset_add_n(data, str, strlen(str));
+}
+
+
+/**
+ * is the string with this str_hashset_hash() value inside the set (does it exist)
+ */
+int cstr_hashset_contains_hashed(ConcurrentStringHashSet* data, uint64_t hash) {
+    if (data == NULL) return 0;
+    StringHashSetShard* shard = cstr_hashset_shard(data, hash);
+    pthread_rwlock_rdlock(&shard->lock);
+    int found = str_hashset_contains_hashed(shard->set, hash);
+    pthread_rwlock_unlock(&shard->lock);
+    return found;
+}
+
+
+/**
+ * are the len bytes at str (don't have to be '\0' terminated) inside the set
+ */
+int cstr_hashset_contains_n(ConcurrentStringHashSet* data, const char* str, size_t len) {
+    // we can never insert an empty string
+    if (str == NULL || len == 0)
+        return 0;
+    return cstr_hashset_contains_hashed(data, str_hashset_hash(str, len));
+}
+
+
+/**
+ * is str inside the set (does it exist)
+ */
+int cstr_hashset_contains(ConcurrentStringHashSet* data, const char* str) {
+    if (str == NULL) return 0;
+    return cstr_hashset_contains_n(data, str, strlen(str));
+}
+
+
+/**
+ * remove the string with this str_hashset_hash() value from the set
+ */
+int cstr_hashset_remove_hashed(ConcurrentStringHashSet* data, uint64_t hash) {
+    if (data == NULL) return 0;
+    StringHashSetShard* shard = cstr_hashset_shard(data, hash);
+    pthread_rwlock_wrlock(&shard->lock);
+    int removed = str_hashset_remove_hashed(shard->set, hash);
+    pthread_rwlock_unlock(&shard->lock);
+    return removed;
+}
+
+
+/**
+ * remove the len bytes at str (don't have to be '\0' terminated) from the set
+ */
+int cstr_hashset_remove_n(ConcurrentStringHashSet* data, const char* str, size_t len) {
+    // can't remove an empty string
+    if (str == NULL || len == 0) return 0;
+    return cstr_hashset_remove_hashed(data, str_hashset_hash(str, len));
+}
+
+
+/**
+ * remove a str from the set
+ */
+int cstr_hashset_remove(ConcurrentStringHashSet* data, const char* str) {
+    if (str == NULL) return 0;
+    return cstr_hashset_remove_n(data, str, strlen(str));
+}
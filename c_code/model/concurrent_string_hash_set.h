@@ -0,0 +1,84 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#ifndef C_CODE_CONCURRENT_STRING_HASH_SET_H
+#define C_CODE_CONCURRENT_STRING_HASH_SET_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "string_hash_set.h"
+
+// the most shards a set can be split into
+#define CONCURRENT_STRING_HASHSET_MAX_SHARDS 1024
+
+/**
+ * one independent part of the set, aligned to a cache line so the locks of neighbouring shards
+ * don't share one
+ */
+struct STRUCT_StringHashSetShard {
+    // readers share it, an add/remove/clear holds it exclusively
+    pthread_rwlock_t lock;
+    // the strings of this shard, grows and shrinks by itself
+    StringHashSet* set;
+} __attribute__((aligned(64)));
+
+typedef struct STRUCT_StringHashSetShard StringHashSetShard;
+
+/**
+ * a thread safe StringHashSet: the strings are split over a power of 2 number of shards by the high bits
+ * of their hash, each shard has its own lock so threads working on different shards never wait for each other
+ */
+struct STRUCT_ConcurrentStringHashSet {
+    // the shards
+    StringHashSetShard* shards;
+    // how many shards there are (a power of 2)
+    int numShards;
+    // log2(numShards), the number of hash bits that pick the shard
+    int shardBits;
+};
+
+// define a nice name for the data structure
+typedef struct STRUCT_ConcurrentStringHashSet ConcurrentStringHashSet;
+
+// create a new thread safe hash set for initialSize strings (in total) split over (at least) numShards shards
+ConcurrentStringHashSet* cstr_hashset_create(int initialSize, int numShards);
+
+// clear the hash set (not safe to call while other threads use the set)
+void cstr_hashset_clear(ConcurrentStringHashSet* data);
+
+// de-allocate the hash set (not safe to call while other threads use the set)
+void cstr_hashset_free(ConcurrentStringHashSet* data);
+
+// the number of strings in the set
+long cstr_hashset_size(ConcurrentStringHashSet* data);
+
+// add a new string into the hash set and return 1 if it wasn't in there already
+int cstr_hashset_add(ConcurrentStringHashSet* data, const char* str);
+
+// add len bytes at str (not '\0' terminated) into the hash set and return 1 if they weren't in there already
+int cstr_hashset_add_n(ConcurrentStringHashSet* data, const char* str, size_t len);
+
+// add a string by its str_hashset_hash() into the hash set and return 1 if it wasn't in there already
+int cstr_hashset_add_hashed(ConcurrentStringHashSet* data, uint64_t hash);
+
+// does the set contain str?
+int cstr_hashset_contains(ConcurrentStringHashSet* data, const char* str);
+
+// does the set contain the len bytes at str?
+int cstr_hashset_contains_n(ConcurrentStringHashSet* data, const char* str, size_t len);
+
+// does the set contain the string with this str_hashset_hash()?
+int cstr_hashset_contains_hashed(ConcurrentStringHashSet* data, uint64_t hash);
+
+// remove a string from the hash set
+int cstr_hashset_remove(ConcurrentStringHashSet* data, const char* str);
+
+// remove the len bytes at str from the hash set
+int cstr_hashset_remove_n(ConcurrentStringHashSet* data, const char* str, size_t len);
+
+// remove the string with this str_hashset_hash() from the hash set
+int cstr_hashset_remove_hashed(ConcurrentStringHashSet* data, uint64_t hash);
+
+#endif //C_CODE_CONCURRENT_STRING_HASH_SET_H
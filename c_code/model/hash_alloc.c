@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2024 by Rock de Vocht
+ *
+ * All rights reserved. No part of this publication may be reproduced, distributed, or
+ * transmitted in any form or by any means, including photocopying, recording, or other
+ * electronic or mechanical methods, without the prior written permission of the publisher,
+ * except in the case of brief quotations embodied in critical reviews and certain other
+ * noncommercial uses permitted by copyright law.
+ *
+ */
+
+/**
+ * the built in allocators of the structures: default (calloc / realloc / free), bump arena and huge pages
+ * (see hash_alloc.h)
+ *
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "hash_alloc.h"
+
+
+// round size up to a multiple of align (a power of 2)
+static inline size_t hash_round_up(size_t size, size_t align) {
+    return (size + align - 1) & ~(align - 1);
+}
+
+
+// the default allocator: the c library
+
+static void* hash_default_alloc(void* context, size_t size) {
+    (void)context;
+    return calloc(size > 0 ? size : 1, 1);
+}
+
+static void* hash_default_resize(void* context, void* ptr, size_t oldSize, size_t newSize) {
+    (void)context;
+    void* block = realloc(ptr, newSize > 0 ? newSize : 1);
+    if (block == NULL && newSize <= oldSize)
+        return ptr; // a smaller block can always stay where it is
+    return block;
+}
+
+static void hash_default_release(void* context, void* ptr, size_t size) {
+    (void)context;
+    (void)size;
+    free(ptr);
+}
+
+const HashAllocator hash_allocator_default = {hash_default_alloc, hash_default_resize, hash_default_release, NULL};
+
+
+// the bump arena: blocks are cut from big chunks one after the other
+
+// where the blocks of a chunk start
+#define HASH_ARENA_HEADER hash_round_up(sizeof(HashArenaChunk), HASH_ARENA_ALIGN)
+
+static inline char* hash_arena_data(HashArenaChunk* chunk) {
+    return (char*)chunk + HASH_ARENA_HEADER;
+}
+
+// is ptr (of size bytes) the last block cut from the current chunk
+static inline int hash_arena_is_last(HashArena* arena, void* ptr, size_t size) {
+    HashArenaChunk* chunk = arena->chunk;
+    return chunk != NULL &&
+           (char*)ptr + hash_round_up(size, HASH_ARENA_ALIGN) == hash_arena_data(chunk) + chunk->used;
+}
+
+static void* hash_arena_alloc(void* context, size_t size) {
+    HashArena* arena = (HashArena*)context;
+    size_t rounded = hash_round_up(size > 0 ? size : 1, HASH_ARENA_ALIGN);
+    HashArenaChunk* chunk = arena->chunk;
+    if (chunk == NULL || chunk->size - chunk->used < rounded) { // start a new chunk
+        size_t chunkSize = rounded > arena->chunkSize ? rounded : arena->chunkSize;
+        void* memory = NULL;
+        if (posix_memalign(&memory, HASH_ARENA_ALIGN, HASH_ARENA_HEADER + chunkSize) != 0)
+            return NULL;
+        chunk = (HashArenaChunk*)memory;
+        chunk->previous = arena->chunk;
+        chunk->size = chunkSize;
+        chunk->used = 0;
+        arena->chunk = chunk;
+    }
+    char* block = hash_arena_data(chunk) + chunk->used;
+    chunk->used += rounded;
+    memset(block, 0, size);
+    return block;
+}
+
+static void* hash_arena_resize(void* context, void* ptr, size_t oldSize, size_t newSize) {
+    HashArena* arena = (HashArena*)context;
+    size_t oldRounded = hash_round_up(oldSize > 0 ? oldSize : 1, HASH_ARENA_ALIGN);
+    size_t newRounded = hash_round_up(newSize > 0 ? newSize : 1, HASH_ARENA_ALIGN);
+    if (hash_arena_is_last(arena, ptr, oldRounded)) {
+        HashArenaChunk* chunk = arena->chunk;
+        if (chunk->used - oldRounded + newRounded <= chunk->size) { // grow or shrink in place
+            chunk->used = chunk->used - oldRounded + newRounded;
+            return ptr;
+        }
+    }
+    if (newRounded <= oldRounded)
+        return ptr; // the tail of the block is wasted until the arena is reset
+    void* block = hash_arena_alloc(context, newSize);
+    if (block == NULL) return NULL;
+    memcpy(block, ptr, oldSize);
+    return block; // the old block is only given back by a reset
+}
+
+static void hash_arena_release(void* context, void* ptr, size_t size) {
+    HashArena* arena = (HashArena*)context;
+    if (hash_arena_is_last(arena, ptr, size)) // only the last block can be handed out again straight away
+        arena->chunk->used -= hash_round_up(size > 0 ? size : 1, HASH_ARENA_ALIGN);
+}
+
+
+/**
+ * create an arena that cuts its blocks from chunks of chunkSize bytes (0: HASH_ARENA_CHUNK_SIZE), a block
+ * bigger than that gets a chunk of its own
+ * @return the arena, or NULL if out of memory
+ */
+HashArena* hash_arena_create(size_t chunkSize) {
+    HashArena* arena = (HashArena*) calloc(1, sizeof(HashArena));
+    if (arena == NULL) return NULL;
+    arena->allocator.alloc = hash_arena_alloc;
+    arena->allocator.resize = hash_arena_resize;
+    arena->allocator.release = hash_arena_release;
+    arena->allocator.context = arena;
+    arena->chunkSize = hash_round_up(chunkSize > 0 ? chunkSize : HASH_ARENA_CHUNK_SIZE, HASH_ARENA_ALIGN);
+    return arena;
+}
+
+
+/**
+ * give back everything allocated from the arena at once, the current chunk is kept for re-use if it is an
+ * ordinary one - the maps created in the arena must not be used (or freed) anymore
+ */
+void hash_arena_reset(HashArena* arena) {
+    if (arena == NULL || arena->chunk == NULL) return;
+    HashArenaChunk* keep = arena->chunk->size == arena->chunkSize ? arena->chunk : NULL;
+    HashArenaChunk* chunk = keep != NULL ? keep->previous : arena->chunk;
+    while (chunk != NULL) {
+        HashArenaChunk* previous = chunk->previous;
+        free(chunk);
+        chunk = previous;
+    }
+    if (keep != NULL) {
+        keep->previous = NULL;
+        keep->used = 0;
+    }
+    arena->chunk = keep;
+}
+
+
+/**
+ * de-allocate the arena and everything allocated from it
+ */
+void hash_arena_free(HashArena* arena) {
+    if (arena == NULL) return;
+    while (arena->chunk != NULL) {
+        HashArenaChunk* previous = arena->chunk->previous;
+        free(arena->chunk);
+        arena->chunk = previous;
+    }
+    free(arena);
+}
+
+
+// the huge page allocator: a mapping per block
+
+// the length of the mapping of a block of size bytes: whole huge pages from HASH_HUGE_PAGE_SIZE up, whole pages below
+static size_t hash_huge_length(size_t size) {
+    if (size >= HASH_HUGE_PAGE_SIZE)
+        return hash_round_up(size, HASH_HUGE_PAGE_SIZE);
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return hash_round_up(size > 0 ? size : 1, page);
+}
+
+static void* hash_huge_alloc(void* context, size_t size) {
+    (void)context;
+    size_t length = hash_huge_length(size);
+    if (size < HASH_HUGE_PAGE_SIZE) { // a small block, its own pages are all it needs
+        void* block = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return block != MAP_FAILED ? block : NULL;
+    }
+    // map a huge page more than needed and cut the unaligned ends off again
+    char* base = mmap(NULL, length + HASH_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+    if (base == MAP_FAILED) return NULL;
+    char* block = (char*)hash_round_up((uintptr_t)base, HASH_HUGE_PAGE_SIZE);
+    if (block > base)
+        munmap(base, (size_t)(block - base));
+    size_t tail = (size_t)(base + length + HASH_HUGE_PAGE_SIZE - (block + length));
+    if (tail > 0)
+        munmap(block + length, tail);
+#if defined(MADV_HUGEPAGE)
+    madvise(block, length, MADV_HUGEPAGE); // only a hint, the block works without it
+#endif
+    return block;
+}
+
+static void hash_huge_release(void* context, void* ptr, size_t size) {
+    (void)context;
+    munmap(ptr, hash_huge_length(size));
+}
+
+static void* hash_huge_resize(void* context, void* ptr, size_t oldSize, size_t newSize) {
+    size_t oldLength = hash_huge_length(oldSize);
+    size_t newLength = hash_huge_length(newSize);
+    if (newSize <= oldSize) { // unmap the pages past the new end, the block stays aligned
+        if (newLength < oldLength)
+            munmap((char*)ptr + newLength, oldLength - newLength);
+        return ptr;
+    }
+    if (newLength == oldLength)
+        return ptr; // still fits in its pages
+    void* block = hash_huge_alloc(context, newSize);
+    if (block == NULL) return NULL;
+    memcpy(block, ptr, oldSize);
+    hash_huge_release(context, ptr, oldSize);
+    return block;
+}
+
+const HashAllocator hash_allocator_huge = {hash_huge_alloc, hash_huge_resize, hash_huge_release, NULL};
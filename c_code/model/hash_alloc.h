@@ -0,0 +1,97 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#ifndef C_CODE_HASH_ALLOC_H
+#define C_CODE_HASH_ALLOC_H
+
+#include <stddef.h>
+
+/**
+ * where the structures get their memory from
+ *
+ * every map and set allocates its struct and arrays through the HashAllocator it was created with (see the
+ * *_create_with_allocator() fns.), the plain create fns. use hash_allocator_default (calloc / realloc / free).
+ * the fns. are told the size of every block they resize or release, so an allocator doesn't have to keep
+ * any bookkeeping of its own.
+ *
+ * two more allocators are built in:
+ *  - a bump arena (hash_arena_create()) for short lived maps: blocks are cut from big chunks one after the
+ *    other, so a map's struct and arrays sit side by side, and everything is given back at once with
+ *    hash_arena_reset() / hash_arena_free()
+ *  - hash_allocator_huge for big tables: every block is its own mmap() mapping, blocks of 2MB and up are
+ *    aligned to 2MB and marked MADV_HUGEPAGE so a lookup needs a fraction of the TLB entries
+ */
+
+// the huge page size hash_allocator_huge aligns its big blocks to
+#define HASH_HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+// arena blocks start on a cache line
+#define HASH_ARENA_ALIGN 64
+
+// the default size of the chunks an arena cuts its blocks from
+#define HASH_ARENA_CHUNK_SIZE ((size_t)1 << 20)
+
+typedef struct STRUCT_HashAllocator {
+    // allocate size bytes of zeroed memory, NULL if out of memory
+    void* (*alloc)(void* context, size_t size);
+    // resize the block ptr of oldSize bytes to newSize bytes keeping its contents (bytes past oldSize are not
+    // set), NULL if out of memory with the block left as it was - making a block smaller never fails
+    void* (*resize)(void* context, void* ptr, size_t oldSize, size_t newSize);
+    // give back the block ptr of size bytes
+    void (*release)(void* context, void* ptr, size_t size);
+    // handed to the fns. above
+    void* context;
+} HashAllocator;
+
+// a chunk of an arena, the blocks follow the header
+typedef struct STRUCT_HashArenaChunk {
+    struct STRUCT_HashArenaChunk* previous;
+    size_t size;
+    size_t used;
+} HashArenaChunk;
+
+typedef struct STRUCT_HashArena {
+    // pass &arena->allocator to a create fn.
+    HashAllocator allocator;
+    // the chunk blocks are cut from, the older chunks hang off it
+    HashArenaChunk* chunk;
+    // the size of a new chunk (a bigger block gets a chunk of its own)
+    size_t chunkSize;
+} HashArena;
+
+// calloc / realloc / free
+extern const HashAllocator hash_allocator_default;
+
+// mmap per block, 2MB aligned with MADV_HUGEPAGE from 2MB up - meant for big tables, a small block takes a page
+extern const HashAllocator hash_allocator_huge;
+
+// fn. to create an arena that cuts its blocks from chunks of chunkSize bytes (0: HASH_ARENA_CHUNK_SIZE)
+HashArena* hash_arena_create(size_t chunkSize);
+
+// fn. to give back everything allocated from the arena at once (maps created in it can't be used anymore)
+void hash_arena_reset(HashArena* arena);
+
+// fn. to de-allocate the arena and everything allocated from it
+void hash_arena_free(HashArena* arena);
+
+// fn. to allocate size bytes of zeroed memory from allocator (NULL: the default allocator)
+static inline void* hash_alloc(const HashAllocator* allocator, size_t size) {
+    if (allocator == NULL) allocator = &hash_allocator_default;
+    return allocator->alloc(allocator->context, size);
+}
+
+// fn. to resize a block of allocator (NULL: the default allocator), NULL if out of memory
+static inline void* hash_resize(const HashAllocator* allocator, void* ptr, size_t oldSize, size_t newSize) {
+    if (allocator == NULL) allocator = &hash_allocator_default;
+    return allocator->resize(allocator->context, ptr, oldSize, newSize);
+}
+
+// fn. to give back a block of allocator (NULL: the default allocator), ptr can be NULL
+static inline void hash_release(const HashAllocator* allocator, void* ptr, size_t size) {
+    if (ptr == NULL) return;
+    if (allocator == NULL) allocator = &hash_allocator_default;
+    allocator->release(allocator->context, ptr, size);
+}
+
+#endif //C_CODE_HASH_ALLOC_H
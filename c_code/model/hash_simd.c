@@ -0,0 +1,358 @@
+/*
+ * Copyright (c) 2024 by Rock de Vocht
+ *
+ * All rights reserved. No part of this publication may be reproduced, distributed, or
+ * transmitted in any form or by any means, including photocopying, recording, or other
+ * electronic or mechanical methods, without the prior written permission of the publisher,
+ * except in the case of brief quotations embodied in critical reviews and certain other
+ * noncommercial uses permitted by copyright law.
+ *
+ */
+
+/**
+ * the bulk lookup kernels of the chained tables (see hash_simd.h)
+ *
+ * all of them work INT_HASH_BATCH keys at a time in the stages of the *_get_many() fns.: hash every key and
+ * prefetch its bucket, read the buckets and prefetch the first entry of every chain, then compare.  the AVX2 and
+ * AVX-512 kernels do each stage for 8 or 16 keys at once with gathers, and are compiled for their instruction set
+ * with a target attribute, so the rest of the library doesn't need -mavx2 and runs on cpus without it.
+ */
+
+
+#include "hash_simd.h"
+#include "int_hash.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define HASH_SIMD_X86 1
+#include <immintrin.h>
+#define HASH_SIMD_AVX2_FN __attribute__((target("avx2")))
+#define HASH_SIMD_AVX512_FN __attribute__((target("avx512f")))
+#else
+#define HASH_SIMD_X86 0
+#endif
+
+// the end of a chain (INT_INT_HASHMAP_NO_ENTRY / STRING_HASHMAP_EMPTY_KEY)
+#define HASH_SIMD_NO_ENTRY (-1)
+
+// the level hash_simd_set_level() capped the kernels at, -1: no cap
+static int levelCap = -1;
+
+
+// the best kernel the cpu (and the os, which has to save the wider registers) supports
+static int hash_simd_detect(void) {
+#if HASH_SIMD_X86
+    if (__builtin_cpu_supports("avx512f"))
+        return HASH_SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return HASH_SIMD_AVX2;
+#endif
+    return HASH_SIMD_SCALAR;
+}
+
+
+/**
+ * the kernel level the lookups use
+ */
+int hash_simd_level(void) {
+    int level = hash_simd_detect();
+    return levelCap >= 0 && levelCap < level ? levelCap : level;
+}
+
+
+/**
+ * cap the kernel level at level, so the kernels can be compared (or a slow one avoided), -1 removes the cap
+ * @return the level used from now on
+ */
+int hash_simd_set_level(int level) {
+    levelCap = level < 0 ? -1 : level;
+    return hash_simd_level();
+}
+
+
+// the bucket of key
+static inline int hash_simd_bucket(const HashSimdChains* chains, int key) {
+    uint32_t hash = chains->hashKeys ? int_hash(key, chains->seed) : (uint32_t)key;
+    return (int)(hash & chains->mask);
+}
+
+
+// the first entry of bucket b's chain, HASH_SIMD_NO_ENTRY if it is empty (or of an older generation)
+static inline int hash_simd_head(const HashSimdChains* chains, int b) {
+    if (chains->generations != NULL && chains->generations[b] != chains->generation)
+        return HASH_SIMD_NO_ENTRY;
+    return chains->first[b];
+}
+
+
+// is entry i the one of key / key2?
+static inline int hash_simd_match(const HashSimdChains* chains, int i, int key, int key2) {
+    return chains->keys[i] == key && (chains->keys2 == NULL || chains->keys2[i] == key2);
+}
+
+
+/**
+ * walk the chain from entry index on, probes is the number of entries already compared
+ * @return the entry of key / key2, HASH_SIMD_NO_ENTRY if it isn't in the chain
+ */
+static inline int hash_simd_walk(const HashSimdChains* chains, int index, int key, int key2, int probes) {
+    probes += index != HASH_SIMD_NO_ENTRY;
+    while (index != HASH_SIMD_NO_ENTRY && !hash_simd_match(chains, index, key, key2)) {
+        index = chains->next[index];
+        probes += index != HASH_SIMD_NO_ENTRY;
+    }
+    hash_stats_probe(chains->counters, HASH_STATS_CONTAINS, probes);
+    return index;
+}
+
+
+// write the result of lookup i (entry index) out, returns 1 if it was found
+static inline int hash_simd_result(const HashSimdChains* chains, int i, int index, int* outValues, int* outFound) {
+    int found = index != HASH_SIMD_NO_ENTRY;
+    if (outValues != NULL)
+        outValues[i] = found && chains->values != NULL ? chains->values[index] : 0;
+    if (outFound != NULL)
+        outFound[i] = found;
+    return found;
+}
+
+
+/**
+ * the portable kernel: the stages one key at a time
+ */
+static int hash_simd_find_scalar(const HashSimdChains* chains, const int* keys, const int* keys2, int n,
+                                 int* outValues, int* outFound) {
+    int found = 0;
+    int buckets[INT_HASH_BATCH];
+    for (int start = 0; start < n; start += INT_HASH_BATCH) {
+        int count = n - start < INT_HASH_BATCH ? n - start : INT_HASH_BATCH;
+        for (int i = 0; i < count; i++) { // stage 1: hash, prefetch the buckets
+            buckets[i] = hash_simd_bucket(chains, keys[start + i]);
+            INT_HASH_PREFETCH(chains->first + buckets[i]);
+        }
+        for (int i = 0; i < count; i++) { // stage 2: read the buckets, prefetch the first entry of each chain
+            buckets[i] = hash_simd_head(chains, buckets[i]);
+            if (buckets[i] != HASH_SIMD_NO_ENTRY) {
+                INT_HASH_PREFETCH(chains->keys + buckets[i]);
+                if (chains->keys2 != NULL) INT_HASH_PREFETCH(chains->keys2 + buckets[i]);
+                if (chains->values != NULL) INT_HASH_PREFETCH(chains->values + buckets[i]);
+            }
+        }
+        for (int i = 0; i < count; i++) { // stage 3: walk the chains
+            int key2 = keys2 != NULL ? keys2[start + i] : 0;
+            int index = hash_simd_walk(chains, buckets[i], keys[start + i], key2, 0);
+            found += hash_simd_result(chains, start + i, index, outValues, outFound);
+        }
+    }
+    return found;
+}
+
+
+#if HASH_SIMD_X86
+
+// int_hash() of 8 keys
+HASH_SIMD_AVX2_FN
+static inline __m256i hash_simd_hash8(__m256i keys, uint32_t seed) {
+    __m256i h = _mm256_xor_si256(keys, _mm256_set1_epi32((int)seed));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+    h = _mm256_mullo_epi32(h, _mm256_set1_epi32((int)0x85EBCA6BU));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 13));
+    h = _mm256_mullo_epi32(h, _mm256_set1_epi32((int)0xC2B2AE35U));
+    return _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+}
+
+
+/**
+ * the AVX2 kernel: the stages 8 keys at a time, what is left over (less than a batch) goes to the scalar one
+ */
+HASH_SIMD_AVX2_FN
+static int hash_simd_find_avx2(const HashSimdChains* chains, const int* keys, const int* keys2, int n,
+                               int* outValues, int* outFound) {
+    int found = 0;
+    int heads[INT_HASH_BATCH];
+    __m256i mask = _mm256_set1_epi32((int)chains->mask);
+    __m256i noEntry = _mm256_set1_epi32(HASH_SIMD_NO_ENTRY);
+    __m256i zero = _mm256_setzero_si256();
+    int start = 0;
+    for (; start + INT_HASH_BATCH <= n; start += INT_HASH_BATCH) {
+        __m256i buckets[INT_HASH_BATCH / 8];
+        for (int v = 0; v < INT_HASH_BATCH / 8; v++) { // stage 1: hash, prefetch the buckets
+            __m256i k = _mm256_loadu_si256((const __m256i*)(keys + start + v * 8));
+            buckets[v] = _mm256_and_si256(chains->hashKeys ? hash_simd_hash8(k, chains->seed) : k, mask);
+            _mm256_storeu_si256((__m256i*)(heads + v * 8), buckets[v]);
+        }
+        for (int i = 0; i < INT_HASH_BATCH; i++)
+            INT_HASH_PREFETCH(chains->first + heads[i]);
+        for (int v = 0; v < INT_HASH_BATCH / 8; v++) { // stage 2: gather the buckets
+            __m256i head = _mm256_i32gather_epi32(chains->first, buckets[v], 4);
+            if (chains->generations != NULL) { // buckets of an older generation are empty
+                __m256i generation = _mm256_i32gather_epi32(chains->generations, buckets[v], 4);
+                __m256i current = _mm256_cmpeq_epi32(generation, _mm256_set1_epi32(chains->generation));
+                head = _mm256_blendv_epi8(noEntry, head, current);
+            }
+            _mm256_storeu_si256((__m256i*)(heads + v * 8), head);
+        }
+        for (int i = 0; i < INT_HASH_BATCH; i++) { // prefetch the first entry of each chain
+            if (heads[i] != HASH_SIMD_NO_ENTRY) {
+                INT_HASH_PREFETCH(chains->keys + heads[i]);
+                if (chains->keys2 != NULL) INT_HASH_PREFETCH(chains->keys2 + heads[i]);
+                if (chains->values != NULL) INT_HASH_PREFETCH(chains->values + heads[i]);
+            }
+        }
+        for (int v = 0; v < INT_HASH_BATCH / 8; v++) { // stage 3: gather the first entries and compare
+            int base = start + v * 8;
+            __m256i k = _mm256_loadu_si256((const __m256i*)(keys + base));
+            __m256i head = _mm256_loadu_si256((const __m256i*)(heads + v * 8));
+            __m256i occupied = _mm256_cmpgt_epi32(head, noEntry);
+            __m256i match = _mm256_and_si256(occupied,
+                _mm256_cmpeq_epi32(_mm256_mask_i32gather_epi32(zero, chains->keys, head, occupied, 4), k));
+            if (chains->keys2 != NULL) {
+                __m256i k2 = _mm256_loadu_si256((const __m256i*)(keys2 + base));
+                match = _mm256_and_si256(match,
+                    _mm256_cmpeq_epi32(_mm256_mask_i32gather_epi32(zero, chains->keys2, head, occupied, 4), k2));
+            }
+            if (outValues != NULL) {
+                __m256i values = chains->values != NULL ?
+                                 _mm256_mask_i32gather_epi32(zero, chains->values, head, match, 4) : zero;
+                _mm256_storeu_si256((__m256i*)(outValues + base), values);
+            }
+            int matched = _mm256_movemask_ps(_mm256_castsi256_ps(match));
+            int walk = _mm256_movemask_ps(_mm256_castsi256_ps(occupied)) & ~matched;
+            if (HASH_STATS_ENABLED) { // the first entry decided these
+                for (int i = 0; i < 8; i++)
+                    if (!(walk >> i & 1))
+                        hash_stats_probe(chains->counters, HASH_STATS_CONTAINS, matched >> i & 1);
+            }
+            while (walk != 0) { // the rest of the chain, one key at a time
+                int i = __builtin_ctz((unsigned)walk);
+                walk &= walk - 1;
+                int key2 = keys2 != NULL ? keys2[base + i] : 0;
+                int index = hash_simd_walk(chains, chains->next[heads[v * 8 + i]], keys[base + i], key2, 1);
+                if (index != HASH_SIMD_NO_ENTRY) {
+                    matched |= 1 << i;
+                    if (outValues != NULL && chains->values != NULL)
+                        outValues[base + i] = chains->values[index];
+                }
+            }
+            if (outFound != NULL) {
+                for (int i = 0; i < 8; i++)
+                    outFound[base + i] = matched >> i & 1;
+            }
+            found += __builtin_popcount((unsigned)matched);
+        }
+    }
+    // clean out the upper halves of the vector registers, or the sse code that runs after this slows down
+    _mm256_zeroupper();
+    return found + hash_simd_find_scalar(chains, keys + start, keys2 != NULL ? keys2 + start : NULL, n - start,
+                                         outValues != NULL ? outValues + start : NULL,
+                                         outFound != NULL ? outFound + start : NULL);
+}
+
+
+// int_hash() of 16 keys
+HASH_SIMD_AVX512_FN
+static inline __m512i hash_simd_hash16(__m512i keys, uint32_t seed) {
+    __m512i h = _mm512_xor_si512(keys, _mm512_set1_epi32((int)seed));
+    h = _mm512_xor_si512(h, _mm512_srli_epi32(h, 16));
+    h = _mm512_mullo_epi32(h, _mm512_set1_epi32((int)0x85EBCA6BU));
+    h = _mm512_xor_si512(h, _mm512_srli_epi32(h, 13));
+    h = _mm512_mullo_epi32(h, _mm512_set1_epi32((int)0xC2B2AE35U));
+    return _mm512_xor_si512(h, _mm512_srli_epi32(h, 16));
+}
+
+
+/**
+ * the AVX-512 kernel: a batch (16 keys) per stage at once, what is left over goes to the scalar one
+ */
+HASH_SIMD_AVX512_FN
+static int hash_simd_find_avx512(const HashSimdChains* chains, const int* keys, const int* keys2, int n,
+                                 int* outValues, int* outFound) {
+    int found = 0;
+    int heads[16];
+    __m512i mask = _mm512_set1_epi32((int)chains->mask);
+    __m512i zero = _mm512_setzero_si512();
+    int start = 0;
+    for (; start + 16 <= n; start += 16) {
+        // stage 1: hash, prefetch the buckets
+        __m512i k = _mm512_loadu_si512(keys + start);
+        __m512i buckets = _mm512_and_si512(chains->hashKeys ? hash_simd_hash16(k, chains->seed) : k, mask);
+        _mm512_storeu_si512(heads, buckets);
+        for (int i = 0; i < 16; i++)
+            INT_HASH_PREFETCH(chains->first + heads[i]);
+        // stage 2: gather the buckets (buckets of an older generation are empty), prefetch the first entries
+        __m512i head = _mm512_i32gather_epi32(buckets, chains->first, 4);
+        __mmask16 occupied = _mm512_cmpneq_epi32_mask(head, _mm512_set1_epi32(HASH_SIMD_NO_ENTRY));
+        if (chains->generations != NULL) {
+            __m512i generation = _mm512_i32gather_epi32(buckets, chains->generations, 4);
+            occupied &= _mm512_cmpeq_epi32_mask(generation, _mm512_set1_epi32(chains->generation));
+        }
+        _mm512_storeu_si512(heads, head);
+        for (int i = 0; i < 16; i++) {
+            if (occupied >> i & 1) {
+                INT_HASH_PREFETCH(chains->keys + heads[i]);
+                if (chains->keys2 != NULL) INT_HASH_PREFETCH(chains->keys2 + heads[i]);
+                if (chains->values != NULL) INT_HASH_PREFETCH(chains->values + heads[i]);
+            }
+        }
+        // stage 3: gather the first entries and compare
+        __m512i first = _mm512_mask_i32gather_epi32(zero, occupied, head, chains->keys, 4);
+        __mmask16 match = _mm512_mask_cmpeq_epi32_mask(occupied, k, first);
+        if (chains->keys2 != NULL) {
+            __m512i k2 = _mm512_loadu_si512(keys2 + start);
+            __m512i first2 = _mm512_mask_i32gather_epi32(zero, occupied, head, chains->keys2, 4);
+            match = _mm512_mask_cmpeq_epi32_mask(match, k2, first2);
+        }
+        if (outValues != NULL) {
+            __m512i values = chains->values != NULL ?
+                             _mm512_mask_i32gather_epi32(zero, match, head, chains->values, 4) : zero;
+            _mm512_storeu_si512(outValues + start, values);
+        }
+        int matched = match;
+        int walk = occupied & ~match;
+        if (HASH_STATS_ENABLED) { // the first entry decided these
+            for (int i = 0; i < 16; i++)
+                if (!(walk >> i & 1))
+                    hash_stats_probe(chains->counters, HASH_STATS_CONTAINS, matched >> i & 1);
+        }
+        while (walk != 0) { // the rest of the chain, one key at a time
+            int i = __builtin_ctz((unsigned)walk);
+            walk &= walk - 1;
+            int key2 = keys2 != NULL ? keys2[start + i] : 0;
+            int index = hash_simd_walk(chains, chains->next[heads[i]], keys[start + i], key2, 1);
+            if (index != HASH_SIMD_NO_ENTRY) {
+                matched |= 1 << i;
+                if (outValues != NULL && chains->values != NULL)
+                    outValues[start + i] = chains->values[index];
+            }
+        }
+        if (outFound != NULL) {
+            for (int i = 0; i < 16; i++)
+                outFound[start + i] = matched >> i & 1;
+        }
+        found += __builtin_popcount((unsigned)matched);
+    }
+    // clean out the upper halves of the vector registers, or the sse code that runs after this slows down
+    _mm256_zeroupper();
+    return found + hash_simd_find_scalar(chains, keys + start, keys2 != NULL ? keys2 + start : NULL, n - start,
+                                         outValues != NULL ? outValues + start : NULL,
+                                         outFound != NULL ? outFound + start : NULL);
+}
+
+#endif
+
+
+/**
+ * look up n keys with the best kernel there is (see hash_simd_level())
+ * @return the number of keys found
+ */
+int hash_simd_find_many(const HashSimdChains* chains, const int* keys, const int* keys2, int n,
+                        int* outValues, int* outFound) {
+    if (n <= 0) return 0;
+#if HASH_SIMD_X86
+    int level = hash_simd_level();
+    if (level == HASH_SIMD_AVX512)
+        return hash_simd_find_avx512(chains, keys, keys2, n, outValues, outFound);
+    if (level == HASH_SIMD_AVX2)
+        return hash_simd_find_avx2(chains, keys, keys2, n, outValues, outFound);
+#endif
+    return hash_simd_find_scalar(chains, keys, keys2, n, outValues, outFound);
+}
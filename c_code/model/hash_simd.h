@@ -0,0 +1,56 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#ifndef C_CODE_HASH_SIMD_H
+#define C_CODE_HASH_SIMD_H
+
+#include <stdint.h>
+#include "hash_stats.h"
+
+/**
+ * vectorized bulk lookup in first[] -> next[] chains (iihm_get_many() and str_hashset_contains_many())
+ *
+ * a batch of keys is hashed 8 (AVX2) or 16 (AVX-512) at a time, their first[] buckets and the first entry of
+ * every chain are gathered and compared in one go.  most keys are decided by the first entry of their chain, the
+ * few that aren't walk the rest of it one at a time.  the kernel is picked when called from what the cpu supports
+ * (cpuid), so one binary runs on any x86-64 - and other architectures use the staged scalar loop.
+ */
+
+// kernel levels
+#define HASH_SIMD_SCALAR 0
+#define HASH_SIMD_AVX2 1
+#define HASH_SIMD_AVX512 2
+
+// the chains to look keys up in
+typedef struct {
+    // first[] (mask + 1 buckets) and the generations of its buckets (NULL without fast clear)
+    const int* first;
+    const int* generations;
+    int generation;
+    uint32_t mask;
+    // 1: a key's bucket is its int_hash() with seed, 0: the keys are hashes already and are masked as they are
+    int hashKeys;
+    uint32_t seed;
+    // the entries: the key (or first hash) of every entry, its second hash (NULL if there is none), the next
+    // entry of its chain and its value (NULL for sets)
+    const int* keys;
+    const int* keys2;
+    const int* next;
+    const int* values;
+    // the counters the lookups are counted into as HASH_STATS_CONTAINS
+    HashCounters* counters;
+} HashSimdChains;
+
+// fn. to get the kernel level used: the best the cpu supports, or less if hash_simd_set_level() said so
+int hash_simd_level(void);
+
+// fn. to use at most level (HASH_SIMD_*, -1 for the best there is), returns the level used from now on
+int hash_simd_set_level(int level);
+
+// fn. to look up n keys (and their second hashes, if the chains have them): outValues (can be NULL) receives the
+// value of every key (0 if not found), outFound (can be NULL) 1 for every key found, returns the number found
+int hash_simd_find_many(const HashSimdChains* chains, const int* keys, const int* keys2, int n,
+                        int* outValues, int* outFound);
+
+#endif //C_CODE_HASH_SIMD_H
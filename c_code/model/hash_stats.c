@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2024 by Rock de Vocht
+ *
+ * All rights reserved. No part of this publication may be reproduced, distributed, or
+ * transmitted in any form or by any means, including photocopying, recording, or other
+ * electronic or mechanical methods, without the prior written permission of the publisher,
+ * except in the case of brief quotations embodied in critical reviews and certain other
+ * noncommercial uses permitted by copyright law.
+ *
+ */
+
+/**
+ * the shared part of the *_stats() fns. of the maps and sets (see hash_stats.h)
+ *
+ */
+
+
+#include <string.h>
+#include "hash_stats.h"
+
+
+/**
+ * start the stats of a table: clear out, fill in its size and memory and copy over the counters
+ */
+void hash_stats_begin(HashStats* out, const HashCounters* counters, int size, int slots, size_t memory) {
+    memset(out, 0, sizeof(HashStats));
+    out->enabled = HASH_STATS_ENABLED;
+    out->size = size;
+    out->slots = slots;
+    out->loadFactor = slots > 0 ? (double)size / slots : 0.0;
+    out->memory = memory;
+    for (int op = 0; op < HASH_STATS_OPS; op++) { // lookups can still be counting (see hash_stats_probe())
+        uint64_t calls = __atomic_load_n(&counters->calls[op], __ATOMIC_RELAXED);
+        uint64_t probes = __atomic_load_n(&counters->probes[op], __ATOMIC_RELAXED);
+        out->calls[op] = calls;
+        out->averageProbe[op] = calls > 0 ? (double)probes / calls : 0.0;
+        out->maxProbe[op] = __atomic_load_n(&counters->maxProbe[op], __ATOMIC_RELAXED);
+    }
+    out->grows = counters->grows;
+    out->growNanos = counters->growNanos;
+}
+
+
+/**
+ * count a chain of length entries (or a key found in the length-th group probed)
+ */
+void hash_stats_chain(HashStats* out, int length) {
+    out->chains[length < HASH_STATS_CHAINS ? length : HASH_STATS_CHAINS - 1] += 1;
+    if (length > out->longestChain)
+        out->longestChain = length;
+    out->averageChain += length; // the total, until hash_stats_end()
+}
+
+
+/**
+ * count the length of the chain of every first[] bucket
+ */
+void hash_stats_chains(HashStats* out, const int* first, const int* next, int stride, int buckets,
+                       const int* generations, int generation) {
+    for (int i = 0; i < buckets; i++) {
+        int length = 0;
+        if (generations == NULL || generations[i] == generation) {
+            for (int index = first[i]; index >= 0; index = next[(size_t)index * stride])
+                length += 1;
+        }
+        hash_stats_chain(out, length);
+    }
+}
+
+
+/**
+ * work out the average length of the chains that aren't empty
+ */
+void hash_stats_end(HashStats* out) {
+    long chains = 0;
+    for (int length = 1; length < HASH_STATS_CHAINS; length++)
+        chains += out->chains[length];
+    out->averageChain = chains > 0 ? out->averageChain / (double)chains : 0.0;
+}
@@ -0,0 +1,157 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#ifndef C_CODE_HASH_STATS_H
+#define C_CODE_HASH_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#if defined(HASH_STATS)
+#include <time.h>
+#endif
+
+/**
+ * statistics of the maps and sets (the iihm_stats(), iohm_stats() and str_hashset_stats() fns.)
+ *
+ * the shape of a table (its chains, load and memory) is worked out when asked for.  what happened on the hot
+ * paths - how many entries every add / contains / remove looked at, how often and how long the table grew - is
+ * only counted when the library is compiled with -DHASH_STATS.  without it the fns. below are empty, the probe
+ * counts that would be passed to them are dropped by the compiler and the counters stay 0, so it can be left
+ * compiled in.  the counters are in the structs either way, code compiled with and without it can be mixed.
+ *
+ * lookups count too, and lookups may run side by side on one map: the read lock of the concurrent string set,
+ * a contains() from a *_for_each_parallel() visitor.  so the probe counters are updated with relaxed atomics -
+ * the totals are exact, only the order the threads see each other's counts in isn't.  grows only happen on
+ * the thread that has the map to itself and are plain adds.
+ */
+
+// 1 if the hot path counters are compiled in
+#if defined(HASH_STATS)
+#define HASH_STATS_ENABLED 1
+#else
+#define HASH_STATS_ENABLED 0
+#endif
+
+// the operations counted
+#define HASH_STATS_ADD 0
+#define HASH_STATS_CONTAINS 1
+#define HASH_STATS_REMOVE 2
+#define HASH_STATS_OPS 3
+
+// the chain length histogram has a count for the lengths 0 .. HASH_STATS_CHAINS - 2, the last one counts all longer
+#define HASH_STATS_CHAINS 16
+
+// the hot path counters a map or set keeps (HASH_STATS builds only)
+typedef struct {
+    // the number of adds / contains / removes (a get or a lookup of a batch counts as a contains, and so does the
+    // look in the old table an add makes during an incremental resize)
+    uint64_t calls[HASH_STATS_OPS];
+    // the number of entries they compared their key with, all together and the most one of them did
+    uint64_t probes[HASH_STATS_OPS];
+    uint64_t maxProbe[HASH_STATS_OPS];
+    // the number of times the table grew, and the nanoseconds spent growing it
+    uint64_t grows;
+    uint64_t growNanos;
+} HashCounters;
+
+// the statistics of a map or set
+typedef struct {
+    // HASH_STATS_ENABLED of the library: 0 means the counters below were not kept
+    int enabled;
+    // the number of entries, the number of slots of the table and size / slots
+    int size;
+    int slots;
+    double loadFactor;
+    // the bytes of the struct and all its arrays
+    size_t memory;
+    // chained tables: chains[n] is the number of first[] buckets with a chain of n entries (n = 0: empty buckets),
+    // open addressing: chains[n] is the number of keys found in the n-th group probed (chains[0] stays 0)
+    int chains[HASH_STATS_CHAINS];
+    int longestChain;
+    // the average length of the chains that aren't empty
+    double averageChain;
+    // slots no entry uses but that aren't free either (the deleted markers of the grouped engine), the chained
+    // tables move their last entry into a removed one's slot so they never have any
+    int deadSlots;
+    // from the counters: the number of adds / contains / removes and the average and longest number of
+    // entries they compared their key with
+    uint64_t calls[HASH_STATS_OPS];
+    double averageProbe[HASH_STATS_OPS];
+    uint64_t maxProbe[HASH_STATS_OPS];
+    // from the counters: the number of times the table grew and the nanoseconds spent growing it
+    uint64_t grows;
+    uint64_t growNanos;
+} HashStats;
+
+// fn. to count an operation that compared its key with probes entries (safe from threads sharing the map)
+static inline void hash_stats_probe(HashCounters* counters, int op, int probes) {
+#if defined(HASH_STATS)
+    __atomic_fetch_add(&counters->calls[op], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counters->probes[op], (uint64_t)probes, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&counters->maxProbe[op], __ATOMIC_RELAXED);
+    while ((uint64_t)probes > max && !__atomic_compare_exchange_n(&counters->maxProbe[op], &max, (uint64_t)probes,
+                                                                  1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        // max was changed by another thread and re-read, try again while ours is still bigger
+    }
+#else
+    (void)counters;
+    (void)op;
+    (void)probes;
+#endif
+}
+
+// fn. to get the time a grow starts at (0 without HASH_STATS)
+static inline uint64_t hash_stats_clock(void) {
+#if defined(HASH_STATS)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+// fn. to count a grow that started at start (a hash_stats_clock() time)
+static inline void hash_stats_grow(HashCounters* counters, uint64_t start) {
+#if defined(HASH_STATS)
+    counters->grows += 1;
+    counters->growNanos += hash_stats_clock() - start;
+#else
+    (void)counters;
+    (void)start;
+#endif
+}
+
+// fn. to add the counters of from (the table of an incremental resize) to counters
+static inline void hash_stats_merge(HashCounters* counters, const HashCounters* from) {
+#if defined(HASH_STATS)
+    for (int op = 0; op < HASH_STATS_OPS; op++) {
+        counters->calls[op] += from->calls[op];
+        counters->probes[op] += from->probes[op];
+        if (from->maxProbe[op] > counters->maxProbe[op])
+            counters->maxProbe[op] = from->maxProbe[op];
+    }
+    counters->grows += from->grows;
+    counters->growNanos += from->growNanos;
+#else
+    (void)counters;
+    (void)from;
+#endif
+}
+
+// fn. to start the stats of a table of size entries in slots slots taking memory bytes, with its counters
+void hash_stats_begin(HashStats* out, const HashCounters* counters, int size, int slots, size_t memory);
+
+// fn. to count a chain (or probe sequence) of length entries into the histogram of out
+void hash_stats_chain(HashStats* out, int length);
+
+// fn. to count the chains of first[] -> next[] (next[i] of entry i is at next[i * stride]), generations (can be
+// NULL) marks the buckets not of generation as empty
+void hash_stats_chains(HashStats* out, const int* first, const int* next, int stride, int buckets,
+                       const int* generations, int generation);
+
+// fn. to work out the averages of out once all chains are counted
+void hash_stats_end(HashStats* out);
+
+#endif //C_CODE_HASH_STATS_H
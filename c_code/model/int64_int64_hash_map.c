@@ -0,0 +1,366 @@
+/*
+ * Copyright (c) 2024 by Rock de Vocht
+ *
+ * All rights reserved. No part of this publication may be reproduced, distributed, or
+ * transmitted in any form or by any means, including photocopying, recording, or other
+ * electronic or mechanical methods, without the prior written permission of the publisher,
+ * except in the case of brief quotations embodied in critical reviews and certain other
+ * noncommercial uses permitted by copyright law.
+ *
+ */
+
+/**
+ * an int64 -> int64 hash map with 64 bit sizes and indexes, laid out like the chained IntIntHashMap:
+ * first[] buckets pointing into next[] chains over entries packed in 0..size-1
+ *
+ * every size and index is a uint64_t and every allocation size is computed in size_t, so nothing wraps
+ * around at 2^31 (or 2^32) entries.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "int64_int64_hash_map.h"
+#include "int_hash.h"
+#include "bulk_build.h"
+
+
+// the bucket (first[] index) of key: its hash masked to the power of 2 table size
+static inline uint64_t i64hm_bucket(Int64Int64HashMap* data, int64_t key) {
+    return int64_hash((uint64_t)key, data->seed) & (data->allocatedSize - 1);
+}
+
+
+// allocate n entries of size bytes, NULL if that many bytes don't fit in a size_t
+static void* i64hm_allocate(void* array, uint64_t n, size_t size) {
+    if (n > SIZE_MAX / size) return NULL;
+    return realloc(array, (size_t)n * size);
+}
+
+
+// set up the arrays for allocatedSize slots, all buckets empty, returns 0 if out of memory
+static int i64hm_allocate_arrays(Int64Int64HashMap* data, uint64_t allocatedSize) {
+    data->first = i64hm_allocate(NULL, allocatedSize, sizeof(uint64_t));
+    data->keySet = i64hm_allocate(NULL, allocatedSize, sizeof(int64_t));
+    data->valueSet = i64hm_allocate(NULL, allocatedSize, sizeof(int64_t));
+    data->next = i64hm_allocate(NULL, allocatedSize, sizeof(uint64_t));
+    data->allocatedSize = allocatedSize;
+    if (data->first == NULL || data->keySet == NULL || data->valueSet == NULL || data->next == NULL)
+        return 0;
+    // mark every bucket as empty
+    for (uint64_t i = 0; i < allocatedSize; i++)
+        data->first[i] = INT64_INT64_HASHMAP_NO_ENTRY;
+    return 1;
+}
+
+
+// free the arrays of data
+static void i64hm_free_arrays(Int64Int64HashMap* data) {
+    free(data->first);
+    free(data->keySet);
+    free(data->valueSet);
+    free(data->next);
+    data->first = NULL;
+    data->keySet = NULL;
+    data->valueSet = NULL;
+    data->next = NULL;
+    data->size = 0;
+    data->allocatedSize = 0;
+}
+
+
+/**
+ * clear the hash map - remove all data and shrink to the initial size if need be
+ */
+void i64hm_clear(Int64Int64HashMap* data) {
+    if (data == NULL) return;
+    data->size = 0;
+    if (data->allocatedSize > data->initialSize) { // if we've grown beyond the initial size
+        i64hm_free_arrays(data);
+        if (!i64hm_allocate_arrays(data, data->initialSize))
+            i64hm_free_arrays(data); // out of memory, the next add allocates again
+        return;
+    }
+    for (uint64_t i = 0; i < data->allocatedSize; i++)
+        data->first[i] = INT64_INT64_HASHMAP_NO_ENTRY;
+}
+
+
+/**
+ * free all the data allocated by the Int64Int64HashMap
+ */
+void i64hm_free(Int64Int64HashMap* data) {
+    if (data == NULL) return;
+    i64hm_free_arrays(data);
+    free(data);
+}
+
+
+/**
+ * create a new hash map for (at least) initialSize items
+ */
+Int64Int64HashMap* i64hm_create(uint64_t initialSize) {
+    return i64hm_create_seeded(initialSize, 0);
+}
+
+
+/**
+ * create a new hash map for (at least) initialSize items whose keys are hashed with seed,
+ * use a random seed for keys that come from outside so they can't be picked to collide
+ */
+Int64Int64HashMap* i64hm_create_seeded(uint64_t initialSize, uint64_t seed) {
+    Int64Int64HashMap* data = (Int64Int64HashMap*) calloc(1, sizeof(Int64Int64HashMap));
+    if (data == NULL) return NULL; // failed?
+    // set the initial size, rounded up to a power of 2 so buckets can be found with a mask
+    data->initialSize = int64_hash_capacity(initialSize);
+    data->seed = seed;
+    if (!i64hm_allocate_arrays(data, data->initialSize)) {
+        i64hm_free(data); // out of memory
+        return NULL;
+    }
+    return data;
+}
+
+
+/**
+ * re-size the map to newSize slots without re-inserting anything (see iih_resize()): the entry arrays are
+ * re-allocated where they are and first[] / next[] are re-built in one pass over the packed entries
+ * @return 1 on success, 0 if out of memory (the map is unchanged)
+ */
+static int i64hm_resize(Int64Int64HashMap* data, uint64_t newSize) {
+    uint64_t* first = i64hm_allocate(NULL, newSize, sizeof(uint64_t));
+    if (first == NULL) return 0;
+    // a failed realloc() leaves the array as it was: still big enough to shrink, but the map can't grow
+    int64_t* keySet = i64hm_allocate(data->keySet, newSize, sizeof(int64_t));
+    if (keySet != NULL) data->keySet = keySet;
+    int64_t* valueSet = i64hm_allocate(data->valueSet, newSize, sizeof(int64_t));
+    if (valueSet != NULL) data->valueSet = valueSet;
+    uint64_t* next = i64hm_allocate(data->next, newSize, sizeof(uint64_t));
+    if (next != NULL) data->next = next;
+    if ((keySet == NULL || valueSet == NULL || next == NULL) && newSize > data->allocatedSize) {
+        free(first);
+        return 0;
+    }
+    free(data->first);
+    data->first = first;
+    data->allocatedSize = newSize;
+    for (uint64_t i = 0; i < newSize; i++)
+        first[i] = INT64_INT64_HASHMAP_NO_ENTRY;
+    // chain every entry in at the front of its new bucket
+    for (uint64_t i = 0; i < data->size; i++) {
+        uint64_t firstIndex = i64hm_bucket(data, data->keySet[i]);
+        data->next[i] = first[firstIndex];
+        first[firstIndex] = i;
+    }
+    return 1;
+}
+
+
+/**
+ * find the slot of key in the chains of data
+ * @return the index of the key's slot, or INT64_INT64_HASHMAP_NO_ENTRY if not found
+ */
+static uint64_t i64hm_find(Int64Int64HashMap* data, int64_t key) {
+    uint64_t nextIndex = data->first[i64hm_bucket(data, key)];
+    while (nextIndex != INT64_INT64_HASHMAP_NO_ENTRY) {
+        if (data->keySet[nextIndex] == key)
+            return nextIndex; // found it!
+        nextIndex = data->next[nextIndex];
+    }
+    return INT64_INT64_HASHMAP_NO_ENTRY; // not found
+}
+
+
+/**
+ * add a new key/value to our map, the value of a key already in the map is replaced
+ * @return 1 if a new item was added, 0 if the item already existed (or the map is out of memory)
+ */
+int i64hm_add(Int64Int64HashMap* data, int64_t key, int64_t value) {
+    if (data == NULL) return 0;
+    if (data->first == NULL && !i64hm_allocate_arrays(data, data->initialSize)) { // cleared while out of memory
+        i64hm_free_arrays(data);
+        return 0;
+    }
+    uint64_t index = i64hm_find(data, key);
+    if (index != INT64_INT64_HASHMAP_NO_ENTRY) {
+        data->valueSet[index] = value;
+        return 0;
+    }
+    // do we need to grow our arrays? (doubling, the size can't overflow below INT64_HASH_MAX_CAPACITY)
+    if (data->size + 1 >= data->allocatedSize) {
+        if (data->allocatedSize >= INT64_HASH_MAX_CAPACITY || !i64hm_resize(data, data->allocatedSize * 2)) {
+            if (data->size == data->allocatedSize)
+                return 0; // full and can't grow
+        }
+    }
+    // the new entry goes to the front of its chain
+    uint64_t firstIndex = i64hm_bucket(data, key);
+    data->keySet[data->size] = key;
+    data->valueSet[data->size] = value;
+    data->next[data->size] = data->first[firstIndex];
+    data->first[firstIndex] = data->size;
+    data->size += 1;
+    return 1;
+}
+
+
+/**
+ * is key inside the map (does it exist)
+ * @return 0 if not found, otherwise 1
+ */
+int i64hm_contains(Int64Int64HashMap* data, int64_t key) {
+    if (data == NULL || data->first == NULL) return 0;
+    return i64hm_find(data, key) != INT64_INT64_HASHMAP_NO_ENTRY;
+}
+
+
+/**
+ * get the value of key
+ * @return the value, or 0 if the key isn't in the map (use i64hm_contains() to tell the two apart)
+ */
+int64_t i64hm_get(Int64Int64HashMap* data, int64_t key) {
+    if (data == NULL || data->first == NULL) return 0;
+    uint64_t index = i64hm_find(data, key);
+    return index != INT64_INT64_HASHMAP_NO_ENTRY ? data->valueSet[index] : 0;
+}
+
+
+/**
+ * look up n keys at once, INT_HASH_BATCH at a time and in stages so their cache misses overlap
+ * (see iihm_get_many())
+ * @param outValues receives the value of every key (0 if not found)
+ * @param outFound receives 1 for every key found and 0 otherwise, can be NULL
+ * @return the number of keys found
+ */
+size_t i64hm_get_many(Int64Int64HashMap* data, const int64_t* keys, size_t n, int64_t* outValues, int* outFound) {
+    if (data == NULL || data->first == NULL || keys == NULL || outValues == NULL) return 0;
+    size_t found = 0;
+    uint64_t buckets[INT_HASH_BATCH];
+    for (size_t start = 0; start < n; start += INT_HASH_BATCH) {
+        size_t count = n - start < INT_HASH_BATCH ? n - start : INT_HASH_BATCH;
+        for (size_t i = 0; i < count; i++) { // stage 1: hash, prefetch the buckets
+            buckets[i] = i64hm_bucket(data, keys[start + i]);
+            INT_HASH_PREFETCH(data->first + buckets[i]);
+        }
+        for (size_t i = 0; i < count; i++) { // stage 2: read the buckets, prefetch the first entry of each chain
+            buckets[i] = data->first[buckets[i]];
+            if (buckets[i] != INT64_INT64_HASHMAP_NO_ENTRY) {
+                INT_HASH_PREFETCH(data->keySet + buckets[i]);
+                INT_HASH_PREFETCH(data->valueSet + buckets[i]);
+            }
+        }
+        for (size_t i = 0; i < count; i++) { // stage 3: walk the chains
+            int64_t key = keys[start + i];
+            uint64_t nextIndex = buckets[i];
+            while (nextIndex != INT64_INT64_HASHMAP_NO_ENTRY && data->keySet[nextIndex] != key)
+                nextIndex = data->next[nextIndex];
+            outValues[start + i] = nextIndex != INT64_INT64_HASHMAP_NO_ENTRY ? data->valueSet[nextIndex] : 0;
+            if (outFound != NULL) outFound[start + i] = nextIndex != INT64_INT64_HASHMAP_NO_ENTRY;
+            found += nextIndex != INT64_INT64_HASHMAP_NO_ENTRY;
+        }
+    }
+    return found;
+}
+
+
+/**
+ * remove a key from the map (delete), the last entry moves into its slot so the entries stay packed
+ * @return 1 if an item was removed, 0 otherwise
+ */
+int i64hm_remove(Int64Int64HashMap* data, int64_t key) {
+    if (data == NULL || data->first == NULL) return 0;
+    // unlink key from its chain
+    uint64_t firstIndex = i64hm_bucket(data, key);
+    uint64_t index = data->first[firstIndex];
+    uint64_t prevIndex = INT64_INT64_HASHMAP_NO_ENTRY;
+    while (index != INT64_INT64_HASHMAP_NO_ENTRY && data->keySet[index] != key) {
+        prevIndex = index;
+        index = data->next[index];
+    }
+    if (index == INT64_INT64_HASHMAP_NO_ENTRY)
+        return 0; // not found
+    if (prevIndex == INT64_INT64_HASHMAP_NO_ENTRY)
+        data->first[firstIndex] = data->next[index]; // unchain first item
+    else
+        data->next[prevIndex] = data->next[index]; // skip one in the chain
+
+    // move the last entry into the free slot, and point whatever linked to it at its new slot
+    uint64_t last = data->size - 1;
+    if (index != last) {
+        uint64_t lastFirst = i64hm_bucket(data, data->keySet[last]);
+        if (data->first[lastFirst] == last) {
+            data->first[lastFirst] = index;
+        } else {
+            uint64_t prev = data->first[lastFirst];
+            while (data->next[prev] != last) // find the item before it
+                prev = data->next[prev];
+            data->next[prev] = index;
+        }
+        data->keySet[index] = data->keySet[last];
+        data->valueSet[index] = data->valueSet[last];
+        data->next[index] = data->next[last];
+    }
+    data->size -= 1;
+
+    // give memory back if we're mostly empty (less than a quarter used)
+    if (data->size < data->allocatedSize / 4 && data->allocatedSize > data->initialSize) {
+        uint64_t shrinkSize = data->allocatedSize / 2;
+        i64hm_resize(data, shrinkSize < data->initialSize ? data->initialSize : shrinkSize);
+    }
+    return 1;
+}
+
+
+/**
+ * get the next key/value of the map: start with *cursor = 0 and call it until it returns 0, the entries are
+ * read in the order they sit in memory (not in any key order) - the map must not be changed in between
+ * @return 1 if *key / *value were set, 0 once every entry has been returned
+ */
+int i64hm_next(Int64Int64HashMap* data, uint64_t* cursor, int64_t* key, int64_t* value) {
+    if (data == NULL || *cursor >= data->size) return 0;
+    uint64_t i = (*cursor)++;
+    *key = data->keySet[i];
+    *value = data->valueSet[i];
+    return 1;
+}
+
+
+/**
+ * call fn(key, value, context, 0) for every key/value of the map, walking its entry arrays front to back
+ */
+void i64hm_for_each(Int64Int64HashMap* data, Int64Int64Visitor fn, void* context) {
+    if (data == NULL) return;
+    for (uint64_t i = 0; i < data->size; i++)
+        fn(data->keySet[i], data->valueSet[i], context, 0);
+}
+
+
+// the state shared by the threads of i64hm_for_each_parallel()
+typedef struct {
+    Int64Int64HashMap* data;
+    Int64Int64Visitor fn;
+    void* context;
+    int nthreads;
+} I64HMForEachWork;
+
+
+// visit thread t's chunk of the entries
+static void i64hm_for_each_chunk(void* arg, int t) {
+    I64HMForEachWork* work = (I64HMForEachWork*)arg;
+    Int64Int64HashMap* data = work->data;
+    uint64_t from = data->size / work->nthreads * t + data->size % work->nthreads * t / work->nthreads;
+    uint64_t to = data->size / work->nthreads * (t + 1) + data->size % work->nthreads * (t + 1) / work->nthreads;
+    for (uint64_t i = from; i < to; i++)
+        work->fn(data->keySet[i], data->valueSet[i], work->context, t);
+}
+
+
+/**
+ * call fn(key, value, context, thread) for every key/value of the map with nthreads threads, every thread
+ * walks its own contiguous chunk of the entries (see iihm_for_each_parallel())
+ */
+void i64hm_for_each_parallel(Int64Int64HashMap* data, int nthreads, Int64Int64Visitor fn, void* context) {
+    if (data == NULL) return;
+    I64HMForEachWork work = {data, fn, context, nthreads > 1 ? nthreads : 1};
+    bulk_run(work.nthreads, i64hm_for_each_chunk, &work);
+}
@@ -0,0 +1,80 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#ifndef C_CODE_INT64_INT64_HASH_MAP_H
+#define C_CODE_INT64_INT64_HASH_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// marks an empty bucket in first[] and the end of a chain in next[], every int64_t can be used as a key
+#define INT64_INT64_HASHMAP_NO_ENTRY UINT64_MAX
+
+/**
+ * the 64 bit version of the (chained) IntIntHashMap: int64_t keys and values, and 64 bit sizes and indexes
+ * so a table can hold as many entries as there is memory for.  a set of more than 2^31 strings can be kept
+ * as a map of their str_hashset_hash() values.
+ */
+struct STRUCT_Int64Int64HashMap {
+    // a list of first indexes
+    uint64_t* first;
+    // an array keys
+    int64_t* keySet;
+    // an array of values
+    int64_t* valueSet;
+    // an array of next offsets for collisions
+    uint64_t* next;
+    // how big the arrays are right now
+    uint64_t allocatedSize;
+    // how much data was allocated
+    uint64_t initialSize;
+    // how much data we have and where the offset is for the next entry
+    uint64_t size;
+    // mixed into the hash of every key (see int_hash.h)
+    uint64_t seed;
+};
+
+// define a nice name for the data structure
+typedef struct STRUCT_Int64Int64HashMap Int64Int64HashMap;
+
+// called for every key/value by the iterating fns., thread is the number of the calling thread (0 .. nthreads - 1)
+typedef void (*Int64Int64Visitor)(int64_t key, int64_t value, void* context, int thread);
+
+// fn. to create a new int64-int64 hash map
+Int64Int64HashMap* i64hm_create(uint64_t initialSize);
+
+// fn. to create a new int64-int64 hash map that hashes its keys with seed (use a random seed for untrusted keys)
+Int64Int64HashMap* i64hm_create_seeded(uint64_t initialSize, uint64_t seed);
+
+// fn. to clear the hash map (ungrow and remove all data)
+void i64hm_clear(Int64Int64HashMap* data);
+
+// fn. to de-allocate the hash map (data can't be used anymore after calling this!)
+void i64hm_free(Int64Int64HashMap* data);
+
+// fn. to add a key/value to the hash map and return 1 if the key wasn't in there already
+int i64hm_add(Int64Int64HashMap* data, int64_t key, int64_t value);
+
+// fn. to check if the map contain the key given key, returns 1 if it does
+int i64hm_contains(Int64Int64HashMap* data, int64_t key);
+
+// fn. to get the value for the associated key (0 if not found)
+int64_t i64hm_get(Int64Int64HashMap* data, int64_t key);
+
+// fn. to get the values of n keys at once (prefetch pipelined), outFound (can be NULL) is set to 1 for every key found
+size_t i64hm_get_many(Int64Int64HashMap* data, const int64_t* keys, size_t n, int64_t* outValues, int* outFound);
+
+// fn. to remove a key from the hash map, returns 1 if the value was removed
+int i64hm_remove(Int64Int64HashMap* data, int64_t key);
+
+// fn. to get the next key/value (start with *cursor = 0), returns 0 once every entry has been returned
+int i64hm_next(Int64Int64HashMap* data, uint64_t* cursor, int64_t* key, int64_t* value);
+
+// fn. to call fn for every key/value of the map in memory order
+void i64hm_for_each(Int64Int64HashMap* data, Int64Int64Visitor fn, void* context);
+
+// fn. to call fn for every key/value of the map with nthreads threads, each walking its own chunk of the entries
+void i64hm_for_each_parallel(Int64Int64HashMap* data, int nthreads, Int64Int64Visitor fn, void* context);
+
+#endif //C_CODE_INT64_INT64_HASH_MAP_H
@@ -0,0 +1,90 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#ifndef C_CODE_INT_HASH_H
+#define C_CODE_INT_HASH_H
+
+#include <stdint.h>
+
+/**
+ * hashing shared by the int keyed maps
+ *
+ * the tables have a power of 2 number of buckets, so a bucket is picked by masking the hash instead
+ * of dividing by the table size.  that only works if every bit of the hash depends on every bit of the
+ * key, which is what the murmur3 finalizer below does - sequential or strided keys don't cluster.
+ * the seed is mixed in first, a map created with a random seed can't be flooded with keys that were
+ * chosen to collide.
+ */
+
+// the biggest power of 2 table size an int can index
+#define INT_HASH_MAX_CAPACITY (1 << 30)
+
+// number of keys the *_get_many / *_contains_many fns. work on at a time, all their bucket loads are in flight together
+#define INT_HASH_BATCH 16
+
+// fn. to start loading the cache line of addr without waiting for it (does nothing if the compiler can't)
+#if defined(__GNUC__) || defined(__clang__)
+#define INT_HASH_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define INT_HASH_PREFETCH(addr) ((void)(addr))
+#endif
+
+// fn. to spread the bits of key (mixed with seed) over a 32 bit hash
+static inline uint32_t int_hash(int key, uint32_t seed) {
+    uint32_t h = (uint32_t)key ^ seed;
+    h ^= h >> 16;
+    h *= 0x85EBCA6BU;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35U;
+    h ^= h >> 16;
+    return h;
+}
+
+// fn. to round size up to a power of 2 table size (at least 16), StringHashSet sizes its tables the same way
+static inline int int_hash_capacity(int size) {
+    int capacity = 16;
+    while (capacity < size && capacity < INT_HASH_MAX_CAPACITY)
+        capacity *= 2;
+    return capacity;
+}
+
+// fast clear (the *_set_fast_clear() fns.): every bucket of first[] has the generation it was last written in,
+// a clear starts a new generation so all buckets of older ones count as empty.  after this many clears the
+// generations of the buckets are wiped and counting starts over
+#define INT_HASH_MAX_GENERATION INT32_MAX
+
+// fn. to start a new generation of a table of n buckets, the buckets of all older generations become empty
+static inline void int_hash_next_generation(int* generations, int n, int* generation) {
+    if (*generation < INT_HASH_MAX_GENERATION) {
+        *generation += 1;
+        return;
+    }
+    for (int i = 0; i < n; i++) // the counter wraps around: a full wipe, once every 2^31 clears
+        generations[i] = 0;
+    *generation = 1;
+}
+
+// the biggest power of 2 table size of the 64 bit keyed maps
+#define INT64_HASH_MAX_CAPACITY (1ULL << 62)
+
+// fn. to spread the bits of a 64 bit key (mixed with seed) over a 64 bit hash (murmur3 64 bit finalizer)
+static inline uint64_t int64_hash(uint64_t key, uint64_t seed) {
+    uint64_t h = key ^ seed;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// fn. to round size up to a power of 2 table size (at least 16) of a 64 bit keyed map
+static inline uint64_t int64_hash_capacity(uint64_t size) {
+    uint64_t capacity = 16;
+    while (capacity < size && capacity < INT64_HASH_MAX_CAPACITY)
+        capacity *= 2;
+    return capacity;
+}
+
+#endif //C_CODE_INT_HASH_H
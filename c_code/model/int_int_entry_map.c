@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2024 by Rock de Vocht
+ *
+ * All rights reserved. No part of this publication may be reproduced, distributed, or
+ * transmitted in any form or by any means, including photocopying, recording, or other
+ * electronic or mechanical methods, without the prior written permission of the publisher,
+ * except in the case of brief quotations embodied in critical reviews and certain other
+ * noncommercial uses permitted by copyright law.
+ *
+ */
+
+/**
+ * interleaved (array of structs) chained engine for the int -> int hash map
+ *
+ * the same first[] -> chain layout as the chained engine, but the key, next link and value of a slot are
+ * kept together in one 12 byte IntIntEntry instead of in three arrays.  a hit reads first[] and then
+ * (almost always) a single cache line for the whole entry, where the chained engine reads keySet[],
+ * valueSet[] and, on a collision, next[] - up to three more lines.
+ *
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "int_int_entry_map.h"
+#include "int_hash.h"
+#include "hash_alloc.h"
+
+
+// the bucket (first[] index) of key
+static inline int iiem_bucket(IntIntHashMap* data, int key) {
+    return (int)(int_hash(key, data->seed) & (uint32_t)(data->allocatedSize - 1));
+}
+
+
+// chain entries 0..size-1 into the (already allocated) first[] of the current table size
+static void iiem_rechain(IntIntHashMap* data) {
+    for (int i = 0; i < data->allocatedSize; i++)
+        data->first[i] = INT_INT_HASHMAP_NO_ENTRY;
+    for (int i = 0; i < data->size; i++) {
+        int firstIndex = iiem_bucket(data, data->entries[i].key);
+        data->entries[i].next = data->first[firstIndex];
+        data->first[firstIndex] = i;
+    }
+}
+
+
+/**
+ * resize the map to newSize buckets (and entries): the packed entries are kept (resized), only first[] is
+ * allocated again and the chains re-built
+ * @return 1 if successful, 0 if out of memory (the map is left as it was)
+ */
+static int iiem_resize(IntIntHashMap* data, int newSize) {
+    int* first = hash_alloc(data->allocator, (size_t)newSize * sizeof(int));
+    if (first == NULL) return 0;
+    IntIntEntry* entries = data->entries == NULL ?
+            hash_alloc(data->allocator, (size_t)newSize * sizeof(IntIntEntry)) :
+            hash_resize(data->allocator, data->entries, (size_t)data->allocatedSize * sizeof(IntIntEntry),
+                        (size_t)newSize * sizeof(IntIntEntry));
+    if (entries == NULL) { // out of memory (only a grow can fail)
+        hash_release(data->allocator, first, (size_t)newSize * sizeof(int));
+        return 0;
+    }
+    data->entries = entries;
+    hash_release(data->allocator, data->first, (size_t)data->allocatedSize * sizeof(int));
+    data->first = first;
+    data->allocatedSize = newSize;
+    iiem_rechain(data);
+    return 1;
+}
+
+
+/**
+ * set up a new map for at least initialSize items
+ */
+int iiem_init(IntIntHashMap* data, int initialSize, uint32_t seed) {
+    data->engine = INT_INT_HASHMAP_ENGINE_INTERLEAVED;
+    data->initialSize = int_hash_capacity(initialSize);
+    data->seed = seed;
+    data->size = 0;
+    data->first = NULL;
+    data->entries = NULL;
+    data->allocatedSize = 0;
+    return iiem_resize(data, data->initialSize);
+}
+
+
+/**
+ * clear the map - remove all data and shrink to the initial size if need be
+ */
+void iiem_clear(IntIntHashMap* data) {
+    data->size = 0;
+    if (data->allocatedSize > data->initialSize && iiem_resize(data, data->initialSize))
+        return; // the new first[] is all empty
+    for (int i = 0; i < data->allocatedSize; i++)
+        data->first[i] = INT_INT_HASHMAP_NO_ENTRY;
+}
+
+
+/**
+ * find the entry of key, counted as an op (HASH_STATS_*)
+ * @return its index, or INT_INT_HASHMAP_NO_ENTRY if the key isn't in the map
+ */
+static inline int iiem_find(IntIntHashMap* data, int key, int op) {
+    int nextIndex = data->first[iiem_bucket(data, key)];
+    int probes = nextIndex != INT_INT_HASHMAP_NO_ENTRY;
+    while (nextIndex != INT_INT_HASHMAP_NO_ENTRY && data->entries[nextIndex].key != key) {
+        nextIndex = data->entries[nextIndex].next;
+        probes += nextIndex != INT_INT_HASHMAP_NO_ENTRY;
+    }
+    hash_stats_probe(&data->counters, op, probes);
+    return nextIndex;
+}
+
+
+/**
+ * find the value slot of key with a single walk down its chain, a key that isn't in the map yet is added with value
+ * @param added set to 1 if the key was added, 0 if it was in the map already (its value is left alone)
+ * @return the slot of the key's value, or NULL if it couldn't be added (out of memory)
+ */
+int* iiem_upsert(IntIntHashMap* data, int key, int value, int* added) {
+    int index = iiem_find(data, key, HASH_STATS_ADD);
+    if (index != INT_INT_HASHMAP_NO_ENTRY) { // already exists, not added
+        *added = 0;
+        return &data->entries[index].value;
+    }
+    // grow at the same point as the chained engine, so both run at the same load
+    if (data->size + 1 >= data->allocatedSize) {
+        if (data->allocatedSize >= INT_HASH_MAX_CAPACITY)
+            return NULL; // full, and as big as a table gets
+        uint64_t start = hash_stats_clock();
+        int grown = iiem_resize(data, data->allocatedSize * 2);
+        hash_stats_grow(&data->counters, start);
+        if (!grown)
+            return NULL; // full and out of memory
+    }
+    int firstIndex = iiem_bucket(data, key);
+    IntIntEntry* entry = data->entries + data->size;
+    entry->key = key;
+    entry->value = value;
+    entry->next = data->first[firstIndex]; // new entries go to the front of their chain
+    data->first[firstIndex] = data->size;
+    data->size += 1;
+    *added = 1;
+    return &entry->value;
+}
+
+
+/**
+ * is key inside the map
+ * @return 0 if not found, otherwise 1
+ */
+int iiem_contains(IntIntHashMap* data, int key) {
+    return iiem_find(data, key, HASH_STATS_CONTAINS) != INT_INT_HASHMAP_NO_ENTRY;
+}
+
+
+/**
+ * get the value of key into *value
+ * @return 1 if the key was found, 0 otherwise (*value is left alone)
+ */
+int iiem_get(IntIntHashMap* data, int key, int* value) {
+    int index = iiem_find(data, key, HASH_STATS_CONTAINS);
+    if (index == INT_INT_HASHMAP_NO_ENTRY) return 0;
+    *value = data->entries[index].value;
+    return 1;
+}
+
+
+/**
+ * look up n keys at once, INT_HASH_BATCH at a time: hash every key and prefetch its bucket, then read the
+ * buckets and prefetch the entries they point at, then walk the chains
+ */
+int iiem_get_many(IntIntHashMap* data, const int* keys, int n, int* outValues, int* outFound) {
+    int found = 0;
+    int buckets[INT_HASH_BATCH];
+    for (int start = 0; start < n; start += INT_HASH_BATCH) {
+        int count = n - start < INT_HASH_BATCH ? n - start : INT_HASH_BATCH;
+        for (int i = 0; i < count; i++) { // stage 1: hash, prefetch the buckets
+            buckets[i] = iiem_bucket(data, keys[start + i]);
+            INT_HASH_PREFETCH(data->first + buckets[i]);
+        }
+        for (int i = 0; i < count; i++) { // stage 2: read the buckets, prefetch the first entry of each chain
+            buckets[i] = data->first[buckets[i]];
+            if (buckets[i] != INT_INT_HASHMAP_NO_ENTRY)
+                INT_HASH_PREFETCH(data->entries + buckets[i]);
+        }
+        for (int i = 0; i < count; i++) { // stage 3: walk the chains
+            int key = keys[start + i];
+            int nextIndex = buckets[i];
+            int probes = nextIndex != INT_INT_HASHMAP_NO_ENTRY;
+            while (nextIndex != INT_INT_HASHMAP_NO_ENTRY && data->entries[nextIndex].key != key) {
+                nextIndex = data->entries[nextIndex].next;
+                probes += nextIndex != INT_INT_HASHMAP_NO_ENTRY;
+            }
+            hash_stats_probe(&data->counters, HASH_STATS_CONTAINS, probes);
+            outValues[start + i] = nextIndex != INT_INT_HASHMAP_NO_ENTRY ? data->entries[nextIndex].value : 0;
+            if (outFound != NULL) outFound[start + i] = nextIndex != INT_INT_HASHMAP_NO_ENTRY;
+            found += nextIndex != INT_INT_HASHMAP_NO_ENTRY;
+        }
+    }
+    return found;
+}
+
+
+/**
+ * remove a key from the map, the last entry is moved into its slot so the entries stay packed in 0..size-1
+ * @return 1 if an item was removed, 0 otherwise
+ */
+int iiem_remove(IntIntHashMap* data, int key) {
+    int firstIndex = iiem_bucket(data, key);
+    int* link = data->first + firstIndex; // the link that points at the current entry
+    int probes = *link != INT_INT_HASHMAP_NO_ENTRY;
+    while (*link != INT_INT_HASHMAP_NO_ENTRY && data->entries[*link].key != key) {
+        link = &data->entries[*link].next;
+        probes += *link != INT_INT_HASHMAP_NO_ENTRY;
+    }
+    hash_stats_probe(&data->counters, HASH_STATS_REMOVE, probes);
+    if (*link == INT_INT_HASHMAP_NO_ENTRY)
+        return 0; // not found
+    int index = *link;
+    *link = data->entries[index].next; // unchain it
+    int last = data->size - 1;
+    if (index != last) {
+        // re-point the link to the last entry at its new slot, then move it
+        link = data->first + iiem_bucket(data, data->entries[last].key);
+        while (*link != last)
+            link = &data->entries[*link].next;
+        *link = index;
+        data->entries[index] = data->entries[last];
+    }
+    data->size -= 1;
+    // give memory back if we're mostly empty (less than a quarter used)
+    if (data->size < data->allocatedSize / 4 && data->allocatedSize > data->initialSize)
+        iiem_resize(data, data->allocatedSize / 2 > data->initialSize ? data->allocatedSize / 2 : data->initialSize);
+    return 1;
+}
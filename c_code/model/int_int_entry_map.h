@@ -0,0 +1,37 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#ifndef C_CODE_INT_INT_ENTRY_MAP_H
+#define C_CODE_INT_INT_ENTRY_MAP_H
+
+#include "int_int_hash_map.h"
+
+/**
+ * the interleaved (array of structs) chained engine behind the iihm_* API
+ * these are called by the iihm_* functions for maps created with iihm_create_interleaved(), don't call them directly
+ */
+
+// fn. to allocate the arrays of a map for (at least) initialSize items
+int iiem_init(IntIntHashMap* data, int initialSize, uint32_t seed);
+
+// fn. to clear the map (ungrow and remove all data)
+void iiem_clear(IntIntHashMap* data);
+
+// fn. to get the value slot of key, adding it with value if it isn't in the map yet (*added is set to 1 then),
+// returns NULL if it couldn't be added, see iihm_get_or_insert()
+int* iiem_upsert(IntIntHashMap* data, int key, int value, int* added);
+
+// fn. to check if the map contains key, returns 1 if it does
+int iiem_contains(IntIntHashMap* data, int key);
+
+// fn. to get the value of key into *value, returns 1 if the key was found
+int iiem_get(IntIntHashMap* data, int key, int* value);
+
+// fn. to look up n keys at once, see iihm_get_many()
+int iiem_get_many(IntIntHashMap* data, const int* keys, int n, int* outValues, int* outFound);
+
+// fn. to remove a key from the map, returns 1 if the value was removed
+int iiem_remove(IntIntHashMap* data, int key);
+
+#endif //C_CODE_INT_INT_ENTRY_MAP_H
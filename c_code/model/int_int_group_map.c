@@ -0,0 +1,365 @@
+/*
+ * Copyright (c) 2024 by Rock de Vocht
+ *
+ * All rights reserved. No part of this publication may be reproduced, distributed, or
+ * transmitted in any form or by any means, including photocopying, recording, or other
+ * electronic or mechanical methods, without the prior written permission of the publisher,
+ * except in the case of brief quotations embodied in critical reviews and certain other
+ * noncommercial uses permitted by copyright law.
+ *
+ */
+
+/**
+ * grouped open addressing engine for the int -> int hash map
+ *
+ * keys and values live directly in slots (keySet / valueSet), next to them is an array with one
+ * control byte per slot: empty, deleted or the low 7 bits of the key's hash.  the slots are split into
+ * groups of 16 and a lookup compares all 16 control bytes of a group at once (SSE2, or a scalar loop
+ * on other cpus).  a miss usually finishes inside the first group's 16 control bytes - one cache line -
+ * without ever touching the keys.
+ *
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "int_int_group_map.h"
+#include "int_hash.h"
+#include "hash_alloc.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// control byte values, a full slot has 0..127 (7 bits of the hash)
+#define CONTROL_EMPTY ((signed char)-128)
+#define CONTROL_DELETED ((signed char)-2)
+
+
+// the key's hash, its low 7 bits go into the control byte and the rest picks the group
+static inline uint32_t iigm_hash(IntIntHashMap* data, int key) {
+    return int_hash(key, data->seed);
+}
+
+
+#if defined(__SSE2__)
+
+// bit i is set if control byte i of the group equals value
+static inline unsigned iigm_match(const signed char* group, signed char value) {
+    __m128i control = _mm_loadu_si128((const __m128i*)group);
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8(value)));
+}
+
+// bit i is set if slot i of the group is empty or deleted (both have their high bit set)
+static inline unsigned iigm_match_free(const signed char* group) {
+    return (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+}
+
+#else
+
+// bit i is set if control byte i of the group equals value
+static inline unsigned iigm_match(const signed char* group, signed char value) {
+    unsigned mask = 0;
+    for (int i = 0; i < INT_INT_GROUP_SIZE; i++)
+        mask |= (unsigned)(group[i] == value) << i;
+    return mask;
+}
+
+// bit i is set if slot i of the group is empty or deleted (both have their high bit set)
+static inline unsigned iigm_match_free(const signed char* group) {
+    unsigned mask = 0;
+    for (int i = 0; i < INT_INT_GROUP_SIZE; i++)
+        mask |= (unsigned)(group[i] < 0) << i;
+    return mask;
+}
+
+#endif
+
+
+// the number of slots needed for initialSize items: a power of 2 number of groups, at most 7/8 full
+static int iigm_capacity_for(int initialSize) {
+    long needed = ((long)initialSize * 8) / 7 + 1;
+    long capacity = INT_INT_GROUP_SIZE;
+    while (capacity < needed && capacity < (1L << 30))
+        capacity *= 2;
+    return (int)capacity;
+}
+
+// how many slots (items + deleted markers) can be used before we rehash
+static inline int iigm_max_load(int capacity) {
+    return capacity - capacity / 8;
+}
+
+
+/**
+ * allocate the slot arrays of a map for a given capacity and mark all slots as empty
+ * @return 1 if successful
+ */
+static int iigm_allocate(IntIntHashMap* data, int capacity) {
+    data->control = hash_alloc(data->allocator, (size_t)capacity);
+    data->keySet = hash_alloc(data->allocator, (size_t)capacity * sizeof(int));
+    data->valueSet = hash_alloc(data->allocator, (size_t)capacity * sizeof(int));
+    if (data->control == NULL || data->keySet == NULL || data->valueSet == NULL) {
+        hash_release(data->allocator, data->control, (size_t)capacity);
+        hash_release(data->allocator, data->keySet, (size_t)capacity * sizeof(int));
+        hash_release(data->allocator, data->valueSet, (size_t)capacity * sizeof(int));
+        data->control = NULL;
+        data->keySet = NULL;
+        data->valueSet = NULL;
+        return 0;
+    }
+    memset(data->control, CONTROL_EMPTY, (size_t)capacity);
+    data->allocatedSize = capacity;
+    data->size = 0;
+    data->deleted = 0;
+    return 1;
+}
+
+
+/**
+ * set up a new map for at least initialSize items
+ */
+int iigm_init(IntIntHashMap* data, int initialSize) {
+    data->engine = INT_INT_HASHMAP_ENGINE_GROUPED;
+    data->initialSize = initialSize;
+    data->first = NULL; // not used by this engine
+    data->next = NULL;
+    return iigm_allocate(data, iigm_capacity_for(initialSize));
+}
+
+
+/**
+ * find the slot for key, counted as an op (HASH_STATS_*) that compared its key with the keys of every slot whose
+ * control byte matched
+ * @return the slot index, or -1 if the key isn't in the map
+ */
+static inline int iigm_find(IntIntHashMap* data, int key, uint32_t hash, int op) {
+    signed char h2 = (signed char)(hash & 0x7F);
+    uint32_t groupMask = (uint32_t)(data->allocatedSize / INT_INT_GROUP_SIZE) - 1;
+    uint32_t group = (hash >> 7) & groupMask;
+    int probes = 0;
+    for (uint32_t probe = 1; probe <= groupMask + 1; probe++) {
+        const signed char* control = data->control + (size_t)group * INT_INT_GROUP_SIZE;
+        unsigned matches = iigm_match(control, h2);
+        while (matches != 0) {
+            int slot = (int)(group * INT_INT_GROUP_SIZE) + __builtin_ctz(matches);
+            probes += 1;
+            if (data->keySet[slot] == key) {
+                hash_stats_probe(&data->counters, op, probes);
+                return slot; // found it!
+            }
+            matches &= matches - 1; // next candidate
+        }
+        // an empty slot in this group means the key was never placed further along
+        if (iigm_match(control, CONTROL_EMPTY) != 0)
+            break;
+        group = (group + probe) & groupMask; // triangular probing visits every group
+    }
+    hash_stats_probe(&data->counters, op, probes);
+    return -1;
+}
+
+
+/**
+ * find the slot a new (not yet present) key with the given hash goes into
+ * @return the slot index of the first empty or deleted slot on the key's probe sequence
+ */
+static inline int iigm_find_free(IntIntHashMap* data, uint32_t hash) {
+    uint32_t groupMask = (uint32_t)(data->allocatedSize / INT_INT_GROUP_SIZE) - 1;
+    uint32_t group = (hash >> 7) & groupMask;
+    for (uint32_t probe = 1; ; probe++) {
+        unsigned freeSlots = iigm_match_free(data->control + (size_t)group * INT_INT_GROUP_SIZE);
+        if (freeSlots != 0)
+            return (int)(group * INT_INT_GROUP_SIZE) + __builtin_ctz(freeSlots);
+        group = (group + probe) & groupMask;
+    }
+}
+
+
+/**
+ * re-insert all items into new arrays of newCapacity slots, this also cleans out all deleted markers
+ */
+static void iigm_rehash(IntIntHashMap* data, int newCapacity) {
+    int oldCapacity = data->allocatedSize;
+    signed char* oldControl = data->control;
+    int* oldKeySet = data->keySet;
+    int* oldValueSet = data->valueSet;
+    int oldSize = data->size;
+
+    if (!iigm_allocate(data, newCapacity)) {
+        // out of memory - keep the old arrays
+        data->control = oldControl;
+        data->keySet = oldKeySet;
+        data->valueSet = oldValueSet;
+        return;
+    }
+
+    // copy existing data into the new arrays, all keys are unique so just find the first free slot
+    for (int i = 0; i < oldCapacity; i++) {
+        if (oldControl[i] >= 0) {
+            uint32_t hash = iigm_hash(data, oldKeySet[i]);
+            int slot = iigm_find_free(data, hash);
+            data->control[slot] = (signed char)(hash & 0x7F);
+            data->keySet[slot] = oldKeySet[i];
+            data->valueSet[slot] = oldValueSet[i];
+        }
+    }
+    data->size = oldSize;
+
+    hash_release(data->allocator, oldControl, (size_t)oldCapacity);
+    hash_release(data->allocator, oldKeySet, (size_t)oldCapacity * sizeof(int));
+    hash_release(data->allocator, oldValueSet, (size_t)oldCapacity * sizeof(int));
+}
+
+
+/**
+ * clear the map - remove all data and shrink to the initial size if need be
+ */
+void iigm_clear(IntIntHashMap* data) {
+    int capacity = iigm_capacity_for(data->initialSize);
+    if (data->allocatedSize > capacity) { // if we've grown beyond the initial size
+        hash_release(data->allocator, data->control, (size_t)data->allocatedSize);
+        hash_release(data->allocator, data->keySet, (size_t)data->allocatedSize * sizeof(int));
+        hash_release(data->allocator, data->valueSet, (size_t)data->allocatedSize * sizeof(int));
+        iigm_allocate(data, capacity);
+    } else {
+        memset(data->control, CONTROL_EMPTY, (size_t)data->allocatedSize);
+        data->size = 0;
+        data->deleted = 0;
+    }
+}
+
+
+/**
+ * find the value slot of key with a single probe sequence, a key that isn't in the map yet is added with value
+ * @param added set to 1 if the key was added, 0 if it was in the map already (its value is left alone)
+ * @return the slot of the key's value, or NULL if it couldn't be added (out of memory)
+ */
+int* iigm_upsert(IntIntHashMap* data, int key, int value, int* added) {
+    uint32_t hash = iigm_hash(data, key);
+    int slot = iigm_find(data, key, hash, HASH_STATS_ADD);
+    if (slot >= 0) { // already exists, not added
+        *added = 0;
+        return &data->valueSet[slot];
+    }
+
+    // do we need to make room first?
+    if (data->size + data->deleted + 1 > iigm_max_load(data->allocatedSize)) {
+        // if less than half the slots hold items, cleaning out the deleted markers is enough
+        int capacity = data->allocatedSize;
+        if (data->size < capacity / 2 || (capacity >= INT_HASH_MAX_CAPACITY && data->deleted > 0)) {
+            iigm_rehash(data, capacity); // (a table as big as they get can only be cleaned out)
+        } else if (capacity < INT_HASH_MAX_CAPACITY) {
+            uint64_t start = hash_stats_clock();
+            iigm_rehash(data, capacity * 2);
+            hash_stats_grow(&data->counters, start);
+        }
+        if (data->size + data->deleted + 1 >= data->allocatedSize)
+            return NULL; // out of memory, and the last free slot has to stay free so probing for a miss ends
+    }
+
+    slot = iigm_find_free(data, hash);
+    if (data->control[slot] == CONTROL_DELETED)
+        data->deleted -= 1; // re-using a deleted slot
+    data->control[slot] = (signed char)(hash & 0x7F);
+    data->keySet[slot] = key;
+    data->valueSet[slot] = value;
+    data->size += 1;
+    *added = 1;
+    return &data->valueSet[slot];
+}
+
+
+/**
+ * is key inside the map (does it exist)
+ * @return 0 if not found, otherwise 1
+ */
+int iigm_contains(IntIntHashMap* data, int key) {
+    return iigm_find(data, key, iigm_hash(data, key), HASH_STATS_CONTAINS) >= 0;
+}
+
+
+/**
+ * get the value of key
+ * @return 1 if found (its value is in *value), otherwise 0
+ */
+int iigm_get(IntIntHashMap* data, int key, int* value) {
+    int slot = iigm_find(data, key, iigm_hash(data, key), HASH_STATS_CONTAINS);
+    if (slot < 0)
+        return 0; // not found
+    *value = data->valueSet[slot];
+    return 1;
+}
+
+
+/**
+ * look up n keys, INT_HASH_BATCH at a time: hash them all and prefetch the first group each one probes,
+ * then resolve them - by then most of those groups are in the cache
+ * @return the number of keys found
+ */
+int iigm_get_many(IntIntHashMap* data, const int* keys, int n, int* outValues, int* outFound) {
+    uint32_t hashes[INT_HASH_BATCH];
+    uint32_t groupMask = (uint32_t)(data->allocatedSize / INT_INT_GROUP_SIZE) - 1;
+    int found = 0;
+    for (int start = 0; start < n; start += INT_HASH_BATCH) {
+        int count = n - start < INT_HASH_BATCH ? n - start : INT_HASH_BATCH;
+        for (int i = 0; i < count; i++) { // stage 1: hash and prefetch the control bytes and keys of the first group
+            hashes[i] = iigm_hash(data, keys[start + i]);
+            size_t slot = (size_t)((hashes[i] >> 7) & groupMask) * INT_INT_GROUP_SIZE;
+            INT_HASH_PREFETCH(data->control + slot);
+            INT_HASH_PREFETCH(data->keySet + slot);
+        }
+        for (int i = 0; i < count; i++) { // stage 2: probe
+            int slot = iigm_find(data, keys[start + i], hashes[i], HASH_STATS_CONTAINS);
+            outValues[start + i] = slot >= 0 ? data->valueSet[slot] : 0;
+            found += slot >= 0;
+            if (outFound != NULL) outFound[start + i] = slot >= 0;
+        }
+    }
+    return found;
+}
+
+
+/**
+ * remove a key from the map (delete)
+ * @return 1 if an item was removed, 0 otherwise
+ */
+int iigm_remove(IntIntHashMap* data, int key) {
+    int slot = iigm_find(data, key, iigm_hash(data, key), HASH_STATS_REMOVE);
+    if (slot < 0)
+        return 0; // not found
+    // a group that still has an empty slot has never been full, so no probe sequence ever went past it
+    // and the slot can become empty again, otherwise leave a deleted marker so later keys are still found
+    const signed char* group = data->control + (slot & ~(INT_INT_GROUP_SIZE - 1));
+    if (iigm_match(group, CONTROL_EMPTY) != 0) {
+        data->control[slot] = CONTROL_EMPTY;
+    } else {
+        data->control[slot] = CONTROL_DELETED;
+        data->deleted += 1;
+    }
+    data->size -= 1;
+    // give memory back if the map has become mostly empty (less than an eighth used)
+    if (data->size < data->allocatedSize / 8 && data->allocatedSize > iigm_capacity_for(data->initialSize)) {
+        iigm_rehash(data, data->allocatedSize / 2);
+    }
+    return 1;
+}
+
+
+/**
+ * count every key into the histogram of out by the number of groups probed to find it (1: its own group)
+ */
+void iigm_stats_chains(IntIntHashMap* data, HashStats* out) {
+    uint32_t groupMask = (uint32_t)(data->allocatedSize / INT_INT_GROUP_SIZE) - 1;
+    for (int i = 0; i < data->allocatedSize; i++) {
+        if (data->control[i] < 0) continue; // free or deleted
+        uint32_t group = (iigm_hash(data, data->keySet[i]) >> 7) & groupMask;
+        uint32_t probe = 1;
+        while (group != (uint32_t)i / INT_INT_GROUP_SIZE) {
+            group = (group + probe) & groupMask;
+            probe += 1;
+        }
+        hash_stats_chain(out, (int)probe);
+    }
+}
@@ -0,0 +1,43 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#ifndef C_CODE_INT_INT_GROUP_MAP_H
+#define C_CODE_INT_INT_GROUP_MAP_H
+
+#include "int_int_hash_map.h"
+
+/**
+ * the grouped open addressing engine behind the iihm_* API
+ * these are called by the iihm_* functions for maps created with iihm_create_grouped(), don't call them directly
+ */
+
+// number of slots probed at once
+#define INT_INT_GROUP_SIZE 16
+
+// fn. to allocate the arrays of a map for (at least) initialSize items
+int iigm_init(IntIntHashMap* data, int initialSize);
+
+// fn. to clear the map (ungrow and remove all data)
+void iigm_clear(IntIntHashMap* data);
+
+// fn. to get the value slot of key, adding it with value if it isn't in the map yet (*added is set to 1 then),
+// returns NULL if it couldn't be added, see iihm_get_or_insert()
+int* iigm_upsert(IntIntHashMap* data, int key, int value, int* added);
+
+// fn. to check if the map contains key, returns 1 if it does
+int iigm_contains(IntIntHashMap* data, int key);
+
+// fn. to get the value of key into *value, returns 1 if the key was found
+int iigm_get(IntIntHashMap* data, int key, int* value);
+
+// fn. to look up n keys at once, see iihm_get_many()
+int iigm_get_many(IntIntHashMap* data, const int* keys, int n, int* outValues, int* outFound);
+
+// fn. to remove a key from the map, returns 1 if the value was removed
+int iigm_remove(IntIntHashMap* data, int key);
+
+// fn. to count the groups probed to find every key into the histogram of out, see iihm_stats()
+void iigm_stats_chains(IntIntHashMap* data, HashStats* out);
+
+#endif //C_CODE_INT_INT_GROUP_MAP_H
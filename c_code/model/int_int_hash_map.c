@@ -18,38 +18,109 @@
 #include <stdlib.h>
 #include <string.h>
 #include "int_int_hash_map.h"
+#include "int_hash.h"
+#include "int_int_group_map.h"
+#include "int_int_entry_map.h"
+#include "snapshot.h"
+#include "bulk_build.h"
+#include "hash_alloc.h"
+#include "hash_simd.h"
+
+
+// the bucket (first[] index) of key: its hash masked to the power of 2 table size
+static inline int iihm_bucket(IntIntHashMap* data, int key) {
+    return (int)(int_hash(key, data->seed) & (uint32_t)(data->allocatedSize - 1));
+}
+
+
+// the first entry of bucket b's chain, INT_INT_HASHMAP_NO_ENTRY if it is empty (with fast clear on: or if the
+// bucket was last written before the last clear)
+static inline int iihm_head(IntIntHashMap* data, int b) {
+    if (data->generations != NULL && data->generations[b] != data->generation)
+        return INT_INT_HASHMAP_NO_ENTRY;
+    return data->first[b];
+}
+
+
+// make index the first entry of bucket b's chain
+static inline void iihm_set_head(IntIntHashMap* data, int b, int index) {
+    data->first[b] = index;
+    if (data->generations != NULL)
+        data->generations[b] = data->generation;
+}
+
+
+// allocate the four arrays of a chained table of size slots (zeroed), returns 1 if successful
+static int iihm_allocate_arrays(IntIntHashMap* data, int size) {
+    size_t bytes = (size_t)size * sizeof(int);
+    data->first = hash_alloc(data->allocator, bytes);
+    data->keySet = hash_alloc(data->allocator, bytes);
+    data->valueSet = hash_alloc(data->allocator, bytes);
+    data->next = hash_alloc(data->allocator, bytes);
+    data->allocatedSize = size;
+    return data->first != NULL && data->keySet != NULL && data->valueSet != NULL && data->next != NULL;
+}
+
+
+// give back every array of the map (whichever engine it is), they all have allocatedSize slots
+static void iihm_release_arrays(IntIntHashMap* data) {
+    size_t slots = (size_t)data->allocatedSize;
+    hash_release(data->allocator, data->first, slots * sizeof(int));
+    hash_release(data->allocator, data->keySet, slots * sizeof(int));
+    hash_release(data->allocator, data->valueSet, slots * sizeof(int));
+    hash_release(data->allocator, data->next, slots * sizeof(int));
+    hash_release(data->allocator, data->control, slots);
+    hash_release(data->allocator, data->entries, slots * sizeof(IntIntEntry));
+    hash_release(data->allocator, data->generations, slots * sizeof(int));
+    data->generations = NULL;
+}
+
+
+// the number of threads to work on a whole table of n slots with
+static inline int iihm_threads(IntIntHashMap* data, int n) {
+    return data->parallelThreads > 1 && n >= data->parallelMinSize ? data->parallelThreads : 1;
+}
 
 
 /**
- * clear the hash map - remove all data and shrink to the initial size if need be
+ * clear the hash map - remove all data and shrink to the initial size if need be (with fast clear on: start a
+ * new generation instead, see iihm_set_fast_clear())
  */
 void iihm_clear(IntIntHashMap* data) {
-    if (data == NULL) // not set - just return
+    if (data == NULL || data->mapping != NULL) // not set or read-only - just return
+        return;
+    if (data->engine == INT_INT_HASHMAP_ENGINE_GROUPED) { // open addressing engine
+        iigm_clear(data);
         return;
+    }
+    if (data->engine == INT_INT_HASHMAP_ENGINE_INTERLEAVED) { // array of structs engine
+        iiem_clear(data);
+        return;
+    }
+    if (data->generations != NULL) { // fast clear: a new generation empties every bucket, the size stays
+        data->size = 0;
+        int_hash_next_generation(data->generations, data->allocatedSize, &data->generation);
+        return;
+    }
+    if (data->resizeTo != NULL) { // drop an incremental resize in progress
+        iihm_free(data->resizeTo);
+        data->resizeTo = NULL;
+    }
     data->size = 0; // empty data
-    // shrink the arrays?
+    // shrink the arrays? the smaller ones are allocated before the current ones are released, so running out of
+    // memory keeps the table at the size it is instead of leaving it without arrays
     if (data->allocatedSize > data->initialSize) { // if we've grown beyond the initial size
-        // first release the allocated data
-        if (data->first != NULL) free(data->first);
-        if (data->keySet != NULL) free(data->keySet);
-        if (data->valueSet != NULL) free(data->valueSet);
-        if (data->next != NULL) free(data->next);
-
-        // re-allocate the original sizes
-        data->first = calloc(data->initialSize, sizeof(int));
-        data->keySet = calloc(data->initialSize, sizeof(int));
-        data->valueSet = calloc(data->initialSize, sizeof(int));
-        data->next = calloc(data->initialSize, sizeof(int));
-        data->allocatedSize = data->initialSize;
+        IntIntHashMap smaller = *data;
+        if (iihm_allocate_arrays(&smaller, data->initialSize)) {
+            iihm_release_arrays(data);
+            *data = smaller;
+        } else
+            iihm_release_arrays(&smaller); // whichever of them were allocated
     }
 
-    // clear the arrays with "empty" keys so they appear as empty to our algorithm
-    for (int i = 0; i < data->initialSize; i++) {
-        data->first[i] = INT_INT_HASHMAP_EMPTY_KEY;
-        data->keySet[i] = INT_INT_HASHMAP_EMPTY_KEY;
-        data->valueSet[i] = INT_INT_HASHMAP_EMPTY_KEY;
-        data->next[i] = INT_INT_HASHMAP_EMPTY_KEY;
-    }
+    // mark every bucket as empty
+    bulk_fill(data->first, data->allocatedSize, INT_INT_HASHMAP_NO_ENTRY, iihm_threads(data, data->allocatedSize));
+    bulk_fill(data->next, data->allocatedSize, INT_INT_HASHMAP_NO_ENTRY, iihm_threads(data, data->allocatedSize));
 }
 
 
@@ -58,16 +129,30 @@ void iihm_clear(IntIntHashMap* data) {
  */
 void iihm_free_content_only(IntIntHashMap* data) {
     if (data == NULL) return; // no data, don't de-allocate
+    if (data->mapping != NULL) { // the arrays point into a snapshot, unmap it instead
+        snapshot_close(data->mapping, data->mappingSize);
+        data->mapping = NULL;
+        data->first = NULL;
+        data->keySet = NULL;
+        data->valueSet = NULL;
+        data->next = NULL;
+        data->size = 0;
+        data->allocatedSize = 0;
+        return;
+    }
+    if (data->resizeTo != NULL) { // the new table of an incremental resize
+        iihm_free(data->resizeTo);
+        data->resizeTo = NULL;
+    }
     // de-allocate the arrays first
-    if (data->first != NULL) free(data->first);
-    if (data->keySet != NULL) free(data->keySet);
-    if (data->valueSet != NULL) free(data->valueSet);
-    if (data->next != NULL) free(data->next);
+    iihm_release_arrays(data);
     // set all items in data to NULL and 0
     data->first = NULL;
     data->keySet = NULL;
     data->valueSet = NULL;
     data->next = NULL;
+    data->control = NULL;
+    data->entries = NULL;
     data->size = 0;
     data->allocatedSize = 0;
 }
@@ -77,69 +162,119 @@ void iihm_free_content_only(IntIntHashMap* data) {
  * free all the data allocated by the IntIntHashMap
  */
 void iihm_free(IntIntHashMap* data) {
+    if (data == NULL) return;
     // free content of map
     iihm_free_content_only(data);
     // then free the data itself
-    free(data);
+    hash_release(data->allocator, data, sizeof(IntIntHashMap));
 }
 
 
 /**
- * create a new hash map of a certain size
+ * create a new hash map for (at least) initialSize items
  */
 IntIntHashMap* iihm_create(int initialSize) {
+    return iihm_create_seeded(initialSize, 0);
+}
+
+
+/**
+ * create a new hash map for (at least) initialSize items whose keys are hashed with seed,
+ * use a random seed for keys that come from outside so they can't be picked to collide
+ */
+IntIntHashMap* iihm_create_seeded(int initialSize, uint32_t seed) {
+    return iihm_create_with_allocator(initialSize, seed, INT_INT_HASHMAP_ENGINE_CHAINED, NULL);
+}
+
+
+/**
+ * create a new hash map of a certain size that uses the grouped open addressing engine
+ * (see int_int_group_map.c) - it has the same iihm_* API as a map created by iihm_create()
+ */
+IntIntHashMap* iihm_create_grouped(int initialSize) {
+    return iihm_create_with_allocator(initialSize, 0, INT_INT_HASHMAP_ENGINE_GROUPED, NULL);
+}
+
+
+/**
+ * create a new hash map of a certain size that uses the interleaved chained engine (see int_int_entry_map.c)
+ * - it has the same iihm_* API as a map created by iihm_create()
+ */
+IntIntHashMap* iihm_create_interleaved(int initialSize) {
+    return iihm_create_with_allocator(initialSize, 0, INT_INT_HASHMAP_ENGINE_INTERLEAVED, NULL);
+}
+
+
+/**
+ * create a new hash map for (at least) initialSize items of one of the INT_INT_HASHMAP_ENGINE_* engines, whose
+ * struct and arrays all come from allocator (NULL: calloc / realloc / free, see hash_alloc.h) - the allocator
+ * must stay around until the map is freed
+ * @return the new map, or NULL if out of memory
+ */
+IntIntHashMap* iihm_create_with_allocator(int initialSize, uint32_t seed, int engine,
+                                          const HashAllocator* allocator) {
     // allocate the main structure
-    IntIntHashMap* data = (IntIntHashMap*) calloc(1, sizeof(IntIntHashMap));
+    IntIntHashMap* data = (IntIntHashMap*) hash_alloc(allocator, sizeof(IntIntHashMap));
     if (data == NULL) return NULL; // failed?
-    // set the initial size
-    data->initialSize = initialSize;
-    data->allocatedSize = initialSize;
-    // allocate the key arrays
-    data->first = calloc(data->initialSize, sizeof(int));
-    data->keySet = calloc(data->initialSize, sizeof(int));
-    data->valueSet = calloc(data->initialSize, sizeof(int));
-    data->next = calloc(data->initialSize, sizeof(int));
-    // set the map size to 0
-    data->size = 0;
-
-    // clear all values inside the arrays as empty
-    for (int i = 0; i < data->initialSize; i++) {
-        data->first[i] = INT_INT_HASHMAP_EMPTY_KEY;
-        data->keySet[i] = INT_INT_HASHMAP_EMPTY_KEY;
-        data->valueSet[i] = INT_INT_HASHMAP_EMPTY_KEY;
-        data->next[i] = INT_INT_HASHMAP_EMPTY_KEY;
+    data->allocator = allocator;
+    data->seed = seed;
+    int created;
+    if (engine == INT_INT_HASHMAP_ENGINE_GROUPED) {
+        created = iigm_init(data, initialSize); // allocate the slots
+    } else if (engine == INT_INT_HASHMAP_ENGINE_INTERLEAVED) {
+        created = iiem_init(data, initialSize, seed); // allocate first[] and the entries
+    } else {
+        // set the initial size, rounded up to a power of 2 so buckets can be found with a mask
+        data->initialSize = int_hash_capacity(initialSize);
+        created = iihm_allocate_arrays(data, data->initialSize);
+        // mark every bucket as empty
+        for (int i = 0; created && i < data->initialSize; i++) {
+            data->first[i] = INT_INT_HASHMAP_NO_ENTRY;
+            data->next[i] = INT_INT_HASHMAP_NO_ENTRY;
+        }
+    }
+    if (!created) { // out of memory
+        iihm_free(data);
+        return NULL;
     }
     // done - return the new data structure
     return data;
 }
 
-// help insert a key/value into our map, return the new size/count of the map
-int iihm_insertHelper(int key, int value, IntIntHashMap* data) {
+// help insert a key/value into our map (a key already in there keeps its value), *index receives the slot of the
+// key, return the new size/count of the map
+int iihm_insertHelper(int key, int value, IntIntHashMap* data, int* index) {
     if (data == NULL) return 0; // can't insert
-    int firstIndex = abs(key % data->allocatedSize); // calculate the "key" offset
+    int firstIndex = iihm_bucket(data, key); // calculate the "key" offset
     int newSize = data->size;
+    int probes = 0;
 
     // simplest case - we don't have an entry yet
-    if (data->first[firstIndex] == INT_INT_HASHMAP_EMPTY_KEY) {
-        data->first[firstIndex] = data->size; // first points to the next empty data-slot
+    if (iihm_head(data, firstIndex) == INT_INT_HASHMAP_NO_ENTRY) {
+        iihm_set_head(data, firstIndex, data->size); // first points to the next empty data-slot
         // and the data goes into the slots
         data->keySet[data->size] = key;
         data->valueSet[data->size] = value;
-        data->next[data->size] = INT_INT_HASHMAP_EMPTY_KEY;
+        data->next[data->size] = INT_INT_HASHMAP_NO_ENTRY;
+        *index = data->size;
         newSize += 1;
 
     } else {
         // chain down the colliding items and find the next empty
-        int nextIndex = data->first[firstIndex];
-        while (data->next[nextIndex] != INT_INT_HASHMAP_EMPTY_KEY) {
+        int nextIndex = iihm_head(data, firstIndex);
+        while (data->next[nextIndex] != INT_INT_HASHMAP_NO_ENTRY) {
+            probes += 1;
             if (data->keySet[nextIndex] == key) { // already exists, not added
-                data->valueSet[nextIndex] = value;
+                *index = nextIndex;
+                hash_stats_probe(&data->counters, HASH_STATS_ADD, probes);
                 return data->size;
             }
             nextIndex = data->next[nextIndex];
         }
+        probes += 1;
         if (data->keySet[nextIndex] == key) { // no new data added, already exists
-            data->valueSet[nextIndex] = value;
+            *index = nextIndex;
+            hash_stats_probe(&data->counters, HASH_STATS_ADD, probes);
             return data->size; // size hasn't changed
         }
         // now prevNext points to the last slot that wasn't empty - chain it in
@@ -147,66 +282,404 @@ int iihm_insertHelper(int key, int value, IntIntHashMap* data) {
         // and put in our data at the end
         data->keySet[data->size] = key;
         data->valueSet[data->size] = value;
-        data->next[data->size] = INT_INT_HASHMAP_EMPTY_KEY;
+        data->next[data->size] = INT_INT_HASHMAP_NO_ENTRY;
+        *index = data->size;
         newSize += 1;
     }
+    hash_stats_probe(&data->counters, HASH_STATS_ADD, probes);
     return newSize;
 }
 
-// grow the map by 50%
+/**
+ * re-size the map to newSize slots without re-inserting anything: the entries are already packed in
+ * 0..size-1, so their arrays are re-allocated where they are and first[] / next[] are re-built in one
+ * pass over them - at most one extra first[] array is needed on top of the map while this runs
+ */
+void iih_resize(IntIntHashMap* data, int newSize) {
+    if (data == NULL) return; // empty map, can't grow
+    const HashAllocator* allocator = data->allocator;
+    size_t oldBytes = (size_t)data->allocatedSize * sizeof(int);
+    size_t newBytes = (size_t)newSize * sizeof(int);
+    int* first = hash_alloc(allocator, newBytes);
+    if (first == NULL) return; // out of memory, keep the current size
+    int* generations = NULL; // fast clear: the re-built buckets all start in generation 0
+    if (data->generations != NULL && (generations = hash_alloc(allocator, newBytes)) == NULL) {
+        hash_release(allocator, first, newBytes);
+        return;
+    }
+    // a failed resize leaves the array as it was, and only a grow can fail
+    int* keySet = hash_resize(allocator, data->keySet, oldBytes, newBytes);
+    if (keySet != NULL) data->keySet = keySet;
+    int* valueSet = keySet == NULL ? NULL : hash_resize(allocator, data->valueSet, oldBytes, newBytes);
+    if (valueSet != NULL) data->valueSet = valueSet;
+    int* next = valueSet == NULL ? NULL : hash_resize(allocator, data->next, oldBytes, newBytes);
+    if (next == NULL) { // out of memory - the arrays that did grow go back to the current size
+        if (valueSet != NULL) data->valueSet = hash_resize(allocator, valueSet, newBytes, oldBytes);
+        if (keySet != NULL) data->keySet = hash_resize(allocator, keySet, newBytes, oldBytes);
+        hash_release(allocator, first, newBytes);
+        hash_release(allocator, generations, newBytes);
+        return;
+    }
+    data->next = next;
+    hash_release(allocator, data->first, oldBytes);
+    data->first = first;
+    if (generations != NULL) {
+        hash_release(allocator, data->generations, oldBytes);
+        data->generations = generations;
+        data->generation = 0;
+    }
+    data->allocatedSize = newSize;
+    // chain every entry in at the front of its new bucket
+    bulk_rehash(first, data->next, data->keySet, data->size, newSize, data->seed, 1, iihm_threads(data, newSize));
+}
+
+
+// number of new first[] buckets set up during an incremental resize for every chain we'd migrate
+#define IIHM_INIT_PER_CHAIN 16
+
+
+/**
+ * allocate the arrays of an empty table for an incremental resize, its first[] array is set to
+ * empty a bit at a time by iihm_resize_step() so no single call has to touch all of it
+ */
+IntIntHashMap* iihm_allocate_table(int newSize, uint32_t seed, const HashAllocator* allocator) {
+    IntIntHashMap* table = (IntIntHashMap*) hash_alloc(allocator, sizeof(IntIntHashMap));
+    if (table == NULL) return NULL; // failed?
+    table->allocator = allocator;
+    table->initialSize = newSize;
+    table->seed = seed;
+    if (!iihm_allocate_arrays(table, newSize)) {
+        iihm_free(table); // out of memory
+        return NULL;
+    }
+    return table;
+}
+
+
+// start an incremental resize to newSize slots - the map keeps working while it is migrated
+void iih_resize_start(IntIntHashMap* data, int newSize) {
+    IntIntHashMap* table = iihm_allocate_table(newSize, data->seed, data->allocator);
+    if (table == NULL) return; // out of memory, keep using the current table
+    data->resizeTo = table;
+    data->resizeInitialized = 0;
+    data->resizeMigrated = 0;
+}
+
+
+// is an incremental resize migrating chains (the new table is set up and in use)?
+static inline int iihm_migrating(IntIntHashMap* data) {
+    return data->resizeTo != NULL && data->resizeInitialized == data->resizeTo->allocatedSize;
+}
+
+
+// the new table replaces the old one at the end of an incremental resize
+void iihm_resize_finish(IntIntHashMap* data) {
+    IntIntHashMap* table = data->resizeTo;
+    int initialSize = data->initialSize;
+    data->resizeTo = NULL;
+    iihm_free_content_only(data); // de-allocate the now empty old table
+    data->first = table->first;
+    data->next = table->next;
+    data->keySet = table->keySet;
+    data->valueSet = table->valueSet;
+    data->size = table->size;
+    data->initialSize = initialSize; // keep the size clear() shrinks back to
+    data->allocatedSize = table->allocatedSize;
+    hash_stats_merge(&data->counters, &table->counters); // the adds into the new table
+    hash_release(data->allocator, table, sizeof(IntIntHashMap)); // de-allocate temporary helper data
+}
+
+
+/**
+ * do a bounded amount of incremental resize work: set up the next part of the new table's first[] array,
+ * or once that is done move the next "chains" chains of the old table into the new one
+ */
+void iihm_resize_step(IntIntHashMap* data, int chains) {
+    IntIntHashMap* table = data->resizeTo;
+    if (data->resizeInitialized < table->allocatedSize) {
+        long end = data->resizeInitialized + (long)chains * IIHM_INIT_PER_CHAIN;
+        if (end > table->allocatedSize) end = table->allocatedSize;
+        for (int i = data->resizeInitialized; i < end; i++)
+            table->first[i] = INT_INT_HASHMAP_NO_ENTRY;
+        data->resizeInitialized = (int)end;
+        return;
+    }
+    long end = data->resizeMigrated + (long)chains;
+    if (end > data->allocatedSize) end = data->allocatedSize;
+    for (int i = data->resizeMigrated; i < end; i++) {
+        // move every entry of the chain into the new table, its keys can't be in there yet
+        // so they go straight to the front of their new chains
+        int nextIndex = data->first[i];
+        while (nextIndex != INT_INT_HASHMAP_NO_ENTRY) {
+            int firstIndex = iihm_bucket(table, data->keySet[nextIndex]);
+            table->keySet[table->size] = data->keySet[nextIndex];
+            table->valueSet[table->size] = data->valueSet[nextIndex];
+            table->next[table->size] = table->first[firstIndex];
+            table->first[firstIndex] = table->size;
+            table->size += 1;
+            nextIndex = data->next[nextIndex];
+        }
+        data->first[i] = INT_INT_HASHMAP_NO_ENTRY; // the chain is gone from the old table
+    }
+    data->resizeMigrated = (int)end;
+    if (data->resizeMigrated == data->allocatedSize)
+        iihm_resize_finish(data);
+}
+
+
+/**
+ * make sure the new table of an incremental resize can take every entry of the map and one more before it is
+ * finished in one go: adds while a shrink migrates go into the smaller table and can outgrow it.  a new table
+ * that isn't in use yet is dropped (the old one still holds everything), one that is grows - re-chaining the
+ * entries it has and setting up all of its first[] - or stays as it is if there's no memory for that
+ */
+static void iihm_resize_fit(IntIntHashMap* data) {
+    IntIntHashMap* table = data->resizeTo;
+    if (data->size + 1 < table->allocatedSize)
+        return; // fits
+    if (!iihm_migrating(data)) {
+        iihm_free(table);
+        data->resizeTo = NULL;
+        return;
+    }
+    int newSize = table->allocatedSize;
+    while (data->size + 1 >= newSize && newSize < INT_HASH_MAX_CAPACITY)
+        newSize *= 2;
+    iih_resize(table, newSize);
+    data->resizeInitialized = table->allocatedSize;
+}
+
+
+// finish an incremental resize in one go (one that can't take every entry is left as it is)
+void iihm_resize_complete(IntIntHashMap* data) {
+    if (data->resizeTo == NULL)
+        return;
+    iihm_resize_fit(data);
+    if (data->resizeTo != NULL && data->size >= data->resizeTo->allocatedSize)
+        return; // out of memory: there's no room to move the rest into
+    while (data->resizeTo != NULL)
+        iihm_resize_step(data, data->allocatedSize);
+}
+
+
+// grow the map to twice its size
 void iih_grow(IntIntHashMap* data) {
     if (data == NULL) return; // empty map, can't grow
     int oldSize = data->allocatedSize;
-    int growSize = ((oldSize * 3) / 2) + 1; // 50% growth
-
-    IntIntHashMap* newData = iihm_create(growSize);
-    if (newData == NULL) return;
-
-    // copy existing data into the new array
-    for (int i = 0; i < data->allocatedSize; i++) {
-        int oldFirst = data->first[i];
-        int oldNextIndex = oldFirst;
-        while (oldNextIndex != INT_INT_HASHMAP_EMPTY_KEY) {
-            int keySetValue = data->keySet[oldNextIndex];
-            int valueSetValue = data->valueSet[oldNextIndex];
-            newData->size = iihm_insertHelper(keySetValue, valueSetValue, newData);
-            oldNextIndex = data->next[oldNextIndex];
-        }
+    if (oldSize >= INT_HASH_MAX_CAPACITY) return; // as big as a table gets
+    uint64_t start = hash_stats_clock();
+    if (data->resizeStep > 0)
+        iih_resize_start(data, oldSize * 2); // double, a bit at a time
+    else
+        iih_resize(data, oldSize * 2); // double
+    hash_stats_grow(&data->counters, start);
+}
 
-    } // for each existing entry
 
-    // transfer the newly mapped data
-    iihm_free_content_only(data); // de-allocate the now duplicate old data
-    // copy newData into data, as this is what is being replaced / grown
-    data->first = newData->first;
-    data->next = newData->next;
-    data->keySet = newData->keySet;
-    data->valueSet = newData->valueSet;
-    data->size = newData->size;
-    data->initialSize = newData->initialSize;
-    data->allocatedSize = newData->allocatedSize;
-    free(newData); // de-allocate temporary helper data
+// shrink the map to half its size if it has become mostly empty (less than a quarter used)
+void iih_shrink(IntIntHashMap* data) {
+    if (data->size >= data->allocatedSize / 4 || data->allocatedSize <= data->initialSize)
+        return; // still well used, or already at its smallest
+    int shrinkSize = data->allocatedSize / 2;
+    if (shrinkSize < data->initialSize)
+        shrinkSize = data->initialSize;
+    if (data->resizeStep > 0)
+        iih_resize_start(data, shrinkSize);
+    else
+        iih_resize(data, shrinkSize);
 }
 
 
 /**
- * add a new key/value to our map
- * @return true if a new item was added, false if the item already existed
+ * turn incremental resizing on (chainsPerStep > 0) or off (0)
+ * when on, a grow or shrink no longer re-maps the whole map inside one add/remove: the old and new tables
+ * coexist and every add/contains/remove migrates chainsPerStep chains until the old table is empty
  */
-int iihm_add(IntIntHashMap* data, int key, int value) {
-    // we can never insert an "empty key" value - or into a NULL data array
-    if (key == INT_INT_HASHMAP_EMPTY_KEY || data == NULL)
-        return 0;
+void iihm_set_incremental_resize(IntIntHashMap* data, int chainsPerStep) {
+    if (data == NULL || data->engine != INT_INT_HASHMAP_ENGINE_CHAINED || data->mapping != NULL ||
+        data->generations != NULL)
+        return; // chained engine only, never a read-only map and not together with fast clear
+    data->resizeStep = chainsPerStep > 0 ? chainsPerStep : 0;
+    if (data->resizeStep == 0 && data->resizeTo != NULL)
+        iihm_resize_complete(data); // turned off during a resize
+}
+
+
+// fast clear: reset the buckets of older generations to empty, first[] is then valid without generations[]
+static void iihm_flush_generations(IntIntHashMap* data) {
+    for (int i = 0; i < data->allocatedSize; i++)
+        if (data->generations[i] != data->generation)
+            data->first[i] = INT_INT_HASHMAP_NO_ENTRY;
+}
+
+
+/**
+ * turn fast clear on (on != 0) or off (0)
+ * when on, every first[] bucket carries the generation it was last written in and iihm_clear() only starts a new
+ * generation: the buckets of older ones count as empty, so a clear costs the same for any table size and keeps
+ * the table at its current size.  incremental resizing is turned off (a resize in progress is finished first)
+ */
+void iihm_set_fast_clear(IntIntHashMap* data, int on) {
+    if (data == NULL || data->engine != INT_INT_HASHMAP_ENGINE_CHAINED || data->mapping != NULL)
+        return; // chained engine only, and never a read-only map
+    size_t bytes = (size_t)data->allocatedSize * sizeof(int);
+    if (!on) {
+        if (data->generations == NULL) return;
+        iihm_flush_generations(data);
+        hash_release(data->allocator, data->generations, bytes);
+        data->generations = NULL;
+        return;
+    }
+    if (data->generations != NULL) return;
+    if (data->resizeTo != NULL)
+        iihm_resize_complete(data);
+    data->resizeStep = 0;
+    data->generations = hash_alloc(data->allocator, bytes); // zeroed: every bucket is in the current generation
+    data->generation = 0;
+}
+
+
+/**
+ * spread the work of re-chaining a table on resize and of clearing it over nthreads threads, for tables of at
+ * least minSize slots (<= 0: BULK_PARALLEL_MIN_SIZE) - smaller tables are cheaper to do on the calling thread
+ */
+void iihm_set_parallel_resize(IntIntHashMap* data, int nthreads, int minSize) {
+    if (data == NULL) return;
+    data->parallelThreads = nthreads > 1 ? nthreads : 0;
+    data->parallelMinSize = minSize > 0 ? minSize : BULK_PARALLEL_MIN_SIZE;
+}
+
+
+/**
+ * find the slot of key in the chains of data
+ * @return the index of the key's slot, or INT_INT_HASHMAP_NO_ENTRY if not found
+ */
+int iihm_find(IntIntHashMap* data, int key) {
+    int firstIndex = iihm_bucket(data, key); // starting location
+    int nextIndex = iihm_head(data, firstIndex);
+    int probes = 0;
+    while (nextIndex != INT_INT_HASHMAP_NO_ENTRY) {
+        probes += 1;
+        if (data->keySet[nextIndex] == key)
+            break; // found it!
+        nextIndex = data->next[nextIndex];
+    }
+    hash_stats_probe(&data->counters, HASH_STATS_CONTAINS, probes);
+    return nextIndex; // INT_INT_HASHMAP_NO_ENTRY if not found
+}
+
+
+/**
+ * the chained engine's iihm_upsert(): find the slot of key in one walk down its chain, a key that isn't there
+ * yet is added at the end of it with value
+ */
+static int* iihm_chained_upsert(IntIntHashMap* data, int key, int value, int* added) {
+    int index;
+    if (data->resizeTo != NULL) { // incremental resize in progress
+        iihm_resize_step(data, data->resizeStep);
+        if (iihm_migrating(data)) {
+            // keys live in either table: use its slot in the old one, otherwise it goes into the new one
+            index = iihm_find(data, key);
+            if (index != INT_INT_HASHMAP_NO_ENTRY) {
+                *added = 0;
+                return &data->valueSet[index];
+            }
+            IntIntHashMap* table = data->resizeTo;
+            if (data->size + 1 < table->allocatedSize) { // room for the entries of both tables
+                int oldSize = table->size;
+                table->size = iihm_insertHelper(key, value, table, &index);
+                data->size += table->size - oldSize;
+                *added = table->size > oldSize;
+                return &table->valueSet[index];
+            }
+            iihm_resize_complete(data); // the new table filled up (or a shrink outgrew it) early, finish it now
+            if (data->resizeTo != NULL)
+                return NULL; // it can't hold all of the entries and there's no memory to grow it
+        } else if (data->size + 1 >= data->allocatedSize) {
+            iihm_resize_complete(data); // the old table filled up while the new one was being set up
+        }
+    }
 
     // do we need to grow our arrays and remap all existing data?
-    if (data->size + 1 >= data->allocatedSize) {
+    // with incremental resizing we start early, so the old table still has room while the new one is set up
+    int growAt = data->resizeStep > 0 ? data->allocatedSize - data->allocatedSize / 8 : data->allocatedSize;
+    if (data->size + 1 >= growAt && data->resizeTo == NULL) {
         iih_grow(data);
+        if (data->size + 1 >= data->allocatedSize) { // still no room left in this table
+            if (data->resizeTo != NULL)
+                iihm_resize_complete(data); // too small to resize a bit at a time
+            else if (data->allocatedSize < INT_HASH_MAX_CAPACITY)
+                iih_resize(data, data->allocatedSize * 2); // couldn't start an incremental resize
+        }
+        // the resize above can have failed as well
+        if (data->size + 1 >= data->allocatedSize) { // full and can't grow (out of memory, or at INT_HASH_MAX_CAPACITY)
+            index = iihm_find(data, key); // only a key that is in there already has a slot
+            return index != INT_INT_HASHMAP_NO_ENTRY ? &data->valueSet[index] : NULL;
+        }
     }
 
     // get an index into the first array
     int oldSize = data->size;
-    data->size = iihm_insertHelper(key, value, data);
-    return data->size > oldSize;
+    data->size = iihm_insertHelper(key, value, data, &index);
+    *added = data->size > oldSize;
+    return &data->valueSet[index];
+}
+
+
+/**
+ * find the value slot of key with a single lookup, a key that isn't in the map yet is added with value first
+ * @param added set to 1 if the key was added, 0 if it was in the map already
+ * @return the slot of the key's value, or NULL if it couldn't be added (out of memory, or a read-only map)
+ */
+static int* iihm_upsert(IntIntHashMap* data, int key, int value, int* added) {
+    *added = 0;
+    // we can never insert into a NULL data array, or a read-only one
+    if (data == NULL || data->mapping != NULL)
+        return NULL;
+    if (data->engine == INT_INT_HASHMAP_ENGINE_GROUPED) // open addressing engine
+        return iigm_upsert(data, key, value, added);
+    if (data->engine == INT_INT_HASHMAP_ENGINE_INTERLEAVED) // array of structs engine
+        return iiem_upsert(data, key, value, added);
+    return iihm_chained_upsert(data, key, value, added);
+}
+
+
+/**
+ * add a new key/value to our map
+ * @return true if a new item was added, false if the item already existed (or the map is full and out of memory)
+ */
+int iihm_add(IntIntHashMap* data, int key, int value) {
+    int added;
+    int* slot = iihm_upsert(data, key, value, &added);
+    if (slot != NULL && !added)
+        *slot = value; // already exists, update its value
+    return added;
+}
+
+
+/**
+ * get the value of key, adding it with defaultValue if it isn't in the map yet - with a single lookup
+ * @return the slot of the key's value, it can be read and written until the next add / remove / clear of the map
+ *         (those can move the values), or NULL if the key couldn't be added (out of memory, or a read-only map)
+ */
+int* iihm_get_or_insert(IntIntHashMap* data, int key, int defaultValue) {
+    int added;
+    return iihm_upsert(data, key, defaultValue, &added);
+}
+
+
+/**
+ * add delta to the value of key, a key that isn't in the map yet starts at 0 - with a single lookup
+ * @return the new value of key (it wraps around like an unsigned int), 0 if the key couldn't be added
+ */
+int iihm_add_to(IntIntHashMap* data, int key, int delta) {
+    int added;
+    int* slot = iihm_upsert(data, key, delta, &added);
+    if (slot == NULL)
+        return 0;
+    if (!added)
+        *slot = (int)((unsigned)*slot + (unsigned)delta);
+    return *slot;
 }
 
 
@@ -215,55 +688,508 @@ int iihm_add(IntIntHashMap* data, int key, int value) {
  * @return 0 if not found, otherwise 1
  */
 int iihm_contains(IntIntHashMap* data, int key) {
-    // we can never check for an "empty key" value - or find data inside a NULL data array
-    if (key == INT_INT_HASHMAP_EMPTY_KEY || data == NULL)
-        return 0;
-    int firstIndex = abs(key % data->allocatedSize); // starting location
-    int nextIndex = data->first[firstIndex];
-    if (nextIndex == INT_INT_HASHMAP_EMPTY_KEY) // not found?
+    // we can never find data inside a NULL data array
+    if (data == NULL)
         return 0;
-    while (data->next[nextIndex] != INT_INT_HASHMAP_EMPTY_KEY) {
-        if (data->keySet[nextIndex] == key)
-            return 1; // found it!
-        nextIndex = data->next[nextIndex];
+    if (data->engine == INT_INT_HASHMAP_ENGINE_GROUPED) // open addressing engine
+        return iigm_contains(data, key);
+    if (data->engine == INT_INT_HASHMAP_ENGINE_INTERLEAVED) // array of structs engine
+        return iiem_contains(data, key);
+    if (data->resizeTo != NULL) { // incremental resize in progress
+        iihm_resize_step(data, data->resizeStep);
+        if (iihm_migrating(data) && iihm_find(data->resizeTo, key) != INT_INT_HASHMAP_NO_ENTRY)
+            return 1; // found it in the new table
     }
-    return (data->keySet[nextIndex] == key); // found it if we are at the right key
+    return iihm_find(data, key) != INT_INT_HASHMAP_NO_ENTRY;
 }
 
 
 /**
- * remove a key from the map (delete)
- * @return 1 if an item was removed, 0 otherwise
+ * move the last entry into the free slot "to" so the entries stay densely packed in 0..size-1,
+ * the link (first[] or next[]) that pointed at the last entry is updated to point at its new slot
  */
-int iihm_remove(IntIntHashMap* data, int key) {
-    // can't remove something from a NULL data structure, or an empty key
-    if (data == NULL || key == INT_INT_HASHMAP_EMPTY_KEY) return 0;
-    int firstIndex = abs(key % data->allocatedSize); // start location
-    int nextIndex = data->first[firstIndex]; // data at location
-    if (nextIndex == INT_INT_HASHMAP_EMPTY_KEY) // no data
-        return 0; // nothing to remove
-    int prevIndex = nextIndex;
-    while (data->next[nextIndex] != INT_INT_HASHMAP_EMPTY_KEY) {
+void iihm_move_last(IntIntHashMap* data, int to) {
+    int last = data->size - 1;
+    if (to != last) {
+        int firstIndex = iihm_bucket(data, data->keySet[last]); // where the last entry is chained from
+        if (iihm_head(data, firstIndex) == last) {
+            iihm_set_head(data, firstIndex, to); // it is the first item of its chain
+        } else {
+            int prevIndex = iihm_head(data, firstIndex);
+            while (data->next[prevIndex] != last) // find the item before it
+                prevIndex = data->next[prevIndex];
+            data->next[prevIndex] = to;
+        }
+        // copy the data across
+        data->keySet[to] = data->keySet[last];
+        data->valueSet[to] = data->valueSet[last];
+        data->next[to] = data->next[last];
+    }
+    // the last slot is now free
+    data->next[last] = INT_INT_HASHMAP_NO_ENTRY;
+    data->size -= 1; // decrease size of map
+}
+
+
+/**
+ * unlink key from its chain (the slot itself isn't freed)
+ * @return the index of the unlinked slot, or INT_INT_HASHMAP_NO_ENTRY if the key wasn't found
+ */
+int iihm_unlink(IntIntHashMap* data, int key) {
+    int firstIndex = iihm_bucket(data, key); // start location
+    int nextIndex = iihm_head(data, firstIndex); // data at location
+    int prevIndex = INT_INT_HASHMAP_NO_ENTRY;
+    int probes = 0;
+    while (nextIndex != INT_INT_HASHMAP_NO_ENTRY) {
+        probes += 1;
         if (data->keySet[nextIndex] == key)
             break; // found it!
         prevIndex = nextIndex;
         nextIndex = data->next[nextIndex]; // cycle through
     }
-    // found or end?
-    if (data->keySet[nextIndex] == key) {
-        // first update?
-        if (nextIndex == data->first[firstIndex]) {
-            data->first[firstIndex] = data->next[nextIndex]; // unchain first item
-            // does it remove the item completely?
-            if (data->next[nextIndex] == INT_INT_HASHMAP_EMPTY_KEY) {
-                data->keySet[nextIndex] = INT_INT_HASHMAP_EMPTY_KEY;
-                data->valueSet[nextIndex] = INT_INT_HASHMAP_EMPTY_KEY;
-            }
+    hash_stats_probe(&data->counters, HASH_STATS_REMOVE, probes);
+    // found?
+    if (nextIndex != INT_INT_HASHMAP_NO_ENTRY) {
+        if (prevIndex == INT_INT_HASHMAP_NO_ENTRY) {
+            iihm_set_head(data, firstIndex, data->next[nextIndex]); // unchain first item
         } else {
             data->next[prevIndex] = data->next[nextIndex]; // skip one in the chain
         }
-        data->size -= 1; // decrease size of map
-        return 1; // done!
     }
-    return 0; // not found
+    return nextIndex;
+}
+
+
+/**
+ * remove a key from the map (delete)
+ * @return 1 if an item was removed, 0 otherwise
+ */
+int iihm_remove(IntIntHashMap* data, int key) {
+    // can't remove something from a NULL data structure, or a read-only one
+    if (data == NULL || data->mapping != NULL) return 0;
+    if (data->engine == INT_INT_HASHMAP_ENGINE_GROUPED) // open addressing engine
+        return iigm_remove(data, key);
+    if (data->engine == INT_INT_HASHMAP_ENGINE_INTERLEAVED) // array of structs engine
+        return iiem_remove(data, key);
+
+    if (data->resizeTo != NULL) { // incremental resize in progress
+        iihm_resize_step(data, data->resizeStep);
+        if (iihm_migrating(data)) {
+            // the old table is being emptied, just unlink its slot - otherwise remove it from the new table
+            if (iihm_unlink(data, key) == INT_INT_HASHMAP_NO_ENTRY) {
+                IntIntHashMap* table = data->resizeTo;
+                int index = iihm_unlink(table, key);
+                if (index == INT_INT_HASHMAP_NO_ENTRY)
+                    return 0; // not found
+                iihm_move_last(table, index);
+            }
+            data->size -= 1;
+            return 1;
+        }
+    }
+
+    int index = iihm_unlink(data, key);
+    if (index == INT_INT_HASHMAP_NO_ENTRY)
+        return 0; // not found
+    // re-use the slot by moving the last entry into it, then give memory back if we're mostly empty
+    iihm_move_last(data, index);
+    if (data->resizeTo == NULL)
+        iih_shrink(data);
+    return 1; // done!
+}
+
+
+/**
+ * get the value of key and whether it was found, with a single lookup
+ * @param found set to 1 if the key is in the map, 0 otherwise
+ * @return the value, or 0 if the key isn't in the map
+ */
+int iihm_get_found(IntIntHashMap* data, int key, int* found) {
+    int value = 0;
+    *found = 0;
+    // we can never find data inside a NULL data array
+    if (data == NULL) return 0;
+    if (data->engine == INT_INT_HASHMAP_ENGINE_GROUPED) { // open addressing engine
+        *found = iigm_get(data, key, &value);
+        return value;
+    }
+    if (data->engine == INT_INT_HASHMAP_ENGINE_INTERLEAVED) { // array of structs engine
+        *found = iiem_get(data, key, &value);
+        return value;
+    }
+    if (data->resizeTo != NULL) { // incremental resize in progress
+        iihm_resize_step(data, data->resizeStep);
+        if (iihm_migrating(data)) {
+            int index = iihm_find(data->resizeTo, key);
+            if (index != INT_INT_HASHMAP_NO_ENTRY) {
+                *found = 1;
+                return data->resizeTo->valueSet[index]; // found it in the new table
+            }
+        }
+    }
+    int index = iihm_find(data, key);
+    if (index == INT_INT_HASHMAP_NO_ENTRY)
+        return 0;
+    *found = 1;
+    return data->valueSet[index];
+}
+
+
+/**
+ * get the value of key
+ * @return the value, or 0 if the key isn't in the map (use iihm_get_found() to tell the two apart)
+ */
+int iihm_get(IntIntHashMap* data, int key) {
+    int found;
+    return iihm_get_found(data, key, &found);
+}
+
+
+/**
+ * look up n keys at once, INT_HASH_BATCH at a time and in stages so their cache misses overlap:
+ * hash every key and prefetch its first[] bucket, then read the buckets and prefetch the chain entries
+ * they point at, then walk the chains - each stage for 8 or 16 keys at once on cpus with AVX2 / AVX-512 (hash_simd.h)
+ * @param outValues receives the value of every key (0 if not found)
+ * @param outFound receives 1 for every key found and 0 otherwise, can be NULL
+ * @return the number of keys found
+ */
+int iihm_get_many(IntIntHashMap* data, const int* keys, int n, int* outValues, int* outFound) {
+    if (data == NULL || keys == NULL || outValues == NULL || n <= 0) return 0;
+    if (data->engine == INT_INT_HASHMAP_ENGINE_GROUPED) // open addressing engine
+        return iigm_get_many(data, keys, n, outValues, outFound);
+    if (data->engine == INT_INT_HASHMAP_ENGINE_INTERLEAVED) // array of structs engine
+        return iiem_get_many(data, keys, n, outValues, outFound);
+    int found = 0;
+    int start = 0;
+    // keys live in either table during an incremental resize, look those up one at a time
+    for (; start < n && data->resizeTo != NULL; start++) {
+        iihm_resize_step(data, data->resizeStep);
+        IntIntHashMap* table = data;
+        int index = INT_INT_HASHMAP_NO_ENTRY;
+        if (iihm_migrating(data) && (index = iihm_find(data->resizeTo, keys[start])) != INT_INT_HASHMAP_NO_ENTRY)
+            table = data->resizeTo; // found it in the new table
+        else
+            index = iihm_find(data, keys[start]);
+        outValues[start] = index != INT_INT_HASHMAP_NO_ENTRY ? table->valueSet[index] : 0;
+        if (outFound != NULL) outFound[start] = index != INT_INT_HASHMAP_NO_ENTRY;
+        found += index != INT_INT_HASHMAP_NO_ENTRY;
+    }
+    // the rest in batches, with the vector kernel the cpu supports
+    HashSimdChains chains = {data->first, data->generations, data->generation, (uint32_t)(data->allocatedSize - 1),
+                             1, data->seed, data->keySet, NULL, data->next, data->valueSet, &data->counters};
+    found += hash_simd_find_many(&chains, keys + start, NULL, n - start, outValues + start,
+                                 outFound != NULL ? outFound + start : NULL);
+    return found;
+}
+
+
+// the number of slots iterating walks: the dense entries 0..size-1, or every slot of the grouped engine
+static inline int iihm_slots(IntIntHashMap* data) {
+    return data->engine == INT_INT_HASHMAP_ENGINE_GROUPED ? data->allocatedSize : data->size;
+}
+
+
+// read slot i into key / value, returns 0 if it holds no entry (a free or deleted slot of the grouped engine)
+static inline int iihm_slot(IntIntHashMap* data, int i, int* key, int* value) {
+    if (data->engine == INT_INT_HASHMAP_ENGINE_INTERLEAVED) {
+        *key = data->entries[i].key;
+        *value = data->entries[i].value;
+        return 1;
+    }
+    if (data->engine == INT_INT_HASHMAP_ENGINE_GROUPED && data->control[i] < 0)
+        return 0; // a full slot's control byte is 7 bits of its hash
+    *key = data->keySet[i];
+    *value = data->valueSet[i];
+    return 1;
+}
+
+
+/**
+ * get the next key/value of the map: start with *cursor = 0 and call it until it returns 0, the entries are
+ * read in the order they sit in memory (not in any key order).  the map must not be changed in between,
+ * an incremental resize in progress is finished by the first call
+ * @return 1 if *key / *value were set, 0 once every entry has been returned
+ */
+int iihm_next(IntIntHashMap* data, int* cursor, int* key, int* value) {
+    if (data == NULL) return 0;
+    if (data->resizeTo != NULL)
+        iihm_resize_complete(data); // the entries of both tables would overlap
+    int slots = iihm_slots(data);
+    while (*cursor < slots) {
+        int i = (*cursor)++;
+        if (iihm_slot(data, i, key, value))
+            return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * call fn(key, value, context, 0) for every key/value of the map, walking its entry arrays front to back
+ * (an incremental resize in progress is finished first) - fn must not change the map
+ */
+void iihm_for_each(IntIntHashMap* data, IntIntVisitor fn, void* context) {
+    int cursor = 0, key, value;
+    while (iihm_next(data, &cursor, &key, &value))
+        fn(key, value, context, 0);
+}
+
+
+// the state shared by the threads of iihm_for_each_parallel()
+typedef struct {
+    IntIntHashMap* data;
+    IntIntVisitor fn;
+    void* context;
+    int nthreads;
+} IIHMForEachWork;
+
+
+// visit thread t's chunk of the slots
+static void iihm_for_each_chunk(void* arg, int t) {
+    IIHMForEachWork* work = (IIHMForEachWork*)arg;
+    int slots = iihm_slots(work->data);
+    int from = (int)((long)slots * t / work->nthreads);
+    int to = (int)((long)slots * (t + 1) / work->nthreads);
+    int key, value;
+    for (int i = from; i < to; i++)
+        if (iihm_slot(work->data, i, &key, &value))
+            work->fn(key, value, work->context, t);
+}
+
+
+/**
+ * call fn(key, value, context, thread) for every key/value of the map with nthreads threads, every thread
+ * walks its own contiguous chunk of the entry arrays.  fn is called by several threads at the same time, use
+ * the thread number (0 .. nthreads - 1) to keep per thread results (sums, counts, output buffers) apart
+ */
+void iihm_for_each_parallel(IntIntHashMap* data, int nthreads, IntIntVisitor fn, void* context) {
+    if (data == NULL) return;
+    if (data->resizeTo != NULL)
+        iihm_resize_complete(data);
+    IIHMForEachWork work = {data, fn, context, nthreads > 1 ? nthreads : 1};
+    bulk_run(work.nthreads, iihm_for_each_chunk, &work);
+}
+
+
+// the state shared by the threads of iihm_build()
+typedef struct {
+    IntIntHashMap* data;
+    const int* keys;
+    const int* values;
+    int n;
+    int nthreads;
+    int duplicates;
+    // the bucket of every key
+    uint32_t* buckets;
+    BulkPartitions partitions;
+} IIHMBuildWork;
+
+
+// hash thread t's part of the keys
+static void iihm_build_hash(void* arg, int t) {
+    IIHMBuildWork* work = (IIHMBuildWork*)arg;
+    int from = (int)((long)work->n * t / work->nthreads);
+    int to = (int)((long)work->n * (t + 1) / work->nthreads);
+    for (int i = from; i < to; i++)
+        work->buckets[i] = (uint32_t)iihm_bucket(work->data, work->keys[i]);
+}
+
+
+// fill the partitions of thread t: each owns its own buckets and slots, so nothing is shared
+static void iihm_build_fill(void* arg, int t) {
+    IIHMBuildWork* work = (IIHMBuildWork*)arg;
+    IntIntHashMap* data = work->data;
+    BulkPartitions* partitions = &work->partitions;
+    for (int p = t; p < partitions->numPartitions; p += work->nthreads) {
+        int bucketFrom = p << partitions->bucketShift;
+        int bucketTo = (p + 1) << partitions->bucketShift;
+        for (int b = bucketFrom; b < bucketTo; b++)
+            data->first[b] = INT_INT_HASHMAP_NO_ENTRY;
+        int slot = partitions->starts[p];
+        for (int j = partitions->starts[p]; j < partitions->starts[p + 1]; j++) {
+            int i = partitions->order[j];
+            int key = work->keys[i];
+            int firstIndex = (int)work->buckets[i];
+            int index = data->first[firstIndex];
+            while (index != INT_INT_HASHMAP_NO_ENTRY && data->keySet[index] != key)
+                index = data->next[index];
+            if (index != INT_INT_HASHMAP_NO_ENTRY) { // a duplicate, the input order within a partition is kept
+                if (work->duplicates == IIHM_BUILD_LAST_WINS)
+                    data->valueSet[index] = work->values[i];
+                else if (work->duplicates == IIHM_BUILD_SUM) // wraps around like unsigned ints do
+                    data->valueSet[index] = (int)((unsigned)data->valueSet[index] + (unsigned)work->values[i]);
+                continue;
+            }
+            // a new key goes to the front of its chain
+            data->keySet[slot] = key;
+            data->valueSet[slot] = work->values[i];
+            data->next[slot] = data->first[firstIndex];
+            data->first[firstIndex] = slot;
+            slot += 1;
+        }
+        partitions->used[p] = slot - partitions->starts[p];
+    }
+}
+
+
+/**
+ * build a map from n keys and their values at once, much faster than n calls of iihm_add(): the table is
+ * sized for n keys once, the keys are hashed and radix partitioned by bucket range by nthreads threads
+ * and every thread then fills its own partitions without any locking
+ * @param duplicates what to do with a key that is in keys more than once: IIHM_BUILD_LAST_WINS (as iihm_add()
+ *                   would), IIHM_BUILD_FIRST_WINS or IIHM_BUILD_SUM (add up all its values)
+ * @return the new map (chained engine, seed 0), or NULL if out of memory
+ */
+IntIntHashMap* iihm_build(const int* keys, const int* values, int n, int nthreads, int duplicates) {
+    if (n < 0 || (n > 0 && (keys == NULL || values == NULL)) || n >= INT_HASH_MAX_CAPACITY)
+        return NULL;
+    if (nthreads < 1) nthreads = 1;
+    int allocatedSize = int_hash_capacity(n + 1); // room for one more, as iihm_add() keeps
+    IIHMBuildWork work = {NULL, keys, values, n, nthreads, duplicates, NULL, {0}};
+    work.data = iihm_allocate_table(allocatedSize, 0, NULL);
+    work.buckets = malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+    if (work.data == NULL || work.buckets == NULL) {
+        iihm_free(work.data);
+        free(work.buckets);
+        return NULL;
+    }
+    bulk_run(nthreads > n ? 1 : nthreads, iihm_build_hash, &work);
+    int bucketBits = 0;
+    while ((1 << bucketBits) < allocatedSize)
+        bucketBits += 1;
+    if (!bulk_partition(&work.partitions, work.buckets, n, bucketBits, nthreads)) {
+        iihm_free(work.data);
+        free(work.buckets);
+        return NULL;
+    }
+    if (work.nthreads > work.partitions.numPartitions)
+        work.nthreads = work.partitions.numPartitions;
+    bulk_run(work.nthreads, iihm_build_fill, &work);
+    IntIntHashMap* data = work.data;
+    data->size = bulk_compact(&work.partitions, data->first, data->next, data->keySet, data->valueSet, nthreads);
+    bulk_free(&work.partitions);
+    free(work.buckets);
+    return data;
+}
+
+
+/**
+ * fill in out with the statistics of the map: the length of every chain (for the grouped engine the number of
+ * groups probed to find every key), its load and the bytes of its struct and arrays, and the counters of its
+ * adds / contains / removes and grows if the library was compiled with HASH_STATS (see hash_stats.h)
+ * an incremental resize in progress is finished first
+ */
+void iihm_stats(IntIntHashMap* data, HashStats* out) {
+    if (data == NULL || out == NULL) return;
+    if (data->resizeTo != NULL)
+        iihm_resize_complete(data);
+    size_t slots = (size_t)data->allocatedSize;
+    size_t memory;
+    if (data->mapping != NULL) // the arrays are the snapshot file
+        memory = data->mappingSize;
+    else if (data->engine == INT_INT_HASHMAP_ENGINE_GROUPED) // a control byte, a key and a value per slot
+        memory = slots * (1 + 2 * sizeof(int));
+    else if (data->engine == INT_INT_HASHMAP_ENGINE_INTERLEAVED) // first[] and the entries
+        memory = slots * (sizeof(int) + sizeof(IntIntEntry));
+    else // first[], keySet[], valueSet[], next[] and the generations of fast clear
+        memory = slots * (data->generations != NULL ? 5 : 4) * sizeof(int);
+    hash_stats_begin(out, &data->counters, data->size, data->allocatedSize, sizeof(IntIntHashMap) + memory);
+    if (data->engine == INT_INT_HASHMAP_ENGINE_GROUPED) {
+        iigm_stats_chains(data, out);
+        out->deadSlots = data->deleted;
+    } else if (data->engine == INT_INT_HASHMAP_ENGINE_INTERLEAVED) {
+        hash_stats_chains(out, data->first, &data->entries[0].next, (int)(sizeof(IntIntEntry) / sizeof(int)),
+                          data->allocatedSize, NULL, 0);
+    } else {
+        hash_stats_chains(out, data->first, data->next, 1, data->allocatedSize, data->generations, data->generation);
+    }
+    hash_stats_end(out);
+}
+
+
+// identifies an IntIntHashMap snapshot
+#define IIHM_SNAPSHOT_MAGIC "RDSIIHM"
+
+
+/**
+ * save the map to a snapshot file at path (see snapshot.h), it can be opened with iihm_open_mmap()
+ * an incremental resize in progress is finished first, only maps of the chained engine can be saved
+ * @return 1 on success, 0 on failure
+ */
+int iihm_save(IntIntHashMap* data, const char* path) {
+    if (data == NULL || data->engine != INT_INT_HASHMAP_ENGINE_CHAINED) return 0;
+    if (data->resizeTo != NULL)
+        iihm_resize_complete(data);
+    if (data->generations != NULL) { // the snapshot has no generations, so its first[] must be up to date
+        iihm_flush_generations(data);
+        memset(data->generations, 0, (size_t)data->allocatedSize * sizeof(int));
+        data->generation = 0;
+    }
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IIHM_SNAPSHOT_MAGIC, sizeof(IIHM_SNAPSHOT_MAGIC));
+    header.seed = data->seed;
+    header.allocatedSize = data->allocatedSize;
+    header.initialSize = data->initialSize;
+    header.size = data->size;
+    // first[] is needed in full, the entries only up to size
+    header.numArrays = 4;
+    header.arrayBytes[0] = (uint64_t)data->allocatedSize * sizeof(int);
+    header.arrayBytes[1] = (uint64_t)data->size * sizeof(int);
+    header.arrayBytes[2] = (uint64_t)data->size * sizeof(int);
+    header.arrayBytes[3] = (uint64_t)data->size * sizeof(int);
+    const void* arrays[4] = {data->first, data->next, data->keySet, data->valueSet};
+    return snapshot_save(path, &header, arrays);
+}
+
+
+/**
+ * open a snapshot saved by iihm_save() as a read-only map: its arrays point straight into a read-only
+ * mapping of the file, so nothing is read or re-hashed until it is used.  only the header is checked, call
+ * iihm_verify() before trusting a file that could be damaged - add, remove and clear do nothing
+ * on such a map, iihm_free() unmaps the file.
+ * @return the map, or NULL if path isn't a valid IntIntHashMap snapshot
+ */
+IntIntHashMap* iihm_open_mmap(const char* path) {
+    size_t mappingSize = 0;
+    const SnapshotHeader* header = snapshot_open(path, IIHM_SNAPSHOT_MAGIC, &mappingSize);
+    if (header == NULL) return NULL;
+    int allocatedSize = header->allocatedSize;
+    if (header->numArrays != 4 || allocatedSize <= 0 || (allocatedSize & (allocatedSize - 1)) != 0 ||
+            header->size < 0 || header->size > allocatedSize ||
+            header->arrayBytes[0] != (uint64_t)allocatedSize * sizeof(int) ||
+            header->arrayBytes[1] != (uint64_t)header->size * sizeof(int) ||
+            header->arrayBytes[2] != header->arrayBytes[1] || header->arrayBytes[3] != header->arrayBytes[1]) {
+        snapshot_close(header, mappingSize); // not the arrays of a map
+        return NULL;
+    }
+    IntIntHashMap* data = (IntIntHashMap*) calloc(1, sizeof(IntIntHashMap));
+    if (data == NULL) {
+        snapshot_close(header, mappingSize);
+        return NULL;
+    }
+    const char* base = (const char*)header;
+    data->first = (int*)(base + header->arrayOffset[0]);
+    data->next = (int*)(base + header->arrayOffset[1]);
+    data->keySet = (int*)(base + header->arrayOffset[2]);
+    data->valueSet = (int*)(base + header->arrayOffset[3]);
+    data->allocatedSize = allocatedSize;
+    data->initialSize = header->initialSize;
+    data->size = header->size;
+    data->seed = header->seed;
+    data->mapping = header;
+    data->mappingSize = mappingSize;
+    return data;
+}
+
+
+/**
+ * check a map opened by iihm_open_mmap() against the checksum it was saved with (reads the whole file)
+ * @return 1 if it is intact, 0 if it isn't (or the map isn't a snapshot)
+ */
+int iihm_verify(IntIntHashMap* data) {
+    if (data == NULL || data->mapping == NULL) return 0;
+    return snapshot_verify((const SnapshotHeader*)data->mapping) &&
+           snapshot_check_links(data->first, data->allocatedSize, data->size) &&
+           snapshot_check_links(data->next, data->size, data->size);
 }
@@ -5,8 +5,35 @@
 #ifndef C_CODE_INT_INT_HASH_MAP_H
 #define C_CODE_INT_INT_HASH_MAP_H
 
-// this is the only value that can't be used in the map of the entire INT range
-#define INT_INT_HASHMAP_EMPTY_KEY (-1)
+#include <stddef.h>
+#include <stdint.h>
+#include "hash_alloc.h"
+#include "hash_stats.h"
+
+// marks an empty bucket in first[] and the end of a chain in next[], every int can be used as a key
+#define INT_INT_HASHMAP_NO_ENTRY (-1)
+
+// the default engine: first[] -> next[] -> keySet[] chains
+#define INT_INT_HASHMAP_ENGINE_CHAINED 0
+// open addressing engine: a metadata byte per slot, probed 16 slots (a group) at a time
+#define INT_INT_HASHMAP_ENGINE_GROUPED 1
+// first[] -> chains of interleaved {key, next, value} entries, a hit reads one entry instead of three arrays
+#define INT_INT_HASHMAP_ENGINE_INTERLEAVED 2
+
+// iihm_build(): what to do with a key that is in the input more than once
+// keep the value of its last occurrence (the same as adding the keys one by one)
+#define IIHM_BUILD_LAST_WINS 0
+// keep the value of its first occurrence
+#define IIHM_BUILD_FIRST_WINS 1
+// add up the values of all its occurrences
+#define IIHM_BUILD_SUM 2
+
+// interleaved engine only: a slot's key, chain link and value side by side
+typedef struct {
+    int key;
+    int next;
+    int value;
+} IntIntEntry;
 
 struct STRUCT_IntIntHashMap {
     // a list of first indexes
@@ -23,14 +50,68 @@ struct STRUCT_IntIntHashMap {
     int initialSize;
     // how much data we have and where the offset is for the next entry
     int size;
+    // mixed into the hash of every key (see int_hash.h)
+    uint32_t seed;
+    // where the struct and its arrays come from, NULL: calloc / realloc / free (see hash_alloc.h)
+    const HashAllocator* allocator;
+    // which engine implements this map (one of the INT_INT_HASHMAP_ENGINE_* values)
+    int engine;
+    // interleaved engine only: the entries (keySet, valueSet and next are not used)
+    IntIntEntry* entries;
+    // grouped engine only: a metadata byte per slot (empty, deleted or 7 bits of the key's hash)
+    signed char* control;
+    // grouped engine only: number of slots marked deleted
+    int deleted;
+    // incremental resizing: 0 re-maps the whole map inside the add/remove that grows or shrinks it,
+    // otherwise the number of chains every add/contains/remove migrates while a resize is in progress
+    int resizeStep;
+    // incremental resizing: the table being filled while a resize is in progress, NULL otherwise
+    struct STRUCT_IntIntHashMap* resizeTo;
+    // incremental resizing: how many first[] buckets of resizeTo have been set up
+    int resizeInitialized;
+    // incremental resizing: how many chains of this table have been migrated to resizeTo
+    int resizeMigrated;
+    // parallel resizing: number of threads that re-chain or clear a table of at least parallelMinSize slots,
+    // 0 or 1 does all of it on the calling thread
+    int parallelThreads;
+    int parallelMinSize;
+    // fast clear (chained engine only): the generation every first[] bucket was last written in, NULL when off
+    int* generations;
+    // fast clear: the current generation, buckets of any other generation are empty
+    int generation;
+    // the hot path counters of iihm_stats(), only kept in HASH_STATS builds (see hash_stats.h)
+    HashCounters counters;
+    // read-only maps (iihm_open_mmap()): the snapshot file mapping the arrays point into, NULL otherwise
+    const void* mapping;
+    // read-only maps: the size of the mapping in bytes
+    size_t mappingSize;
 };
 
 // define a nice name for the data structure
 typedef struct STRUCT_IntIntHashMap IntIntHashMap;
 
+// called for every key/value by the iterating fns., thread is the number of the calling thread (0 .. nthreads - 1)
+typedef void (*IntIntVisitor)(int key, int value, void* context, int thread);
+
 // fn. to create a new int-int hash map
 IntIntHashMap* iihm_create(int initialSize);
 
+// fn. to create a new int-int hash map that hashes its keys with seed (use a random seed for untrusted keys)
+IntIntHashMap* iihm_create_seeded(int initialSize, uint32_t seed);
+
+// fn. to create a new int-int hash map using the grouped open addressing engine (same iihm_* API)
+IntIntHashMap* iihm_create_grouped(int initialSize);
+
+// fn. to create a new int-int hash map using the interleaved (array of structs) chained engine (same iihm_* API)
+IntIntHashMap* iihm_create_interleaved(int initialSize);
+
+// fn. to create a new int-int hash map of an INT_INT_HASHMAP_ENGINE_* engine whose memory comes from allocator
+IntIntHashMap* iihm_create_with_allocator(int initialSize, uint32_t seed, int engine,
+                                          const HashAllocator* allocator);
+
+// fn. to build a map from n keys/values at once with nthreads threads, duplicates is one of the IIHM_BUILD_* policies
+IntIntHashMap* iihm_build(const int* keys, const int* values, int n, int nthreads, int duplicates);
+
 // fn. to clear the hash map (ungrow and remove all data)
 void iihm_clear(IntIntHashMap* data);
 
@@ -43,10 +124,54 @@ int iihm_add(IntIntHashMap* data, int key, int value);
 // fn. to check if the map contain the key given key, returns 1 if it does
 int iihm_contains(IntIntHashMap* data, int key);
 
-// fn. to get the value for the associated key
+// fn. to get the value for the associated key (0 if not found)
 int iihm_get(IntIntHashMap* data, int key);
 
+// fn. to get the value for the associated key (0 if not found), *found is set to 1 if the key is in the map
+int iihm_get_found(IntIntHashMap* data, int key, int* found);
+
+// fn. to get a pointer to the value of key, adding the key with defaultValue first if it isn't in the map.  the
+// pointer can be read and written until the next add / remove / clear, NULL if the key couldn't be added
+int* iihm_get_or_insert(IntIntHashMap* data, int key, int defaultValue);
+
+// fn. to add delta to the value of key (a missing key starts at 0) and return its new value
+int iihm_add_to(IntIntHashMap* data, int key, int delta);
+
+// fn. to get the values of n keys at once (prefetch pipelined), outFound (can be NULL) is set to 1 for every key found
+int iihm_get_many(IntIntHashMap* data, const int* keys, int n, int* outValues, int* outFound);
+
 // fn. to remove a key from the hash map, returns 1 if the value was removed
 int iihm_remove(IntIntHashMap* data, int key);
 
+// fn. to get the next key/value (start with *cursor = 0), returns 0 once every entry has been returned
+int iihm_next(IntIntHashMap* data, int* cursor, int* key, int* value);
+
+// fn. to call fn for every key/value of the map in memory order
+void iihm_for_each(IntIntHashMap* data, IntIntVisitor fn, void* context);
+
+// fn. to call fn for every key/value of the map with nthreads threads, each walking its own chunk of the entries
+void iihm_for_each_parallel(IntIntHashMap* data, int nthreads, IntIntVisitor fn, void* context);
+
+// fn. to turn incremental resizing on (chainsPerStep > 0: chains migrated per operation) or off (0), chained engine only
+void iihm_set_incremental_resize(IntIntHashMap* data, int chainsPerStep);
+
+// fn. to use nthreads threads to re-chain or clear a table of at least minSize slots (<= 0: the default size)
+void iihm_set_parallel_resize(IntIntHashMap* data, int nthreads, int minSize);
+
+// fn. to turn fast clear on (1: iihm_clear() is O(1) and keeps the table size) or off (0), chained engine only
+void iihm_set_fast_clear(IntIntHashMap* data, int on);
+
+// fn. to fill in out with the statistics of the map: its chains, load and memory (and its counters, see hash_stats.h)
+void iihm_stats(IntIntHashMap* data, HashStats* out);
+
+// fn. to save the map to a snapshot file at path, returns 1 on success (chained engine only)
+int iihm_save(IntIntHashMap* data, const char* path);
+
+// fn. to open a snapshot file as a read-only map whose arrays point straight into the mapped file (NULL on failure)
+IntIntHashMap* iihm_open_mmap(const char* path);
+
+// fn. to check a map opened with iihm_open_mmap() against its checksum and that its chains stay inside the file,
+// returns 1 if it is intact - open only checks the header, call this before trusting a file that could be damaged
+int iihm_verify(IntIntHashMap* data);
+
 #endif //C_CODE_INT_INT_HASH_MAP_H
@@ -11,44 +11,151 @@
 
 /**
  * a memory efficient int -> object hash map
+ *
+ * a map either stores pointers to the caller's objects (valueSet), or copies of fixed size values in an arena
+ * next to its keys (valueArena, see iohm_create_inline()) - every read or write of a value goes through
+ * the iohm_value*() helpers below so the rest of the map works the same for both
  */
 
 
 #include <stdlib.h>
 #include <string.h>
 #include "int_obj_hash_map.h"
+#include "int_hash.h"
+#include "bulk_build.h"
+#include "hash_alloc.h"
+
+
+// the bucket (first[] index) of key: its hash masked to the power of 2 table size
+static inline int iohm_bucket(IntObjHashMap* data, int key) {
+    return (int)(int_hash(key, data->seed) & (uint32_t)(data->allocatedSize - 1));
+}
+
+
+// the value of slot i as iohm_get() returns it: the object, or the address of the inline copy
+static inline void* iohm_value(IntObjHashMap* data, int i) {
+    return data->valueSize == 0 ? data->valueSet[i] : data->valueArena + (size_t)i * data->valueSize;
+}
+
+
+// the slot of value i as iohm_get_or_insert() returns it: the address of the object pointer, or of the inline copy
+static inline void* iohm_value_slot(IntObjHashMap* data, int i) {
+    return data->valueSize == 0 ? (void*)&data->valueSet[i] : data->valueArena + (size_t)i * data->valueSize;
+}
+
+
+// set the value of slot i: the object, or a copy of the valueSize bytes at value (zeros for NULL)
+static inline void iohm_set_value(IntObjHashMap* data, int i, void* value) {
+    if (data->valueSize == 0) {
+        data->valueSet[i] = value;
+    } else if (value != NULL) {
+        memcpy(data->valueArena + (size_t)i * data->valueSize, value, data->valueSize);
+    } else {
+        memset(data->valueArena + (size_t)i * data->valueSize, 0, data->valueSize);
+    }
+}
+
+
+// the size in bytes of the value array of size slots
+static inline size_t iohm_value_bytes(IntObjHashMap* data, int size) {
+    return (size_t)size * (data->valueSize == 0 ? sizeof(void*) : (size_t)data->valueSize);
+}
+
+
+// the value array of the map, whichever it uses
+static inline void* iohm_values(IntObjHashMap* data) {
+    return data->valueSize == 0 ? (void*)data->valueSet : (void*)data->valueArena;
+}
+
+
+// point the map at its value array
+static inline void iohm_set_values(IntObjHashMap* data, void* values) {
+    if (data->valueSize == 0)
+        data->valueSet = (void**)values;
+    else
+        data->valueArena = (char*)values;
+}
+
+
+// the first entry of bucket b's chain, INT_OBJ_HASHMAP_NO_ENTRY if it is empty (with fast clear on: or if the
+// bucket was last written before the last clear)
+static inline int iohm_head(IntObjHashMap* data, int b) {
+    if (data->generations != NULL && data->generations[b] != data->generation)
+        return INT_OBJ_HASHMAP_NO_ENTRY;
+    return data->first[b];
+}
+
+
+// make index the first entry of bucket b's chain
+static inline void iohm_set_head(IntObjHashMap* data, int b, int index) {
+    data->first[b] = index;
+    if (data->generations != NULL)
+        data->generations[b] = data->generation;
+}
+
+
+// allocate the arrays of a table of size slots (zeroed), returns 1 if successful
+static int iohm_allocate_arrays(IntObjHashMap* data, int size) {
+    data->first = hash_alloc(data->allocator, (size_t)size * sizeof(int));
+    data->keySet = hash_alloc(data->allocator, (size_t)size * sizeof(int));
+    iohm_set_values(data, hash_alloc(data->allocator, iohm_value_bytes(data, size)));
+    data->next = hash_alloc(data->allocator, (size_t)size * sizeof(int));
+    data->allocatedSize = size;
+    return data->first != NULL && data->keySet != NULL && iohm_values(data) != NULL && data->next != NULL;
+}
+
+
+// give back the arrays of the map, they all have allocatedSize slots
+static void iohm_release_arrays(IntObjHashMap* data) {
+    size_t slots = (size_t)data->allocatedSize;
+    hash_release(data->allocator, data->first, slots * sizeof(int));
+    hash_release(data->allocator, data->keySet, slots * sizeof(int));
+    hash_release(data->allocator, iohm_values(data), iohm_value_bytes(data, data->allocatedSize));
+    hash_release(data->allocator, data->next, slots * sizeof(int));
+    hash_release(data->allocator, data->generations, slots * sizeof(int));
+    data->generations = NULL;
+}
+
+
+// the number of threads to work on a whole table of n slots with
+static inline int iohm_threads(IntObjHashMap* data, int n) {
+    return data->parallelThreads > 1 && n >= data->parallelMinSize ? data->parallelThreads : 1;
+}
 
 
 /**
- * clear the hash map - remove all data and re-allocate to initial size if need be
+ * clear the hash map - remove all data and re-allocate to initial size if need be (with fast clear on: start a
+ * new generation instead, see iohm_set_fast_clear())
  */
 void iohm_clear(IntObjHashMap* data) {
     if (data == NULL)
         return;
+    if (data->generations != NULL) { // fast clear: a new generation empties every bucket, the size stays
+        data->size = 0;
+        int_hash_next_generation(data->generations, data->allocatedSize, &data->generation);
+        return;
+    }
+    if (data->resizeTo != NULL) { // drop an incremental resize in progress
+        iohm_free(data->resizeTo);
+        data->resizeTo = NULL;
+    }
     data->size = 0;
-    // shrink the arrays?
-    if (data->allocatedSize > data->initialSize) {
-        // first release the allocated data
-        if (data->first != NULL) free(data->first);
-        if (data->keySet != NULL) free(data->keySet);
-        if (data->valueSet != NULL) free(data->valueSet);
-        if (data->next != NULL) free(data->next);
-
-        // re-allocate the original sizes
-        data->first = calloc(data->initialSize, sizeof(int));
-        data->keySet = calloc(data->initialSize, sizeof(int));
-        data->valueSet = calloc(data->initialSize, sizeof(void*));
-        data->next = calloc(data->initialSize, sizeof(int));
-        data->allocatedSize = data->initialSize;
+    // shrink the arrays? the smaller ones are allocated before the current ones are released, so running out of
+    // memory keeps the table at the size it is instead of leaving it without arrays
+    if (data->allocatedSize > data->initialSize) { // if we've grown beyond the initial size
+        IntObjHashMap smaller = *data;
+        if (iohm_allocate_arrays(&smaller, data->initialSize)) {
+            iohm_release_arrays(data);
+            *data = smaller;
+        } else
+            iohm_release_arrays(&smaller); // whichever of them were allocated
     }
 
-    // clear the arrays with "empty" keys so they appear as empty to our algorithm
-    for (int i = 0; i < data->initialSize; i++) {
-        data->first[i] = INT_OBJ_HASHMAP_EMPTY_KEY;
-        data->keySet[i] = INT_OBJ_HASHMAP_EMPTY_KEY;
+    // mark every bucket as empty
+    bulk_fill(data->first, data->allocatedSize, INT_OBJ_HASHMAP_NO_ENTRY, iohm_threads(data, data->allocatedSize));
+    bulk_fill(data->next, data->allocatedSize, INT_OBJ_HASHMAP_NO_ENTRY, iohm_threads(data, data->allocatedSize));
+    for (int i = 0; data->valueSize == 0 && i < data->allocatedSize; i++)
         data->valueSet[i] = NULL;
-        data->next[i] = INT_OBJ_HASHMAP_EMPTY_KEY;
-    }
 }
 
 
@@ -57,15 +164,17 @@ void iohm_clear(IntObjHashMap* data) {
  */
 void iohm_free_content_only(IntObjHashMap* data) {
     if (data == NULL) return; // no data, don't de-allocate
+    if (data->resizeTo != NULL) { // the new table of an incremental resize
+        iohm_free(data->resizeTo);
+        data->resizeTo = NULL;
+    }
     // de-allocate the arrays first
-    if (data->first != NULL) free(data->first);
-    if (data->keySet != NULL) free(data->keySet);
-    if (data->valueSet != NULL) free(data->valueSet);
-    if (data->next != NULL) free(data->next);
+    iohm_release_arrays(data);
     // set all items in data to NULL and 0
     data->first = NULL;
     data->keySet = NULL;
     data->valueSet = NULL;
+    data->valueArena = NULL;
     data->next = NULL;
     data->size = 0;
     data->allocatedSize = 0;
@@ -76,191 +185,762 @@ void iohm_free_content_only(IntObjHashMap* data) {
  * free all the data allocated by the IntObjHashMap
  */
 void iohm_free(IntObjHashMap* data) {
+    if (data == NULL) return;
     // free content of map
     iohm_free_content_only(data);
     // then free the data itself
-    free(data);
+    hash_release(data->allocator, data, sizeof(IntObjHashMap));
 }
 
 
 /**
- * create a new hash map
+ * create a new hash map for (at least) initialSize items
  */
 IntObjHashMap* iohm_create(int initialSize) {
+    return iohm_create_seeded(initialSize, 0);
+}
+
+
+/**
+ * create a new hash map for (at least) initialSize items, with inline values of valueSize bytes (0: pointers),
+ * whose struct and arrays all come from allocator (NULL: calloc / realloc / free, see hash_alloc.h) - the
+ * allocator must stay around until the map is freed
+ * @return the new map, or NULL if out of memory
+ */
+IntObjHashMap* iohm_create_with_allocator(int initialSize, uint32_t seed, int valueSize,
+                                          const HashAllocator* allocator) {
+    if (valueSize < 0) return NULL;
     // allocate the main structure
-    IntObjHashMap* data = (IntObjHashMap*) calloc(1, sizeof(IntObjHashMap));
+    IntObjHashMap* data = (IntObjHashMap*) hash_alloc(allocator, sizeof(IntObjHashMap));
     if (data == NULL) return NULL; // failed?
-    data->initialSize = initialSize;
-    data->allocatedSize = initialSize;
+    data->allocator = allocator;
+    // set the initial size, rounded up to a power of 2 so buckets can be found with a mask
+    data->initialSize = int_hash_capacity(initialSize);
+    data->seed = seed;
+    data->valueSize = valueSize;
     // allocate the key arrays
-    data->first = calloc(data->initialSize, sizeof(int));
-    data->keySet = calloc(data->initialSize, sizeof(int));
-    data->valueSet = calloc(data->initialSize, sizeof(void*));
-    data->next = calloc(data->initialSize, sizeof(int));
+    if (!iohm_allocate_arrays(data, data->initialSize)) {
+        iohm_free(data); // out of memory
+        return NULL;
+    }
     // set the map size to 0
     data->size = 0;
 
-    // clear all values inside the arrays as empty
+    // mark every bucket as empty
     for (int i = 0; i < data->initialSize; i++) {
-        data->first[i] = INT_OBJ_HASHMAP_EMPTY_KEY;
-        data->keySet[i] = INT_OBJ_HASHMAP_EMPTY_KEY;
-        data->valueSet[i] = NULL;
-        data->next[i] = INT_OBJ_HASHMAP_EMPTY_KEY;
+        data->first[i] = INT_OBJ_HASHMAP_NO_ENTRY;
+        data->next[i] = INT_OBJ_HASHMAP_NO_ENTRY;
     }
+    for (int i = 0; valueSize == 0 && i < data->initialSize; i++)
+        data->valueSet[i] = NULL;
     // done - return the new data structure
     return data;
 }
 
-// help insert a key/value into our map
-int iohm_insertHelper(int key, void* value, IntObjHashMap* data) {
+
+/**
+ * create a new hash map for (at least) initialSize items whose keys are hashed with seed,
+ * use a random seed for keys that come from outside so they can't be picked to collide
+ */
+IntObjHashMap* iohm_create_seeded(int initialSize, uint32_t seed) {
+    return iohm_create_with_allocator(initialSize, seed, 0, NULL);
+}
+
+
+/**
+ * create a new hash map for (at least) initialSize items that stores a copy of every value inline: valueSize
+ * bytes per slot in one arena next to the keys, instead of a pointer to an object allocated by the caller.
+ * iohm_add() copies valueSize bytes from its value pointer, iohm_get() returns the address of the copy -
+ * an address that moves on the next add / remove / clear, so copy the value out (or use it) before then
+ * (and don't add a value from such an address, the add can move it before it is copied).
+ * slot i starts at i * valueSize bytes, a valueSize of sizeof(some struct) keeps every copy aligned.
+ * @return the map, or NULL for a valueSize <= 0 or out of memory
+ */
+IntObjHashMap* iohm_create_inline(int initialSize, int valueSize) {
+    if (valueSize <= 0) return NULL;
+    return iohm_create_with_allocator(initialSize, 0, valueSize, NULL);
+}
+
+// help insert a key/value into our map (a key already in there keeps its value), *index receives the slot of the
+// key, return the new size/count of the map
+int iohm_insertHelper(int key, void* value, IntObjHashMap* data, int* index) {
     if (data == NULL) return 0; // can't insert
-    int firstIndex = abs(key % data->allocatedSize); // calculate the "key" offset
+    int firstIndex = iohm_bucket(data, key); // calculate the "key" offset
     int newSize = data->size;
+    int probes = 0;
 
     // simplest case - we don't have an entry yet
-    if (data->first[firstIndex] == INT_OBJ_HASHMAP_EMPTY_KEY) {
-        data->first[firstIndex] = data->size; // first points to the next empty data-slot
+    if (iohm_head(data, firstIndex) == INT_OBJ_HASHMAP_NO_ENTRY) {
+        iohm_set_head(data, firstIndex, data->size); // first points to the next empty data-slot
         // and the data goes into the slots
         data->keySet[data->size] = key;
-        data->valueSet[data->size] = value;
-        data->next[data->size] = INT_OBJ_HASHMAP_EMPTY_KEY;
+        iohm_set_value(data, data->size, value);
+        data->next[data->size] = INT_OBJ_HASHMAP_NO_ENTRY;
+        *index = data->size;
         newSize += 1;
 
     } else {
         // chain down the colliding items and find the next empty
-        int nextIndex = data->first[firstIndex];
-        while (data->next[nextIndex] != INT_OBJ_HASHMAP_EMPTY_KEY) {
+        int nextIndex = iohm_head(data, firstIndex);
+        while (data->next[nextIndex] != INT_OBJ_HASHMAP_NO_ENTRY) {
+            probes += 1;
             if (data->keySet[nextIndex] == key) { // already exists, not added
-                data->valueSet[nextIndex] = value;
+                *index = nextIndex;
+                hash_stats_probe(&data->counters, HASH_STATS_ADD, probes);
                 return data->size;
             }
             nextIndex = data->next[nextIndex];
         }
+        probes += 1;
         if (data->keySet[nextIndex] == key) { // no new data added, already exists
-            data->valueSet[nextIndex] = value;
+            *index = nextIndex;
+            hash_stats_probe(&data->counters, HASH_STATS_ADD, probes);
             return data->size;
         }
         // now prevNext points to the last slot that wasn't empty - chain it in
         data->next[nextIndex] = data->size;
         // and put in our data at the end
         data->keySet[data->size] = key;
-        data->valueSet[data->size] = value;
-        data->next[data->size] = INT_OBJ_HASHMAP_EMPTY_KEY;
+        iohm_set_value(data, data->size, value);
+        data->next[data->size] = INT_OBJ_HASHMAP_NO_ENTRY;
+        *index = data->size;
         newSize += 1;
     }
+    hash_stats_probe(&data->counters, HASH_STATS_ADD, probes);
     return newSize;
 }
 
-// grow the map by 50%
+/**
+ * re-size the map to newSize slots without re-inserting anything: the entries are already packed in
+ * 0..size-1, so their arrays are re-allocated where they are and first[] / next[] are re-built in one
+ * pass over them - at most one extra first[] array is needed on top of the map while this runs
+ */
+void iohm_resize(IntObjHashMap* data, int newSize) {
+    if (data == NULL) return; // empty map, can't grow
+    const HashAllocator* allocator = data->allocator;
+    size_t oldBytes = (size_t)data->allocatedSize * sizeof(int);
+    size_t newBytes = (size_t)newSize * sizeof(int);
+    size_t oldValueBytes = iohm_value_bytes(data, data->allocatedSize);
+    size_t newValueBytes = iohm_value_bytes(data, newSize);
+    int* first = hash_alloc(allocator, newBytes);
+    if (first == NULL) return; // out of memory, keep the current size
+    int* generations = NULL; // fast clear: the re-built buckets all start in generation 0
+    if (data->generations != NULL && (generations = hash_alloc(allocator, newBytes)) == NULL) {
+        hash_release(allocator, first, newBytes);
+        return;
+    }
+    // a failed resize leaves the array as it was, and only a grow can fail
+    int* keySet = hash_resize(allocator, data->keySet, oldBytes, newBytes);
+    if (keySet != NULL) data->keySet = keySet;
+    void* values = keySet == NULL ? NULL : hash_resize(allocator, iohm_values(data), oldValueBytes, newValueBytes);
+    if (values != NULL) iohm_set_values(data, values);
+    int* next = values == NULL ? NULL : hash_resize(allocator, data->next, oldBytes, newBytes);
+    if (next == NULL) { // out of memory - the arrays that did grow go back to the current size
+        if (values != NULL) iohm_set_values(data, hash_resize(allocator, values, newValueBytes, oldValueBytes));
+        if (keySet != NULL) data->keySet = hash_resize(allocator, keySet, newBytes, oldBytes);
+        hash_release(allocator, first, newBytes);
+        hash_release(allocator, generations, newBytes);
+        return;
+    }
+    data->next = next;
+    hash_release(allocator, data->first, oldBytes);
+    data->first = first;
+    if (generations != NULL) {
+        hash_release(allocator, data->generations, oldBytes);
+        data->generations = generations;
+        data->generation = 0;
+    }
+    data->allocatedSize = newSize;
+    // chain every entry in at the front of its new bucket
+    bulk_rehash(first, data->next, data->keySet, data->size, newSize, data->seed, 1, iohm_threads(data, newSize));
+}
+
+
+// number of new first[] buckets set up during an incremental resize for every chain we'd migrate
+#define IOHM_INIT_PER_CHAIN 16
+
+
+/**
+ * allocate the arrays of an empty table for an incremental resize, its first[] array is set to
+ * empty a bit at a time by iohm_resize_step() so no single call has to touch all of it
+ */
+IntObjHashMap* iohm_allocate_table(int newSize, uint32_t seed, int valueSize, const HashAllocator* allocator) {
+    IntObjHashMap* table = (IntObjHashMap*) hash_alloc(allocator, sizeof(IntObjHashMap));
+    if (table == NULL) return NULL; // failed?
+    table->allocator = allocator;
+    table->valueSize = valueSize;
+    table->initialSize = newSize;
+    table->seed = seed;
+    if (!iohm_allocate_arrays(table, newSize)) {
+        iohm_free(table); // out of memory
+        return NULL;
+    }
+    return table;
+}
+
+
+// start an incremental resize to newSize slots - the map keeps working while it is migrated
+void iohm_resize_start(IntObjHashMap* data, int newSize) {
+    IntObjHashMap* table = iohm_allocate_table(newSize, data->seed, data->valueSize, data->allocator);
+    if (table == NULL) return; // out of memory, keep using the current table
+    data->resizeTo = table;
+    data->resizeInitialized = 0;
+    data->resizeMigrated = 0;
+}
+
+
+// is an incremental resize migrating chains (the new table is set up and in use)?
+static inline int iohm_migrating(IntObjHashMap* data) {
+    return data->resizeTo != NULL && data->resizeInitialized == data->resizeTo->allocatedSize;
+}
+
+
+// the new table replaces the old one at the end of an incremental resize
+void iohm_resize_finish(IntObjHashMap* data) {
+    IntObjHashMap* table = data->resizeTo;
+    int initialSize = data->initialSize;
+    data->resizeTo = NULL;
+    iohm_free_content_only(data); // de-allocate the now empty old table
+    data->first = table->first;
+    data->next = table->next;
+    data->keySet = table->keySet;
+    data->valueSet = table->valueSet;
+    data->valueArena = table->valueArena;
+    data->size = table->size;
+    data->initialSize = initialSize; // keep the size clear() shrinks back to
+    data->allocatedSize = table->allocatedSize;
+    hash_stats_merge(&data->counters, &table->counters); // the adds into the new table
+    hash_release(data->allocator, table, sizeof(IntObjHashMap)); // de-allocate temporary helper data
+}
+
+
+/**
+ * do a bounded amount of incremental resize work: set up the next part of the new table's first[] array,
+ * or once that is done move the next "chains" chains of the old table into the new one
+ */
+void iohm_resize_step(IntObjHashMap* data, int chains) {
+    IntObjHashMap* table = data->resizeTo;
+    if (data->resizeInitialized < table->allocatedSize) {
+        long end = data->resizeInitialized + (long)chains * IOHM_INIT_PER_CHAIN;
+        if (end > table->allocatedSize) end = table->allocatedSize;
+        for (int i = data->resizeInitialized; i < end; i++)
+            table->first[i] = INT_OBJ_HASHMAP_NO_ENTRY;
+        data->resizeInitialized = (int)end;
+        return;
+    }
+    long end = data->resizeMigrated + (long)chains;
+    if (end > data->allocatedSize) end = data->allocatedSize;
+    for (int i = data->resizeMigrated; i < end; i++) {
+        // move every entry of the chain into the new table, its keys can't be in there yet
+        // so they go straight to the front of their new chains
+        int nextIndex = data->first[i];
+        while (nextIndex != INT_OBJ_HASHMAP_NO_ENTRY) {
+            int firstIndex = iohm_bucket(table, data->keySet[nextIndex]);
+            table->keySet[table->size] = data->keySet[nextIndex];
+            iohm_set_value(table, table->size, iohm_value(data, nextIndex));
+            table->next[table->size] = table->first[firstIndex];
+            table->first[firstIndex] = table->size;
+            table->size += 1;
+            nextIndex = data->next[nextIndex];
+        }
+        data->first[i] = INT_OBJ_HASHMAP_NO_ENTRY; // the chain is gone from the old table
+    }
+    data->resizeMigrated = (int)end;
+    if (data->resizeMigrated == data->allocatedSize)
+        iohm_resize_finish(data);
+}
+
+
+/**
+ * make sure the new table of an incremental resize can take every entry of the map and one more before it is
+ * finished in one go: adds while a shrink migrates go into the smaller table and can outgrow it.  a new table
+ * that isn't in use yet is dropped (the old one still holds everything), one that is grows - re-chaining the
+ * entries it has and setting up all of its first[] - or stays as it is if there's no memory for that
+ */
+static void iohm_resize_fit(IntObjHashMap* data) {
+    IntObjHashMap* table = data->resizeTo;
+    if (data->size + 1 < table->allocatedSize)
+        return; // fits
+    if (!iohm_migrating(data)) {
+        iohm_free(table);
+        data->resizeTo = NULL;
+        return;
+    }
+    int newSize = table->allocatedSize;
+    while (data->size + 1 >= newSize && newSize < INT_HASH_MAX_CAPACITY)
+        newSize *= 2;
+    iohm_resize(table, newSize);
+    data->resizeInitialized = table->allocatedSize;
+}
+
+
+// finish an incremental resize in one go (one that can't take every entry is left as it is)
+void iohm_resize_complete(IntObjHashMap* data) {
+    if (data->resizeTo == NULL)
+        return;
+    iohm_resize_fit(data);
+    if (data->resizeTo != NULL && data->size >= data->resizeTo->allocatedSize)
+        return; // out of memory: there's no room to move the rest into
+    while (data->resizeTo != NULL)
+        iohm_resize_step(data, data->allocatedSize);
+}
+
+
+// grow the map to twice its size
 void iohm_grow(IntObjHashMap* data) {
     if (data == NULL) return; // empty map, can't grow
     int oldSize = data->allocatedSize;
-    int growSize = ((oldSize * 3) / 2) + 1; // 50% growth
-
-    IntObjHashMap* newData = iohm_create(growSize);
-    if (newData == NULL) return;
-
-    // copy existing data into the new array
-    for (int i = 0; i < data->allocatedSize; i++) {
-        int oldFirst = data->first[i];
-        int oldNextIndex = oldFirst;
-        while (oldNextIndex != INT_OBJ_HASHMAP_EMPTY_KEY) {
-            int key = data->keySet[oldNextIndex];
-            void* value = data->valueSet[oldNextIndex];
-            newData->size = iohm_insertHelper(key, value, newData);
-            oldNextIndex = data->next[oldNextIndex];
-        }
+    if (oldSize >= INT_HASH_MAX_CAPACITY) return; // as big as a table gets
+    uint64_t start = hash_stats_clock();
+    if (data->resizeStep > 0)
+        iohm_resize_start(data, oldSize * 2); // double, a bit at a time
+    else
+        iohm_resize(data, oldSize * 2); // double
+    hash_stats_grow(&data->counters, start);
+}
 
-    } // for each existing entry
 
-    // transfer the newly mapped data
-    iohm_free_content_only(data);
-    // copy newData into data, as this is what is being replaced / grown
-    data->first = newData->first;
-    data->next = newData->next;
-    data->keySet = newData->keySet;
-    data->valueSet = newData->valueSet;
-    data->size = newData->size;
-    data->initialSize = newData->initialSize;
-    data->allocatedSize = newData->allocatedSize;
-    free(newData); // de-allocate temporary helper data
+// shrink the map to half its size if it has become mostly empty (less than a quarter used)
+void iohm_shrink(IntObjHashMap* data) {
+    if (data->size >= data->allocatedSize / 4 || data->allocatedSize <= data->initialSize)
+        return; // still well used, or already at its smallest
+    int shrinkSize = data->allocatedSize / 2;
+    if (shrinkSize < data->initialSize)
+        shrinkSize = data->initialSize;
+    if (data->resizeStep > 0)
+        iohm_resize_start(data, shrinkSize);
+    else
+        iohm_resize(data, shrinkSize);
 }
 
 
 /**
- * add a key / value
- * @return true if a new item was added, false if the item already existed
+ * turn incremental resizing on (chainsPerStep > 0) or off (0)
+ * when on, a grow or shrink no longer re-maps the whole map inside one add/remove: the old and new tables
+ * coexist and every add/contains/remove migrates chainsPerStep chains until the old table is empty
  */
-int iohm_add(IntObjHashMap* data, int key, void* value) {
-    // we can never insert an "empty key" value - or into a NULL data array
-    if (key == INT_OBJ_HASHMAP_EMPTY_KEY || data == NULL)
-        return 0;
+void iohm_set_incremental_resize(IntObjHashMap* data, int chainsPerStep) {
+    if (data == NULL || data->generations != NULL) return; // not together with fast clear
+    data->resizeStep = chainsPerStep > 0 ? chainsPerStep : 0;
+    if (data->resizeStep == 0 && data->resizeTo != NULL)
+        iohm_resize_complete(data); // turned off during a resize
+}
+
+
+// fast clear: reset the buckets of older generations to empty, first[] is then valid without generations[]
+static void iohm_flush_generations(IntObjHashMap* data) {
+    for (int i = 0; i < data->allocatedSize; i++)
+        if (data->generations[i] != data->generation)
+            data->first[i] = INT_OBJ_HASHMAP_NO_ENTRY;
+}
+
+
+/**
+ * turn fast clear on (on != 0) or off (0)
+ * when on, every first[] bucket carries the generation it was last written in and iohm_clear() only starts a new
+ * generation: the buckets of older ones count as empty, so a clear costs the same for any table size and keeps
+ * the table at its current size.  incremental resizing is turned off (a resize in progress is finished first)
+ */
+void iohm_set_fast_clear(IntObjHashMap* data, int on) {
+    if (data == NULL) return;
+    size_t bytes = (size_t)data->allocatedSize * sizeof(int);
+    if (!on) {
+        if (data->generations == NULL) return;
+        iohm_flush_generations(data);
+        hash_release(data->allocator, data->generations, bytes);
+        data->generations = NULL;
+        return;
+    }
+    if (data->generations != NULL) return;
+    if (data->resizeTo != NULL)
+        iohm_resize_complete(data);
+    data->resizeStep = 0;
+    data->generations = hash_alloc(data->allocator, bytes); // zeroed: every bucket is in the current generation
+    data->generation = 0;
+}
+
+
+/**
+ * spread the work of re-chaining a table on resize and of clearing it over nthreads threads, for tables of at
+ * least minSize slots (<= 0: BULK_PARALLEL_MIN_SIZE) - smaller tables are cheaper to do on the calling thread
+ */
+void iohm_set_parallel_resize(IntObjHashMap* data, int nthreads, int minSize) {
+    if (data == NULL) return;
+    data->parallelThreads = nthreads > 1 ? nthreads : 0;
+    data->parallelMinSize = minSize > 0 ? minSize : BULK_PARALLEL_MIN_SIZE;
+}
+
+
+/**
+ * find the slot of key in the chains of data
+ * @return the index of the key's slot, or INT_OBJ_HASHMAP_NO_ENTRY if not found
+ */
+int iohm_find(IntObjHashMap* data, int key) {
+    int firstIndex = iohm_bucket(data, key); // starting location
+    int nextIndex = iohm_head(data, firstIndex);
+    int probes = 0;
+    while (nextIndex != INT_OBJ_HASHMAP_NO_ENTRY) {
+        probes += 1;
+        if (data->keySet[nextIndex] == key)
+            break; // found it!
+        nextIndex = data->next[nextIndex];
+    }
+    hash_stats_probe(&data->counters, HASH_STATS_CONTAINS, probes);
+    return nextIndex; // INT_OBJ_HASHMAP_NO_ENTRY if not found
+}
+
+
+/**
+ * find the slot of key with a single walk down its chain, a key that isn't in the map yet is added with value
+ * @param table set to the table the key is in (the new one of an incremental resize, or data)
+ * @param added set to 1 if the key was added, 0 if it was in the map already (its value is left alone)
+ * @return the index of the key in *table, INT_OBJ_HASHMAP_NO_ENTRY if it couldn't be added (the map is full)
+ */
+static int iohm_upsert(IntObjHashMap* data, int key, void* value, IntObjHashMap** table, int* added) {
+    int index;
+    *added = 0;
+    if (data->resizeTo != NULL) { // incremental resize in progress
+        iohm_resize_step(data, data->resizeStep);
+        if (iohm_migrating(data)) {
+            // keys live in either table: use its slot in the old one, otherwise it goes into the new one
+            index = iohm_find(data, key);
+            if (index != INT_OBJ_HASHMAP_NO_ENTRY) {
+                *table = data;
+                *added = 0;
+                return index;
+            }
+            IntObjHashMap* resizeTo = data->resizeTo;
+            if (data->size + 1 < resizeTo->allocatedSize) { // room for the entries of both tables
+                int oldSize = resizeTo->size;
+                resizeTo->size = iohm_insertHelper(key, value, resizeTo, &index);
+                data->size += resizeTo->size - oldSize;
+                *table = resizeTo;
+                *added = resizeTo->size > oldSize;
+                return index;
+            }
+            iohm_resize_complete(data); // the new table filled up (or a shrink outgrew it) early, finish it now
+            if (data->resizeTo != NULL) { // it can't hold all of the entries and there's no memory to grow it
+                *table = data;
+                return INT_OBJ_HASHMAP_NO_ENTRY;
+            }
+        } else if (data->size + 1 >= data->allocatedSize) {
+            iohm_resize_complete(data); // the old table filled up while the new one was being set up
+        }
+    }
 
     // do we need to grow our arrays and remap all existing data?
-    if (data->size + 1 >= data->allocatedSize) {
+    // with incremental resizing we start early, so the old table still has room while the new one is set up
+    int growAt = data->resizeStep > 0 ? data->allocatedSize - data->allocatedSize / 8 : data->allocatedSize;
+    if (data->size + 1 >= growAt && data->resizeTo == NULL) {
         iohm_grow(data);
+        if (data->size + 1 >= data->allocatedSize) { // still no room left in this table
+            if (data->resizeTo != NULL)
+                iohm_resize_complete(data); // too small to resize a bit at a time
+            else if (data->allocatedSize < INT_HASH_MAX_CAPACITY)
+                iohm_resize(data, data->allocatedSize * 2); // couldn't start an incremental resize
+        }
+        // the resize above can have failed as well
+        if (data->size + 1 >= data->allocatedSize) { // full and can't grow (out of memory, or at INT_HASH_MAX_CAPACITY)
+            *table = data;
+            return iohm_find(data, key); // only a key that is in there already has a slot
+        }
     }
 
     // get an index into the first array
     int oldSize = data->size;
-    data->size = iohm_insertHelper(key, value, data);
-    return data->size > oldSize;
+    data->size = iohm_insertHelper(key, value, data, &index);
+    *table = data;
+    *added = data->size > oldSize;
+    return index;
+}
+
+
+/**
+ * add a key / value
+ * @return true if a new item was added, false if the item already existed (or the map is full and out of memory)
+ */
+int iohm_add(IntObjHashMap* data, int key, void* value) {
+    // we can never insert into a NULL data array
+    if (data == NULL)
+        return 0;
+    IntObjHashMap* table;
+    int added;
+    int index = iohm_upsert(data, key, value, &table, &added);
+    if (index != INT_OBJ_HASHMAP_NO_ENTRY && !added)
+        iohm_set_value(table, index, value); // already exists, update its value
+    return added;
+}
+
+
+/**
+ * get the value slot of key, adding the key with value first if it isn't in the map yet - with a single lookup
+ * @return the address of the object pointer (a void**, so the object of a new key can be set through it), or of
+ *         the inline copy of an iohm_create_inline() map.  it is valid until the next add / remove / clear of the
+ *         map (those can move the values), NULL for a NULL map or if the key couldn't be added (out of memory)
+ */
+void* iohm_get_or_insert(IntObjHashMap* data, int key, void* value) {
+    if (data == NULL)
+        return NULL;
+    IntObjHashMap* table;
+    int added;
+    int index = iohm_upsert(data, key, value, &table, &added);
+    return index != INT_OBJ_HASHMAP_NO_ENTRY ? iohm_value_slot(table, index) : NULL;
 }
 
 
 /**
  * is key inside the map (does it exist)
+ * @return 0 if not found, otherwise 1
  */
 int iohm_contains(IntObjHashMap* data, int key) {
-    // we can never insert an "empty key" value - or into a NULL data array
-    if (key == INT_OBJ_HASHMAP_EMPTY_KEY || data == NULL) return 0;
-    int firstIndex = abs(key % data->allocatedSize); // start location
-    int nextIndex = data->first[firstIndex]; // the data at that location
-    if (nextIndex == INT_OBJ_HASHMAP_EMPTY_KEY) // no data
-        return 0; // nothing to remove
-    while (data->next[nextIndex] != INT_OBJ_HASHMAP_EMPTY_KEY) {
-        if (data->keySet[nextIndex] == key)
-            return 1; // found it!
-        nextIndex = data->next[nextIndex];
+    // we can never find data inside a NULL data array
+    if (data == NULL)
+        return 0;
+    if (data->resizeTo != NULL) { // incremental resize in progress
+        iohm_resize_step(data, data->resizeStep);
+        if (iohm_migrating(data) && iohm_find(data->resizeTo, key) != INT_OBJ_HASHMAP_NO_ENTRY)
+            return 1; // found it in the new table
     }
-    // found that key?
-    return (data->keySet[nextIndex] == key);
+    return iohm_find(data, key) != INT_OBJ_HASHMAP_NO_ENTRY;
 }
 
 
 /**
- * remove a key from the map (delete)
- * @return 1 if an item was removed, 0 otherwise
+ * move the last entry into the free slot "to" so the entries stay densely packed in 0..size-1,
+ * the link (first[] or next[]) that pointed at the last entry is updated to point at its new slot
  */
-int iohm_remove(IntObjHashMap* data, int key) {
-    // can't remove something from a NULL data structure, or an empty key
-    if (data == NULL || key == INT_INT_HASHMAP_EMPTY_KEY) return 0;
-    int firstIndex = abs(key % data->allocatedSize); // start location
-    int nextIndex = data->first[firstIndex]; // data at location
-    if (nextIndex == INT_OBJ_HASHMAP_EMPTY_KEY) // no data
-        return 0; // nothing to remove
-    int prevIndex = nextIndex;
-    while (data->next[nextIndex] != INT_OBJ_HASHMAP_EMPTY_KEY) {
+void iohm_move_last(IntObjHashMap* data, int to) {
+    int last = data->size - 1;
+    if (to != last) {
+        int firstIndex = iohm_bucket(data, data->keySet[last]); // where the last entry is chained from
+        if (iohm_head(data, firstIndex) == last) {
+            iohm_set_head(data, firstIndex, to); // it is the first item of its chain
+        } else {
+            int prevIndex = iohm_head(data, firstIndex);
+            while (data->next[prevIndex] != last) // find the item before it
+                prevIndex = data->next[prevIndex];
+            data->next[prevIndex] = to;
+        }
+        // copy the data across
+        data->keySet[to] = data->keySet[last];
+        iohm_set_value(data, to, iohm_value(data, last));
+        data->next[to] = data->next[last];
+    }
+    // the last slot is now free
+    if (data->valueSize == 0)
+        data->valueSet[last] = NULL;
+    data->next[last] = INT_OBJ_HASHMAP_NO_ENTRY;
+    data->size -= 1; // decrease size of map
+}
+
+
+/**
+ * unlink key from its chain (the slot itself isn't freed)
+ * @return the index of the unlinked slot, or INT_OBJ_HASHMAP_NO_ENTRY if the key wasn't found
+ */
+int iohm_unlink(IntObjHashMap* data, int key) {
+    int firstIndex = iohm_bucket(data, key); // start location
+    int nextIndex = iohm_head(data, firstIndex); // data at location
+    int prevIndex = INT_OBJ_HASHMAP_NO_ENTRY;
+    int probes = 0;
+    while (nextIndex != INT_OBJ_HASHMAP_NO_ENTRY) {
+        probes += 1;
         if (data->keySet[nextIndex] == key)
             break; // found it!
         prevIndex = nextIndex;
-        nextIndex = data->next[nextIndex];
+        nextIndex = data->next[nextIndex]; // cycle through
     }
+    hash_stats_probe(&data->counters, HASH_STATS_REMOVE, probes);
     // found?
-    if (data->keySet[nextIndex] == key) {
-        // first update?
-        if (nextIndex == data->first[firstIndex]) {
-            data->first[firstIndex] = data->next[nextIndex]; // unchain first item
-            // does it remove the item completely?
-            if (data->next[nextIndex] == INT_OBJ_HASHMAP_EMPTY_KEY) {
-                data->keySet[nextIndex] = INT_OBJ_HASHMAP_EMPTY_KEY;
-                data->valueSet[nextIndex] = NULL;
-            }
+    if (nextIndex != INT_OBJ_HASHMAP_NO_ENTRY) {
+        if (prevIndex == INT_OBJ_HASHMAP_NO_ENTRY) {
+            iohm_set_head(data, firstIndex, data->next[nextIndex]); // unchain first item
         } else {
             data->next[prevIndex] = data->next[nextIndex]; // skip one in the chain
         }
-        data->size -= 1; // decrease size of map
-        return 1; // success
     }
-    return 0; // not found
+    return nextIndex;
+}
+
+
+/**
+ * remove a key from the map (delete)
+ * @return 1 if an item was removed, 0 otherwise
+ */
+int iohm_remove(IntObjHashMap* data, int key) {
+    // can't remove something from a NULL data structure
+    if (data == NULL) return 0;
+
+    if (data->resizeTo != NULL) { // incremental resize in progress
+        iohm_resize_step(data, data->resizeStep);
+        if (iohm_migrating(data)) {
+            // the old table is being emptied, just unlink its slot - otherwise remove it from the new table
+            if (iohm_unlink(data, key) == INT_OBJ_HASHMAP_NO_ENTRY) {
+                IntObjHashMap* table = data->resizeTo;
+                int index = iohm_unlink(table, key);
+                if (index == INT_OBJ_HASHMAP_NO_ENTRY)
+                    return 0; // not found
+                iohm_move_last(table, index);
+            }
+            data->size -= 1;
+            return 1;
+        }
+    }
+
+    int index = iohm_unlink(data, key);
+    if (index == INT_OBJ_HASHMAP_NO_ENTRY)
+        return 0; // not found
+    // re-use the slot by moving the last entry into it, then give memory back if we're mostly empty
+    iohm_move_last(data, index);
+    if (data->resizeTo == NULL)
+        iohm_shrink(data);
+    return 1; // done!
+}
+
+
+/**
+ * get the value for the associated key
+ * @return the object for key, or NULL if the key isn't in the map
+ */
+void* iohm_get(IntObjHashMap* data, int key) {
+    // we can never find data inside a NULL data array
+    if (data == NULL) return NULL;
+    if (data->resizeTo != NULL) { // incremental resize in progress
+        iohm_resize_step(data, data->resizeStep);
+        if (iohm_migrating(data)) {
+            int index = iohm_find(data->resizeTo, key);
+            if (index != INT_OBJ_HASHMAP_NO_ENTRY)
+                return iohm_value(data->resizeTo, index); // found it in the new table
+        }
+    }
+    int index = iohm_find(data, key);
+    return index != INT_OBJ_HASHMAP_NO_ENTRY ? iohm_value(data, index) : NULL;
+}
+
+
+/**
+ * look up n keys at once, INT_HASH_BATCH at a time and in stages so their cache misses overlap:
+ * hash every key and prefetch its first[] bucket, then read the buckets and prefetch the chain entries
+ * they point at, then walk the chains
+ * @param outValues receives the value of every key (NULL if not found)
+ * @return the number of keys found
+ */
+int iohm_get_many(IntObjHashMap* data, const int* keys, int n, void** outValues) {
+    if (data == NULL || keys == NULL || outValues == NULL || n <= 0) return 0;
+    int found = 0;
+    int start = 0;
+    // keys live in either table during an incremental resize, look those up one at a time
+    for (; start < n && data->resizeTo != NULL; start++) {
+        outValues[start] = iohm_get(data, keys[start]);
+        found += outValues[start] != NULL;
+    }
+    int buckets[INT_HASH_BATCH];
+    for (; start < n; start += INT_HASH_BATCH) {
+        int count = n - start < INT_HASH_BATCH ? n - start : INT_HASH_BATCH;
+        for (int i = 0; i < count; i++) { // stage 1: hash, prefetch the buckets
+            buckets[i] = iohm_bucket(data, keys[start + i]);
+            INT_HASH_PREFETCH(data->first + buckets[i]);
+        }
+        for (int i = 0; i < count; i++) { // stage 2: read the buckets, prefetch the first entry of each chain
+            buckets[i] = iohm_head(data, buckets[i]);
+            if (buckets[i] != INT_OBJ_HASHMAP_NO_ENTRY) {
+                INT_HASH_PREFETCH(data->keySet + buckets[i]);
+                INT_HASH_PREFETCH(iohm_value(data, buckets[i]));
+            }
+        }
+        for (int i = 0; i < count; i++) { // stage 3: walk the chains
+            int key = keys[start + i];
+            int nextIndex = buckets[i];
+            int probes = nextIndex != INT_OBJ_HASHMAP_NO_ENTRY;
+            while (nextIndex != INT_OBJ_HASHMAP_NO_ENTRY && data->keySet[nextIndex] != key) {
+                nextIndex = data->next[nextIndex];
+                probes += nextIndex != INT_OBJ_HASHMAP_NO_ENTRY;
+            }
+            hash_stats_probe(&data->counters, HASH_STATS_CONTAINS, probes);
+            outValues[start + i] = nextIndex != INT_OBJ_HASHMAP_NO_ENTRY ? iohm_value(data, nextIndex) : NULL;
+            found += outValues[start + i] != NULL;
+        }
+    }
+    return found;
+}
+
+
+/**
+ * get the next key/value of the map: start with *cursor = 0 and call it until it returns 0, the entries are
+ * read in the order they sit in memory (not in any key order).  the map must not be changed in between,
+ * an incremental resize in progress is finished by the first call
+ * @return 1 if *key / *value were set (value as iohm_get() returns it), 0 once every entry has been returned
+ */
+int iohm_next(IntObjHashMap* data, int* cursor, int* key, void** value) {
+    if (data == NULL) return 0;
+    if (data->resizeTo != NULL)
+        iohm_resize_complete(data); // the entries of both tables would overlap
+    if (*cursor >= data->size) return 0;
+    int i = (*cursor)++;
+    *key = data->keySet[i];
+    *value = iohm_value(data, i);
+    return 1;
+}
+
+
+/**
+ * call fn(key, value, context, 0) for every key/value of the map, walking its entry arrays front to back
+ * (an incremental resize in progress is finished first) - fn must not change the map
+ */
+void iohm_for_each(IntObjHashMap* data, IntObjVisitor fn, void* context) {
+    int cursor = 0, key;
+    void* value;
+    while (iohm_next(data, &cursor, &key, &value))
+        fn(key, value, context, 0);
+}
+
+
+// the state shared by the threads of iohm_for_each_parallel()
+typedef struct {
+    IntObjHashMap* data;
+    IntObjVisitor fn;
+    void* context;
+    int nthreads;
+} IOHMForEachWork;
+
+
+// visit thread t's chunk of the entries
+static void iohm_for_each_chunk(void* arg, int t) {
+    IOHMForEachWork* work = (IOHMForEachWork*)arg;
+    IntObjHashMap* data = work->data;
+    int from = (int)((long)data->size * t / work->nthreads);
+    int to = (int)((long)data->size * (t + 1) / work->nthreads);
+    for (int i = from; i < to; i++)
+        work->fn(data->keySet[i], iohm_value(data, i), work->context, t);
+}
+
+
+/**
+ * call fn(key, value, context, thread) for every key/value of the map with nthreads threads, every thread
+ * walks its own contiguous chunk of the entries (see iihm_for_each_parallel())
+ */
+void iohm_for_each_parallel(IntObjHashMap* data, int nthreads, IntObjVisitor fn, void* context) {
+    if (data == NULL) return;
+    if (data->resizeTo != NULL)
+        iohm_resize_complete(data);
+    IOHMForEachWork work = {data, fn, context, nthreads > 1 ? nthreads : 1};
+    bulk_run(work.nthreads, iohm_for_each_chunk, &work);
+}
+
+
+/**
+ * fill in out with the statistics of the map: the length of every chain, its load and the bytes of its struct and
+ * arrays, and the counters of its adds / contains / removes and grows if the library was compiled with HASH_STATS
+ * (see hash_stats.h) - an incremental resize in progress is finished first
+ */
+void iohm_stats(IntObjHashMap* data, HashStats* out) {
+    if (data == NULL || out == NULL) return;
+    if (data->resizeTo != NULL)
+        iohm_resize_complete(data);
+    // first[], keySet[], next[], the generations of fast clear and the values
+    size_t memory = (size_t)data->allocatedSize * (data->generations != NULL ? 4 : 3) * sizeof(int) +
+                    iohm_value_bytes(data, data->allocatedSize);
+    hash_stats_begin(out, &data->counters, data->size, data->allocatedSize, sizeof(IntObjHashMap) + memory);
+    hash_stats_chains(out, data->first, data->next, 1, data->allocatedSize, data->generations, data->generation);
+    hash_stats_end(out);
 }
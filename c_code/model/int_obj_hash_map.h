@@ -5,16 +5,24 @@
 #ifndef C_CODE_INT_OBJ_HASH_MAP_H
 #define C_CODE_INT_OBJ_HASH_MAP_H
 
-// this is the only value that can't be used in the map of the entire INT range
-#define INT_OBJ_HASHMAP_EMPTY_KEY (-1)
+#include <stdint.h>
+#include "hash_alloc.h"
+#include "hash_stats.h"
+
+// marks an empty bucket in first[] and the end of a chain in next[], every int can be used as a key
+#define INT_OBJ_HASHMAP_NO_ENTRY (-1)
 
 struct STRUCT_IntObjHashMap {
     // a list of first indexes
     int* first;
     // an array keys
     int* keySet;
-    // an array of objects
+    // an array of objects (NULL for maps with inline values)
     void** valueSet;
+    // maps with inline values (iohm_create_inline()): the bytes of every value, valueSize bytes per slot
+    char* valueArena;
+    // maps with inline values: the size of a value in bytes, 0 for maps of pointers
+    int valueSize;
     // an array of next offsets for collisions
     int* next;
     // how big the arrays are right now
@@ -23,14 +31,51 @@ struct STRUCT_IntObjHashMap {
     int initialSize;
     // how much data we have and where the offset is for the next entry
     int size;
+    // mixed into the hash of every key (see int_hash.h)
+    uint32_t seed;
+    // where the struct and its arrays come from, NULL: calloc / realloc / free (see hash_alloc.h)
+    const HashAllocator* allocator;
+    // incremental resizing: 0 re-maps the whole map inside the add/remove that grows or shrinks it,
+    // otherwise the number of chains every add/contains/get/remove migrates while a resize is in progress
+    int resizeStep;
+    // incremental resizing: the table being filled while a resize is in progress, NULL otherwise
+    struct STRUCT_IntObjHashMap* resizeTo;
+    // incremental resizing: how many first[] buckets of resizeTo have been set up
+    int resizeInitialized;
+    // incremental resizing: how many chains of this table have been migrated to resizeTo
+    int resizeMigrated;
+    // parallel resizing: number of threads that re-chain or clear a table of at least parallelMinSize slots,
+    // 0 or 1 does all of it on the calling thread
+    int parallelThreads;
+    int parallelMinSize;
+    // fast clear: the generation every first[] bucket was last written in, NULL when off
+    int* generations;
+    // fast clear: the current generation, buckets of any other generation are empty
+    int generation;
+    // the hot path counters of iohm_stats(), only kept in HASH_STATS builds (see hash_stats.h)
+    HashCounters counters;
 };
 
 // define a nice name for the data structure
 typedef struct STRUCT_IntObjHashMap IntObjHashMap;
 
+// called for every key/value by the iterating fns., thread is the number of the calling thread (0 .. nthreads - 1)
+typedef void (*IntObjVisitor)(int key, void* value, void* context, int thread);
+
 // create a new int -> obj hash map
 IntObjHashMap* iohm_create(int initialSize);
 
+// create a new int -> obj hash map that hashes its keys with seed (use a random seed for untrusted keys)
+IntObjHashMap* iohm_create_seeded(int initialSize, uint32_t seed);
+
+// create a new int -> obj hash map that keeps a copy of every value (valueSize bytes) inline, iohm_get() returns
+// a pointer to the copy that stays valid until the next add/remove/clear
+IntObjHashMap* iohm_create_inline(int initialSize, int valueSize);
+
+// create a new int -> obj hash map (valueSize 0: pointers, otherwise inline values) whose memory comes from allocator
+IntObjHashMap* iohm_create_with_allocator(int initialSize, uint32_t seed, int valueSize,
+                                          const HashAllocator* allocator);
+
 // clear the hash map (reset to size if need be and initialize to 0 items)
 void iohm_clear(IntObjHashMap* data);
 
@@ -38,6 +83,7 @@ void iohm_clear(IntObjHashMap* data);
 void iohm_free(IntObjHashMap* data);
 
 // add a key/value to the hash map and return 1 if the key wasn't in there already
+// (inline values: valueSize bytes are copied from value, NULL stores zeros)
 int iohm_add(IntObjHashMap* data, int key, void* value);
 
 // does the map contain the key?
@@ -46,7 +92,35 @@ int iohm_contains(IntObjHashMap* data, int key);
 // get the value for the associated key
 void* iohm_get(IntObjHashMap* data, int key);
 
+// get the value slot of key, adding the key with value first if it isn't in the map (a single lookup): a void** to
+// the object, or the inline copy.  it is valid until the next add / remove / clear
+void* iohm_get_or_insert(IntObjHashMap* data, int key, void* value);
+
+// get the values of n keys at once (prefetch pipelined) into outValues, NULL for keys not found
+int iohm_get_many(IntObjHashMap* data, const int* keys, int n, void** outValues);
+
 // remove a key from the hash map, returns true if removed
 int iohm_remove(IntObjHashMap* data, int key);
 
+// get the next key/value (start with *cursor = 0), returns 0 once every entry has been returned
+int iohm_next(IntObjHashMap* data, int* cursor, int* key, void** value);
+
+// call fn for every key/value of the map in memory order
+void iohm_for_each(IntObjHashMap* data, IntObjVisitor fn, void* context);
+
+// call fn for every key/value of the map with nthreads threads, each walking its own chunk of the entries
+void iohm_for_each_parallel(IntObjHashMap* data, int nthreads, IntObjVisitor fn, void* context);
+
+// turn incremental resizing on (chainsPerStep > 0: chains migrated per operation) or off (0)
+void iohm_set_incremental_resize(IntObjHashMap* data, int chainsPerStep);
+
+// turn fast clear on (1: iohm_clear() is O(1) and keeps the table size) or off (0)
+void iohm_set_fast_clear(IntObjHashMap* data, int on);
+
+// use nthreads threads to re-chain or clear a table of at least minSize slots (<= 0: the default size)
+void iohm_set_parallel_resize(IntObjHashMap* data, int nthreads, int minSize);
+
+// fill in out with the statistics of the map: its chains, load and memory (and its counters, see hash_stats.h)
+void iohm_stats(IntObjHashMap* data, HashStats* out);
+
 #endif //C_CODE_INT_OBJ_HASH_MAP_H
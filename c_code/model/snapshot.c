@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2024 by Rock de Vocht
+ *
+ * All rights reserved. No part of this publication may be reproduced, distributed, or
+ * transmitted in any form or by any means, including photocopying, recording, or other
+ * electronic or mechanical methods, without the prior written permission of the publisher,
+ * except in the case of brief quotations embodied in critical reviews and certain other
+ * noncommercial uses permitted by copyright law.
+ *
+ */
+
+/**
+ * reading and writing snapshot files (see snapshot.h)
+ *
+ * a snapshot is written to "path.tmp" and renamed over path once complete, so a crash while saving
+ * leaves the previous snapshot in place.
+ *
+ */
+
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "snapshot.h"
+
+
+// arrays start on a multiple of this
+#define SNAPSHOT_ALIGNMENT 64
+
+
+// fn. to continue the checksum h over len bytes (8 at a time, murmur3 style mixing)
+static uint64_t snapshot_checksum(uint64_t h, const void* data, size_t len) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t k;
+        memcpy(&k, bytes + i, 8);
+        k *= 0x87C37B91114253D5ULL;
+        k = (k << 31) | (k >> 33);
+        k *= 0x4CF5AD432745937FULL;
+        h ^= k;
+        h = ((h << 27) | (h >> 37)) * 5 + 0x52DCE729;
+    }
+    for (; i < len; i++) // the last few bytes
+        h = (h ^ bytes[i]) * 0x100000001B3ULL;
+    return h;
+}
+
+
+// the checksum of the header fields before headerChecksum
+static uint64_t snapshot_header_checksum(const SnapshotHeader* header) {
+    return snapshot_checksum(0, header, offsetof(SnapshotHeader, headerChecksum));
+}
+
+
+// write len bytes, returns 1 on success
+static int snapshot_write(FILE* file, const void* data, size_t len) {
+    return len == 0 || fwrite(data, 1, len, file) == len;
+}
+
+
+// sync the directory holding path, so a rename into it is on disk, returns 1 on success
+static int snapshot_sync_dir(const char* path) {
+    const char* slash = strrchr(path, '/');
+    size_t length = slash == NULL ? 1 : slash == path ? 1 : (size_t)(slash - path); // "." or "/" or the dir
+    char* dir = malloc(length + 1);
+    if (dir == NULL) return 0;
+    memcpy(dir, slash == NULL ? "." : path, length);
+    dir[length] = 0;
+    int fd = open(dir, O_RDONLY);
+    free(dir);
+    if (fd < 0) return 0;
+    int ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+
+/**
+ * write header and arrays to path: the caller fills in magic, the structure's fields, numArrays and arrayBytes,
+ * the rest of the header (version, offsets and checksums) is filled in here
+ * @return 1 on success (the new snapshot is on disk), 0 on failure (path isn't changed - unless only syncing its
+ * directory failed, then path can be the new snapshot or, after a crash, still the old one)
+ */
+int snapshot_save(const char* path, SnapshotHeader* header, const void* const* arrays) {
+    if (path == NULL || header == NULL || header->numArrays > SNAPSHOT_MAX_ARRAYS)
+        return 0;
+    header->version = SNAPSHOT_VERSION;
+    header->byteOrder = SNAPSHOT_BYTE_ORDER;
+    header->reserved = 0;
+    // lay out the arrays after the header
+    uint64_t offset = (sizeof(SnapshotHeader) + SNAPSHOT_ALIGNMENT - 1) & ~(uint64_t)(SNAPSHOT_ALIGNMENT - 1);
+    header->dataChecksum = 0;
+    for (int i = 0; i < header->numArrays; i++) {
+        header->arrayOffset[i] = offset;
+        offset = (offset + header->arrayBytes[i] + SNAPSHOT_ALIGNMENT - 1) & ~(uint64_t)(SNAPSHOT_ALIGNMENT - 1);
+        header->dataChecksum = snapshot_checksum(header->dataChecksum, arrays[i], header->arrayBytes[i]);
+    }
+    for (int i = header->numArrays; i < SNAPSHOT_MAX_ARRAYS; i++) {
+        header->arrayOffset[i] = 0;
+        header->arrayBytes[i] = 0;
+    }
+    header->headerChecksum = snapshot_header_checksum(header);
+
+    // write to a temporary file first, so a failed save never leaves half a snapshot at path
+    size_t pathLength = strlen(path);
+    char* tmpPath = malloc(pathLength + 5);
+    if (tmpPath == NULL) return 0;
+    memcpy(tmpPath, path, pathLength);
+    memcpy(tmpPath + pathLength, ".tmp", 5);
+    FILE* file = fopen(tmpPath, "wb");
+    if (file == NULL) {
+        free(tmpPath);
+        return 0;
+    }
+    static const char padding[SNAPSHOT_ALIGNMENT] = {0};
+    int ok = snapshot_write(file, header, sizeof(SnapshotHeader));
+    uint64_t written = sizeof(SnapshotHeader);
+    for (int i = 0; ok && i < header->numArrays; i++) {
+        ok = snapshot_write(file, padding, (size_t)(header->arrayOffset[i] - written)) &&
+             snapshot_write(file, arrays[i], (size_t)header->arrayBytes[i]);
+        written = header->arrayOffset[i] + header->arrayBytes[i];
+    }
+    ok = ok && snapshot_write(file, padding, (size_t)(offset - written)); // the file ends aligned too
+    // the data has to be on disk before the rename is, or a crash could leave path naming a half written file
+    ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = (fclose(file) == 0) && ok;
+    if (ok)
+        ok = rename(tmpPath, path) == 0;
+    if (!ok)
+        remove(tmpPath);
+    free(tmpPath);
+    return ok && snapshot_sync_dir(path); // and the rename itself only lasts once the directory is synced
+}
+
+
+/**
+ * map path read-only and check that it is a snapshot of the right kind (magic), version and byte order,
+ * that its header checksum matches and that every array lies inside the file
+ * @return the mapping, starting with the header, or NULL if path can't be used
+ */
+const SnapshotHeader* snapshot_open(const char* path, const char* magic, size_t* mappingSize) {
+    if (path == NULL || magic == NULL || mappingSize == NULL) return NULL;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (mapping == MAP_FAILED) return NULL;
+
+    const SnapshotHeader* header = (const SnapshotHeader*)mapping;
+    int ok = strncmp(header->magic, magic, sizeof(header->magic)) == 0 &&
+             header->version == SNAPSHOT_VERSION && header->byteOrder == SNAPSHOT_BYTE_ORDER &&
+             header->headerChecksum == snapshot_header_checksum(header) &&
+             header->numArrays >= 0 && header->numArrays <= SNAPSHOT_MAX_ARRAYS;
+    for (int i = 0; ok && i < header->numArrays; i++) {
+        ok = header->arrayOffset[i] % SNAPSHOT_ALIGNMENT == 0 && header->arrayOffset[i] <= size &&
+             header->arrayBytes[i] <= size - header->arrayOffset[i];
+    }
+    if (!ok) {
+        munmap(mapping, size);
+        return NULL;
+    }
+    *mappingSize = size;
+    return header;
+}
+
+
+/**
+ * release a mapping returned by snapshot_open()
+ */
+void snapshot_close(const void* mapping, size_t mappingSize) {
+    if (mapping != NULL)
+        munmap((void*)mapping, mappingSize);
+}
+
+
+/**
+ * check that every one of the n links (the first[] / next[] entries of a chained table) is -1 (the end of a chain)
+ * or the index of an entry below size, so following them can't read outside the arrays - one sequential pass
+ * @return 1 if they all are, 0 if the file was damaged
+ */
+int snapshot_check_links(const int* links, int n, int size) {
+    int bad = 0;
+    for (int i = 0; i < n; i++)
+        bad |= links[i] < -1 || links[i] >= size; // no branch, so it runs at the speed of reading the array
+    return !bad;
+}
+
+
+/**
+ * check the arrays of a mapped snapshot against the checksum they were saved with (reads all of them)
+ * @return 1 if they match, 0 if the file was damaged
+ */
+int snapshot_verify(const SnapshotHeader* header) {
+    if (header == NULL) return 0;
+    uint64_t checksum = 0;
+    for (int i = 0; i < header->numArrays; i++)
+        checksum = snapshot_checksum(checksum, (const char*)header + header->arrayOffset[i], header->arrayBytes[i]);
+    return checksum == header->dataChecksum;
+}
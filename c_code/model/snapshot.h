@@ -0,0 +1,71 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#ifndef C_CODE_SNAPSHOT_H
+#define C_CODE_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * the on-disk snapshot format shared by the *_save() / *_open_mmap() fns. of the structures
+ *
+ * a file is a SnapshotHeader followed by the arrays of a structure, each array starts on a 64 byte boundary
+ * so a read-only mapping of the file can be used as the arrays directly.  the header has its own checksum
+ * and is checked on open, the checksum of the arrays is only checked by snapshot_verify() - checking it on
+ * open would read the whole file, and the point of a mapping is to only fault in what is used.  so a damaged
+ * body is only found by the *_verify() fns., which also check that every first[] / next[] link points inside
+ * the arrays (snapshot_check_links()): until then lookups in a damaged file can read outside the mapping or go
+ * round a chain forever, call *_verify() before trusting a file that could be damaged.
+ * numbers are stored in the byte order of the machine that wrote them, a file from a machine with another
+ * byte order is rejected.
+ */
+
+// the version of the format written, files of other versions are rejected
+#define SNAPSHOT_VERSION 1
+// the most arrays a snapshot can hold
+#define SNAPSHOT_MAX_ARRAYS 4
+// tells byte orders apart
+#define SNAPSHOT_BYTE_ORDER 0x01020304U
+
+typedef struct {
+    // identifies the structure stored, e.g. "RDSIIHM"
+    char magic[8];
+    // SNAPSHOT_VERSION
+    uint32_t version;
+    // SNAPSHOT_BYTE_ORDER as written by the machine that saved it
+    uint32_t byteOrder;
+    // the fields of the structure
+    uint32_t seed;
+    int32_t allocatedSize;
+    int32_t initialSize;
+    int32_t size;
+    // the arrays: where they start in the file and how many bytes they are
+    int32_t numArrays;
+    uint32_t reserved;
+    uint64_t arrayOffset[SNAPSHOT_MAX_ARRAYS];
+    uint64_t arrayBytes[SNAPSHOT_MAX_ARRAYS];
+    // checksum of all the array bytes
+    uint64_t dataChecksum;
+    // checksum of the header up to here
+    uint64_t headerChecksum;
+} SnapshotHeader;
+
+// fn. to write header (magic and the structure's fields filled in) and its arrays to path, synced to disk before
+// it replaces path, returns 1 on success
+int snapshot_save(const char* path, SnapshotHeader* header, const void* const* arrays);
+
+// fn. to map path read-only and check its header against magic, returns the mapping (NULL on failure)
+const SnapshotHeader* snapshot_open(const char* path, const char* magic, size_t* mappingSize);
+
+// fn. to release a mapping returned by snapshot_open()
+void snapshot_close(const void* mapping, size_t mappingSize);
+
+// fn. to check that each of the n links is -1 or below size, returns 1 if they are
+int snapshot_check_links(const int* links, int n, int size);
+
+// fn. to check the arrays of a mapped snapshot against its checksum, returns 1 if they match
+int snapshot_verify(const SnapshotHeader* header);
+
+#endif //C_CODE_SNAPSHOT_H
@@ -0,0 +1,431 @@
+/*
+ * Copyright (c) 2024 by Rock de Vocht
+ *
+ * All rights reserved. No part of this publication may be reproduced, distributed, or
+ * transmitted in any form or by any means, including photocopying, recording, or other
+ * electronic or mechanical methods, without the prior written permission of the publisher,
+ * except in the case of brief quotations embodied in critical reviews and certain other
+ * noncommercial uses permitted by copyright law.
+ *
+ */
+
+/**
+ * an approximate string set: a cuckoo filter of 8 or 16 bit fingerprints (see string_cuckoo_filter.h)
+ *
+ * a string can be in one of two buckets, i1 from its hash and i2 = (h(fingerprint) - i1) mod bucketCount.
+ * that is its own inverse, so the other bucket of a fingerprint is known without the string and the number of
+ * buckets doesn't have to be a power of 2 - the filter is sized to the strings, not rounded up to twice that.
+ * a lookup reads the two bucket words and compares all 8 fingerprints in them at once (SSE2, or bit tricks on
+ * a word at a time on other cpus).
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "string_cuckoo_filter.h"
+#include "string_hash_set.h"
+#include "int_hash.h"
+#include "hash_alloc.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// the filter is sized to be this full (in percent) with capacity strings, a bucket of 4 slots makes it to about
+// 95% before adds start to fail
+#define STRING_CUCKOO_LOAD 90
+
+// an empty slot
+#define STRING_CUCKOO_EMPTY 0
+
+
+// the number of bytes of a bucket
+static inline size_t str_cuckoo_bucket_bytes(int fingerprintBits) {
+    return fingerprintBits == STRING_CUCKOO_FINGERPRINT_8 ? sizeof(uint32_t) : sizeof(uint64_t);
+}
+
+// the word of bucket i
+static inline uint64_t str_cuckoo_load(StringCuckooFilter* data, int i) {
+    if (data->fingerprintBits == STRING_CUCKOO_FINGERPRINT_8)
+        return ((uint32_t*)data->buckets)[i];
+    return ((uint64_t*)data->buckets)[i];
+}
+
+// set the word of bucket i
+static inline void str_cuckoo_store(StringCuckooFilter* data, int i, uint64_t word) {
+    if (data->fingerprintBits == STRING_CUCKOO_FINGERPRINT_8)
+        ((uint32_t*)data->buckets)[i] = (uint32_t)word;
+    else
+        ((uint64_t*)data->buckets)[i] = word;
+}
+
+// map a 32 bit hash onto 0 .. n - 1 (a multiply instead of a division)
+static inline uint32_t str_cuckoo_range(uint32_t hash, uint32_t n) {
+    return (uint32_t)(((uint64_t)hash * n) >> 32);
+}
+
+// the fingerprint of a string: its high 32 bits mapped onto 1 .. 2^bits - 1 (0 marks an empty slot)
+static inline uint32_t str_cuckoo_fingerprint(StringCuckooFilter* data, uint64_t hash) {
+    return str_cuckoo_range((uint32_t)(hash >> 32), (1U << data->fingerprintBits) - 1) + 1;
+}
+
+// the first bucket of a string
+static inline int str_cuckoo_bucket(StringCuckooFilter* data, uint64_t hash) {
+    return (int)str_cuckoo_range((uint32_t)hash, (uint32_t)data->bucketCount);
+}
+
+// the other bucket of fingerprint in bucket i
+static inline int str_cuckoo_other(StringCuckooFilter* data, int i, uint32_t fingerprint) {
+    int other = (int)str_cuckoo_range(int_hash((int)fingerprint, 0), (uint32_t)data->bucketCount) - i;
+    return other < 0 ? other + data->bucketCount : other;
+}
+
+
+#if defined(__SSE2__)
+
+// is fingerprint in either of the bucket words w1 and w2
+static inline int str_cuckoo_match(StringCuckooFilter* data, uint64_t w1, uint64_t w2, uint32_t fingerprint) {
+    if (data->fingerprintBits == STRING_CUCKOO_FINGERPRINT_8) {
+        __m128i words = _mm_set_epi32(0, 0, (int)(uint32_t)w2, (int)(uint32_t)w1);
+        __m128i equal = _mm_cmpeq_epi8(words, _mm_set1_epi8((char)fingerprint));
+        return (_mm_movemask_epi8(equal) & 0xFF) != 0;
+    }
+    __m128i words = _mm_set_epi64x((long long)w2, (long long)w1);
+    return _mm_movemask_epi8(_mm_cmpeq_epi16(words, _mm_set1_epi16((short)fingerprint))) != 0;
+}
+
+#else
+
+// does a word of 8 or 16 bit lanes have a lane that is 0 (a borrow into the high bit of a lane that was 0)
+static inline int str_cuckoo_has_zero(StringCuckooFilter* data, uint64_t word) {
+    if (data->fingerprintBits == STRING_CUCKOO_FINGERPRINT_8)
+        return ((word - 0x01010101ULL) & ~word & 0x80808080ULL) != 0;
+    return ((word - 0x0001000100010001ULL) & ~word & 0x8000800080008000ULL) != 0;
+}
+
+// is fingerprint in either of the bucket words w1 and w2
+static inline int str_cuckoo_match(StringCuckooFilter* data, uint64_t w1, uint64_t w2, uint32_t fingerprint) {
+    uint64_t lanes = data->fingerprintBits == STRING_CUCKOO_FINGERPRINT_8 ? 0x01010101ULL : 0x0001000100010001ULL;
+    uint64_t repeated = lanes * fingerprint;
+    return str_cuckoo_has_zero(data, w1 ^ repeated) || str_cuckoo_has_zero(data, w2 ^ repeated);
+}
+
+#endif
+
+
+// the slot of bucket i that holds fingerprint (STRING_CUCKOO_EMPTY: a free slot), -1 if there is none
+static int str_cuckoo_find_slot(StringCuckooFilter* data, int i, uint32_t fingerprint) {
+    uint64_t word = str_cuckoo_load(data, i);
+    int bits = data->fingerprintBits;
+    uint64_t mask = (1ULL << bits) - 1;
+    for (int slot = 0; slot < STRING_CUCKOO_BUCKET_SLOTS; slot++) {
+        if (((word >> (slot * bits)) & mask) == fingerprint)
+            return slot;
+    }
+    return -1;
+}
+
+// put fingerprint into a slot of bucket i, returns what was in that slot before
+static uint32_t str_cuckoo_put(StringCuckooFilter* data, int i, int slot, uint32_t fingerprint) {
+    uint64_t word = str_cuckoo_load(data, i);
+    int shift = slot * data->fingerprintBits;
+    uint64_t mask = ((1ULL << data->fingerprintBits) - 1) << shift;
+    uint32_t previous = (uint32_t)((word & mask) >> shift);
+    str_cuckoo_store(data, i, (word & ~mask) | ((uint64_t)fingerprint << shift));
+    return previous;
+}
+
+// put fingerprint into a free slot of bucket i, returns 1 if there was one
+static int str_cuckoo_put_free(StringCuckooFilter* data, int i, uint32_t fingerprint) {
+    int slot = str_cuckoo_find_slot(data, i, STRING_CUCKOO_EMPTY);
+    if (slot < 0) return 0;
+    str_cuckoo_put(data, i, slot, fingerprint);
+    return 1;
+}
+
+// the next number of the filter's xorshift generator
+static inline uint32_t str_cuckoo_random(StringCuckooFilter* data) {
+    uint32_t x = data->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    data->random = x;
+    return x;
+}
+
+
+/**
+ * put fingerprint in bucket i or its other bucket, if both are full move a random fingerprint out of the way to
+ * its own other bucket and so on, until one fits or STRING_CUCKOO_MAX_KICKS moves were made - the fingerprint
+ * left over then becomes the victim.  the fingerprint is always stored, size is counted by the caller
+ */
+static void str_cuckoo_insert(StringCuckooFilter* data, int i, uint32_t fingerprint) {
+    int other = str_cuckoo_other(data, i, fingerprint);
+    if (str_cuckoo_put_free(data, i, fingerprint) || str_cuckoo_put_free(data, other, fingerprint))
+        return;
+    if (str_cuckoo_random(data) & 1)
+        i = other;
+    for (int kick = 0; kick < STRING_CUCKOO_MAX_KICKS; kick++) {
+        int slot = (int)(str_cuckoo_random(data) % STRING_CUCKOO_BUCKET_SLOTS);
+        fingerprint = str_cuckoo_put(data, i, slot, fingerprint);
+        i = str_cuckoo_other(data, i, fingerprint);
+        if (str_cuckoo_put_free(data, i, fingerprint))
+            return;
+    }
+    data->hasVictim = 1;
+    data->victimBucket = i;
+    data->victimFingerprint = fingerprint;
+}
+
+
+/**
+ * free all the data allocated by the filter
+ */
+void str_cuckoo_free(StringCuckooFilter* data) {
+    if (data == NULL) return;
+    hash_release(data->allocator, data->buckets, str_cuckoo_memory(data));
+    hash_release(data->allocator, data, sizeof(StringCuckooFilter));
+}
+
+
+/**
+ * create a filter for capacity strings with a false positive rate of at most falsePositiveRate once it holds
+ * them all: 8 bit fingerprints if that is good enough (a rate of 2.8% or more), 16 bit ones otherwise (as low
+ * as 0.011%, a lower rate needs a StringHashSet)
+ * @return the filter, or NULL if out of memory
+ */
+StringCuckooFilter* str_cuckoo_create(int capacity, double falsePositiveRate) {
+    // a lookup compares 2 buckets of slots that are STRING_CUCKOO_LOAD% full with 255 possible fingerprints
+    double rate8 = 2.0 * STRING_CUCKOO_BUCKET_SLOTS * STRING_CUCKOO_LOAD / 100.0 / 255.0;
+    int fingerprintBits = falsePositiveRate >= rate8 ? STRING_CUCKOO_FINGERPRINT_8 : STRING_CUCKOO_FINGERPRINT_16;
+    return str_cuckoo_create_with_allocator(capacity, fingerprintBits, NULL);
+}
+
+
+/**
+ * create a filter for capacity strings with fingerprints of fingerprintBits (STRING_CUCKOO_FINGERPRINT_8 or
+ * STRING_CUCKOO_FINGERPRINT_16) whose struct and buckets come from allocator (NULL: the default allocator)
+ * @return the filter, or NULL if out of memory (or an unknown fingerprint width)
+ */
+StringCuckooFilter* str_cuckoo_create_with_allocator(int capacity, int fingerprintBits,
+                                                     const HashAllocator* allocator) {
+    if (fingerprintBits != STRING_CUCKOO_FINGERPRINT_8 && fingerprintBits != STRING_CUCKOO_FINGERPRINT_16)
+        return NULL;
+    StringCuckooFilter* data = (StringCuckooFilter*) hash_alloc(allocator, sizeof(StringCuckooFilter));
+    if (data == NULL) return NULL; // failed?
+    data->allocator = allocator;
+    data->fingerprintBits = fingerprintBits;
+    data->capacity = capacity > 0 ? capacity : 1;
+    long slots = ((long)data->capacity * 100 + STRING_CUCKOO_LOAD - 1) / STRING_CUCKOO_LOAD;
+    long bucketCount = (slots + STRING_CUCKOO_BUCKET_SLOTS - 1) / STRING_CUCKOO_BUCKET_SLOTS;
+    data->bucketCount = (int)(bucketCount < INT_HASH_MAX_CAPACITY ? bucketCount : INT_HASH_MAX_CAPACITY);
+    data->random = 2463534242U;
+    data->buckets = hash_alloc(allocator, str_cuckoo_memory(data));
+    if (data->buckets == NULL) {
+        str_cuckoo_free(data); // out of memory
+        return NULL;
+    }
+    return data;
+}
+
+
+/**
+ * remove all strings from the filter, it keeps its size
+ */
+void str_cuckoo_clear(StringCuckooFilter* data) {
+    if (data == NULL) return;
+    memset(data->buckets, 0, str_cuckoo_memory(data));
+    data->size = 0;
+    data->hasVictim = 0;
+}
+
+
+/**
+ * add a string by its str_hashset_hash() value, a string already in the filter takes another slot
+ * @return 1 if successful, 0 if the filter is full (no string can be added until one is removed)
+ */
+int str_cuckoo_add_hashed(StringCuckooFilter* data, uint64_t hash) {
+    if (data == NULL || data->hasVictim) return 0;
+    str_cuckoo_insert(data, str_cuckoo_bucket(data, hash), str_cuckoo_fingerprint(data, hash));
+    data->size += 1;
+    return 1;
+}
+
+
+/**
+ * add the len bytes at str (not '\0' terminated) to the filter
+ * @return 1 if successful, 0 if the filter is full (or str is empty)
+ */
+int str_cuckoo_add_n(StringCuckooFilter* data, const char* str, size_t len) {
+    // can't add empty str
+    if (data == NULL || str == NULL || len == 0)
+        return 0;
+    return str_cuckoo_add_hashed(data, str_hashset_hash(str, len));
+}
+
+
+/**
+ * add a string to the filter
+ * @return 1 if successful, 0 if the filter is full (or str is empty)
+ */
+int str_cuckoo_add(StringCuckooFilter* data, const char* str) {
+    if (str == NULL) return 0;
+    return str_cuckoo_add_n(data, str, strlen(str));
+}
+
+
+// is the victim fingerprint in bucket i1 or i2
+static inline int str_cuckoo_is_victim(StringCuckooFilter* data, int i1, int i2, uint32_t fingerprint) {
+    return data->hasVictim && data->victimFingerprint == fingerprint &&
+           (data->victimBucket == i1 || data->victimBucket == i2);
+}
+
+
+/**
+ * might the filter contain the string with this str_hashset_hash() value
+ * @return 1 if it might (with a chance of str_cuckoo_false_positive_rate() that it doesn't), 0 if it doesn't
+ */
+int str_cuckoo_contains_hashed(StringCuckooFilter* data, uint64_t hash) {
+    if (data == NULL) return 0;
+    uint32_t fingerprint = str_cuckoo_fingerprint(data, hash);
+    int i1 = str_cuckoo_bucket(data, hash);
+    int i2 = str_cuckoo_other(data, i1, fingerprint);
+    return str_cuckoo_match(data, str_cuckoo_load(data, i1), str_cuckoo_load(data, i2), fingerprint) ||
+           str_cuckoo_is_victim(data, i1, i2, fingerprint);
+}
+
+
+/**
+ * might the filter contain the len bytes at str
+ * @return 1 if it might, 0 if it certainly doesn't
+ */
+int str_cuckoo_contains_n(StringCuckooFilter* data, const char* str, size_t len) {
+    if (data == NULL || str == NULL || len == 0) return 0;
+    return str_cuckoo_contains_hashed(data, str_hashset_hash(str, len));
+}
+
+
+/**
+ * might the filter contain str
+ * @return 1 if it might, 0 if it certainly doesn't
+ */
+int str_cuckoo_contains(StringCuckooFilter* data, const char* str) {
+    if (str == NULL) return 0;
+    return str_cuckoo_contains_n(data, str, strlen(str));
+}
+
+
+/**
+ * look up n '\0' terminated strings at once, INT_HASH_BATCH at a time: all of their strings are hashed and
+ * both their buckets prefetched before the first bucket is read
+ * @param outFound outFound[i] is set to 1 if the filter might contain strs[i], 0 if it doesn't
+ * @return the number of strings the filter might contain
+ */
+int str_cuckoo_contains_many(StringCuckooFilter* data, const char* const* strs, int n, int* outFound) {
+    if (data == NULL || strs == NULL || outFound == NULL || n <= 0) return 0;
+    int found = 0;
+    uint32_t fingerprints[INT_HASH_BATCH];
+    int buckets1[INT_HASH_BATCH];
+    int buckets2[INT_HASH_BATCH];
+    size_t bucketBytes = str_cuckoo_bucket_bytes(data->fingerprintBits);
+    for (int start = 0; start < n; start += INT_HASH_BATCH) {
+        int count = n - start < INT_HASH_BATCH ? n - start : INT_HASH_BATCH;
+        for (int i = 0; i < count; i++) { // stage 1: hash, prefetch both buckets
+            const char* str = strs[start + i];
+            size_t len = str != NULL ? strlen(str) : 0;
+            if (len == 0) { // never in the filter
+                buckets1[i] = -1;
+                continue;
+            }
+            uint64_t hash = str_hashset_hash(str, len);
+            fingerprints[i] = str_cuckoo_fingerprint(data, hash);
+            buckets1[i] = str_cuckoo_bucket(data, hash);
+            buckets2[i] = str_cuckoo_other(data, buckets1[i], fingerprints[i]);
+            INT_HASH_PREFETCH((char*)data->buckets + (size_t)buckets1[i] * bucketBytes);
+            INT_HASH_PREFETCH((char*)data->buckets + (size_t)buckets2[i] * bucketBytes);
+        }
+        for (int i = 0; i < count; i++) { // stage 2: compare the buckets
+            int i1 = buckets1[i];
+            int i2 = buckets2[i];
+            outFound[start + i] = i1 >= 0 &&
+                    (str_cuckoo_match(data, str_cuckoo_load(data, i1), str_cuckoo_load(data, i2), fingerprints[i]) ||
+                     str_cuckoo_is_victim(data, i1, i2, fingerprints[i]));
+            found += outFound[start + i];
+        }
+    }
+    return found;
+}
+
+
+/**
+ * remove a string that was added by its str_hashset_hash() value: one slot with its fingerprint is emptied,
+ * the victim (if any) is then put back into the buckets
+ * @return 1 if its fingerprint was found, 0 otherwise
+ */
+int str_cuckoo_remove_hashed(StringCuckooFilter* data, uint64_t hash) {
+    if (data == NULL) return 0;
+    uint32_t fingerprint = str_cuckoo_fingerprint(data, hash);
+    int i1 = str_cuckoo_bucket(data, hash);
+    int i2 = str_cuckoo_other(data, i1, fingerprint);
+    if (str_cuckoo_is_victim(data, i1, i2, fingerprint)) {
+        data->hasVictim = 0;
+        data->size -= 1;
+        return 1;
+    }
+    int i = i1;
+    int slot = str_cuckoo_find_slot(data, i, fingerprint);
+    if (slot < 0) {
+        i = i2;
+        slot = str_cuckoo_find_slot(data, i, fingerprint);
+    }
+    if (slot < 0) return 0;
+    str_cuckoo_put(data, i, slot, STRING_CUCKOO_EMPTY);
+    data->size -= 1;
+    if (data->hasVictim) { // there is room now
+        data->hasVictim = 0;
+        str_cuckoo_insert(data, data->victimBucket, data->victimFingerprint);
+    }
+    return 1;
+}
+
+
+/**
+ * remove the len bytes at str, that were added before, from the filter
+ * @return 1 if its fingerprint was found, 0 otherwise
+ */
+int str_cuckoo_remove_n(StringCuckooFilter* data, const char* str, size_t len) {
+    if (data == NULL || str == NULL || len == 0) return 0;
+    return str_cuckoo_remove_hashed(data, str_hashset_hash(str, len));
+}
+
+
+/**
+ * remove a string, that was added before, from the filter
+ * @return 1 if its fingerprint was found, 0 otherwise
+ */
+int str_cuckoo_remove(StringCuckooFilter* data, const char* str) {
+    if (str == NULL) return 0;
+    return str_cuckoo_remove_n(data, str, strlen(str));
+}
+
+
+/**
+ * the chance that the filter says it might contain a string that was never added, at its current size: a lookup
+ * compares the fingerprints in 2 buckets, each one (of 2^bits - 1 values) matches by chance
+ */
+double str_cuckoo_false_positive_rate(StringCuckooFilter* data) {
+    if (data == NULL || data->bucketCount == 0) return 0.0;
+    double load = (double)data->size / ((double)data->bucketCount * STRING_CUCKOO_BUCKET_SLOTS);
+    double rate = 2.0 * STRING_CUCKOO_BUCKET_SLOTS * load / (double)((1U << data->fingerprintBits) - 1);
+    return rate < 1.0 ? rate : 1.0;
+}
+
+
+/**
+ * the number of bytes of the buckets (the struct not included)
+ */
+size_t str_cuckoo_memory(StringCuckooFilter* data) {
+    if (data == NULL) return 0;
+    return (size_t)data->bucketCount * str_cuckoo_bucket_bytes(data->fingerprintBits);
+}
@@ -0,0 +1,108 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#ifndef C_CODE_STRING_CUCKOO_FILTER_H
+#define C_CODE_STRING_CUCKOO_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hash_alloc.h"
+
+// the number of fingerprints a bucket holds
+#define STRING_CUCKOO_BUCKET_SLOTS 4
+
+// fingerprint widths: 8 bits (about 1 byte per string, a false positive rate of about 3%)
+#define STRING_CUCKOO_FINGERPRINT_8 8
+// or 16 bits (about 2 bytes per string, a false positive rate of about 0.012%)
+#define STRING_CUCKOO_FINGERPRINT_16 16
+
+// how many times an add moves a fingerprint to its other bucket before it gives up
+#define STRING_CUCKOO_MAX_KICKS 500
+
+/**
+ * an approximate set of strings: contains() is never wrong about a string that was added, but says yes to a
+ * string that wasn't with a small chance (the false positive rate).  in return a string takes only a few bytes:
+ * the filter keeps an 8 or 16 bit fingerprint of each string in one of two buckets of 4 slots.
+ * the strings are hashed with str_hashset_hash(), the low 32 bits pick the first bucket and the high 32 bits are
+ * the fingerprint, the second bucket follows from the first and the fingerprint alone (so fingerprints can be
+ * moved between their buckets without the string).  a bucket is one 32 or 64 bit word and is compared with
+ * a fingerprint all at once.
+ * unlike a StringHashSet this is a multiset of fingerprints: adding a string twice takes two slots and it has to
+ * be removed twice, and only strings that were added may be removed (or another string can go missing)
+ */
+struct STRUCT_StringCuckooFilter {
+    // the buckets, bucketCount words of 4 fingerprints (uint32_t for 8 bit, uint64_t for 16 bit), 0 is an empty slot
+    void* buckets;
+    // the number of buckets (any number, not just powers of 2)
+    int bucketCount;
+    // STRING_CUCKOO_FINGERPRINT_8 or STRING_CUCKOO_FINGERPRINT_16
+    int fingerprintBits;
+    // the number of fingerprints in the filter, the victim included
+    int size;
+    // the number of strings the filter was sized for
+    int capacity;
+    // a fingerprint that didn't fit after STRING_CUCKOO_MAX_KICKS moves, kept here so it isn't lost (the
+    // filter is full while there is one)
+    int hasVictim;
+    int victimBucket;
+    uint32_t victimFingerprint;
+    // picks the slot an add moves a fingerprint out of
+    uint32_t random;
+    // where the struct and its buckets come from, NULL: calloc / realloc / free (see hash_alloc.h)
+    const HashAllocator* allocator;
+};
+
+// define a nice name for the data structure
+typedef struct STRUCT_StringCuckooFilter StringCuckooFilter;
+
+// create a filter for capacity strings with (at most) falsePositiveRate, picks 8 or 16 bit fingerprints
+StringCuckooFilter* str_cuckoo_create(int capacity, double falsePositiveRate);
+
+// create a filter for capacity strings with 8 or 16 bit fingerprints whose memory comes from allocator
+StringCuckooFilter* str_cuckoo_create_with_allocator(int capacity, int fingerprintBits,
+                                                     const HashAllocator* allocator);
+
+// de-allocate the filter
+void str_cuckoo_free(StringCuckooFilter* data);
+
+// remove all strings from the filter
+void str_cuckoo_clear(StringCuckooFilter* data);
+
+// add a string and return 1, 0 if the filter is full
+int str_cuckoo_add(StringCuckooFilter* data, const char* str);
+
+// add the len bytes at str (not '\0' terminated) and return 1, 0 if the filter is full
+int str_cuckoo_add_n(StringCuckooFilter* data, const char* str, size_t len);
+
+// add a string by its str_hashset_hash() and return 1, 0 if the filter is full
+int str_cuckoo_add_hashed(StringCuckooFilter* data, uint64_t hash);
+
+// might the filter contain str? 0 means it certainly doesn't
+int str_cuckoo_contains(StringCuckooFilter* data, const char* str);
+
+// might the filter contain the len bytes at str?
+int str_cuckoo_contains_n(StringCuckooFilter* data, const char* str, size_t len);
+
+// might the filter contain the string with this str_hashset_hash()?
+int str_cuckoo_contains_hashed(StringCuckooFilter* data, uint64_t hash);
+
+// might the filter contain each of the n strings? outFound[i] is set to 1 if it might contain strs[i] (prefetch pipelined)
+int str_cuckoo_contains_many(StringCuckooFilter* data, const char* const* strs, int n, int* outFound);
+
+// remove a string that was added, returns 1 if its fingerprint was found
+int str_cuckoo_remove(StringCuckooFilter* data, const char* str);
+
+// remove the len bytes at str that were added
+int str_cuckoo_remove_n(StringCuckooFilter* data, const char* str, size_t len);
+
+// remove a string that was added by its str_hashset_hash()
+int str_cuckoo_remove_hashed(StringCuckooFilter* data, uint64_t hash);
+
+// the false positive rate to expect at the current number of strings
+double str_cuckoo_false_positive_rate(StringCuckooFilter* data);
+
+// the number of bytes the buckets take
+size_t str_cuckoo_memory(StringCuckooFilter* data);
+
+#endif //C_CODE_STRING_CUCKOO_FILTER_H
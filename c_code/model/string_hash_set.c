@@ -13,47 +13,236 @@
 /**
  * a memory efficient mostly accurate String hash set
  * checking for the presence / existence of a string
- * based on double hash values 0 allocating 20 bytes per string total
+ * based on a 64 bit hash value (two 32 bit halves) - allocating 20 bytes per string total
  *
  */
 
 
 #include <stdlib.h>
 #include <string.h>
-#include <zlib.h>
 #include "string_hash_set.h"
+#include "int_hash.h"
+#include "snapshot.h"
+#include "bulk_build.h"
+#include "hash_alloc.h"
+#include "string_interner.h"
+#include "hash_simd.h"
+
+
+// murmur3 x64 constants, used by str_hashset_hash()
+#define STR_HASH_C1 0x87C37B91114253D5ULL
+#define STR_HASH_C2 0x4CF5AD432745937FULL
+
+
+static inline uint64_t str_hash_rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+
+// mix an 8 byte block of the string into the hash
+static inline uint64_t str_hash_block(uint64_t h, uint64_t k) {
+    k *= STR_HASH_C1;
+    k = str_hash_rotl(k, 31);
+    k *= STR_HASH_C2;
+    h ^= k;
+    return str_hash_rotl(h, 27) * 5 + 0x52DCE729;
+}
+
+
+/**
+ * the 64 bit hash of the len bytes at str, computed in a single pass 8 bytes at a time
+ * its low 32 bits (intHash1) pick the bucket, the high 32 bits (intHash2) tell strings in a chain apart
+ */
+uint64_t str_hashset_hash(const char* str, size_t len) {
+    if (str == NULL) return 0; // NULL string has no hash
+    const unsigned char* bytes = (const unsigned char*)str;
+    uint64_t h = (uint64_t)len * 0x9E3779B97F4A7C15ULL; // the length is part of the hash
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t k;
+        memcpy(&k, bytes + i, 8); // unaligned safe load
+        h = str_hash_block(h, k);
+    }
+    if (i < len) { // the last 1..7 bytes, zero padded
+        uint64_t k = 0;
+        memcpy(&k, bytes + i, len - i);
+        h = str_hash_block(h, k);
+    }
+    // murmur3 64 bit finalizer - every bit of the hash depends on every byte
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+
+/**
+ * the 128 bit fingerprint of the len bytes at str in one pass: the returned low 64 bits are str_hashset_hash(),
+ * the high 64 bits (*high) come from a second lane with its own seed and constants that reads the same blocks
+ */
+uint64_t str_hashset_hash128(const char* str, size_t len, uint64_t* high) {
+    if (str == NULL) {
+        *high = 0;
+        return 0;
+    }
+    const unsigned char* bytes = (const unsigned char*)str;
+    uint64_t h = (uint64_t)len * 0x9E3779B97F4A7C15ULL;
+    uint64_t h2 = (uint64_t)len * 0xC2B2AE3D27D4EB4FULL ^ 0x165667B19E3779F9ULL;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t k;
+        memcpy(&k, bytes + i, 8);
+        h = str_hash_block(h, k);
+        h2 = str_hash_rotl(h2 ^ str_hash_rotl(k * STR_HASH_C2, 33) * STR_HASH_C1, 31) * 5 + 0x38495AB5;
+    }
+    if (i < len) {
+        uint64_t k = 0;
+        memcpy(&k, bytes + i, len - i);
+        h = str_hash_block(h, k);
+        h2 = str_hash_rotl(h2 ^ str_hash_rotl(k * STR_HASH_C2, 33) * STR_HASH_C1, 31) * 5 + 0x38495AB5;
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    h2 ^= h2 >> 33;
+    h2 *= 0xFF51AFD7ED558CCDULL;
+    h2 ^= h2 >> 33;
+    h2 *= 0xC4CEB9FE1A85EC53ULL;
+    h2 ^= h2 >> 33;
+    *high = h2;
+    return h;
+}
+
+
+// does the set keep 128 bit fingerprints?
+static inline int str_hashset_wide(StringHashSet* data) {
+    return data->fingerprintBits == STRING_HASHSET_FINGERPRINT_128;
+}
+
+
+// the fingerprint of the len bytes at str as this set keeps it (*high is 0 for a 64 bit set)
+static inline uint64_t str_hashset_fingerprint(StringHashSet* data, const char* str, size_t len, uint64_t* high) {
+    if (str_hashset_wide(data))
+        return str_hashset_hash128(str, len, high);
+    *high = 0;
+    return str_hashset_hash(str, len);
+}
+
+
+// does entry i hold the string with this fingerprint - every bit of it is compared
+static inline int str_hashset_match(StringHashSet* data, int i, int intHash1Value, int intHash2Value,
+                                    uint64_t high) {
+    return data->intHash1[i] == intHash1Value && data->intHash2[i] == intHash2Value &&
+           (data->hashHigh == NULL || data->hashHigh[i] == high);
+}
+
+
+// the bucket (first[] index) of a string: its first hash masked to the power of 2 table size
+static inline int str_hashset_bucket(StringHashSet* data, int intHash1Value) {
+    return (int)((uint32_t)intHash1Value & (uint32_t)(data->allocatedSize - 1));
+}
+
+
+// the number of threads to work on a whole table of n slots with
+static inline int str_hashset_threads(StringHashSet* data, int n) {
+    return data->parallelThreads > 1 && n >= data->parallelMinSize ? data->parallelThreads : 1;
+}
+
+
+// the first entry of bucket b's chain, STRING_HASHMAP_EMPTY_KEY if it is empty (with fast clear on: or if the
+// bucket was last written before the last clear)
+static inline int str_hashset_head(StringHashSet* data, int b) {
+    if (data->generations != NULL && data->generations[b] != data->generation)
+        return STRING_HASHMAP_EMPTY_KEY;
+    return data->first[b];
+}
+
+
+// make index the first entry of bucket b's chain
+static inline void str_hashset_set_head(StringHashSet* data, int b, int index) {
+    data->first[b] = index;
+    if (data->generations != NULL)
+        data->generations[b] = data->generation;
+}
+
+
+// fast clear: reset the buckets of older generations to empty, first[] is then valid without generations[]
+static void str_hashset_flush_generations(StringHashSet* data) {
+    for (int i = 0; i < data->allocatedSize; i++)
+        if (data->generations[i] != data->generation)
+            data->first[i] = STRING_HASHMAP_EMPTY_KEY;
+}
+
+
+// allocate the four arrays (five for 128 bit fingerprints) of a table of size slots (zeroed), returns 1 if successful
+static int str_hashset_allocate_arrays(StringHashSet* data, int size) {
+    size_t bytes = (size_t)size * sizeof(int);
+    data->first = hash_alloc(data->allocator, bytes);
+    data->intHash1 = hash_alloc(data->allocator, bytes);
+    data->intHash2 = hash_alloc(data->allocator, bytes);
+    data->next = hash_alloc(data->allocator, bytes);
+    if (str_hashset_wide(data))
+        data->hashHigh = hash_alloc(data->allocator, (size_t)size * sizeof(uint64_t));
+    data->allocatedSize = size;
+    return data->first != NULL && data->intHash1 != NULL && data->intHash2 != NULL && data->next != NULL &&
+           (data->hashHigh != NULL || !str_hashset_wide(data));
+}
+
+
+// give back the arrays of the set, they all have allocatedSize slots
+static void str_hashset_release_arrays(StringHashSet* data) {
+    size_t bytes = (size_t)data->allocatedSize * sizeof(int);
+    hash_release(data->allocator, data->first, bytes);
+    hash_release(data->allocator, data->intHash1, bytes);
+    hash_release(data->allocator, data->intHash2, bytes);
+    hash_release(data->allocator, data->next, bytes);
+    hash_release(data->allocator, data->generations, bytes);
+    hash_release(data->allocator, data->hashHigh, (size_t)data->allocatedSize * sizeof(uint64_t));
+    data->generations = NULL;
+    data->hashHigh = NULL;
+}
 
 
 /**
- * clear the hash set - remove all data
+ * clear the hash set - remove all data (with fast clear on: start a new generation instead, see
+ * str_hashset_set_fast_clear())
  */
 void str_hashset_clear(StringHashSet* data) {
-    if (data == NULL) // not set - just return
+    if (data == NULL || data->mapping != NULL) // not set or read-only - just return
+        return;
+    if (data->exactIn != NULL) // exact checking: none of the strings seen is in the set anymore
+        memset(data->exactIn, 0, (size_t)data->exactInSize);
+    if (data->generations != NULL) { // fast clear: a new generation empties every bucket, the size stays
+        data->size = 0;
+        int_hash_next_generation(data->generations, data->allocatedSize, &data->generation);
         return;
+    }
+    if (data->resizeTo != NULL) { // drop an incremental resize in progress
+        str_hashset_free(data->resizeTo);
+        data->resizeTo = NULL;
+    }
     data->size = 0; // empty data
-    // shrink the arrays?
+    // shrink the arrays? the smaller ones are allocated before the current ones are released, so running out of
+    // memory keeps the table at the size it is instead of leaving it without arrays
     if (data->allocatedSize > data->initialSize) { // if we've grown beyond the initial size
-        // first release the allocated data
-        if (data->first != NULL) free(data->first);
-        if (data->intHash1 != NULL) free(data->intHash1);
-        if (data->intHash2 != NULL) free(data->intHash2);
-        if (data->next != NULL) free(data->next);
-
-        // re-allocate the original sizes
-        data->first = calloc(data->initialSize, sizeof(int));
-        data->intHash1 = calloc(data->initialSize, sizeof(int));
-        data->intHash2 = calloc(data->initialSize, sizeof(int));
-        data->next = calloc(data->initialSize, sizeof(int));
-        data->allocatedSize = data->initialSize;
+        StringHashSet smaller = *data;
+        if (str_hashset_allocate_arrays(&smaller, data->initialSize)) {
+            str_hashset_release_arrays(data);
+            *data = smaller;
+        } else
+            str_hashset_release_arrays(&smaller); // whichever of them were allocated
     }
 
     // clear the arrays with "empty" keys so they appear as empty to our algorithm
-    for (int i = 0; i < data->initialSize; i++) {
-        data->first[i] = STRING_HASHMAP_EMPTY_KEY;
-        data->intHash1[i] = STRING_HASHMAP_EMPTY_KEY;
-        data->intHash2[i] = STRING_HASHMAP_EMPTY_KEY;
-        data->next[i] = STRING_HASHMAP_EMPTY_KEY;
-    }
+    int threads = str_hashset_threads(data, data->allocatedSize);
+    bulk_fill(data->first, data->allocatedSize, STRING_HASHMAP_EMPTY_KEY, threads);
+    bulk_fill(data->intHash1, data->allocatedSize, STRING_HASHMAP_EMPTY_KEY, threads);
+    bulk_fill(data->intHash2, data->allocatedSize, STRING_HASHMAP_EMPTY_KEY, threads);
+    bulk_fill(data->next, data->allocatedSize, STRING_HASHMAP_EMPTY_KEY, threads);
 }
 
 
@@ -62,11 +251,23 @@ void str_hashset_clear(StringHashSet* data) {
  */
 void str_hashset_free_content_only(StringHashSet* data) {
     if (data == NULL) return; // no data, don't de-allocate
+    if (data->mapping != NULL) { // the arrays point into a snapshot, unmap it instead
+        snapshot_close(data->mapping, data->mappingSize);
+        data->mapping = NULL;
+        data->first = NULL;
+        data->intHash1 = NULL;
+        data->intHash2 = NULL;
+        data->next = NULL;
+        data->size = 0;
+        data->allocatedSize = 0;
+        return;
+    }
+    if (data->resizeTo != NULL) { // the new table of an incremental resize
+        str_hashset_free(data->resizeTo);
+        data->resizeTo = NULL;
+    }
     // de-allocate the arrays first
-    if (data->first != NULL) free(data->first);
-    if (data->intHash1 != NULL) free(data->intHash1);
-    if (data->intHash2 != NULL) free(data->intHash2);
-    if (data->next != NULL) free(data->next);
+    str_hashset_release_arrays(data);
     // set all items in data to NULL and 0
     data->first = NULL;
     data->intHash1 = NULL;
@@ -81,10 +282,12 @@ void str_hashset_free_content_only(StringHashSet* data) {
  * free all the data allocated by the StringHashSet
  */
 void str_hashset_free(StringHashSet* data) {
+    if (data == NULL) return;
+    str_hashset_set_exact_check(data, 0);
     // free content of map
     str_hashset_free_content_only(data);
     // then free the data itself
-    free(data);
+    hash_release(data->allocator, data, sizeof(StringHashSet));
 }
 
 
@@ -92,17 +295,42 @@ void str_hashset_free(StringHashSet* data) {
  * create a new hash set
  */
 StringHashSet* str_hashset_create(int initialSize) {
+    return str_hashset_create_with_allocator(initialSize, NULL);
+}
+
+
+/**
+ * create a new hash set whose struct and arrays all come from allocator (NULL: calloc / realloc / free,
+ * see hash_alloc.h) - the allocator must stay around until the set is freed
+ * @return the new set, or NULL if out of memory
+ */
+StringHashSet* str_hashset_create_with_allocator(int initialSize, const HashAllocator* allocator) {
+    return str_hashset_create_fingerprinted(initialSize, STRING_HASHSET_FINGERPRINT_64, allocator);
+}
+
+
+/**
+ * create a new hash set that tells its strings apart by fingerprints of fingerprintBits bits: 64 (the two
+ * 32 bit halves of str_hashset_hash()) or 128 (str_hashset_hash128(), 8 more bytes per string).  with n
+ * strings in the set, a string that isn't in it is taken for one that is with a chance of n / 2^fingerprintBits
+ * @return the new set, or NULL if out of memory (or fingerprintBits is neither 64 nor 128)
+ */
+StringHashSet* str_hashset_create_fingerprinted(int initialSize, int fingerprintBits,
+                                                const HashAllocator* allocator) {
+    if (fingerprintBits != STRING_HASHSET_FINGERPRINT_64 && fingerprintBits != STRING_HASHSET_FINGERPRINT_128)
+        return NULL;
     // allocate the main structure
-    StringHashSet* data = (StringHashSet*) calloc(1, sizeof(StringHashSet));
+    StringHashSet* data = (StringHashSet*) hash_alloc(allocator, sizeof(StringHashSet));
     if (data == NULL) return NULL; // failed?
-    // set the initial size
-    data->initialSize = initialSize;
-    data->allocatedSize = initialSize;
+    data->allocator = allocator;
+    data->fingerprintBits = fingerprintBits;
+    // set the initial size, rounded up to a power of 2 so buckets can be found with a mask
+    data->initialSize = int_hash_capacity(initialSize);
     // allocate the key arrays
-    data->first = calloc(data->initialSize, sizeof(int));
-    data->intHash1 = calloc(data->initialSize, sizeof(int));
-    data->intHash2 = calloc(data->initialSize, sizeof(int));
-    data->next = calloc(data->initialSize, sizeof(int));
+    if (!str_hashset_allocate_arrays(data, data->initialSize)) {
+        str_hashset_free(data); // out of memory
+        return NULL;
+    }
     // set the map size to 0
     data->size = 0;
 
@@ -117,183 +345,1055 @@ StringHashSet* str_hashset_create(int initialSize) {
     return data;
 }
 
-// adler 32 hash from libz
-int stringToHash1(const char* str) {
-    if (str == NULL) return 0; // NULL string has no hash
-    // use fast adler32 hash to create a unique int value for our string
-    return (int)adler32(1, (const unsigned char*)str, strlen(str));
-}
-
-// the java String.hashCode() implementation (similar to Java's own)
-int stringToHash2(const char* str) {
-    if (str == NULL) return 0; // NULL string has no hash
-    // simple hash based on bit shifts and character values
-    int h = 0;
-    int l = (int)strlen(str);
-    int i = 0;
-    if ( l > 0 )
-        while (i < l)
-            h = (h << 5) - h + str[i++] | 0;
-    return h;
-}
-
 // help insert a value into our map
-int insertHelper(int intHash1Value, int intHash2Value, StringHashSet* data) {
+int insertHelper(int intHash1Value, int intHash2Value, uint64_t high, StringHashSet* data) {
     if (data == NULL) return 0; // null data, no insert
-    int firstIndex = abs(intHash1Value % data->allocatedSize);
+    int firstIndex = str_hashset_bucket(data, intHash1Value);
     int newSize = data->size;
+    int probes = 0;
 
     // simplest case - we don't have an entry yet
-    if (data->first[firstIndex] == STRING_HASHMAP_EMPTY_KEY) {
-        data->first[firstIndex] = data->size; // first points to the next empty data-slot
+    if (str_hashset_head(data, firstIndex) == STRING_HASHMAP_EMPTY_KEY) {
+        str_hashset_set_head(data, firstIndex, data->size); // first points to the next empty data-slot
         // and the data goes into the slots
         data->intHash1[data->size] = intHash1Value;
         data->intHash2[data->size] = intHash2Value;
+        if (data->hashHigh != NULL) data->hashHigh[data->size] = high;
         data->next[data->size] = STRING_HASHMAP_EMPTY_KEY;
         newSize += 1; // increase map size
 
     } else {
         // chain down the colliding items and find the next empty
-        int nextIndex = data->first[firstIndex];
+        int nextIndex = str_hashset_head(data, firstIndex);
         while (data->next[nextIndex] != STRING_HASHMAP_EMPTY_KEY) {
-            if (data->intHash2[nextIndex] == intHash2Value) // already exists, not added
+            probes += 1;
+            if (str_hashset_match(data, nextIndex, intHash1Value, intHash2Value, high)) { // already exists, not added
+                hash_stats_probe(&data->counters, HASH_STATS_ADD, probes);
                 return data->size; // return existing size
+            }
             nextIndex = data->next[nextIndex]; // next value in the chain
         }
         // did we land on a value that matches our hashes?
-        if (data->intHash1[nextIndex] == intHash1Value && data->intHash2[nextIndex] == intHash2Value) // already exists, not added
+        probes += 1;
+        if (str_hashset_match(data, nextIndex, intHash1Value, intHash2Value, high)) { // already exists, not added
+            hash_stats_probe(&data->counters, HASH_STATS_ADD, probes);
             return data->size; // no change, value already exists / inserted
+        }
         // INSERT: now prevNext points to the last slot that wasn't empty - chain it in
         data->next[nextIndex] = data->size;
         // and put in our data at the end
         data->intHash1[data->size] = intHash1Value;
         data->intHash2[data->size] = intHash2Value;
+        if (data->hashHigh != NULL) data->hashHigh[data->size] = high;
         // next pointer is empty
         data->next[data->size] = STRING_HASHMAP_EMPTY_KEY;
         newSize += 1;
     }
+    hash_stats_probe(&data->counters, HASH_STATS_ADD, probes);
     // return new size of the map
     return newSize;
 }
 
 
-// grow the map by 50%
+/**
+ * re-size the set to newSize slots without re-inserting anything: the strings are already packed in
+ * 0..size-1, so their arrays are re-allocated where they are and first[] / next[] are re-built in one
+ * pass over them - at most one extra first[] array is needed on top of the set while this runs
+ */
+void resize(StringHashSet* data, int newSize) {
+    if (data == NULL) return; // NULL map, can't grow
+    const HashAllocator* allocator = data->allocator;
+    size_t oldBytes = (size_t)data->allocatedSize * sizeof(int);
+    size_t newBytes = (size_t)newSize * sizeof(int);
+    int* first = hash_alloc(allocator, newBytes);
+    if (first == NULL) return; // out of memory, keep the current size
+    int* generations = NULL; // fast clear: the re-built buckets all start in generation 0
+    if (data->generations != NULL && (generations = hash_alloc(allocator, newBytes)) == NULL) {
+        hash_release(allocator, first, newBytes);
+        return;
+    }
+    // a failed resize leaves the array as it was, and only a grow can fail
+    int* intHash1 = hash_resize(allocator, data->intHash1, oldBytes, newBytes);
+    if (intHash1 != NULL) data->intHash1 = intHash1;
+    int* intHash2 = intHash1 == NULL ? NULL : hash_resize(allocator, data->intHash2, oldBytes, newBytes);
+    if (intHash2 != NULL) data->intHash2 = intHash2;
+    size_t oldHighBytes = (size_t)data->allocatedSize * sizeof(uint64_t);
+    size_t newHighBytes = (size_t)newSize * sizeof(uint64_t);
+    uint64_t* hashHigh = data->hashHigh;
+    if (intHash2 != NULL && hashHigh != NULL) {
+        hashHigh = hash_resize(allocator, data->hashHigh, oldHighBytes, newHighBytes);
+        if (hashHigh != NULL) data->hashHigh = hashHigh;
+    }
+    int grown = intHash2 != NULL && (hashHigh != NULL || data->hashHigh == NULL);
+    int* next = !grown ? NULL : hash_resize(allocator, data->next, oldBytes, newBytes);
+    if (next == NULL) { // out of memory - the arrays that did grow go back to the current size
+        if (grown && hashHigh != NULL)
+            data->hashHigh = hash_resize(allocator, hashHigh, newHighBytes, oldHighBytes);
+        if (intHash2 != NULL) data->intHash2 = hash_resize(allocator, intHash2, newBytes, oldBytes);
+        if (intHash1 != NULL) data->intHash1 = hash_resize(allocator, intHash1, newBytes, oldBytes);
+        hash_release(allocator, first, newBytes);
+        hash_release(allocator, generations, newBytes);
+        return;
+    }
+    data->next = next;
+    hash_release(allocator, data->first, oldBytes);
+    data->first = first;
+    if (generations != NULL) {
+        hash_release(allocator, data->generations, oldBytes);
+        data->generations = generations;
+        data->generation = 0;
+    }
+    data->allocatedSize = newSize;
+    // chain every string in at the front of its new bucket (intHash1 is the hash already)
+    bulk_rehash(first, data->next, data->intHash1, data->size, newSize, 0, 0, str_hashset_threads(data, newSize));
+}
+
+
+// number of new first[] buckets set up during an incremental resize for every chain we'd migrate
+#define STR_HASHSET_INIT_PER_CHAIN 16
+
+
+/**
+ * allocate the arrays of an empty table for an incremental resize, its first[] array is set to
+ * empty a bit at a time by str_hashset_resize_step() so no single call has to touch all of it
+ */
+StringHashSet* str_hashset_allocate_table(int newSize, int fingerprintBits, const HashAllocator* allocator) {
+    StringHashSet* table = (StringHashSet*) hash_alloc(allocator, sizeof(StringHashSet));
+    if (table == NULL) return NULL; // failed?
+    table->allocator = allocator;
+    table->fingerprintBits = fingerprintBits;
+    table->initialSize = newSize;
+    if (!str_hashset_allocate_arrays(table, newSize)) {
+        str_hashset_free(table); // out of memory
+        return NULL;
+    }
+    return table;
+}
+
+
+// start an incremental resize to newSize slots - the set keeps working while it is migrated
+void resize_start(StringHashSet* data, int newSize) {
+    StringHashSet* table = str_hashset_allocate_table(newSize, data->fingerprintBits, data->allocator);
+    if (table == NULL) return; // out of memory, keep using the current table
+    data->resizeTo = table;
+    data->resizeInitialized = 0;
+    data->resizeMigrated = 0;
+}
+
+
+// is an incremental resize migrating chains (the new table is set up and in use)?
+static inline int migrating(StringHashSet* data) {
+    return data->resizeTo != NULL && data->resizeInitialized == data->resizeTo->allocatedSize;
+}
+
+
+// the new table replaces the old one at the end of an incremental resize
+void resize_finish(StringHashSet* data) {
+    StringHashSet* table = data->resizeTo;
+    int initialSize = data->initialSize;
+    data->resizeTo = NULL;
+    str_hashset_free_content_only(data); // de-allocate the now empty old table
+    data->first = table->first;
+    data->next = table->next;
+    data->intHash1 = table->intHash1;
+    data->intHash2 = table->intHash2;
+    data->hashHigh = table->hashHigh;
+    data->size = table->size;
+    data->initialSize = initialSize; // keep the size clear() shrinks back to
+    data->allocatedSize = table->allocatedSize;
+    hash_stats_merge(&data->counters, &table->counters); // the adds into the new table
+    hash_release(data->allocator, table, sizeof(StringHashSet)); // de-allocate temporary helper data
+}
+
+
+/**
+ * do a bounded amount of incremental resize work: set up the next part of the new table's first[] array,
+ * or once that is done move the next "chains" chains of the old table into the new one
+ */
+void resize_step(StringHashSet* data, int chains) {
+    StringHashSet* table = data->resizeTo;
+    if (data->resizeInitialized < table->allocatedSize) {
+        long end = data->resizeInitialized + (long)chains * STR_HASHSET_INIT_PER_CHAIN;
+        if (end > table->allocatedSize) end = table->allocatedSize;
+        for (int i = data->resizeInitialized; i < end; i++)
+            table->first[i] = STRING_HASHMAP_EMPTY_KEY;
+        data->resizeInitialized = (int)end;
+        return;
+    }
+    long end = data->resizeMigrated + (long)chains;
+    if (end > data->allocatedSize) end = data->allocatedSize;
+    for (int i = data->resizeMigrated; i < end; i++) {
+        // move every entry of the chain into the new table, its strings can't be in there yet
+        // so they go straight to the front of their new chains
+        int nextIndex = data->first[i];
+        while (nextIndex != STRING_HASHMAP_EMPTY_KEY) {
+            int firstIndex = str_hashset_bucket(table, data->intHash1[nextIndex]);
+            table->intHash1[table->size] = data->intHash1[nextIndex];
+            table->intHash2[table->size] = data->intHash2[nextIndex];
+            if (table->hashHigh != NULL) table->hashHigh[table->size] = data->hashHigh[nextIndex];
+            table->next[table->size] = table->first[firstIndex];
+            table->first[firstIndex] = table->size;
+            table->size += 1;
+            nextIndex = data->next[nextIndex];
+        }
+        data->first[i] = STRING_HASHMAP_EMPTY_KEY; // the chain is gone from the old table
+    }
+    data->resizeMigrated = (int)end;
+    if (data->resizeMigrated == data->allocatedSize)
+        resize_finish(data);
+}
+
+
+/**
+ * make sure the new table of an incremental resize can take every string of the set and one more before it is
+ * finished in one go: adds while a shrink migrates go into the smaller table and can outgrow it.  a new table
+ * that isn't in use yet is dropped (the old one still holds everything), one that is grows - re-chaining the
+ * strings it has and setting up all of its first[] - or stays as it is if there's no memory for that
+ */
+static void resize_fit(StringHashSet* data) {
+    StringHashSet* table = data->resizeTo;
+    if (data->size + 1 < table->allocatedSize)
+        return; // fits
+    if (!migrating(data)) {
+        str_hashset_free(table);
+        data->resizeTo = NULL;
+        return;
+    }
+    int newSize = table->allocatedSize;
+    while (data->size + 1 >= newSize && newSize < INT_HASH_MAX_CAPACITY)
+        newSize *= 2;
+    resize(table, newSize);
+    data->resizeInitialized = table->allocatedSize;
+}
+
+
+// finish an incremental resize in one go (one that can't take every string is left as it is)
+void resize_complete(StringHashSet* data) {
+    if (data->resizeTo == NULL)
+        return;
+    resize_fit(data);
+    if (data->resizeTo != NULL && data->size >= data->resizeTo->allocatedSize)
+        return; // out of memory: there's no room to move the rest into
+    while (data->resizeTo != NULL)
+        resize_step(data, data->allocatedSize);
+}
+
+
+// grow the map to twice its size
 void grow(StringHashSet* data) {
     if (data == NULL) return; // NULL map, can't grow
     int oldSize = data->allocatedSize;
-    int growSize = ((oldSize * 3) / 2) + 1; // 50% growth
-
-    StringHashSet* newData = str_hashset_create(growSize);
-    if (newData == NULL) return; // can't allocate new data
-
-    // copy existing data into the new array
-    for (int i = 0; i < data->allocatedSize; i++) {
-        int oldFirst = data->first[i];
-        int oldNextIndex = oldFirst;
-        while (oldNextIndex != STRING_HASHMAP_EMPTY_KEY) {
-            int intHash1Value = data->intHash1[oldNextIndex];
-            int intHash2Value = data->intHash2[oldNextIndex];
-            newData->size = insertHelper(intHash1Value, intHash2Value, newData);
-            oldNextIndex = data->next[oldNextIndex];
-        }
+    if (oldSize >= INT_HASH_MAX_CAPACITY) return; // as big as a table gets
+    uint64_t start = hash_stats_clock();
+    if (data->resizeStep > 0)
+        resize_start(data, oldSize * 2); // double, a bit at a time
+    else
+        resize(data, oldSize * 2); // double
+    hash_stats_grow(&data->counters, start);
+}
 
-    } // for each existing entry
 
-    // transfer the newly mapped data
-    str_hashset_free_content_only(data);
-    // copy newData into data, as this is what is being replaced / grown
-    data->first = newData->first;
-    data->next = newData->next;
-    data->intHash1 = newData->intHash1;
-    data->intHash2 = newData->intHash2;
-    data->size = newData->size;
-    data->initialSize = newData->initialSize;
-    data->allocatedSize = newData->allocatedSize;
-    free(newData); // de-allocate temporary helper data
+// shrink the map to half its size if it has become mostly empty (less than a quarter used)
+void shrink(StringHashSet* data) {
+    if (data->size >= data->allocatedSize / 4 || data->allocatedSize <= data->initialSize)
+        return; // still well used, or already at its smallest
+    int shrinkSize = data->allocatedSize / 2;
+    if (shrinkSize < data->initialSize)
+        shrinkSize = data->initialSize;
+    if (data->resizeStep > 0)
+        resize_start(data, shrinkSize);
+    else
+        resize(data, shrinkSize);
 }
 
 
 /**
- * add a new string into the set
- * @return true if a new item was added, false if the item already existed
+ * turn incremental resizing on (chainsPerStep > 0) or off (0)
+ * when on, a grow or shrink no longer re-maps the whole set inside one add/remove: the old and new tables
+ * coexist and every add/contains/remove migrates chainsPerStep chains until the old table is empty
  */
-int str_hashset_add(StringHashSet* data, const char* str) {
-    // can't add empty str or into a NULL data
-    if (str == NULL || strlen(str) == 0 || data == NULL)
-        return 0;
+void str_hashset_set_incremental_resize(StringHashSet* data, int chainsPerStep) {
+    if (data == NULL || data->mapping != NULL || data->generations != NULL)
+        return; // never for a read-only set, and not together with fast clear
+    data->resizeStep = chainsPerStep > 0 ? chainsPerStep : 0;
+    if (data->resizeStep == 0 && data->resizeTo != NULL)
+        resize_complete(data); // turned off during a resize
+}
+
+
+/**
+ * turn fast clear on (on != 0) or off (0)
+ * when on, every first[] bucket carries the generation it was last written in and str_hashset_clear() only starts
+ * a new generation: the buckets of older ones count as empty, so a clear costs the same for any table size and
+ * keeps the table at its current size.  incremental resizing is turned off (a resize in progress is finished first)
+ */
+void str_hashset_set_fast_clear(StringHashSet* data, int on) {
+    if (data == NULL || data->mapping != NULL) return; // never for a read-only set
+    size_t bytes = (size_t)data->allocatedSize * sizeof(int);
+    if (!on) {
+        if (data->generations == NULL) return;
+        str_hashset_flush_generations(data);
+        hash_release(data->allocator, data->generations, bytes);
+        data->generations = NULL;
+        return;
+    }
+    if (data->generations != NULL) return;
+    if (data->resizeTo != NULL)
+        resize_complete(data);
+    data->resizeStep = 0;
+    data->generations = hash_alloc(data->allocator, bytes); // zeroed: every bucket is in the current generation
+    data->generation = 0;
+}
+
+
+/**
+ * spread the work of re-chaining a table on resize and of clearing it over nthreads threads, for tables of at
+ * least minSize slots (<= 0: BULK_PARALLEL_MIN_SIZE) - smaller tables are cheaper to do on the calling thread
+ */
+void str_hashset_set_parallel_resize(StringHashSet* data, int nthreads, int minSize) {
+    if (data == NULL) return;
+    data->parallelThreads = nthreads > 1 ? nthreads : 0;
+    data->parallelMinSize = minSize > 0 ? minSize : BULK_PARALLEL_MIN_SIZE;
+}
+
+
+/**
+ * find the slot of a string (by its fingerprint) in the chains of data
+ * @return the index of the string's slot, or STRING_HASHMAP_EMPTY_KEY if not found
+ */
+int str_hashset_find(StringHashSet* data, int intHash1Value, int intHash2Value, uint64_t high) {
+    int firstIndex = str_hashset_bucket(data, intHash1Value); // starting location
+    int nextIndex = str_hashset_head(data, firstIndex);
+    int probes = 0;
+    while (nextIndex != STRING_HASHMAP_EMPTY_KEY) {
+        probes += 1;
+        if (str_hashset_match(data, nextIndex, intHash1Value, intHash2Value, high))
+            break; // found it!
+        nextIndex = data->next[nextIndex];
+    }
+    hash_stats_probe(&data->counters, HASH_STATS_CONTAINS, probes);
+    return nextIndex; // STRING_HASHMAP_EMPTY_KEY if not found
+}
+
+
+// is the string with this fingerprint (hash, and high for a 128 bit set) in the set
+static int str_hashset_contains_fingerprint(StringHashSet* data, uint64_t hash, uint64_t high) {
+    int intHash1Value = (int)(uint32_t)hash; // find first index
+    int intHash2Value = (int)(uint32_t)(hash >> 32); // check second hash
+    if (data->resizeTo != NULL) { // incremental resize in progress
+        resize_step(data, data->resizeStep);
+        if (migrating(data) &&
+                str_hashset_find(data->resizeTo, intHash1Value, intHash2Value, high) != STRING_HASHMAP_EMPTY_KEY)
+            return 1; // found it in the new table
+    }
+    return str_hashset_find(data, intHash1Value, intHash2Value, high) != STRING_HASHMAP_EMPTY_KEY;
+}
+
+
+// add a string by its fingerprint (hash, and high for a 128 bit set), returns 1 if it wasn't in the set yet
+static int str_hashset_add_fingerprint(StringHashSet* data, uint64_t hash, uint64_t high) {
+
+    int intHash1Value = (int)(uint32_t)hash; // bucket hash
+    int intHash2Value = (int)(uint32_t)(hash >> 32); // verification hash
+
+    if (data->resizeTo != NULL) { // incremental resize in progress
+        resize_step(data, data->resizeStep);
+        if (migrating(data)) {
+            // strings live in either table: if it isn't in the old one it goes into the new one
+            if (str_hashset_find(data, intHash1Value, intHash2Value, high) != STRING_HASHMAP_EMPTY_KEY)
+                return 0;
+            StringHashSet* table = data->resizeTo;
+            if (data->size + 1 < table->allocatedSize) { // room for the strings of both tables
+                int oldSize = table->size;
+                table->size = insertHelper(intHash1Value, intHash2Value, high, table);
+                data->size += table->size - oldSize;
+                return table->size > oldSize;
+            }
+            resize_complete(data); // the new table filled up (or a shrink outgrew it) early, finish it now
+            if (data->resizeTo != NULL)
+                return 0; // it can't hold all of the strings and there's no memory to grow it
+        } else if (data->size + 1 >= data->allocatedSize) {
+            resize_complete(data); // the old table filled up while the new one was being set up
+        }
+    }
 
     // do we need to grow our arrays and remap all existing data?
-    if (data->size + 1 >= data->allocatedSize) {
+    // with incremental resizing we start early, so the old table still has room while the new one is set up
+    int growAt = data->resizeStep > 0 ? data->allocatedSize - data->allocatedSize / 8 : data->allocatedSize;
+    if (data->size + 1 >= growAt && data->resizeTo == NULL) {
         grow(data);
+        if (data->size + 1 >= data->allocatedSize) { // still no room left in this table
+            if (data->resizeTo != NULL)
+                resize_complete(data); // too small to resize a bit at a time
+            else if (data->allocatedSize < INT_HASH_MAX_CAPACITY)
+                resize(data, data->allocatedSize * 2); // couldn't start an incremental resize
+        }
+        // the resize above can have failed as well
+        if (data->size + 1 >= data->allocatedSize)
+            return 0; // full and can't grow (out of memory, or at INT_HASH_MAX_CAPACITY)
     }
 
-    // get an index into the first array
-    int intHash1Value = stringToHash1(str);
-    int intHash2Value = stringToHash2(str);
     int oldSize = data->size;
-    data->size = insertHelper(intHash1Value, intHash2Value, data);
+    data->size = insertHelper(intHash1Value, intHash2Value, high, data);
     return data->size > oldSize;
 }
 
 
 /**
- * is str inside the map (does it exist)
+ * add a string by its str_hashset_hash() value into the set (64 bit sets only, see str_hashset_add_hashed128())
+ * @return true if a new item was added, false if the item already existed
  */
-int str_hashset_contains(StringHashSet* data, const char* str) {
-    // we can never insert an empty string - or into a NULL data array
-    if (str == NULL || strlen(str) == 0 || data == NULL)
+int str_hashset_add_hashed(StringHashSet* data, uint64_t hash) {
+    // can't add into a NULL data, or a read-only one
+    if (data == NULL || data->mapping != NULL || str_hashset_wide(data))
         return 0;
-    int intHash1Value = stringToHash1(str); // find first index
-    int firstIndex = abs((intHash1Value % data->allocatedSize));
-    int nextIndex = data->first[firstIndex];
-    if (nextIndex == STRING_HASHMAP_EMPTY_KEY) // not set - not found
+    return str_hashset_add_fingerprint(data, hash, 0);
+}
+
+
+/**
+ * add a string by its str_hashset_hash128() value (hash the low, high the high 64 bits) into a 128 bit set
+ * @return true if a new item was added, false if the item already existed
+ */
+int str_hashset_add_hashed128(StringHashSet* data, uint64_t hash, uint64_t high) {
+    if (data == NULL || data->mapping != NULL || !str_hashset_wide(data))
         return 0;
-    int intHash2Value = stringToHash2(str); // check second hash
-    while (data->next[nextIndex] != STRING_HASHMAP_EMPTY_KEY) {
-        if (data->intHash1[nextIndex] == intHash1Value && data->intHash2[nextIndex] == intHash2Value)
-            return 1; // found it!
-        nextIndex = data->next[nextIndex];
+    return str_hashset_add_fingerprint(data, hash, high);
+}
+
+
+// exact checking: make room for the presence flag of interner id id, returns 0 if out of memory
+static int str_hashset_exact_reserve(StringHashSet* data, int id) {
+    if (id < data->exactInSize) return 1;
+    int size = data->exactInSize > 0 ? data->exactInSize : 1024;
+    while (size <= id) size *= 2;
+    unsigned char* exactIn = hash_resize(data->allocator, data->exactIn, (size_t)data->exactInSize, (size_t)size);
+    if (exactIn == NULL) return 0;
+    memset(exactIn + data->exactInSize, 0, (size_t)(size - data->exactInSize));
+    data->exactIn = exactIn;
+    data->exactInSize = size;
+    return 1;
+}
+
+
+// exact checking: a string that isn't in the set was looked for, tookForIn tells if the set took it for one that is
+static void str_hashset_exact_miss(StringHashSet* data, int tookForIn) {
+    data->exactMisses += 1;
+    data->falsePositives += tookForIn != 0;
+    data->expectedFalsePositives += (double)data->size * (str_hashset_wide(data) ? 0x1p-128 : 0x1p-64);
+}
+
+
+/**
+ * turn exact checking on (on != 0) or off (0) - meant for measuring, not for production: every string added
+ * is also kept in a StringInterner, so every add / contains / remove of a string (not of a hash) can tell a
+ * string that really isn't in the set from one the set took for another because their fingerprints matched.
+ * str_hashset_false_positive_rate() reports how often that happened.  strings added before it was turned on
+ * count as not in the set, so turn it on while the set is still empty
+ */
+void str_hashset_set_exact_check(StringHashSet* data, int on) {
+    if (data == NULL || data->mapping != NULL) return;
+    if (!on) {
+        str_interner_free(data->exact);
+        hash_release(data->allocator, data->exactIn, (size_t)data->exactInSize);
+        data->exact = NULL;
+        data->exactIn = NULL;
+        data->exactInSize = 0;
+        return;
     }
-    // we've found it if the two hashes match @ nextIndex
-    return (data->intHash1[nextIndex] == intHash1Value && data->intHash2[nextIndex] == intHash2Value);
+    if (data->exact == NULL)
+        data->exact = str_interner_create_with_allocator(1024, data->allocator);
 }
 
 
 /**
- * remove a str from the set
+ * the false positive rate seen by exact checking: the part of the adds / contains / removes of strings that
+ * weren't in the set where the set took them for one that was
+ * @param expectedRate receives the rate to expect for the fingerprint width, given the set sizes seen (can be NULL)
+ * @return the rate seen (0 before any string that isn't in the set was looked for)
  */
-int str_hashset_remove(StringHashSet* data, const char* str) {
-    // can't remove something from a NULL data structure, or an empty string
-    if (data == NULL || str == NULL || strlen(str) == 0) return 0;
-
-    int intHash1Value = stringToHash1(str); // location hash-value
-    int firstIndex = abs((intHash1Value % data->allocatedSize)); // to index
-    int nextIndex = data->first[firstIndex]; // does it exist?
-    if (nextIndex == STRING_HASHMAP_EMPTY_KEY) // dne
-        return 0; // nothing to remove
-    int intHash2Value = stringToHash2(str); // second verification hash
-    int prevIndex = nextIndex;
-    while (data->next[nextIndex] != STRING_HASHMAP_EMPTY_KEY) {
-        if (data->intHash1[nextIndex] == intHash1Value && data->intHash2[nextIndex] == intHash2Value)
+double str_hashset_false_positive_rate(StringHashSet* data, double* expectedRate) {
+    int any = data != NULL && data->exactMisses > 0;
+    if (expectedRate != NULL)
+        *expectedRate = any ? data->expectedFalsePositives / (double)data->exactMisses : 0;
+    return any ? (double)data->falsePositives / (double)data->exactMisses : 0;
+}
+
+
+/**
+ * add the len bytes at str (don't have to be '\0' terminated) into the set
+ * @return true if a new item was added, false if the item already existed
+ */
+int str_hashset_add_n(StringHashSet* data, const char* str, size_t len) {
+    // can't add empty str
+    if (data == NULL || data->mapping != NULL || str == NULL || len == 0)
+        return 0;
+    uint64_t high;
+    uint64_t hash = str_hashset_fingerprint(data, str, len, &high);
+    if (data->exact == NULL)
+        return str_hashset_add_fingerprint(data, hash, high);
+    int id = str_interner_intern(data->exact, str, len);
+    if (id == STRING_INTERNER_NO_ID || !str_hashset_exact_reserve(data, id))
+        return str_hashset_add_fingerprint(data, hash, high); // can't check this one
+    int added = str_hashset_add_fingerprint(data, hash, high);
+    if (data->exactIn[id])
+        return added;
+    // not added: another string's fingerprint is in the set (a false positive), or the set is full / out of memory
+    int tookForIn = !added && str_hashset_contains_fingerprint(data, hash, high);
+    if (!added && !tookForIn)
+        return 0; // a failed add, the string isn't in the set
+    str_hashset_exact_miss(data, tookForIn);
+    data->exactIn[id] = 1;
+    return added;
+}
+
+
+/**
+ * add a new string into the set
+ * @return true if a new item was added, false if the item already existed
+ */
+int str_hashset_add(StringHashSet* data, const char* str) {
+    if (str == NULL) return 0;
+    return str_hashset_add_n(data, str, strlen(str));
+}
+
+
+// the state shared by the threads of str_hashset_build()
+typedef struct {
+    StringHashSet* data;
+    const char* const* strs;
+    int n;
+    int nthreads;
+    // the hash and bucket of every string
+    uint64_t* hashes;
+    uint32_t* buckets;
+    BulkPartitions partitions;
+} StrHashSetBuildWork;
+
+
+// hash thread t's part of the strings
+static void str_hashset_build_hash(void* arg, int t) {
+    StrHashSetBuildWork* work = (StrHashSetBuildWork*)arg;
+    int from = (int)((long)work->n * t / work->nthreads);
+    int to = (int)((long)work->n * (t + 1) / work->nthreads);
+    for (int i = from; i < to; i++) {
+        const char* str = work->strs[i];
+        work->hashes[i] = str != NULL ? str_hashset_hash(str, strlen(str)) : 0;
+        work->buckets[i] = (uint32_t)str_hashset_bucket(work->data, (int)(uint32_t)work->hashes[i]);
+    }
+}
+
+
+// fill the partitions of thread t: each owns its own buckets and slots, so nothing is shared
+static void str_hashset_build_fill(void* arg, int t) {
+    StrHashSetBuildWork* work = (StrHashSetBuildWork*)arg;
+    StringHashSet* data = work->data;
+    BulkPartitions* partitions = &work->partitions;
+    for (int p = t; p < partitions->numPartitions; p += work->nthreads) {
+        int bucketFrom = p << partitions->bucketShift;
+        int bucketTo = (p + 1) << partitions->bucketShift;
+        for (int b = bucketFrom; b < bucketTo; b++)
+            data->first[b] = STRING_HASHMAP_EMPTY_KEY;
+        int slot = partitions->starts[p];
+        for (int j = partitions->starts[p]; j < partitions->starts[p + 1]; j++) {
+            int i = partitions->order[j];
+            if (work->strs[i] == NULL || work->strs[i][0] == '\0')
+                continue; // never added, as with str_hashset_add()
+            int intHash1Value = (int)(uint32_t)work->hashes[i];
+            int intHash2Value = (int)(uint32_t)(work->hashes[i] >> 32);
+            int firstIndex = (int)work->buckets[i];
+            int index = data->first[firstIndex];
+            while (index != STRING_HASHMAP_EMPTY_KEY &&
+                   (data->intHash1[index] != intHash1Value || data->intHash2[index] != intHash2Value))
+                index = data->next[index];
+            if (index != STRING_HASHMAP_EMPTY_KEY)
+                continue; // already in the set
+            // a new string goes to the front of its chain
+            data->intHash1[slot] = intHash1Value;
+            data->intHash2[slot] = intHash2Value;
+            data->next[slot] = data->first[firstIndex];
+            data->first[firstIndex] = slot;
+            slot += 1;
+        }
+        partitions->used[p] = slot - partitions->starts[p];
+    }
+}
+
+
+/**
+ * build a set from n '\0' terminated strings at once, much faster than n calls of str_hashset_add(): the
+ * table is sized for n strings once, the strings are hashed and radix partitioned by bucket range by nthreads
+ * threads and every thread then fills its own partitions without any locking (NULL and empty strings are skipped)
+ * @return the new set, or NULL if out of memory
+ */
+StringHashSet* str_hashset_build(const char* const* strs, int n, int nthreads) {
+    if (n < 0 || (n > 0 && strs == NULL) || n >= INT_HASH_MAX_CAPACITY)
+        return NULL;
+    if (nthreads < 1) nthreads = 1;
+    int allocatedSize = int_hash_capacity(n + 1); // room for one more, as str_hashset_add() keeps
+    StrHashSetBuildWork work = {NULL, strs, n, nthreads, NULL, NULL, {0}};
+    work.data = str_hashset_allocate_table(allocatedSize, STRING_HASHSET_FINGERPRINT_64, NULL);
+    work.hashes = malloc((n > 0 ? n : 1) * sizeof(uint64_t));
+    work.buckets = malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+    if (work.data == NULL || work.hashes == NULL || work.buckets == NULL) {
+        str_hashset_free(work.data);
+        free(work.hashes);
+        free(work.buckets);
+        return NULL;
+    }
+    bulk_run(nthreads > n ? 1 : nthreads, str_hashset_build_hash, &work);
+    int bucketBits = 0;
+    while ((1 << bucketBits) < allocatedSize)
+        bucketBits += 1;
+    if (!bulk_partition(&work.partitions, work.buckets, n, bucketBits, nthreads)) {
+        str_hashset_free(work.data);
+        free(work.hashes);
+        free(work.buckets);
+        return NULL;
+    }
+    if (work.nthreads > work.partitions.numPartitions)
+        work.nthreads = work.partitions.numPartitions;
+    bulk_run(work.nthreads, str_hashset_build_fill, &work);
+    StringHashSet* data = work.data;
+    data->size = bulk_compact(&work.partitions, data->first, data->next, data->intHash1, data->intHash2, nthreads);
+    bulk_free(&work.partitions);
+    free(work.hashes);
+    free(work.buckets);
+    return data;
+}
+
+
+/**
+ * is the string with this str_hashset_hash() value inside the map (64 bit sets only)
+ */
+int str_hashset_contains_hashed(StringHashSet* data, uint64_t hash) {
+    // we can never find anything in a NULL data array
+    if (data == NULL || str_hashset_wide(data))
+        return 0;
+    return str_hashset_contains_fingerprint(data, hash, 0);
+}
+
+
+/**
+ * is the string with this str_hashset_hash128() value inside a 128 bit set
+ */
+int str_hashset_contains_hashed128(StringHashSet* data, uint64_t hash, uint64_t high) {
+    if (data == NULL || !str_hashset_wide(data))
+        return 0;
+    return str_hashset_contains_fingerprint(data, hash, high);
+}
+
+
+/**
+ * are the len bytes at str (don't have to be '\0' terminated) inside the map
+ */
+int str_hashset_contains_n(StringHashSet* data, const char* str, size_t len) {
+    // we can never insert an empty string
+    if (data == NULL || str == NULL || len == 0)
+        return 0;
+    uint64_t high;
+    uint64_t hash = str_hashset_fingerprint(data, str, len, &high);
+    int found = str_hashset_contains_fingerprint(data, hash, high);
+    if (data->exact != NULL) {
+        int id = str_interner_find(data->exact, str, len);
+        if (id == STRING_INTERNER_NO_ID || id >= data->exactInSize || !data->exactIn[id])
+            str_hashset_exact_miss(data, found);
+    }
+    return found;
+}
+
+
+/**
+ * is str inside the map (does it exist)
+ */
+int str_hashset_contains(StringHashSet* data, const char* str) {
+    if (str == NULL) return 0;
+    return str_hashset_contains_n(data, str, strlen(str));
+}
+
+
+/**
+ * are the n strings inside the map, looked up INT_HASH_BATCH at a time and in stages so their cache misses
+ * overlap: hash every string and prefetch its first[] bucket, then read the buckets and prefetch the chain
+ * entries they point at, then walk the chains - with 64 bit fingerprints for 8 or 16 strings at once on cpus with
+ * AVX2 / AVX-512 (hash_simd.h)
+ * @param outFound receives 1 for every string in the map and 0 otherwise (NULL and empty strings are never in it)
+ * @return the number of strings found
+ */
+int str_hashset_contains_many(StringHashSet* data, const char* const* strs, int n, int* outFound) {
+    if (data == NULL || strs == NULL || outFound == NULL || n <= 0) return 0;
+    int found = 0;
+    int start = 0;
+    // strings live in either table during an incremental resize, look those up one at a time (as well as
+    // with exact checking, which needs every string)
+    for (; start < n && (data->resizeTo != NULL || data->exact != NULL); start++) {
+        outFound[start] = str_hashset_contains(data, strs[start]);
+        found += outFound[start];
+    }
+    HashSimdChains chains = {data->first, data->generations, data->generation, (uint32_t)(data->allocatedSize - 1),
+                             0, 0, data->intHash1, data->intHash2, data->next, NULL, &data->counters};
+    int intHash1[INT_HASH_BATCH];
+    int intHash2[INT_HASH_BATCH];
+    uint64_t high[INT_HASH_BATCH];
+    int buckets[INT_HASH_BATCH];
+    int position[INT_HASH_BATCH];
+    int batchFound[INT_HASH_BATCH];
+    for (; start < n; start += INT_HASH_BATCH) {
+        int count = n - start < INT_HASH_BATCH ? n - start : INT_HASH_BATCH;
+        int hashed = 0;
+        for (int i = 0; i < count; i++) { // stage 1: hash, prefetch the buckets (empty strings are never in the set)
+            const char* str = strs[start + i];
+            size_t len = str != NULL ? strlen(str) : 0;
+            outFound[start + i] = 0;
+            if (len == 0)
+                continue;
+            uint64_t hash = str_hashset_fingerprint(data, str, len, &high[hashed]);
+            intHash1[hashed] = (int)(uint32_t)hash;
+            intHash2[hashed] = (int)(uint32_t)(hash >> 32);
+            buckets[hashed] = str_hashset_bucket(data, intHash1[hashed]);
+            INT_HASH_PREFETCH(data->first + buckets[hashed]);
+            position[hashed++] = start + i;
+        }
+        if (data->hashHigh == NULL) { // the rest with the vector kernel the cpu supports (hash_simd.h)
+            found += hash_simd_find_many(&chains, intHash1, intHash2, hashed, NULL, batchFound);
+            for (int i = 0; i < hashed; i++)
+                outFound[position[i]] = batchFound[i];
+            continue;
+        }
+        for (int i = 0; i < hashed; i++) { // stage 2: read the buckets, prefetch the first entry of each chain
+            buckets[i] = str_hashset_head(data, buckets[i]);
+            if (buckets[i] != STRING_HASHMAP_EMPTY_KEY) {
+                INT_HASH_PREFETCH(data->intHash1 + buckets[i]);
+                INT_HASH_PREFETCH(data->intHash2 + buckets[i]);
+            }
+        }
+        for (int i = 0; i < hashed; i++) { // stage 3: walk the chains
+            int nextIndex = buckets[i];
+            int probes = nextIndex != STRING_HASHMAP_EMPTY_KEY;
+            while (nextIndex != STRING_HASHMAP_EMPTY_KEY &&
+                   !str_hashset_match(data, nextIndex, intHash1[i], intHash2[i], high[i])) {
+                nextIndex = data->next[nextIndex];
+                probes += nextIndex != STRING_HASHMAP_EMPTY_KEY;
+            }
+            hash_stats_probe(&data->counters, HASH_STATS_CONTAINS, probes);
+            outFound[position[i]] = nextIndex != STRING_HASHMAP_EMPTY_KEY;
+            found += outFound[position[i]];
+        }
+    }
+    return found;
+}
+
+
+// the str_hashset_hash() of entry i, put back together from its two halves
+static inline uint64_t str_hashset_entry_hash(StringHashSet* data, int i) {
+    return (uint64_t)(uint32_t)data->intHash2[i] << 32 | (uint32_t)data->intHash1[i];
+}
+
+
+/**
+ * get the str_hashset_hash() of the next string of the set (a set keeps only the hashes of its strings):
+ * start with *cursor = 0 and call it until it returns 0, the set must not be changed in between,
+ * an incremental resize in progress is finished by the first call
+ * @return 1 if *hash was set, 0 once every string has been returned
+ */
+int str_hashset_next(StringHashSet* data, int* cursor, uint64_t* hash) {
+    if (data == NULL) return 0;
+    if (data->resizeTo != NULL)
+        resize_complete(data); // the entries of both tables would overlap
+    if (*cursor >= data->size) return 0;
+    *hash = str_hashset_entry_hash(data, (*cursor)++);
+    return 1;
+}
+
+
+/**
+ * call fn(hash, context, 0) for the hash of every string in the set, walking its entry arrays front to back
+ * (an incremental resize in progress is finished first) - fn must not change the set
+ */
+void str_hashset_for_each(StringHashSet* data, StringHashVisitor fn, void* context) {
+    int cursor = 0;
+    uint64_t hash;
+    while (str_hashset_next(data, &cursor, &hash))
+        fn(hash, context, 0);
+}
+
+
+// the state shared by the threads of str_hashset_for_each_parallel()
+typedef struct {
+    StringHashSet* data;
+    StringHashVisitor fn;
+    void* context;
+    int nthreads;
+} StrHashsetForEachWork;
+
+
+// visit thread t's chunk of the entries
+static void str_hashset_for_each_chunk(void* arg, int t) {
+    StrHashsetForEachWork* work = (StrHashsetForEachWork*)arg;
+    StringHashSet* data = work->data;
+    int from = (int)((long)data->size * t / work->nthreads);
+    int to = (int)((long)data->size * (t + 1) / work->nthreads);
+    for (int i = from; i < to; i++)
+        work->fn(str_hashset_entry_hash(data, i), work->context, t);
+}
+
+
+/**
+ * call fn(hash, context, thread) for the hash of every string in the set with nthreads threads, every thread
+ * walks its own contiguous chunk of the entries (see iihm_for_each_parallel())
+ */
+void str_hashset_for_each_parallel(StringHashSet* data, int nthreads, StringHashVisitor fn, void* context) {
+    if (data == NULL) return;
+    if (data->resizeTo != NULL)
+        resize_complete(data);
+    StrHashsetForEachWork work = {data, fn, context, nthreads > 1 ? nthreads : 1};
+    bulk_run(work.nthreads, str_hashset_for_each_chunk, &work);
+}
+
+/**
+ * move the last entry into the free slot "to" so the entries stay densely packed in 0..size-1,
+ * the link (first[] or next[]) that pointed at the last entry is updated to point at its new slot
+ */
+void move_last(StringHashSet* data, int to) {
+    int last = data->size - 1;
+    if (to != last) {
+        int firstIndex = str_hashset_bucket(data, data->intHash1[last]); // where the last entry is chained from
+        if (str_hashset_head(data, firstIndex) == last) {
+            str_hashset_set_head(data, firstIndex, to); // it is the first item of its chain
+        } else {
+            int prevIndex = str_hashset_head(data, firstIndex);
+            while (data->next[prevIndex] != last) // find the item before it
+                prevIndex = data->next[prevIndex];
+            data->next[prevIndex] = to;
+        }
+        // copy the data across
+        data->intHash1[to] = data->intHash1[last];
+        data->intHash2[to] = data->intHash2[last];
+        if (data->hashHigh != NULL) data->hashHigh[to] = data->hashHigh[last];
+        data->next[to] = data->next[last];
+    }
+    // the last slot is now free
+    data->intHash1[last] = STRING_HASHMAP_EMPTY_KEY;
+    data->intHash2[last] = STRING_HASHMAP_EMPTY_KEY;
+    data->next[last] = STRING_HASHMAP_EMPTY_KEY;
+    data->size -= 1; // decrease size of map
+}
+
+
+/**
+ * unlink a string (by its fingerprint) from its chain (the slot itself isn't freed)
+ * @return the index of the unlinked slot, or STRING_HASHMAP_EMPTY_KEY if the string wasn't found
+ */
+int str_hashset_unlink(StringHashSet* data, int intHash1Value, int intHash2Value, uint64_t high) {
+    int firstIndex = str_hashset_bucket(data, intHash1Value); // to index
+    int nextIndex = str_hashset_head(data, firstIndex); // does it exist?
+    int prevIndex = STRING_HASHMAP_EMPTY_KEY;
+    int probes = 0;
+    while (nextIndex != STRING_HASHMAP_EMPTY_KEY) {
+        probes += 1;
+        if (str_hashset_match(data, nextIndex, intHash1Value, intHash2Value, high))
             break; // found it!
         prevIndex = nextIndex;
-        nextIndex = data->next[nextIndex];
+        nextIndex = data->next[nextIndex]; // cycle through
     }
+    hash_stats_probe(&data->counters, HASH_STATS_REMOVE, probes);
     // found?
-    if (data->intHash1[nextIndex] == intHash1Value && data->intHash2[nextIndex] == intHash2Value) {
-        // first update?
-        if (nextIndex == data->first[firstIndex]) {
-            data->first[firstIndex] = data->next[nextIndex]; // unchain first item
-            // does it remove the item completely?
-            if (data->next[nextIndex] == STRING_HASHMAP_EMPTY_KEY) {
-                data->intHash1[nextIndex] = STRING_HASHMAP_EMPTY_KEY;
-                data->intHash2[nextIndex] = STRING_HASHMAP_EMPTY_KEY;
-            }
+    if (nextIndex != STRING_HASHMAP_EMPTY_KEY) {
+        if (prevIndex == STRING_HASHMAP_EMPTY_KEY) {
+            str_hashset_set_head(data, firstIndex, data->next[nextIndex]); // unchain first item
         } else {
-                data->next[prevIndex] = data->next[nextIndex]; // skip one in the chain
+            data->next[prevIndex] = data->next[nextIndex]; // skip one in the chain
         }
-        data->size -= 1;
-        return 1;
     }
-    return 0; // not found
+    return nextIndex;
+}
+
+
+// remove the string with this fingerprint (hash, and high for a 128 bit set), returns 1 if it was removed
+static int str_hashset_remove_fingerprint(StringHashSet* data, uint64_t hash, uint64_t high) {
+    int intHash1Value = (int)(uint32_t)hash; // location hash-value
+    int intHash2Value = (int)(uint32_t)(hash >> 32); // second verification hash
+
+    if (data->resizeTo != NULL) { // incremental resize in progress
+        resize_step(data, data->resizeStep);
+        if (migrating(data)) {
+            // the old table is being emptied, just unlink its slot - otherwise remove it from the new table
+            if (str_hashset_unlink(data, intHash1Value, intHash2Value, high) == STRING_HASHMAP_EMPTY_KEY) {
+                StringHashSet* table = data->resizeTo;
+                int index = str_hashset_unlink(table, intHash1Value, intHash2Value, high);
+                if (index == STRING_HASHMAP_EMPTY_KEY)
+                    return 0; // not found
+                move_last(table, index);
+            }
+            data->size -= 1;
+            return 1;
+        }
+    }
+
+    int index = str_hashset_unlink(data, intHash1Value, intHash2Value, high);
+    if (index == STRING_HASHMAP_EMPTY_KEY)
+        return 0; // not found
+    // re-use the slot by moving the last entry into it, then give memory back if we're mostly empty
+    move_last(data, index);
+    if (data->resizeTo == NULL)
+        shrink(data);
+    return 1; // done!
+}
+
+
+/**
+ * remove the string with this str_hashset_hash() value from the set (64 bit sets only)
+ */
+int str_hashset_remove_hashed(StringHashSet* data, uint64_t hash) {
+    // can't remove something from a NULL data structure, or a read-only one
+    if (data == NULL || data->mapping != NULL || str_hashset_wide(data)) return 0;
+    return str_hashset_remove_fingerprint(data, hash, 0);
+}
+
+
+/**
+ * remove the string with this str_hashset_hash128() value from a 128 bit set
+ */
+int str_hashset_remove_hashed128(StringHashSet* data, uint64_t hash, uint64_t high) {
+    if (data == NULL || data->mapping != NULL || !str_hashset_wide(data)) return 0;
+    return str_hashset_remove_fingerprint(data, hash, high);
+}
+
+
+/**
+ * remove the len bytes at str (don't have to be '\0' terminated) from the set
+ */
+int str_hashset_remove_n(StringHashSet* data, const char* str, size_t len) {
+    // can't remove an empty string
+    if (data == NULL || data->mapping != NULL || str == NULL || len == 0) return 0;
+    uint64_t high;
+    uint64_t hash = str_hashset_fingerprint(data, str, len, &high);
+    int removed = str_hashset_remove_fingerprint(data, hash, high);
+    if (data->exact != NULL) {
+        int id = str_interner_find(data->exact, str, len);
+        if (id == STRING_INTERNER_NO_ID || id >= data->exactInSize || !data->exactIn[id])
+            str_hashset_exact_miss(data, removed); // removed another string
+        else
+            data->exactIn[id] = 0;
+    }
+    return removed;
+}
+
+
+/**
+ * remove a str from the set
+ */
+int str_hashset_remove(StringHashSet* data, const char* str) {
+    if (str == NULL) return 0;
+    return str_hashset_remove_n(data, str, strlen(str));
+}
+
+
+/**
+ * fill in out with the statistics of the set: the length of every chain, its load and the bytes of its struct and
+ * arrays, and the counters of its adds / contains / removes and grows if the library was compiled with HASH_STATS
+ * (see hash_stats.h) - an incremental resize in progress is finished first
+ */
+void str_hashset_stats(StringHashSet* data, HashStats* out) {
+    if (data == NULL || out == NULL) return;
+    if (data->resizeTo != NULL)
+        resize_complete(data);
+    size_t slots = (size_t)data->allocatedSize;
+    size_t memory;
+    if (data->mapping != NULL) { // the arrays are the snapshot file
+        memory = data->mappingSize;
+    } else { // first[], intHash1[], intHash2[], next[], the generations of fast clear and the high 64 bits
+        memory = slots * (data->generations != NULL ? 5 : 4) * sizeof(int);
+        if (data->hashHigh != NULL)
+            memory += slots * sizeof(uint64_t);
+    }
+    hash_stats_begin(out, &data->counters, data->size, data->allocatedSize, sizeof(StringHashSet) + memory);
+    hash_stats_chains(out, data->first, data->next, 1, data->allocatedSize, data->generations, data->generation);
+    hash_stats_end(out);
+}
+
+
+// identifies a StringHashSet snapshot
+#define STR_HASHSET_SNAPSHOT_MAGIC "RDSSTRS"
+
+
+/**
+ * save the set to a snapshot file at path (see snapshot.h), it can be opened with str_hashset_open_mmap()
+ * an incremental resize in progress is finished first, sets with 128 bit fingerprints can't be saved
+ * @return 1 on success, 0 on failure
+ */
+int str_hashset_save(StringHashSet* data, const char* path) {
+    if (data == NULL || str_hashset_wide(data)) return 0;
+    if (data->resizeTo != NULL)
+        resize_complete(data);
+    if (data->generations != NULL) { // the snapshot has no generations, so its first[] must be up to date
+        str_hashset_flush_generations(data);
+        memset(data->generations, 0, (size_t)data->allocatedSize * sizeof(int));
+        data->generation = 0;
+    }
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STR_HASHSET_SNAPSHOT_MAGIC, sizeof(STR_HASHSET_SNAPSHOT_MAGIC));
+    header.allocatedSize = data->allocatedSize;
+    header.initialSize = data->initialSize;
+    header.size = data->size;
+    // first[] is needed in full, the entries only up to size
+    header.numArrays = 4;
+    header.arrayBytes[0] = (uint64_t)data->allocatedSize * sizeof(int);
+    header.arrayBytes[1] = (uint64_t)data->size * sizeof(int);
+    header.arrayBytes[2] = (uint64_t)data->size * sizeof(int);
+    header.arrayBytes[3] = (uint64_t)data->size * sizeof(int);
+    const void* arrays[4] = {data->first, data->next, data->intHash1, data->intHash2};
+    return snapshot_save(path, &header, arrays);
+}
+
+
+/**
+ * open a snapshot saved by str_hashset_save() as a read-only set: its arrays point straight into a read-only
+ * mapping of the file, so nothing is read or re-hashed until it is used.  only the header is checked, call
+ * str_hashset_verify() before trusting a file that could be damaged - add, remove and clear do nothing
+ * on such a set, str_hashset_free() unmaps the file.
+ * @return the set, or NULL if path isn't a valid StringHashSet snapshot
+ */
+StringHashSet* str_hashset_open_mmap(const char* path) {
+    size_t mappingSize = 0;
+    const SnapshotHeader* header = snapshot_open(path, STR_HASHSET_SNAPSHOT_MAGIC, &mappingSize);
+    if (header == NULL) return NULL;
+    int allocatedSize = header->allocatedSize;
+    if (header->numArrays != 4 || allocatedSize <= 0 || (allocatedSize & (allocatedSize - 1)) != 0 ||
+            header->size < 0 || header->size > allocatedSize ||
+            header->arrayBytes[0] != (uint64_t)allocatedSize * sizeof(int) ||
+            header->arrayBytes[1] != (uint64_t)header->size * sizeof(int) ||
+            header->arrayBytes[2] != header->arrayBytes[1] || header->arrayBytes[3] != header->arrayBytes[1]) {
+        snapshot_close(header, mappingSize); // not the arrays of a set
+        return NULL;
+    }
+    StringHashSet* data = (StringHashSet*) calloc(1, sizeof(StringHashSet));
+    if (data == NULL) {
+        snapshot_close(header, mappingSize);
+        return NULL;
+    }
+    const char* base = (const char*)header;
+    data->first = (int*)(base + header->arrayOffset[0]);
+    data->next = (int*)(base + header->arrayOffset[1]);
+    data->intHash1 = (int*)(base + header->arrayOffset[2]);
+    data->intHash2 = (int*)(base + header->arrayOffset[3]);
+    data->allocatedSize = allocatedSize;
+    data->initialSize = header->initialSize;
+    data->size = header->size;
+    data->mapping = header;
+    data->mappingSize = mappingSize;
+    return data;
+}
+
+
+/**
+ * check a set opened by str_hashset_open_mmap() against the checksum it was saved with (reads the whole file)
+ * @return 1 if it is intact, 0 if it isn't (or the set isn't a snapshot)
+ */
+int str_hashset_verify(StringHashSet* data) {
+    if (data == NULL || data->mapping == NULL) return 0;
+    return snapshot_verify((const SnapshotHeader*)data->mapping) &&
+           snapshot_check_links(data->first, data->allocatedSize, data->size) &&
+           snapshot_check_links(data->next, data->size, data->size);
 }
@@ -5,21 +5,36 @@
 #ifndef C_CODE_STRING_HASH_SET_H
 #define C_CODE_STRING_HASH_SET_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include "hash_alloc.h"
+#include "hash_stats.h"
+
 // this is the only value that can't be used in the map of the entire INT range
 #define STRING_HASHMAP_EMPTY_KEY (-1)
 
+// fingerprint widths (str_hashset_create_fingerprinted()): the 64 bit str_hashset_hash() of a string (the default)
+#define STRING_HASHSET_FINGERPRINT_64 64
+// or the 128 bit str_hashset_hash128(), 8 more bytes per string
+#define STRING_HASHSET_FINGERPRINT_128 128
+
+struct STRUCT_StringInterner;
+
 /**
- * we use a double hash (two different functions) to avoid collisions
- * although this doesn't guarantee no hash collisions, it makes it really
- * really unlikely
+ * every string is stored as its 64 bit hash, split in two 32 bit halves (plus another 64 bits for a set of
+ * 128 bit fingerprints), every bit of it is compared.  although this doesn't guarantee no hash collisions, it
+ * makes them really really unlikely: with n strings in the set, one that isn't is taken for one that is with
+ * a chance of n / 2^64 (n / 2^128)
  */
 struct STRUCT_StringHashSet {
     // a list of first indexes
     int* first;
-    // an array of type 1 hashes identifying a string
+    // an array of the low 32 bits of the hashes identifying a string (picks the bucket)
     int* intHash1;
-    // an array of type 2 hashes identifying a string
+    // an array of the high 32 bits of the hashes identifying a string
     int* intHash2;
+    // 128 bit fingerprints only: the high 64 bits of the str_hashset_hash128() of every string, NULL otherwise
+    uint64_t* hashHigh;
     // an array of next offsets for collisions
     int* next;
     // how big the arrays are right now
@@ -28,27 +43,152 @@ struct STRUCT_StringHashSet {
     int initialSize;
     // how much data we have and where the offset is for the next entry
     int size;
+    // where the struct and its arrays come from, NULL: calloc / realloc / free (see hash_alloc.h)
+    const HashAllocator* allocator;
+    // incremental resizing: 0 re-maps the whole set inside the add/remove that grows or shrinks it,
+    // otherwise the number of chains every add/contains/remove migrates while a resize is in progress
+    int resizeStep;
+    // incremental resizing: the table being filled while a resize is in progress, NULL otherwise
+    struct STRUCT_StringHashSet* resizeTo;
+    // incremental resizing: how many first[] buckets of resizeTo have been set up
+    int resizeInitialized;
+    // incremental resizing: how many chains of this table have been migrated to resizeTo
+    int resizeMigrated;
+    // parallel resizing: number of threads that re-chain or clear a table of at least parallelMinSize slots,
+    // 0 or 1 does all of it on the calling thread
+    int parallelThreads;
+    int parallelMinSize;
+    // fast clear: the generation every first[] bucket was last written in, NULL when off
+    int* generations;
+    // fast clear: the current generation, buckets of any other generation are empty
+    int generation;
+    // STRING_HASHSET_FINGERPRINT_128 or STRING_HASHSET_FINGERPRINT_64 (0 is taken as 64 too)
+    int fingerprintBits;
+    // exact checking (str_hashset_set_exact_check()): every string added so far, NULL when off
+    struct STRUCT_StringInterner* exact;
+    // exact checking: 1 for every id of exact that is in the set right now, exactInSize of them
+    unsigned char* exactIn;
+    int exactInSize;
+    // exact checking: the number of adds / contains / removes of strings that weren't in the set
+    uint64_t exactMisses;
+    // exact checking: how many of those the set took for a string that was, as its fingerprint matched
+    uint64_t falsePositives;
+    // exact checking: how many of those to expect, the sum of size / 2^fingerprintBits over all of them
+    double expectedFalsePositives;
+    // the hot path counters of str_hashset_stats(), only kept in HASH_STATS builds (see hash_stats.h)
+    HashCounters counters;
+    // read-only sets (str_hashset_open_mmap()): the snapshot file mapping the arrays point into, NULL otherwise
+    const void* mapping;
+    // read-only sets: the size of the mapping in bytes
+    size_t mappingSize;
 };
 
 // define a nice name for the data structure
 typedef struct STRUCT_StringHashSet StringHashSet;
 
+// called with the str_hashset_hash() of every string by the iterating fns., thread is the number of the calling
+// thread (0 .. nthreads - 1)
+typedef void (*StringHashVisitor)(uint64_t hash, void* context, int thread);
+
 // create a new hash set
 StringHashSet* str_hashset_create(int initialSize);
 
+// create a new hash set whose memory comes from allocator (see hash_alloc.h)
+StringHashSet* str_hashset_create_with_allocator(int initialSize, const HashAllocator* allocator);
+
+// create a new hash set of 64 or 128 bit fingerprints (STRING_HASHSET_FINGERPRINT_*), allocator can be NULL
+StringHashSet* str_hashset_create_fingerprinted(int initialSize, int fingerprintBits,
+                                                const HashAllocator* allocator);
+
+// build a set from n strings at once with nthreads threads (sized once, partitioned by bucket range)
+StringHashSet* str_hashset_build(const char* const* strs, int n, int nthreads);
+
 // clear the hash set
 void str_hashset_clear(StringHashSet* data);
 
 // de-allocate the hash set
 void str_hashset_free(StringHashSet* data);
 
+// the 64 bit hash of len bytes at str, hash once and pass it to the *_hashed fns. of as many sets as needed
+uint64_t str_hashset_hash(const char* str, size_t len);
+
 // add a new string into the hash set and return 1 if it wasn't in there already
 int str_hashset_add(StringHashSet* data, const char* str);
 
+// add len bytes at str (not '\0' terminated) into the hash set and return 1 if they weren't in there already
+int str_hashset_add_n(StringHashSet* data, const char* str, size_t len);
+
+// the 128 bit hash of len bytes at str: returns the low 64 bits (the same as str_hashset_hash()), *high the rest
+uint64_t str_hashset_hash128(const char* str, size_t len, uint64_t* high);
+
+// add a string by its str_hashset_hash() into the hash set and return 1 if it wasn't in there already (64 bit sets)
+int str_hashset_add_hashed(StringHashSet* data, uint64_t hash);
+
+// add a string by its str_hashset_hash128() into a 128 bit set and return 1 if it wasn't in there already
+int str_hashset_add_hashed128(StringHashSet* data, uint64_t hash, uint64_t high);
+
 // does the map contain str?
 int str_hashset_contains(StringHashSet* data, const char* str);
 
+// does the map contain the len bytes at str?
+int str_hashset_contains_n(StringHashSet* data, const char* str, size_t len);
+
+// does the map contain the string with this str_hashset_hash()? (64 bit sets)
+int str_hashset_contains_hashed(StringHashSet* data, uint64_t hash);
+
+// does a 128 bit set contain the string with this str_hashset_hash128()?
+int str_hashset_contains_hashed128(StringHashSet* data, uint64_t hash, uint64_t high);
+
+// does the map contain each of the n strings? outFound[i] is set to 1 if it contains strs[i] (prefetch pipelined)
+int str_hashset_contains_many(StringHashSet* data, const char* const* strs, int n, int* outFound);
+
 // remove a string from the hash set
 int str_hashset_remove(StringHashSet* data, const char* str);
 
+// remove the len bytes at str from the hash set
+int str_hashset_remove_n(StringHashSet* data, const char* str, size_t len);
+
+// remove the string with this str_hashset_hash() from the hash set (64 bit sets)
+int str_hashset_remove_hashed(StringHashSet* data, uint64_t hash);
+
+// remove the string with this str_hashset_hash128() from a 128 bit set
+int str_hashset_remove_hashed128(StringHashSet* data, uint64_t hash, uint64_t high);
+
+// turn exact checking on (1: every string is kept to count false positives) or off (0), for measuring only
+void str_hashset_set_exact_check(StringHashSet* data, int on);
+
+// the false positive rate exact checking saw, and the rate to expect in *expectedRate (can be NULL)
+double str_hashset_false_positive_rate(StringHashSet* data, double* expectedRate);
+
+// get the hash of the next string (start with *cursor = 0), returns 0 once every string has been returned
+int str_hashset_next(StringHashSet* data, int* cursor, uint64_t* hash);
+
+// call fn with the hash of every string in the set in memory order
+void str_hashset_for_each(StringHashSet* data, StringHashVisitor fn, void* context);
+
+// call fn with the hash of every string in the set with nthreads threads, each walking its own chunk of the entries
+void str_hashset_for_each_parallel(StringHashSet* data, int nthreads, StringHashVisitor fn, void* context);
+
+// turn incremental resizing on (chainsPerStep > 0: chains migrated per operation) or off (0)
+void str_hashset_set_incremental_resize(StringHashSet* data, int chainsPerStep);
+
+// turn fast clear on (1: str_hashset_clear() is O(1) and keeps the table size) or off (0)
+void str_hashset_set_fast_clear(StringHashSet* data, int on);
+
+// use nthreads threads to re-chain or clear a table of at least minSize slots (<= 0: the default size)
+void str_hashset_set_parallel_resize(StringHashSet* data, int nthreads, int minSize);
+
+// fill in out with the statistics of the set: its chains, load and memory (and its counters, see hash_stats.h)
+void str_hashset_stats(StringHashSet* data, HashStats* out);
+
+// save the set to a snapshot file at path, returns 1 on success (not for 128 bit sets)
+int str_hashset_save(StringHashSet* data, const char* path);
+
+// open a snapshot file as a read-only set whose arrays point straight into the mapped file (NULL on failure)
+StringHashSet* str_hashset_open_mmap(const char* path);
+
+// check a set opened with str_hashset_open_mmap() against its checksum and that its chains stay inside the file,
+// returns 1 if it is intact - open only checks the header, call this before trusting a file that could be damaged
+int str_hashset_verify(StringHashSet* data);
+
 #endif //C_CODE_STRING_HASH_SET_H
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2024 by Rock de Vocht
+ *
+ * All rights reserved. No part of this publication may be reproduced, distributed, or
+ * transmitted in any form or by any means, including photocopying, recording, or other
+ * electronic or mechanical methods, without the prior written permission of the publisher,
+ * except in the case of brief quotations embodied in critical reviews and certain other
+ * noncommercial uses permitted by copyright law.
+ *
+ */
+
+/**
+ * an exact string -> dense int id map (see string_interner.h)
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "string_interner.h"
+#include "string_hash_set.h"
+#include "int_hash.h"
+#include "hash_alloc.h"
+
+
+// the bucket (first[] index) of a hash: its low 32 bits masked to the power of 2 table size
+static inline int str_interner_bucket(StringInterner* data, uint64_t hash) {
+    return (int)((uint32_t)hash & (uint32_t)(data->allocatedSize - 1));
+}
+
+
+// where the bytes of a chunk start
+static inline char* str_interner_chunk_data(StringInternerChunk* chunk) {
+    return (char*)(chunk + 1);
+}
+
+
+// give back a chunk
+static void str_interner_release_chunk(StringInterner* data, StringInternerChunk* chunk) {
+    hash_release(data->allocator, chunk, sizeof(StringInternerChunk) + chunk->size);
+}
+
+
+/**
+ * copy the len bytes at str and a '\0' into the current chunk, or a new one if it is full - a string longer
+ * than a chunk gets a chunk of its own, put behind the current one so that one keeps filling up
+ * @return the copy, or NULL if out of memory
+ */
+static char* str_interner_copy(StringInterner* data, const char* str, size_t len) {
+    size_t bytes = len + 1;
+    StringInternerChunk* chunk = data->chunk;
+    char* copy;
+    if (bytes > data->chunkSize) {
+        StringInternerChunk* own = hash_alloc(data->allocator, sizeof(StringInternerChunk) + bytes);
+        if (own == NULL) return NULL;
+        own->size = bytes;
+        own->used = bytes;
+        if (chunk != NULL) {
+            own->previous = chunk->previous;
+            chunk->previous = own;
+        } else {
+            data->chunk = own;
+        }
+        copy = str_interner_chunk_data(own);
+    } else {
+        if (chunk == NULL || chunk->size - chunk->used < bytes) { // start a new chunk
+            chunk = hash_alloc(data->allocator, sizeof(StringInternerChunk) + data->chunkSize);
+            if (chunk == NULL) return NULL;
+            chunk->previous = data->chunk;
+            chunk->size = data->chunkSize;
+            data->chunk = chunk;
+        }
+        copy = str_interner_chunk_data(chunk) + chunk->used;
+        chunk->used += bytes;
+    }
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    data->stringBytes += bytes;
+    return copy;
+}
+
+
+/**
+ * free all the data allocated by the StringInterner
+ */
+void str_interner_free(StringInterner* data) {
+    if (data == NULL) return;
+    size_t slots = (size_t)data->allocatedSize;
+    hash_release(data->allocator, data->first, slots * sizeof(int));
+    hash_release(data->allocator, data->entries, slots * sizeof(StringInternerEntry));
+    while (data->chunk != NULL) {
+        StringInternerChunk* previous = data->chunk->previous;
+        str_interner_release_chunk(data, data->chunk);
+        data->chunk = previous;
+    }
+    hash_release(data->allocator, data, sizeof(StringInterner));
+}
+
+
+/**
+ * create a new string interner for (at least) initialSize strings
+ */
+StringInterner* str_interner_create(int initialSize) {
+    return str_interner_create_with_allocator(initialSize, NULL);
+}
+
+
+/**
+ * create a new string interner for (at least) initialSize strings whose struct, arrays and string chunks come
+ * from allocator (NULL: the default allocator)
+ * @return the interner, or NULL if out of memory
+ */
+StringInterner* str_interner_create_with_allocator(int initialSize, const HashAllocator* allocator) {
+    StringInterner* data = (StringInterner*) hash_alloc(allocator, sizeof(StringInterner));
+    if (data == NULL) return NULL; // failed?
+    data->allocator = allocator;
+    data->initialSize = int_hash_capacity(initialSize);
+    data->allocatedSize = data->initialSize;
+    data->chunkSize = STRING_INTERNER_CHUNK_SIZE;
+    data->first = hash_alloc(allocator, (size_t)data->allocatedSize * sizeof(int));
+    data->entries = hash_alloc(allocator, (size_t)data->allocatedSize * sizeof(StringInternerEntry));
+    if (data->first == NULL || data->entries == NULL) {
+        str_interner_free(data); // out of memory
+        return NULL;
+    }
+    for (int i = 0; i < data->allocatedSize; i++)
+        data->first[i] = STRING_INTERNER_NO_ID;
+    return data;
+}
+
+
+/**
+ * grow the index to newSize slots: the entries are re-allocated where they are and every id is chained in
+ * at the front of its new bucket, nothing is re-hashed and no string moves
+ * @return 1 if successful, 0 if out of memory (the index is left as it was)
+ */
+static int str_interner_resize(StringInterner* data, int newSize) {
+    const HashAllocator* allocator = data->allocator;
+    size_t oldSlots = (size_t)data->allocatedSize;
+    int* first = hash_alloc(allocator, (size_t)newSize * sizeof(int));
+    if (first == NULL) return 0;
+    StringInternerEntry* entries = hash_resize(allocator, data->entries, oldSlots * sizeof(StringInternerEntry),
+                                               (size_t)newSize * sizeof(StringInternerEntry));
+    if (entries == NULL) {
+        hash_release(allocator, first, (size_t)newSize * sizeof(int));
+        return 0;
+    }
+    hash_release(allocator, data->first, oldSlots * sizeof(int));
+    data->first = first;
+    data->entries = entries;
+    data->allocatedSize = newSize;
+    for (int i = 0; i < newSize; i++)
+        first[i] = STRING_INTERNER_NO_ID;
+    for (int id = 0; id < data->size; id++) {
+        int firstIndex = str_interner_bucket(data, entries[id].hash);
+        entries[id].next = first[firstIndex];
+        first[firstIndex] = id;
+    }
+    return 1;
+}
+
+
+// the id of the len bytes at str with this hash, STRING_INTERNER_NO_ID if it isn't there
+static int str_interner_find_hashed(StringInterner* data, const char* str, size_t len, uint64_t hash) {
+    int id = data->first[str_interner_bucket(data, hash)];
+    while (id != STRING_INTERNER_NO_ID) {
+        StringInternerEntry* entry = &data->entries[id];
+        // the whole hash rules out nearly every other string before its bytes are read
+        if (entry->hash == hash && entry->length == len && memcmp(entry->string, str, len) == 0)
+            return id;
+        id = entry->next;
+    }
+    return STRING_INTERNER_NO_ID;
+}
+
+
+/**
+ * find the id of the len bytes at str (not '\0' terminated)
+ * @return the id, or STRING_INTERNER_NO_ID if it was never interned
+ */
+int str_interner_find(StringInterner* data, const char* str, size_t len) {
+    if (data == NULL || str == NULL || len >= UINT32_MAX) return STRING_INTERNER_NO_ID;
+    return str_interner_find_hashed(data, str, len, str_hashset_hash(str, len));
+}
+
+
+/**
+ * intern the len bytes at str (not '\0' terminated): a string seen before gets its id back, a new one is
+ * copied into the chunks and gets the next id (0, 1, 2, ...)
+ * @return the id, or STRING_INTERNER_NO_ID if out of memory (or more strings than the index can hold)
+ */
+int str_interner_intern(StringInterner* data, const char* str, size_t len) {
+    if (data == NULL || str == NULL || len >= UINT32_MAX) return STRING_INTERNER_NO_ID;
+    uint64_t hash = str_hashset_hash(str, len);
+    int id = str_interner_find_hashed(data, str, len, hash);
+    if (id != STRING_INTERNER_NO_ID)
+        return id;
+    // grow before the table is full, a failed grow only matters once there is no slot left
+    if (data->size + 1 >= data->allocatedSize && data->allocatedSize < INT_HASH_MAX_CAPACITY)
+        str_interner_resize(data, data->allocatedSize * 2);
+    if (data->size >= data->allocatedSize)
+        return STRING_INTERNER_NO_ID;
+    const char* copy = str_interner_copy(data, str, len);
+    if (copy == NULL)
+        return STRING_INTERNER_NO_ID;
+    id = data->size;
+    int firstIndex = str_interner_bucket(data, hash);
+    StringInternerEntry* entry = &data->entries[id];
+    entry->string = copy;
+    entry->hash = hash;
+    entry->length = (uint32_t)len;
+    entry->next = data->first[firstIndex];
+    data->first[firstIndex] = id;
+    data->size += 1;
+    return id;
+}
+
+
+/**
+ * the string of an id, it stays where it is until the interner is freed
+ * @param len receives the length of the string in bytes (can be NULL)
+ * @return the '\0' terminated string, or NULL if id isn't an id of this interner
+ */
+const char* str_interner_lookup(StringInterner* data, int id, size_t* len) {
+    if (data == NULL || id < 0 || id >= data->size) return NULL;
+    if (len != NULL) *len = data->entries[id].length;
+    return data->entries[id].string;
+}
@@ -0,0 +1,85 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#ifndef C_CODE_STRING_INTERNER_H
+#define C_CODE_STRING_INTERNER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hash_alloc.h"
+
+// marks an empty bucket in first[] and the end of a chain in next[], also returned for a string that isn't there
+#define STRING_INTERNER_NO_ID (-1)
+
+// the default size of the chunks the string bytes are copied into
+#define STRING_INTERNER_CHUNK_SIZE ((size_t)1 << 20)
+
+/**
+ * an exact string -> id map: the first string interned gets id 0, the next new one id 1 and so on, an id never
+ * changes.  the strings are indexed like StringHashSet (first[] -> next[] chains, the low 32 bits of their
+ * str_hashset_hash() pick the bucket), but their bytes are kept too so two strings with the same hash are
+ * still told apart, and an id can be turned back into its string.
+ * the bytes are copied into big append-only chunks, one after the other and '\0' terminated, so interning
+ * doesn't allocate per string and a string never moves once interned.
+ */
+
+// a chunk of string bytes, the bytes follow the header
+typedef struct STRUCT_StringInternerChunk {
+    struct STRUCT_StringInternerChunk* previous;
+    size_t size;
+    size_t used;
+} StringInternerChunk;
+
+// an interned string: where its bytes are, its hash and the next id of its chain side by side
+typedef struct {
+    const char* string;
+    uint64_t hash;
+    // the length of the string in bytes (not counting the '\0')
+    uint32_t length;
+    int next;
+} StringInternerEntry;
+
+struct STRUCT_StringInterner {
+    // a list of first ids per bucket
+    int* first;
+    // the strings by id
+    StringInternerEntry* entries;
+    // how big the arrays are right now
+    int allocatedSize;
+    // how much data was allocated
+    int initialSize;
+    // the number of strings interned, and the id the next new one gets
+    int size;
+    // the chunk new strings are copied into, the older chunks hang off it
+    StringInternerChunk* chunk;
+    // the size of a new chunk (a longer string gets a chunk of its own)
+    size_t chunkSize;
+    // the number of bytes of all strings, '\0's included
+    size_t stringBytes;
+    // where the struct, its arrays and its chunks come from, NULL: calloc / realloc / free (see hash_alloc.h)
+    const HashAllocator* allocator;
+};
+
+// define a nice name for the data structure
+typedef struct STRUCT_StringInterner StringInterner;
+
+// create a new string interner
+StringInterner* str_interner_create(int initialSize);
+
+// create a new string interner whose memory comes from allocator (see hash_alloc.h)
+StringInterner* str_interner_create_with_allocator(int initialSize, const HashAllocator* allocator);
+
+// de-allocate the interner, the strings lookup() returned can't be used anymore
+void str_interner_free(StringInterner* data);
+
+// the id of the len bytes at str, a new string is copied in and gets the next id (STRING_INTERNER_NO_ID if out of memory)
+int str_interner_intern(StringInterner* data, const char* str, size_t len);
+
+// the id of the len bytes at str, STRING_INTERNER_NO_ID if it was never interned
+int str_interner_find(StringInterner* data, const char* str, size_t len);
+
+// the ('\0' terminated) string of id and its length in *len (can be NULL), NULL for an unknown id
+const char* str_interner_lookup(StringInterner* data, int id, size_t* len);
+
+#endif //C_CODE_STRING_INTERNER_H
@@ -0,0 +1,121 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include "../model/concurrent_int_int_hash_map.h"
+
+// number of threads and distinct keys for the multi-threaded test
+#define CIIHM_TEST_THREADS 8
+#define CIIHM_TEST_KEYS 50000
+
+// test #1 - single threaded insert / add / get, growing from a tiny map
+void concurrent_int_int_hash_map_test_1() {
+    ConcurrentIntIntHashMap* map = ciihm_create(4);
+    assert(ciihm_insert_if_absent(map, -1, 10) == 1); // every int is a key
+    assert(ciihm_insert_if_absent(map, -1, 20) == 0); // already there, value unchanged
+    assert(ciihm_get(map, -1) == 10);
+    assert(ciihm_fetch_add(map, INT_MIN, 5) == 0); // new key
+    assert(ciihm_fetch_add(map, INT_MIN, 5) == 5);
+    assert(ciihm_get(map, INT_MIN) == 10);
+    assert(ciihm_contains(map, 0) == 0);
+    for (int i = 0; i < 100000; i++)
+        assert(ciihm_fetch_add(map, i * 3, i) == 0);
+    for (int i = 0; i < 100000; i++) {
+        assert(ciihm_get(map, i * 3) == i);
+        assert(ciihm_contains(map, i * 3 + 1) == 0); // never added
+    }
+    assert(ciihm_size(map) == 100000 + 2); // and -1, INT_MIN
+    // de-alloc map
+    ciihm_free(map);
+}
+
+// what a thread of test #2 works on
+typedef struct {
+    ConcurrentIntIntHashMap* map;
+    int thread;
+} CIIHMTestThread;
+
+// count every key thread + 1 times, interleaved with inserts that must not change the counts
+static void* ciihm_test_count_thread(void* arg) {
+    CIIHMTestThread* work = (CIIHMTestThread*)arg;
+    for (int round = 0; round <= work->thread; round++) {
+        for (int i = 0; i < CIIHM_TEST_KEYS; i++) {
+            int key = (i * 7919 + work->thread * 13) % CIIHM_TEST_KEYS; // every thread in its own order
+            ciihm_fetch_add(work->map, key, 1);
+            ciihm_insert_if_absent(work->map, key, 1000000);
+            assert(ciihm_get(work->map, key) >= 1); // never goes missing during a resize
+        }
+    }
+    return NULL;
+}
+
+// test #2 - threads counting the same keys while the map grows: no count may get lost
+void concurrent_int_int_hash_map_test_2() {
+    ConcurrentIntIntHashMap* map = ciihm_create(16); // small, so it has to grow a lot
+    pthread_t threads[CIIHM_TEST_THREADS];
+    CIIHMTestThread work[CIIHM_TEST_THREADS];
+    for (int t = 0; t < CIIHM_TEST_THREADS; t++) {
+        work[t].map = map;
+        work[t].thread = t;
+        assert(pthread_create(&threads[t], NULL, ciihm_test_count_thread, &work[t]) == 0);
+    }
+    for (int t = 0; t < CIIHM_TEST_THREADS; t++)
+        pthread_join(threads[t], NULL);
+    int expected = CIIHM_TEST_THREADS * (CIIHM_TEST_THREADS + 1) / 2; // 1 + 2 + ... + threads
+    assert(ciihm_size(map) == CIIHM_TEST_KEYS);
+    for (int i = 0; i < CIIHM_TEST_KEYS; i++)
+        assert(ciihm_get(map, i) == expected);
+    // de-alloc map
+    ciihm_free(map);
+}
+
+// count keys of its own from a tiny map, so tables grow while older ones are still being migrated
+static void* ciihm_test_grow_thread(void* arg) {
+    CIIHMTestThread* work = (CIIHMTestThread*)arg;
+    for (int i = 0; i < CIIHM_TEST_KEYS; i++)
+        ciihm_fetch_add(work->map, i * CIIHM_TEST_THREADS + work->thread, 1);
+    return NULL;
+}
+
+// test #3 - after growing from many threads the map starts in the newest table: every table before it is
+// fully migrated, and it isn't
+void concurrent_int_int_hash_map_test_3() {
+    for (int run = 0; run < 10; run++) {
+        ConcurrentIntIntHashMap* map = ciihm_create(4);
+        pthread_t threads[CIIHM_TEST_THREADS];
+        CIIHMTestThread work[CIIHM_TEST_THREADS];
+        for (int t = 0; t < CIIHM_TEST_THREADS; t++) {
+            work[t].map = map;
+            work[t].thread = t;
+            assert(pthread_create(&threads[t], NULL, ciihm_test_grow_thread, &work[t]) == 0);
+        }
+        for (int t = 0; t < CIIHM_TEST_THREADS; t++)
+            pthread_join(threads[t], NULL);
+        assert(ciihm_size(map) == (long)CIIHM_TEST_THREADS * CIIHM_TEST_KEYS);
+        ConcurrentIntIntTable* current = atomic_load(&map->table);
+        ConcurrentIntIntTable* table = map->tables;
+        for (; table != current; table = atomic_load(&table->resizeTo))
+            assert(table != NULL && atomic_load(&table->resizeMigrated) == table->allocatedSize);
+        assert(atomic_load(&current->resizeMigrated) < current->allocatedSize);
+        ciihm_free(map);
+    }
+}
+
+// run all the above tests
+void concurrent_int_int_hash_map_tests() {
+    printf("concurrent_int_int_hash_map_test_1: ");
+    concurrent_int_int_hash_map_test_1();
+    printf("passed\n");
+
+    printf("concurrent_int_int_hash_map_test_2: ");
+    concurrent_int_int_hash_map_test_2();
+    printf("passed\n");
+
+    printf("concurrent_int_int_hash_map_test_3: ");
+    concurrent_int_int_hash_map_test_3();
+    printf("passed\n");
+}
@@ -0,0 +1,94 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "../model/concurrent_string_hash_set.h"
+
+// number of threads and strings per thread for the multi-threaded tests
+#define CSTR_TEST_THREADS 8
+#define CSTR_TEST_STRINGS 20000
+
+// test #1 - the single threaded behaviour matches StringHashSet
+void concurrent_string_hash_set_test_1() {
+    ConcurrentStringHashSet* set = cstr_hashset_create(100, 6); // rounded up to 8 shards
+    assert(set->numShards == 8);
+    char str[256];
+    for (int i = 0; i < 1000; i++) {
+        sprintf(str, "https://some.com/test_%d.html", i);
+        assert(cstr_hashset_add(set, str) == 1); // must add
+        assert(cstr_hashset_add(set, str) == 0); // exactly once
+    }
+    assert(cstr_hashset_size(set) == 1000);
+    for (int i = 0; i < 1000; i += 2) {
+        sprintf(str, "https://some.com/test_%d.html", i);
+        assert(cstr_hashset_remove(set, str) == 1); // remove the even ones
+    }
+    for (int i = 0; i < 1000; i++) {
+        sprintf(str, "https://some.com/test_%d.html", i);
+        assert(cstr_hashset_contains(set, str) == (i % 2 == 1));
+        assert(cstr_hashset_contains_n(set, str, strlen(str)) == (i % 2 == 1));
+    }
+    assert(cstr_hashset_add(set, "") == 0); // empty strings are never added
+    cstr_hashset_clear(set);
+    assert(cstr_hashset_size(set) == 0);
+    // de-alloc
+    cstr_hashset_free(set);
+}
+
+// what a thread of test #2 works on
+typedef struct {
+    ConcurrentStringHashSet* set;
+    int thread;
+    int added;
+} CStrTestThread;
+
+// add overlapping ranges of strings: thread t adds t * half .. t * half + CSTR_TEST_STRINGS
+static void* cstr_test_add_thread(void* arg) {
+    CStrTestThread* work = (CStrTestThread*)arg;
+    char str[256];
+    int start = work->thread * (CSTR_TEST_STRINGS / 2);
+    for (int i = start; i < start + CSTR_TEST_STRINGS; i++) {
+        sprintf(str, "https://dataset.rock.co.nz/doc-%d.html", i);
+        work->added += cstr_hashset_add(work->set, str);
+        assert(cstr_hashset_contains(work->set, str) == 1); // visible right away
+    }
+    return NULL;
+}
+
+// test #2 - threads adding overlapping strings: every string is added exactly once
+void concurrent_string_hash_set_test_2() {
+    ConcurrentStringHashSet* set = cstr_hashset_create(16, 4); // small, so the shards have to grow
+    pthread_t threads[CSTR_TEST_THREADS];
+    CStrTestThread work[CSTR_TEST_THREADS];
+    for (int t = 0; t < CSTR_TEST_THREADS; t++) {
+        work[t].set = set;
+        work[t].thread = t;
+        work[t].added = 0;
+        assert(pthread_create(&threads[t], NULL, cstr_test_add_thread, &work[t]) == 0);
+    }
+    int added = 0;
+    for (int t = 0; t < CSTR_TEST_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+        added += work[t].added;
+    }
+    int unique = (CSTR_TEST_THREADS + 1) * (CSTR_TEST_STRINGS / 2);
+    assert(added == unique);
+    assert(cstr_hashset_size(set) == unique);
+    // de-alloc
+    cstr_hashset_free(set);
+}
+
+// run all the above tests
+void concurrent_string_hash_set_tests() {
+    printf("concurrent_string_hash_set_test_1: ");
+    concurrent_string_hash_set_test_1();
+    printf("passed\n");
+
+    printf("concurrent_string_hash_set_test_2: ");
+    concurrent_string_hash_set_test_2();
+    printf("passed\n");
+}
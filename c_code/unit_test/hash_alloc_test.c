@@ -0,0 +1,282 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "../model/hash_alloc.h"
+#include "../model/int_int_hash_map.h"
+#include "../model/int_obj_hash_map.h"
+#include "../model/string_hash_set.h"
+
+// fill, grow, empty and clear every structure (and int-int engine) on allocator
+void hash_alloc_test_maps(const HashAllocator* allocator) {
+    for (int engine = INT_INT_HASHMAP_ENGINE_CHAINED; engine <= INT_INT_HASHMAP_ENGINE_INTERLEAVED; engine++) {
+        IntIntHashMap* map = iihm_create_with_allocator(10, 5, engine, allocator);
+        assert(map != NULL && map->allocator == allocator);
+        for (int i = 0; i < 50000; i++)
+            assert(iihm_add(map, i * 3, i) == 1);
+        for (int i = 0; i < 50000; i++)
+            assert(iihm_get(map, i * 3) == i);
+        for (int i = 0; i < 49990; i++)
+            assert(iihm_remove(map, i * 3) == 1);
+        assert(map->size == 10 && iihm_get(map, 49995 * 3) == 49995);
+        iihm_clear(map);
+        assert(map->size == 0 && iihm_add(map, 1, 1) == 1);
+        iihm_free(map);
+    }
+    // incremental resizes allocate their new table from the same allocator
+    IntIntHashMap* map = iihm_create_with_allocator(10, 0, INT_INT_HASHMAP_ENGINE_CHAINED, allocator);
+    iihm_set_incremental_resize(map, 4);
+    for (int i = 0; i < 20000; i++)
+        assert(iihm_add(map, i, -i) == 1);
+    for (int i = 0; i < 20000; i++)
+        assert(iihm_get(map, i) == -i);
+    iihm_free(map);
+
+    // inline values of an int -> obj map
+    IntObjHashMap* objects = iohm_create_with_allocator(10, 0, sizeof(double), allocator);
+    for (int i = 0; i < 20000; i++) {
+        double value = i * 0.5;
+        assert(iohm_add(objects, i, &value) == 1);
+    }
+    for (int i = 0; i < 20000; i++)
+        assert(*(double*)iohm_get(objects, i) == i * 0.5);
+    for (int i = 0; i < 19000; i++)
+        assert(iohm_remove(objects, i) == 1);
+    assert(objects->size == 1000);
+    iohm_free(objects);
+
+    StringHashSet* set = str_hashset_create_with_allocator(10, allocator);
+    char str[32];
+    for (int i = 0; i < 20000; i++) {
+        snprintf(str, sizeof(str), "string %d", i);
+        assert(str_hashset_add(set, str) == 1);
+    }
+    for (int i = 0; i < 20000; i++) {
+        snprintf(str, sizeof(str), "string %d", i);
+        assert(str_hashset_contains(set, str) == 1);
+    }
+    str_hashset_clear(set);
+    assert(set->size == 0 && str_hashset_contains(set, "string 1") == 0);
+    str_hashset_free(set);
+}
+
+// test #1 - arena blocks are zeroed and cache line aligned, the last block resizes in place
+void hash_alloc_test_1() {
+    HashArena* arena = hash_arena_create(4096);
+    char* a = hash_alloc(&arena->allocator, 100);
+    char* b = hash_alloc(&arena->allocator, 10);
+    assert(a != NULL && b != NULL);
+    assert((uintptr_t)a % HASH_ARENA_ALIGN == 0 && (uintptr_t)b % HASH_ARENA_ALIGN == 0);
+    assert(b == a + 128); // side by side
+    for (int i = 0; i < 100; i++)
+        assert(a[i] == 0);
+    memset(b, 7, 10);
+    assert(hash_resize(&arena->allocator, b, 10, 1000) == b); // the last block grows where it is
+    char* c = hash_resize(&arena->allocator, a, 100, 200); // any other block moves
+    assert(c != a && c[0] == 0);
+    char* big = hash_alloc(&arena->allocator, 100000); // bigger than a chunk gets a chunk of its own
+    assert(big != NULL && big[99999] == 0);
+    hash_release(&arena->allocator, big, 100000);
+    hash_arena_reset(arena);
+    assert(arena->chunk == NULL || arena->chunk->used == 0);
+    char* d = hash_alloc(&arena->allocator, 10);
+    assert(d != NULL && d[0] == 0);
+    hash_arena_free(arena);
+}
+
+// test #2 - big huge page blocks are 2MB aligned and keep their contents when resized
+void hash_alloc_test_2() {
+    const HashAllocator* huge = &hash_allocator_huge;
+    size_t size = 3 * HASH_HUGE_PAGE_SIZE + 100;
+    int* block = hash_alloc(huge, size);
+    assert(block != NULL && (uintptr_t)block % HASH_HUGE_PAGE_SIZE == 0);
+    int count = (int)(size / sizeof(int));
+    for (int i = 0; i < count; i++) {
+        assert(block[i] == 0);
+        block[i] = i;
+    }
+    int* grown = hash_resize(huge, block, size, 2 * size);
+    assert(grown != NULL && (uintptr_t)grown % HASH_HUGE_PAGE_SIZE == 0);
+    for (int i = 0; i < count; i++)
+        assert(grown[i] == i);
+    int* shrunk = hash_resize(huge, grown, 2 * size, 1000); // a shrink stays where it is
+    assert(shrunk == grown && shrunk[249] == 249);
+    hash_release(huge, shrunk, 1000);
+    char* small = hash_alloc(huge, 10);
+    assert(small != NULL && small[9] == 0);
+    hash_release(huge, small, 10);
+}
+
+// test #3 - the maps work the same on every built in allocator
+void hash_alloc_test_3() {
+    hash_alloc_test_maps(NULL);
+    hash_alloc_test_maps(&hash_allocator_default);
+    hash_alloc_test_maps(&hash_allocator_huge);
+    HashArena* arena = hash_arena_create(0);
+    hash_alloc_test_maps(&arena->allocator);
+    // a short lived map in an arena doesn't have to be freed one by one
+    IntIntHashMap* map = iihm_create_with_allocator(100, 0, INT_INT_HASHMAP_ENGINE_CHAINED, &arena->allocator);
+    assert(iihm_add(map, 1, 2) == 1 && iihm_get(map, 1) == 2);
+    hash_arena_reset(arena);
+    hash_arena_free(arena);
+}
+
+// an allocator that hands out at most *context bytes (on top of the default one), then runs out of memory
+static void* hash_alloc_test_budget_alloc(void* context, size_t size) {
+    size_t* budget = (size_t*)context;
+    if (size > *budget) return NULL;
+    *budget -= size;
+    return hash_alloc(NULL, size);
+}
+
+static void* hash_alloc_test_budget_resize(void* context, void* ptr, size_t oldSize, size_t newSize) {
+    size_t* budget = (size_t*)context;
+    if (newSize > oldSize && newSize - oldSize > *budget) return NULL;
+    void* block = hash_resize(NULL, ptr, oldSize, newSize);
+    if (block != NULL) *budget = *budget + oldSize - newSize;
+    return block;
+}
+
+static void hash_alloc_test_budget_release(void* context, void* ptr, size_t size) {
+    if (ptr != NULL) *(size_t*)context += size;
+    hash_release(NULL, ptr, size);
+}
+
+// test #4 - a map that can't grow any more refuses new keys, it never writes past its arrays
+void hash_alloc_test_4() {
+    size_t budget;
+    HashAllocator allocator = {hash_alloc_test_budget_alloc, hash_alloc_test_budget_resize,
+                               hash_alloc_test_budget_release, &budget};
+    for (int engine = INT_INT_HASHMAP_ENGINE_CHAINED; engine <= INT_INT_HASHMAP_ENGINE_INTERLEAVED + 1; engine++) {
+        budget = 64 * 1024;
+        IntIntHashMap* map = iihm_create_with_allocator(16, 0, engine % 3, &allocator);
+        if (engine > INT_INT_HASHMAP_ENGINE_INTERLEAVED)
+            iihm_set_incremental_resize(map, 4); // chained, a bit at a time
+        int added = 0;
+        while (added < 1000000 && iihm_add(map, added, added) == 1)
+            added += 1;
+        assert(added > 1000 && added < 1000000 && map->size == added);
+        assert(iihm_get_or_insert(map, -1, 1) == NULL && iihm_add_to(map, -1, 1) == 0 && map->size == added);
+        assert(iihm_add(map, 5, 6) == 0 && iihm_get(map, 5) == 6); // keys already in there can still be set
+        for (int i = 0; i < added; i++)
+            assert(iihm_get(map, i) == (i == 5 ? 6 : i));
+        assert(iihm_contains(map, -1) == 0);
+        iihm_free(map);
+    }
+
+    budget = 64 * 1024;
+    IntObjHashMap* objects = iohm_create_with_allocator(16, 0, sizeof(double), &allocator);
+    int added = 0;
+    double value = 1.5;
+    while (added < 1000000 && iohm_add(objects, added, &value) == 1)
+        added += 1;
+    assert(added > 1000 && added < 1000000 && objects->size == added);
+    assert(iohm_get_or_insert(objects, -1, &value) == NULL && objects->size == added);
+    for (int i = 0; i < added; i++)
+        assert(*(double*)iohm_get(objects, i) == 1.5);
+    iohm_free(objects);
+
+    budget = 64 * 1024;
+    StringHashSet* set = str_hashset_create_with_allocator(16, &allocator);
+    char str[32];
+    added = 0;
+    for (;; added++) {
+        snprintf(str, sizeof(str), "string %d", added);
+        if (added == 1000000 || str_hashset_add(set, str) == 0)
+            break;
+    }
+    assert(added > 1000 && added < 1000000 && set->size == added);
+    for (int i = 0; i < added; i++) {
+        snprintf(str, sizeof(str), "string %d", i);
+        assert(str_hashset_contains(set, str) == 1);
+    }
+    str_hashset_free(set);
+
+    // with exact checking a string the full set can't take isn't a false positive, and isn't in the set
+    budget = 16 * 1024 * 1024; // the strings of the exact check come in 1MB chunks
+    set = str_hashset_create_with_allocator(16, &allocator);
+    str_hashset_set_exact_check(set, 1);
+    for (added = 0; added < 5000; added++) {
+        snprintf(str, sizeof(str), "string %d", added);
+        assert(str_hashset_add(set, str) == 1);
+    }
+    budget = 0; // no more grows
+    for (;; added++) {
+        snprintf(str, sizeof(str), "string %d", added);
+        if (str_hashset_add(set, str) == 0)
+            break;
+    }
+    assert(set->size == added && set->falsePositives == 0 && set->exactMisses == (uint64_t)added);
+    assert(str_hashset_contains(set, str) == 0 && set->falsePositives == 0);
+    assert(set->exactMisses == (uint64_t)added + 1);
+    str_hashset_free(set);
+}
+
+// test #5 - a clear that can't allocate the smaller arrays keeps the ones it has and leaves them empty
+void hash_alloc_test_5() {
+    size_t budget = 1024 * 1024;
+    HashAllocator allocator = {hash_alloc_test_budget_alloc, hash_alloc_test_budget_resize,
+                               hash_alloc_test_budget_release, &budget};
+    IntIntHashMap* map = iihm_create_with_allocator(16, 0, INT_INT_HASHMAP_ENGINE_CHAINED, &allocator);
+    double value = 1.5;
+    IntObjHashMap* objects = iohm_create_with_allocator(16, 0, sizeof(double), &allocator);
+    StringHashSet* set = str_hashset_create_with_allocator(16, &allocator);
+    char str[32];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(str, sizeof(str), "string %d", i);
+        assert(iihm_add(map, i, i) == 1 && iohm_add(objects, i, &value) == 1 && str_hashset_add(set, str) == 1);
+    }
+    int mapSize = map->allocatedSize, objectsSize = objects->allocatedSize, setSize = set->allocatedSize;
+
+    budget = 0; // out of memory
+    iihm_clear(map);
+    iohm_clear(objects);
+    str_hashset_clear(set);
+    assert(map->size == 0 && map->allocatedSize == mapSize);
+    assert(objects->size == 0 && objects->allocatedSize == objectsSize);
+    assert(set->size == 0 && set->allocatedSize == setSize);
+    for (int i = 0; i < 1000; i++) {
+        snprintf(str, sizeof(str), "string %d", i);
+        assert(iihm_contains(map, i) == 0 && iohm_contains(objects, i) == 0 && str_hashset_contains(set, str) == 0);
+    }
+    assert(iihm_add(map, 7, 8) == 1 && iihm_get(map, 7) == 8);
+    assert(iohm_add(objects, 7, &value) == 1 && *(double*)iohm_get(objects, 7) == 1.5);
+    assert(str_hashset_add(set, "seven") == 1 && str_hashset_contains(set, "seven") == 1);
+
+    budget = 1024 * 1024; // with memory again the next clear shrinks them
+    iihm_clear(map);
+    iohm_clear(objects);
+    str_hashset_clear(set);
+    assert(map->allocatedSize == 16 && objects->allocatedSize == 16 && set->allocatedSize == 16);
+    assert(iihm_contains(map, 7) == 0 && iohm_contains(objects, 7) == 0 && str_hashset_contains(set, "seven") == 0);
+    iihm_free(map);
+    iohm_free(objects);
+    str_hashset_free(set);
+}
+
+// run all the above tests
+void hash_alloc_tests() {
+    printf("hash_alloc_test_1: ");
+    hash_alloc_test_1();
+    printf("passed\n");
+
+    printf("hash_alloc_test_2: ");
+    hash_alloc_test_2();
+    printf("passed\n");
+
+    printf("hash_alloc_test_3: ");
+    hash_alloc_test_3();
+    printf("passed\n");
+
+    printf("hash_alloc_test_4: ");
+    hash_alloc_test_4();
+    printf("passed\n");
+
+    printf("hash_alloc_test_5: ");
+    hash_alloc_test_5();
+    printf("passed\n");
+}
@@ -0,0 +1,115 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../model/int64_int64_hash_map.h"
+#include "../model/int_hash.h"
+
+// test #1 - add / get / remove with keys and values that don't fit in an int
+void int64_int64_hash_map_test_1() {
+    Int64Int64HashMap* map = i64hm_create(10);
+    assert(i64hm_add(map, INT64_MIN, 1) == 1); // every int64_t is a key
+    assert(i64hm_add(map, -1, INT64_MAX) == 1);
+    assert(i64hm_add(map, 1LL << 40, 2) == 1);
+    assert(i64hm_add(map, (1LL << 40) + (1LL << 32), 3) == 1); // the same low 32 bits as 1 << 40
+    assert(i64hm_add(map, 1LL << 40, 4) == 0); // already there, value replaced
+    assert(map->size == 4);
+    assert(i64hm_get(map, INT64_MIN) == 1);
+    assert(i64hm_get(map, -1) == INT64_MAX);
+    assert(i64hm_get(map, 1LL << 40) == 4);
+    assert(i64hm_get(map, (1LL << 40) + (1LL << 32)) == 3);
+    assert(i64hm_contains(map, 0) == 0);
+    assert(i64hm_remove(map, 1LL << 40) == 1);
+    assert(i64hm_remove(map, 1LL << 40) == 0);
+    assert(i64hm_contains(map, (1LL << 40) + (1LL << 32)) == 1);
+    i64hm_clear(map);
+    assert(map->size == 0 && i64hm_contains(map, -1) == 0);
+    // de-alloc map
+    i64hm_free(map);
+}
+
+// test #2 - grow, shrink on removes and batched lookups
+void int64_int64_hash_map_test_2() {
+    Int64Int64HashMap* map = i64hm_create(16);
+    for (int64_t i = 0; i < 200000; i++)
+        assert(i64hm_add(map, i * 4000000007LL, i) == 1);
+    assert(map->size == 200000 && map->allocatedSize == 262144);
+    for (int64_t i = 0; i < 200000; i++)
+        assert(i64hm_get(map, i * 4000000007LL) == i);
+    for (int64_t i = 0; i < 190000; i++)
+        assert(i64hm_remove(map, i * 4000000007LL) == 1);
+    assert(map->size == 10000 && map->allocatedSize < 65536);
+    static int64_t keys[1000];
+    static int64_t values[1000];
+    static int found[1000];
+    for (int i = 0; i < 1000; i++)
+        keys[i] = (189500 + i) * 4000000007LL;
+    assert(i64hm_get_many(map, keys, 1000, values, found) == 500);
+    for (int i = 0; i < 1000; i++) {
+        assert(found[i] == (i >= 500));
+        assert(values[i] == (i >= 500 ? 189500 + i : 0));
+    }
+    i64hm_free(map);
+}
+
+// test #3 - table sizes are worked out in 64 bits, well past what an int can count
+void int64_int64_hash_map_test_3() {
+    assert(int64_hash_capacity(0) == 16);
+    assert(int64_hash_capacity((1ULL << 31) + 1) == 1ULL << 32);
+    assert(int64_hash_capacity(5000000000ULL) == 1ULL << 33);
+    assert(int64_hash_capacity(UINT64_MAX) == INT64_HASH_MAX_CAPACITY);
+    // far more than there is memory for: creating fails cleanly
+    assert(i64hm_create(1ULL << 61) == NULL);
+}
+
+// adds up the keys a visitor is called with, per thread
+void int64_int64_test_visit(int64_t key, int64_t value, void* context, int thread) {
+    int64_t* sums = (int64_t*)context;
+    assert(value == key / 4000000007LL);
+    sums[thread] += value;
+}
+
+// test #4 - iterating returns every live entry once, also with several threads
+void int64_int64_hash_map_test_4() {
+    Int64Int64HashMap* map = i64hm_create(16);
+    for (int64_t i = 0; i < 1000; i++)
+        assert(i64hm_add(map, i * 4000000007LL, i) == 1);
+    for (int64_t i = 0; i < 500; i++)
+        assert(i64hm_remove(map, i * 4000000007LL) == 1);
+    uint64_t cursor = 0;
+    int64_t key, value, sum = 0;
+    while (i64hm_next(map, &cursor, &key, &value)) {
+        assert(key == value * 4000000007LL && value >= 500);
+        sum += value;
+    }
+    assert(sum == 374750); // 500 + .. + 999
+    int64_t sums[4] = {0, 0, 0, 0};
+    i64hm_for_each(map, int64_int64_test_visit, sums);
+    assert(sums[0] == 374750);
+    sums[0] = 0;
+    i64hm_for_each_parallel(map, 4, int64_int64_test_visit, sums);
+    assert(sums[0] + sums[1] + sums[2] + sums[3] == 374750 && sums[3] > 0);
+    i64hm_free(map);
+}
+
+// run all the above tests
+void int64_int64_hash_map_tests() {
+    printf("int64_int64_hash_map_test_1: ");
+    int64_int64_hash_map_test_1();
+    printf("passed\n");
+
+    printf("int64_int64_hash_map_test_2: ");
+    int64_int64_hash_map_test_2();
+    printf("passed\n");
+
+    printf("int64_int64_hash_map_test_3: ");
+    int64_int64_hash_map_test_3();
+    printf("passed\n");
+
+    printf("int64_int64_hash_map_test_4: ");
+    int64_int64_hash_map_test_4();
+    printf("passed\n");
+}
@@ -0,0 +1,615 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../model/int_int_hash_map.h"
+#include "../model/int_hash.h"
+#include "../model/hash_simd.h"
+
+// create a map with the chained (default), the grouped or the interleaved engine
+IntIntHashMap* int_int_test_create(int engine, int initialSize) {
+    if (engine == INT_INT_HASHMAP_ENGINE_GROUPED)
+        return iihm_create_grouped(initialSize);
+    if (engine == INT_INT_HASHMAP_ENGINE_INTERLEAVED)
+        return iihm_create_interleaved(initialSize);
+    return iihm_create(initialSize);
+}
+
+// test #1
+void int_int_hash_map_test_1(int engine) {
+    // create a small map (10 items)
+    IntIntHashMap* map = int_int_test_create(engine, 10);
+    assert(iihm_add(map, 1, 2) == 1); // must add
+    assert(iihm_add(map, 1, 3) == 0); // already exists, not added again
+    assert(map->size == 1); // right size
+    assert(iihm_contains(map, 1) == 1); // contains works
+    assert(iihm_contains(map, 2) == 0); // never added
+    iihm_clear(map); // clear the map
+    // should be clear now
+    assert(map->size == 0);
+    assert(iihm_contains(map, 1) == 0);
+    // de-alloc map
+    iihm_free(map);
+}
+
+// test #2 - grow beyond the initial size
+void int_int_hash_map_test_2(int engine) {
+    // many items - small initial map
+    int insertSize = 100000;
+    IntIntHashMap* map = int_int_test_create(engine, 10);
+    for (int i = 0; i < insertSize; i++) {
+        assert(iihm_add(map, i * 7, i) == 1); // insert must work
+    }
+    assert(map->size == insertSize); // must be the right size
+    for (int i = 0; i < insertSize; i++) {
+        assert(iihm_contains(map, i * 7) == 1); // must contain
+        assert(iihm_contains(map, i * 7 + 1) == 0); // must not contain
+    }
+    iihm_clear(map);
+    assert(map->size == 0);
+    assert(iihm_contains(map, 7) == 0);
+    // de-alloc
+    iihm_free(map);
+}
+
+// test #3 - negative keys and removes
+void int_int_hash_map_test_3(int engine) {
+    IntIntHashMap* map = int_int_test_create(engine, 100);
+    // insert 99 negative keys
+    for (int i = 1; i < 100; i++) {
+        assert(iihm_add(map, -i * 1000, i) == 1);
+    }
+    assert(map->size == 99);
+    for (int i = 1; i < 50; i++) {
+        assert(iihm_remove(map, -i * 1000) == 1); // remove the first 49 keys
+        assert(iihm_remove(map, -i * 1000) == 0); // can't remove twice
+    }
+    assert(map->size == 50); // size must match
+    for (int i = 1; i < 100; i++) {
+        assert(iihm_contains(map, -i * 1000) == (i >= 50)); // only the remaining keys
+    }
+    // de-alloc
+    iihm_free(map);
+}
+
+// test #4 - remove / add churn must re-use the freed slots and shrink the map when it empties
+void int_int_hash_map_test_4(int engine) {
+    IntIntHashMap* map = int_int_test_create(engine, 100);
+    int initialAllocated = map->allocatedSize;
+    // keep a window of 50 live keys while moving through 100000 keys
+    for (int i = 0; i < 100000; i++) {
+        assert(iihm_add(map, i, i) == 1); // must add
+        if (i >= 50)
+            assert(iihm_remove(map, i - 50) == 1); // must remove the oldest
+    }
+    assert(map->size == 50); // only the window is left
+    assert(map->allocatedSize == initialAllocated); // and the map never had to grow
+    for (int i = 0; i < 100000; i++)
+        assert(iihm_contains(map, i) == (i >= 100000 - 50)); // only the window exists
+    // grow big, then remove nearly everything
+    for (int i = 0; i < 100000; i++)
+        iihm_add(map, i, i);
+    int grownSize = map->allocatedSize;
+    for (int i = 0; i < 99990; i++)
+        assert(iihm_remove(map, i) == 1);
+    assert(map->size == 10);
+    assert(map->allocatedSize < grownSize / 100); // memory was given back
+    for (int i = 99990; i < 100000; i++)
+        assert(iihm_contains(map, i) == 1); // the rest must still be there
+    // de-alloc
+    iihm_free(map);
+}
+
+// test #5 - incremental resizing keeps every key reachable while the old and new tables coexist
+void int_int_hash_map_test_5() {
+    IntIntHashMap* map = iihm_create(10);
+    iihm_set_incremental_resize(map, 2); // migrate 2 chains per operation
+    int sawResize = 0;
+    for (int i = 0; i < 100000; i++) {
+        assert(iihm_add(map, i, i) == 1); // must add
+        assert(iihm_add(map, i, i) == 0); // exactly once
+        if (map->resizeTo != NULL) sawResize = 1;
+        if (i % 1000 == 0)
+            for (int j = 0; j <= i; j += 97)
+                assert(iihm_contains(map, j) == 1); // everything added so far must be found
+    }
+    assert(sawResize == 1); // the resizes were done a bit at a time
+    assert(map->size == 100000);
+    for (int i = 0; i < 100000; i++)
+        assert(iihm_contains(map, i) == 1);
+    // remove most, the map shrinks incrementally as well
+    for (int i = 0; i < 99990; i++)
+        assert(iihm_remove(map, i) == 1);
+    assert(map->size == 10);
+    for (int i = 0; i < 100000; i++)
+        assert(iihm_contains(map, i) == (i >= 99990));
+    iihm_set_incremental_resize(map, 0); // turning it off finishes any resize in progress
+    assert(map->resizeTo == NULL);
+    assert(map->size == 10);
+    // de-alloc
+    iihm_free(map);
+}
+
+// test #6 - every int is a valid key, including -1 and INT_MIN, and the table size is a power of 2
+void int_int_hash_map_test_6(int engine) {
+    IntIntHashMap* map = int_int_test_create(engine, 100);
+    assert((map->allocatedSize & (map->allocatedSize - 1)) == 0);
+    int keys[5] = {-1, INT_MIN, INT_MAX, 0, 1};
+    for (int i = 0; i < 5; i++)
+        assert(iihm_add(map, keys[i], i) == 1);
+    assert(iihm_add(map, -1, 5) == 0); // -1 is an ordinary key
+    assert(map->size == 5);
+    for (int i = 0; i < 5; i++)
+        assert(iihm_contains(map, keys[i]) == 1);
+    assert(iihm_remove(map, -1) == 1);
+    assert(iihm_contains(map, -1) == 0);
+    assert(iihm_remove(map, INT_MIN) == 1);
+    assert(iihm_contains(map, INT_MIN) == 0);
+    assert(map->size == 3);
+    iihm_free(map);
+
+    // strided keys with a seeded map still spread out fine
+    map = iihm_create_seeded(10, 0x9E3779B9U);
+    for (int i = 0; i < 100000; i++)
+        assert(iihm_add(map, i * 1024, i) == 1);
+    assert((map->allocatedSize & (map->allocatedSize - 1)) == 0);
+    for (int i = 0; i < 100000; i++) {
+        assert(iihm_contains(map, i * 1024) == 1);
+        assert(iihm_contains(map, i * 1024 + 1) == 0);
+    }
+    iihm_free(map);
+}
+
+// test #7 - batched lookups give the same answers as one at a time, also during an incremental resize
+void int_int_hash_map_test_7(int engine) {
+    IntIntHashMap* map = int_int_test_create(engine, 10);
+    iihm_set_incremental_resize(map, 1); // ignored by the grouped and interleaved engines
+    static int keys[5000];
+    static int values[5000];
+    static int found[5000];
+    for (int i = 0; i < 5000; i++)
+        keys[i] = i * 7 - 2500; // every 2nd key is in the map
+    int expected = 0;
+    for (int i = 0; i < 5000; i += 2) {
+        iihm_add(map, keys[i], i + 1);
+        expected += 1;
+    }
+    for (int pass = 0; pass < 2; pass++) { // the first pass may run into a resize in progress
+        assert(iihm_get_many(map, keys, 5000, values, found) == expected);
+        for (int i = 0; i < 5000; i++) {
+            assert(found[i] == (i % 2 == 0));
+            assert(values[i] == (i % 2 == 0 ? i + 1 : 0));
+            assert(iihm_get(map, keys[i]) == values[i]);
+        }
+    }
+    assert(iihm_get_many(map, keys + 1, 3, values, NULL) == 1); // odd sized batch, no found flags
+    assert(values[0] == 0 && values[1] == 3 && values[2] == 0);
+    iihm_free(map);
+}
+
+// test #8 - a saved map opens as a read-only map with the same contents
+void int_int_hash_map_test_8() {
+    const char* path = "iihm_snapshot_test.bin";
+    IntIntHashMap* map = iihm_create_seeded(10, 77);
+    for (int i = 0; i < 10000; i++)
+        iihm_add(map, i * 5 - 100, i);
+    assert(iihm_save(map, path) == 1);
+    IntIntHashMap* loaded = iihm_open_mmap(path);
+    assert(loaded != NULL);
+    assert(loaded->size == map->size && loaded->allocatedSize == map->allocatedSize);
+    assert(iihm_verify(loaded) == 1);
+    for (int i = 0; i < 10000; i++) {
+        assert(iihm_get(loaded, i * 5 - 100) == i);
+        assert(iihm_contains(loaded, i * 5 - 99) == 0);
+    }
+    assert(iihm_add(loaded, 1, 1) == 0); // read-only
+    assert(iihm_remove(loaded, -100) == 0);
+    assert(iihm_contains(loaded, -100) == 1);
+    iihm_free(loaded);
+    iihm_free(map);
+
+    // a damaged file no longer verifies (one with a link past the entries included), something that isn't a
+    // snapshot doesn't open
+    FILE* file = fopen(path, "r+b");
+    int link = 0;
+    fseek(file, 200, SEEK_SET); // inside first[]
+    assert(fread(&link, sizeof(int), 1, file) == 1);
+    link = link == 0 ? 1 : 0;
+    fseek(file, 200, SEEK_SET);
+    fwrite(&link, sizeof(int), 1, file);
+    fclose(file);
+    loaded = iihm_open_mmap(path);
+    assert(loaded != NULL && iihm_verify(loaded) == 0);
+    iihm_free(loaded);
+    file = fopen(path, "r+b");
+    link = 10000; // the size, one past the last entry
+    fseek(file, 200, SEEK_SET);
+    fwrite(&link, sizeof(int), 1, file);
+    fclose(file);
+    loaded = iihm_open_mmap(path);
+    assert(loaded != NULL && iihm_verify(loaded) == 0);
+    iihm_free(loaded);
+    file = fopen(path, "wb");
+    fputs("not a snapshot", file);
+    fclose(file);
+    assert(iihm_open_mmap(path) == NULL);
+    remove(path);
+
+    // only maps of the chained engine have a snapshot layout
+    map = iihm_create_interleaved(10);
+    iihm_add(map, 1, 1);
+    assert(iihm_save(map, path) == 0);
+    iihm_free(map);
+}
+
+// test #9 - a built map holds the same as adding the keys one by one, for every duplicate policy and thread count
+void int_int_hash_map_test_9() {
+    int n = 100000;
+    int* keys = malloc(n * sizeof(int));
+    int* values = malloc(n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        keys[i] = (i % 30000) * 7 - 50000; // every key 3 or 4 times
+        values[i] = i;
+    }
+    keys[0] = INT_MIN; // every int is a key
+    keys[1] = -1;
+    int threadCounts[4] = {1, 2, 3, 8};
+    for (int t = 0; t < 4; t++) {
+        IntIntHashMap* lastWins = iihm_build(keys, values, n, threadCounts[t], IIHM_BUILD_LAST_WINS);
+        IntIntHashMap* firstWins = iihm_build(keys, values, n, threadCounts[t], IIHM_BUILD_FIRST_WINS);
+        IntIntHashMap* sum = iihm_build(keys, values, n, threadCounts[t], IIHM_BUILD_SUM);
+        IntIntHashMap* expected = iihm_create(16);
+        for (int i = 0; i < n; i++) {
+            iihm_add(expected, keys[i], values[i]);
+        }
+        assert(lastWins->size == expected->size && firstWins->size == expected->size && sum->size == expected->size);
+        for (int i = 0; i < n; i++) {
+            int key = keys[i];
+            assert(iihm_get(lastWins, key) == iihm_get(expected, key));
+            if (i >= 2 && i < 30000) { // the first time key is seen
+                assert(iihm_get(firstWins, key) == values[i]);
+                int total = 0;
+                for (int j = i; j < n; j += 30000) total += values[j];
+                assert(iihm_get(sum, key) == total);
+            }
+        }
+        // entries are packed in 0..size-1, so adding and removing carries on as normal
+        for (int i = 0; i < lastWins->size; i++)
+            assert(iihm_contains(lastWins, lastWins->keySet[i]));
+        assert(iihm_add(lastWins, 2, 1) == 1); // not one of the keys
+        assert(iihm_remove(lastWins, keys[5]) == 1 && iihm_contains(lastWins, keys[5]) == 0);
+        assert(iihm_contains(lastWins, 2) == 1);
+        iihm_free(lastWins);
+        iihm_free(firstWins);
+        iihm_free(sum);
+        iihm_free(expected);
+    }
+    IntIntHashMap* empty = iihm_build(NULL, NULL, 0, 4, IIHM_BUILD_LAST_WINS);
+    assert(empty != NULL && empty->size == 0 && iihm_contains(empty, 0) == 0);
+    iihm_free(empty);
+    free(keys);
+    free(values);
+}
+
+// test #10 - growing, shrinking and clearing with several threads keeps every key reachable
+void int_int_hash_map_test_10() {
+    IntIntHashMap* map = iihm_create_seeded(10, 77);
+    IntIntHashMap* serial = iihm_create_seeded(10, 77);
+    iihm_set_parallel_resize(map, 4, 64); // even small tables go parallel
+    for (int i = 0; i < 200000; i++)
+        assert(iihm_add(map, i * 3 - 1000, i) == 1 && iihm_add(serial, i * 3 - 1000, i) == 1);
+    for (int i = 0; i < 200000; i++)
+        assert(iihm_get(map, i * 3 - 1000) == i);
+    // the threads each chain their own buckets in entry order, so the chains are the ones one thread makes
+    assert(map->allocatedSize == serial->allocatedSize);
+    assert(memcmp(map->first, serial->first, map->allocatedSize * sizeof(int)) == 0);
+    assert(memcmp(map->next, serial->next, map->size * sizeof(int)) == 0);
+    iihm_free(serial);
+    for (int i = 0; i < 190000; i++) // shrinks on the way down
+        assert(iihm_remove(map, i * 3 - 1000) == 1);
+    assert(map->size == 10000 && map->allocatedSize < 65536);
+    for (int i = 0; i < 200000; i++)
+        assert(iihm_contains(map, i * 3 - 1000) == (i >= 190000));
+    iihm_clear(map);
+    assert(map->size == 0 && iihm_contains(map, 190000 * 3 - 1000) == 0);
+    iihm_free(map);
+}
+
+// test #16 - adds while an incremental shrink migrates can outgrow the smaller table, it then grows instead
+void int_int_hash_map_test_16() {
+    int n = 65536;
+    IntIntHashMap* map = iihm_create(16);
+    iihm_set_incremental_resize(map, 1);
+    for (int i = 0; i < n; i++)
+        iihm_add(map, i, i);
+    while (map->resizeTo != NULL) // finish the last grow
+        iihm_contains(map, 0);
+    int removed = 0;
+    while (map->resizeTo == NULL) // until a shrink starts
+        assert(iihm_remove(map, removed++) == 1);
+    for (int i = 0; i < n; i++)
+        assert(iihm_add(map, n + i, i) == 1);
+    assert(map->size == n - removed + n);
+    for (int i = 0; i < 2 * n; i++)
+        assert(iihm_contains(map, i) == (i >= removed) && iihm_get(map, i) == (i < removed ? 0 : i % n));
+    iihm_free(map);
+}
+
+// run all the above tests for every engine
+// test #11 - with fast clear a clear keeps the table, stale buckets are empty, also when the generation wraps
+void int_int_hash_map_test_11() {
+    IntIntHashMap* map = iihm_create(10);
+    iihm_set_fast_clear(map, 1);
+    for (int round = 0; round < 5; round++) {
+        for (int i = 0; i < 5000; i++)
+            assert(iihm_add(map, i * 7 + round, i) == 1);
+        for (int i = 0; i < 5000; i += 2)
+            assert(iihm_remove(map, i * 7 + round) == 1);
+        for (int i = 0; i < 5000; i++)
+            assert(iihm_get(map, i * 7 + round) == (i % 2 ? i : 0));
+        int allocatedSize = map->allocatedSize;
+        iihm_clear(map);
+        assert(map->size == 0 && map->allocatedSize == allocatedSize);
+        for (int i = 0; i < 5000; i++)
+            assert(iihm_contains(map, i * 7 + round) == 0);
+    }
+    // the last generation before the counter wraps around
+    map->generation = INT_HASH_MAX_GENERATION - 1;
+    assert(iihm_add(map, 1, 10) == 1 && iihm_add(map, 2, 20) == 1);
+    iihm_clear(map);
+    assert(map->generation == INT_HASH_MAX_GENERATION && iihm_add(map, 2, 21) == 1);
+    iihm_clear(map); // wraps: every bucket is wiped
+    assert(map->generation == 1 && iihm_contains(map, 1) == 0 && iihm_contains(map, 2) == 0);
+    assert(iihm_add(map, 3, 30) == 1 && iihm_get(map, 3) == 30);
+    // turned off again first[] is valid on its own
+    iihm_set_fast_clear(map, 0);
+    assert(map->generations == NULL && iihm_get(map, 3) == 30 && iihm_contains(map, 2) == 0);
+    iihm_free(map);
+}
+
+// sums the keys and values a visitor is called with, per thread
+typedef struct {
+    long keys[4];
+    long values[4];
+    int count[4];
+} IntIntTestSums;
+
+void int_int_test_visit(int key, int value, void* context, int thread) {
+    IntIntTestSums* sums = (IntIntTestSums*)context;
+    sums->keys[thread] += key;
+    sums->values[thread] += value;
+    sums->count[thread] += 1;
+}
+
+// test #12 - iterating returns every live entry once, after removes and for every engine
+void int_int_hash_map_test_12() {
+    for (int engine = INT_INT_HASHMAP_ENGINE_CHAINED; engine <= INT_INT_HASHMAP_ENGINE_INTERLEAVED; engine++) {
+        IntIntHashMap* map = int_int_test_create(engine, 10);
+        iihm_set_incremental_resize(map, 2); // iterating finishes a resize in progress
+        long keySum = 0;
+        for (int i = 0; i < 10000; i++) {
+            iihm_add(map, i, 2 * i);
+            if (i % 3 == 0) iihm_remove(map, i);
+            else keySum += i;
+        }
+        int cursor = 0, key, value, count = 0;
+        static char seen[10000];
+        memset(seen, 0, sizeof(seen));
+        while (iihm_next(map, &cursor, &key, &value)) {
+            assert(key % 3 != 0 && value == 2 * key && seen[key] == 0);
+            seen[key] = 1;
+            count++;
+        }
+        assert(count == map->size && count == 6666 && iihm_next(map, &cursor, &key, &value) == 0);
+        for (int nthreads = 1; nthreads <= 4; nthreads++) {
+            IntIntTestSums sums;
+            memset(&sums, 0, sizeof(sums));
+            if (nthreads == 1)
+                iihm_for_each(map, int_int_test_visit, &sums);
+            else
+                iihm_for_each_parallel(map, nthreads, int_int_test_visit, &sums);
+            long keys = 0, values = 0;
+            count = 0;
+            for (int t = 0; t < 4; t++) {
+                keys += sums.keys[t];
+                values += sums.values[t];
+                count += sums.count[t];
+            }
+            assert(keys == keySum && values == 2 * keySum && count == 6666);
+            assert(nthreads == 1 || sums.count[nthreads - 1] > 0); // every thread had a chunk
+        }
+        iihm_free(map);
+    }
+}
+
+// test #13 - stats: the chains add up to the map, the counters only count in HASH_STATS builds
+void int_int_hash_map_test_13() {
+    for (int engine = INT_INT_HASHMAP_ENGINE_CHAINED; engine <= INT_INT_HASHMAP_ENGINE_INTERLEAVED; engine++) {
+        IntIntHashMap* map = int_int_test_create(engine, 16);
+        for (int i = 0; i < 1000; i++)
+            iihm_add(map, i, i);
+        for (int i = 0; i < 1000; i++)
+            assert(iihm_contains(map, i) == 1);
+        for (int i = 0; i < 1000; i += 2)
+            assert(iihm_remove(map, i) == 1);
+        HashStats stats;
+        iihm_stats(map, &stats);
+        assert(stats.size == 500 && stats.slots == map->allocatedSize);
+        assert(stats.loadFactor == 500.0 / map->allocatedSize && stats.memory > 500 * 2 * sizeof(int));
+        int counted = 0;
+        for (int n = 0; n < HASH_STATS_CHAINS; n++)
+            counted += stats.chains[n];
+        assert(stats.longestChain >= 1 && stats.averageChain >= 1.0);
+        if (engine == INT_INT_HASHMAP_ENGINE_GROUPED) { // every key, by the groups probed to find it
+            assert(counted == 500 && stats.chains[0] == 0 && stats.deadSlots == map->deleted);
+        } else { // every bucket, by the length of its chain
+            assert(counted == map->allocatedSize && stats.deadSlots == 0);
+            assert(stats.averageChain * (map->allocatedSize - stats.chains[0]) > 499.99);
+        }
+        if (stats.enabled) {
+            assert(stats.calls[HASH_STATS_ADD] == 1000 && stats.calls[HASH_STATS_CONTAINS] == 1000);
+            assert(stats.calls[HASH_STATS_REMOVE] == 500);
+            assert(stats.averageProbe[HASH_STATS_CONTAINS] >= 1.0 && stats.maxProbe[HASH_STATS_CONTAINS] >= 1);
+            assert(stats.grows > 0);
+        } else { // nothing was counted
+            assert(stats.calls[HASH_STATS_ADD] == 0 && stats.grows == 0 && stats.growNanos == 0);
+        }
+        iihm_free(map);
+    }
+}
+
+// test #14 - single lookup get / upsert: get_found tells a 0 value from a missing key, get_or_insert and add_to
+// update in place, also while a chained map resizes a bit at a time
+void int_int_hash_map_test_14() {
+    for (int engine = INT_INT_HASHMAP_ENGINE_CHAINED; engine <= INT_INT_HASHMAP_ENGINE_INTERLEAVED + 1; engine++) {
+        IntIntHashMap* map;
+        if (engine > INT_INT_HASHMAP_ENGINE_INTERLEAVED) { // chained, incremental resize
+            map = iihm_create(16);
+            iihm_set_incremental_resize(map, 2);
+        } else {
+            map = int_int_test_create(engine, 16);
+        }
+        int found;
+        assert(iihm_get_found(map, 1, &found) == 0 && found == 0);
+        assert(iihm_add(map, 1, 0) == 1);
+        assert(iihm_get_found(map, 1, &found) == 0 && found == 1);
+
+        // count 5000 keys by % 1000, so every key is added 5 times
+        for (int i = 0; i < 5000; i++)
+            iihm_add_to(map, i % 1000 + 10, 2);
+        assert(map->size == 1001);
+        for (int i = 10; i < 1010; i++)
+            assert(iihm_get(map, i) == 10);
+        assert(iihm_add_to(map, 10, -3) == 7 && iihm_add_to(map, 5000, -3) == -3);
+
+        int* value = iihm_get_or_insert(map, 20, 99); // already there, keeps its value
+        assert(value != NULL && *value == 10);
+        *value = 11;
+        assert(iihm_get(map, 20) == 11);
+        value = iihm_get_or_insert(map, 6000, 99); // added with the default
+        assert(value != NULL && *value == 99 && iihm_contains(map, 6000) == 1);
+        *value += 1;
+        assert(iihm_get(map, 6000) == 100 && map->size == 1003);
+        for (int i = 0; i < 2000; i++) { // across grows
+            value = iihm_get_or_insert(map, 10000 + i, i);
+            *value *= 2;
+        }
+        for (int i = 0; i < 2000; i++)
+            assert(iihm_get_found(map, 10000 + i, &found) == i * 2 && found == 1);
+        assert(iihm_get_or_insert(NULL, 1, 1) == NULL && iihm_add_to(NULL, 1, 1) == 0);
+        iihm_free(map);
+    }
+}
+
+// test #15 - every bulk lookup kernel the cpu has finds the same as iihm_get(): chains longer than one entry,
+// misses, batches that don't fill a vector and buckets emptied by a fast clear
+void int_int_hash_map_test_15() {
+    int n = 5003;
+    int* keys = malloc(sizeof(int) * n);
+    int* values = malloc(sizeof(int) * n);
+    int* found = malloc(sizeof(int) * n);
+    for (int level = HASH_SIMD_SCALAR; level <= HASH_SIMD_AVX512; level++) {
+        if (hash_simd_set_level(level) != level)
+            break; // the cpu can't
+        IntIntHashMap* map = iihm_create(4096);
+        iihm_set_fast_clear(map, 1);
+        for (int i = 0; i < 3000; i++)
+            iihm_add(map, i * 7, i);
+        iihm_clear(map); // all buckets of the last generation
+        for (int i = 0; i < 4000; i++) // most buckets of 4096 have a chain of more than one entry
+            iihm_add(map, i * 3, i + 1);
+        for (int i = 0; i < n; i++)
+            keys[i] = i % 2 == 0 ? i * 3 : -i; // hits and misses
+        for (int count = 1; count <= n; count += count < 40 ? 1 : 997) {
+            memset(values, 0xFF, sizeof(int) * n);
+            int hits = iihm_get_many(map, keys, count, values, found);
+            int expected = 0;
+            for (int i = 0; i < count; i++) {
+                int hit = iihm_contains(map, keys[i]);
+                assert(found[i] == hit && values[i] == iihm_get(map, keys[i]));
+                expected += hit;
+            }
+            assert(hits == expected);
+            assert(iihm_get_many(map, keys, count, values, NULL) == expected);
+        }
+        iihm_free(map);
+    }
+    hash_simd_set_level(-1);
+    free(keys);
+    free(values);
+    free(found);
+}
+
+void int_int_hash_map_tests() {
+    const char* engineNames[3] = {"chained", "grouped", "interleaved"};
+    for (int engine = INT_INT_HASHMAP_ENGINE_CHAINED; engine <= INT_INT_HASHMAP_ENGINE_INTERLEAVED; engine++) {
+        printf("int_int_hash_map_test_1 (%s): ", engineNames[engine]);
+        int_int_hash_map_test_1(engine);
+        printf("passed\n");
+
+        printf("int_int_hash_map_test_2 (%s): ", engineNames[engine]);
+        int_int_hash_map_test_2(engine);
+        printf("passed\n");
+
+        printf("int_int_hash_map_test_3 (%s): ", engineNames[engine]);
+        int_int_hash_map_test_3(engine);
+        printf("passed\n");
+
+        printf("int_int_hash_map_test_4 (%s): ", engineNames[engine]);
+        int_int_hash_map_test_4(engine);
+        printf("passed\n");
+
+        printf("int_int_hash_map_test_6 (%s): ", engineNames[engine]);
+        int_int_hash_map_test_6(engine);
+        printf("passed\n");
+
+        printf("int_int_hash_map_test_7 (%s): ", engineNames[engine]);
+        int_int_hash_map_test_7(engine);
+        printf("passed\n");
+    }
+
+    printf("int_int_hash_map_test_5: ");
+    int_int_hash_map_test_5();
+    printf("passed\n");
+
+    printf("int_int_hash_map_test_8: ");
+    int_int_hash_map_test_8();
+    printf("passed\n");
+
+    printf("int_int_hash_map_test_9: ");
+    int_int_hash_map_test_9();
+    printf("passed\n");
+
+    printf("int_int_hash_map_test_10: ");
+    int_int_hash_map_test_10();
+    printf("passed\n");
+
+    printf("int_int_hash_map_test_11: ");
+    int_int_hash_map_test_11();
+    printf("passed\n");
+
+    printf("int_int_hash_map_test_12: ");
+    int_int_hash_map_test_12();
+    printf("passed\n");
+
+    printf("int_int_hash_map_test_13: ");
+    int_int_hash_map_test_13();
+    printf("passed\n");
+
+    printf("int_int_hash_map_test_14: ");
+    int_int_hash_map_test_14();
+    printf("passed\n");
+
+    printf("int_int_hash_map_test_15: ");
+    int_int_hash_map_test_15();
+    printf("passed\n");
+
+    printf("int_int_hash_map_test_16: ");
+    int_int_hash_map_test_16();
+    printf("passed\n");
+}
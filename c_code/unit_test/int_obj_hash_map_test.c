@@ -0,0 +1,339 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include "../model/int_obj_hash_map.h"
+#include "../model/int_hash.h"
+
+// some objects to store in the maps
+static int objects[100];
+
+// test #1
+void int_obj_hash_map_test_1() {
+    // create a small map (10 items)
+    IntObjHashMap* map = iohm_create(10);
+    assert(iohm_add(map, 1, &objects[1]) == 1); // must add
+    assert(iohm_add(map, 1, &objects[2]) == 0); // already exists, value replaced
+    assert(map->size == 1); // right size
+    assert(iohm_contains(map, 1) == 1); // contains works
+    assert(iohm_get(map, 1) == &objects[2]); // with the new value
+    assert(iohm_get(map, 2) == NULL); // never added
+    iohm_clear(map); // clear the map
+    // should be clear now
+    assert(map->size == 0);
+    assert(iohm_contains(map, 1) == 0);
+    // de-alloc map
+    iohm_free(map);
+}
+
+// test #2 - remove / add churn must re-use the freed slots and shrink the map when it empties
+void int_obj_hash_map_test_2() {
+    IntObjHashMap* map = iohm_create(100);
+    int initialAllocated = map->allocatedSize;
+    // keep a window of 50 live keys while moving through 100000 keys
+    for (int i = 0; i < 100000; i++) {
+        assert(iohm_add(map, i, &objects[i % 100]) == 1); // must add
+        if (i >= 50)
+            assert(iohm_remove(map, i - 50) == 1); // must remove the oldest
+    }
+    assert(map->size == 50); // only the window is left
+    assert(map->allocatedSize == initialAllocated); // and the map never had to grow
+    for (int i = 0; i < 100000; i++)
+        assert(iohm_get(map, i) == (i >= 100000 - 50 ? &objects[i % 100] : NULL)); // only the window exists
+    // grow big, then remove nearly everything
+    for (int i = 0; i < 100000; i++)
+        iohm_add(map, i, &objects[i % 100]);
+    int grownSize = map->allocatedSize;
+    for (int i = 0; i < 99990; i++)
+        assert(iohm_remove(map, i) == 1);
+    assert(map->size == 10);
+    assert(map->allocatedSize < grownSize / 100); // memory was given back
+    for (int i = 99990; i < 100000; i++)
+        assert(iohm_get(map, i) == &objects[i % 100]); // the rest must still be there
+    // de-alloc
+    iohm_free(map);
+}
+
+// test #3 - incremental resizing keeps every key reachable while the old and new tables coexist
+void int_obj_hash_map_test_3() {
+    IntObjHashMap* map = iohm_create(10);
+    iohm_set_incremental_resize(map, 2); // migrate 2 chains per operation
+    int sawResize = 0;
+    for (int i = 0; i < 100000; i++) {
+        assert(iohm_add(map, i, &objects[i % 100]) == 1); // must add
+        if (map->resizeTo != NULL) sawResize = 1;
+        if (i % 1000 == 0)
+            for (int j = 0; j <= i; j += 97)
+                assert(iohm_get(map, j) == &objects[j % 100]); // everything added so far must be found
+    }
+    assert(sawResize == 1); // the resizes were done a bit at a time
+    assert(map->size == 100000);
+    for (int i = 0; i < 99990; i++)
+        assert(iohm_remove(map, i) == 1);
+    assert(map->size == 10);
+    for (int i = 0; i < 100000; i++)
+        assert(iohm_contains(map, i) == (i >= 99990));
+    // de-alloc
+    iohm_free(map);
+}
+
+// test #4 - -1 and INT_MIN are ordinary keys
+void int_obj_hash_map_test_4() {
+    IntObjHashMap* map = iohm_create_seeded(10, 12345);
+    assert(iohm_add(map, -1, &objects[1]) == 1);
+    assert(iohm_add(map, INT_MIN, &objects[2]) == 1);
+    assert(iohm_add(map, INT_MAX, &objects[3]) == 1);
+    assert(iohm_get(map, -1) == &objects[1]);
+    assert(iohm_get(map, INT_MIN) == &objects[2]);
+    assert(iohm_get(map, INT_MAX) == &objects[3]);
+    assert(iohm_remove(map, -1) == 1);
+    assert(iohm_get(map, -1) == NULL);
+    assert(map->size == 2);
+    // de-alloc
+    iohm_free(map);
+}
+
+// test #5 - batched lookups give the same answers as iohm_get()
+void int_obj_hash_map_test_5() {
+    IntObjHashMap* map = iohm_create(10);
+    static int keys[1000];
+    static void* values[1000];
+    for (int i = 0; i < 1000; i++) {
+        keys[i] = i * 3;
+        if (i % 3 == 0)
+            iohm_add(map, keys[i], &objects[i % 100]);
+    }
+    assert(iohm_get_many(map, keys, 1000, values) == 334);
+    for (int i = 0; i < 1000; i++)
+        assert(values[i] == (i % 3 == 0 ? &objects[i % 100] : NULL));
+    // de-alloc
+    iohm_free(map);
+}
+
+// a fixed size record stored inline by test #6
+typedef struct {
+    int id;
+    double score;
+    char name[20];
+} IOHMTestRecord;
+
+// test #6 - inline values are copied into the map and survive growing, removes and incremental resizing
+void int_obj_hash_map_test_6() {
+    for (int incremental = 0; incremental <= 1; incremental++) {
+        IntObjHashMap* map = iohm_create_inline(10, sizeof(IOHMTestRecord));
+        iohm_set_incremental_resize(map, incremental ? 4 : 0);
+        IOHMTestRecord record;
+        for (int i = 0; i < 20000; i++) {
+            memset(&record, 0, sizeof(record));
+            record.id = i;
+            record.score = i * 0.5;
+            snprintf(record.name, sizeof(record.name), "record-%d", i);
+            assert(iohm_add(map, i - 5000, &record) == 1);
+        }
+        record.id = -1; // the map has its own copy
+        for (int i = 0; i < 20000; i++) {
+            IOHMTestRecord* stored = iohm_get(map, i - 5000);
+            assert(stored != NULL && stored->id == i && stored->score == i * 0.5);
+            snprintf(record.name, sizeof(record.name), "record-%d", i);
+            assert(strcmp(stored->name, record.name) == 0);
+        }
+        for (int i = 0; i < 20000; i += 2) // removes move the last value into the free slot
+            assert(iohm_remove(map, i - 5000) == 1);
+        for (int i = 0; i < 20000; i++) {
+            IOHMTestRecord* stored = iohm_get(map, i - 5000);
+            assert(i % 2 == 0 ? stored == NULL : stored != NULL && stored->id == i);
+        }
+        assert(iohm_add(map, 1, NULL) == 0); // overwritten with zeros
+        assert(((IOHMTestRecord*)iohm_get(map, 1))->id == 0);
+        iohm_clear(map);
+        assert(map->size == 0 && iohm_get(map, 1) == NULL);
+        iohm_free(map);
+    }
+    assert(iohm_create_inline(10, 0) == NULL);
+}
+
+// test #11 - adds while an incremental shrink migrates can outgrow the smaller table, it then grows instead
+void int_obj_hash_map_test_11() {
+    int n = 65536;
+    int values[2] = {1, 2};
+    IntObjHashMap* map = iohm_create(16);
+    iohm_set_incremental_resize(map, 1);
+    for (int i = 0; i < n; i++)
+        iohm_add(map, i, &values[0]);
+    while (map->resizeTo != NULL) // finish the last grow
+        iohm_contains(map, 0);
+    int removed = 0;
+    while (map->resizeTo == NULL) // until a shrink starts
+        assert(iohm_remove(map, removed++) == 1);
+    for (int i = 0; i < n; i++)
+        assert(iohm_add(map, n + i, &values[1]) == 1);
+    assert(map->size == n - removed + n);
+    for (int i = 0; i < 2 * n; i++)
+        assert(iohm_get(map, i) == (i < removed ? NULL : &values[i / n]));
+    iohm_free(map);
+}
+
+// run all the above tests
+// test #7 - with fast clear a clear keeps the table and every bucket written before it counts as empty
+void int_obj_hash_map_test_7() {
+    IntObjHashMap* map = iohm_create(10);
+    iohm_set_fast_clear(map, 1);
+    for (int round = 0; round < 5; round++) {
+        for (int i = 0; i < 2000; i++)
+            assert(iohm_add(map, i * 3 + round, &objects[i % 100]) == 1);
+        for (int i = 0; i < 2000; i += 2)
+            assert(iohm_remove(map, i * 3 + round) == 1);
+        for (int i = 0; i < 2000; i++)
+            assert(iohm_get(map, i * 3 + round) == (i % 2 ? &objects[i % 100] : NULL));
+        int allocatedSize = map->allocatedSize;
+        iohm_clear(map);
+        assert(map->size == 0 && map->allocatedSize == allocatedSize && iohm_contains(map, 3 + round) == 0);
+    }
+    map->generation = INT_HASH_MAX_GENERATION; // the next clear wraps around
+    assert(iohm_add(map, 5, &objects[5]) == 1);
+    iohm_clear(map);
+    assert(map->generation == 1 && iohm_contains(map, 5) == 0);
+    assert(iohm_add(map, 6, &objects[6]) == 1);
+    iohm_set_fast_clear(map, 0);
+    assert(iohm_get(map, 6) == &objects[6] && iohm_contains(map, 5) == 0);
+    iohm_free(map);
+}
+
+// counts the entries a visitor is called with whose value is the object of their key, per thread
+void int_obj_test_visit(int key, void* value, void* context, int thread) {
+    int* counts = (int*)context;
+    if (value == &objects[key % 100])
+        counts[thread] += 1;
+}
+
+// test #8 - iterating returns every live entry once, also with several threads
+void int_obj_hash_map_test_8() {
+    IntObjHashMap* map = iohm_create(10);
+    for (int i = 0; i < 3000; i++)
+        assert(iohm_add(map, i, &objects[i % 100]) == 1);
+    for (int i = 0; i < 3000; i += 2)
+        assert(iohm_remove(map, i) == 1);
+    int cursor = 0, key, count = 0;
+    void* value;
+    while (iohm_next(map, &cursor, &key, &value)) {
+        assert(key % 2 == 1 && value == &objects[key % 100]);
+        count++;
+    }
+    assert(count == 1500);
+    int counts[3] = {0, 0, 0};
+    iohm_for_each(map, int_obj_test_visit, counts);
+    assert(counts[0] == 1500);
+    counts[0] = 0;
+    iohm_for_each_parallel(map, 3, int_obj_test_visit, counts);
+    assert(counts[0] + counts[1] + counts[2] == 1500 && counts[2] > 0);
+    iohm_free(map);
+}
+
+// test #9 - stats of a map that grew a bit at a time: the adds into its new tables are counted too
+void int_obj_hash_map_test_9() {
+    IntObjHashMap* map = iohm_create(10);
+    iohm_set_incremental_resize(map, 4);
+    for (int i = 0; i < 2000; i++)
+        assert(iohm_add(map, i, &objects[i % 100]) == 1);
+    for (int i = 0; i < 1000; i++)
+        assert(iohm_remove(map, i) == 1);
+    HashStats stats;
+    iohm_stats(map, &stats);
+    assert(map->resizeTo == NULL); // finished first
+    assert(stats.size == 1000 && stats.slots == map->allocatedSize && stats.deadSlots == 0);
+    assert(stats.memory >= sizeof(IntObjHashMap) + (size_t)map->allocatedSize * (3 * sizeof(int) + sizeof(void*)));
+    int buckets = 0;
+    long entries = 0;
+    for (int n = 0; n < HASH_STATS_CHAINS; n++) {
+        buckets += stats.chains[n];
+        entries += (long)n * stats.chains[n];
+    }
+    assert(buckets == map->allocatedSize && entries == 1000 && stats.longestChain < HASH_STATS_CHAINS);
+    if (stats.enabled) {
+        assert(stats.calls[HASH_STATS_ADD] == 2000 && stats.calls[HASH_STATS_REMOVE] >= 1000);
+        assert(stats.grows > 0 && stats.maxProbe[HASH_STATS_REMOVE] >= 1);
+    } else {
+        assert(stats.calls[HASH_STATS_REMOVE] == 0 && stats.maxProbe[HASH_STATS_ADD] == 0);
+    }
+    iohm_free(map);
+}
+
+// test #10 - get_or_insert: the object of a new key can be set through its slot, inline values update in place
+void int_obj_hash_map_test_10() {
+    IntObjHashMap* map = iohm_create(10);
+    iohm_set_incremental_resize(map, 4);
+    for (int i = 0; i < 2000; i++) {
+        void** slot = iohm_get_or_insert(map, i, NULL);
+        assert(slot != NULL && *slot == NULL);
+        *slot = &objects[i % 100];
+    }
+    assert(map->size == 2000);
+    for (int i = 0; i < 2000; i++) {
+        assert(iohm_get(map, i) == &objects[i % 100]);
+        void** slot = iohm_get_or_insert(map, i, &objects[0]); // already there, keeps its object
+        assert(*slot == &objects[i % 100]);
+    }
+    iohm_free(map);
+
+    map = iohm_create_inline(10, sizeof(long));
+    long start = 100;
+    for (int i = 0; i < 5000; i++) {
+        long* total = iohm_get_or_insert(map, i % 500, &start);
+        *total += 1;
+    }
+    assert(map->size == 500);
+    for (int i = 0; i < 500; i++)
+        assert(*(long*)iohm_get(map, i) == 110);
+    assert(iohm_get_or_insert(NULL, 1, NULL) == NULL);
+    iohm_free(map);
+}
+
+void int_obj_hash_map_tests() {
+    printf("int_obj_hash_map_test_1: ");
+    int_obj_hash_map_test_1();
+    printf("passed\n");
+
+    printf("int_obj_hash_map_test_2: ");
+    int_obj_hash_map_test_2();
+    printf("passed\n");
+
+    printf("int_obj_hash_map_test_3: ");
+    int_obj_hash_map_test_3();
+    printf("passed\n");
+
+    printf("int_obj_hash_map_test_4: ");
+    int_obj_hash_map_test_4();
+    printf("passed\n");
+
+    printf("int_obj_hash_map_test_5: ");
+    int_obj_hash_map_test_5();
+    printf("passed\n");
+
+    printf("int_obj_hash_map_test_6: ");
+    int_obj_hash_map_test_6();
+    printf("passed\n");
+
+    printf("int_obj_hash_map_test_7: ");
+    int_obj_hash_map_test_7();
+    printf("passed\n");
+
+    printf("int_obj_hash_map_test_8: ");
+    int_obj_hash_map_test_8();
+    printf("passed\n");
+
+    printf("int_obj_hash_map_test_9: ");
+    int_obj_hash_map_test_9();
+    printf("passed\n");
+
+    printf("int_obj_hash_map_test_10: ");
+    int_obj_hash_map_test_10();
+    printf("passed\n");
+
+    printf("int_obj_hash_map_test_11: ");
+    int_obj_hash_map_test_11();
+    printf("passed\n");
+}
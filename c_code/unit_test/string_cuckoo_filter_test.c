@@ -0,0 +1,128 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#include <assert.h>
+#include <stdio.h>
+#include "../model/string_cuckoo_filter.h"
+#include "../model/string_hash_set.h"
+
+// test #1 - add, contains and remove, a string added twice has to be removed twice
+void string_cuckoo_filter_test_1() {
+    StringCuckooFilter* filter = str_cuckoo_create(100, 0.05);
+    assert(filter != NULL && filter->fingerprintBits == STRING_CUCKOO_FINGERPRINT_8);
+    assert(str_cuckoo_contains(filter, "hello") == 0);
+    assert(str_cuckoo_add(filter, "hello") == 1);
+    assert(str_cuckoo_add_n(filter, "world!", 5) == 1);
+    assert(str_cuckoo_contains(filter, "hello") == 1);
+    assert(str_cuckoo_contains(filter, "world") == 1);
+    assert(str_cuckoo_contains_hashed(filter, str_hashset_hash("world", 5)) == 1);
+    assert(str_cuckoo_add(filter, "") == 0 && str_cuckoo_contains(filter, "") == 0); // can't add empty strings
+    assert(str_cuckoo_add(filter, "hello") == 1);
+    assert(filter->size == 3);
+    assert(str_cuckoo_remove(filter, "hello") == 1);
+    assert(str_cuckoo_contains(filter, "hello") == 1); // once more
+    assert(str_cuckoo_remove(filter, "hello") == 1);
+    assert(str_cuckoo_contains(filter, "hello") == 0 && str_cuckoo_remove(filter, "hello") == 0);
+    assert(str_cuckoo_remove_hashed(filter, str_hashset_hash("world", 5)) == 1);
+    assert(filter->size == 0 && str_cuckoo_contains(filter, "world") == 0);
+    str_cuckoo_add(filter, "hello");
+    str_cuckoo_clear(filter);
+    assert(filter->size == 0 && str_cuckoo_contains(filter, "hello") == 0);
+    str_cuckoo_free(filter);
+
+    filter = str_cuckoo_create(100, 0.001);
+    assert(filter->fingerprintBits == STRING_CUCKOO_FINGERPRINT_16);
+    str_cuckoo_free(filter);
+    assert(str_cuckoo_create_with_allocator(100, 12, NULL) == NULL); // only 8 or 16 bits
+}
+
+// test #2 - full to capacity: no false negatives, about the expected false positive rate and bytes per string
+void string_cuckoo_filter_test_2() {
+    int widths[] = {STRING_CUCKOO_FINGERPRINT_8, STRING_CUCKOO_FINGERPRINT_16};
+    char str[32];
+    for (int w = 0; w < 2; w++) {
+        int capacity = 200000;
+        StringCuckooFilter* filter = str_cuckoo_create_with_allocator(capacity, widths[w], NULL);
+        for (int i = 0; i < capacity; i++) {
+            snprintf(str, sizeof(str), "https://site-%d.org/", i);
+            assert(str_cuckoo_add(filter, str) == 1);
+        }
+        assert(filter->size == capacity && filter->hasVictim == 0);
+        // 1.11 bytes per string for 8 bits, 2.22 for 16
+        assert(str_cuckoo_memory(filter) <= (size_t)capacity * widths[w] / 8 * 112 / 100);
+        for (int i = 0; i < capacity; i++) {
+            snprintf(str, sizeof(str), "https://site-%d.org/", i);
+            assert(str_cuckoo_contains(filter, str) == 1);
+        }
+        int falsePositives = 0;
+        int misses = 1000000;
+        for (int i = 0; i < misses; i++) {
+            snprintf(str, sizeof(str), "https://other-%d.org/", i);
+            falsePositives += str_cuckoo_contains(filter, str);
+        }
+        double rate = (double)falsePositives / misses;
+        double expected = str_cuckoo_false_positive_rate(filter);
+        assert(rate > expected / 2 && rate < expected * 2);
+
+        // remove every other string, the rest are all still there (checked in batches too)
+        for (int i = 0; i < capacity; i += 2) {
+            snprintf(str, sizeof(str), "https://site-%d.org/", i);
+            assert(str_cuckoo_remove(filter, str) == 1);
+        }
+        assert(filter->size == capacity / 2);
+        static char batch[64][32];
+        const char* strs[64];
+        int found[64];
+        for (int start = 1; start + 128 <= capacity; start += 128) {
+            for (int i = 0; i < 64; i++) {
+                snprintf(batch[i], sizeof(batch[i]), "https://site-%d.org/", start + i * 2);
+                strs[i] = batch[i];
+            }
+            assert(str_cuckoo_contains_many(filter, strs, 64, found) == 64);
+        }
+        str_cuckoo_free(filter);
+    }
+}
+
+// test #3 - a filter that is too small fills up, the string that didn't fit isn't lost
+void string_cuckoo_filter_test_3() {
+    StringCuckooFilter* filter = str_cuckoo_create_with_allocator(1000, STRING_CUCKOO_FINGERPRINT_16, NULL);
+    char str[32];
+    int added = 0;
+    while (added < 100000) {
+        snprintf(str, sizeof(str), "string %d", added);
+        if (str_cuckoo_add(filter, str) == 0)
+            break;
+        added += 1;
+    }
+    assert(filter->hasVictim == 1 && added == filter->size);
+    assert(added >= 1000 && added <= filter->bucketCount * STRING_CUCKOO_BUCKET_SLOTS);
+    for (int i = 0; i < added; i++) {
+        snprintf(str, sizeof(str), "string %d", i);
+        assert(str_cuckoo_contains(filter, str) == 1);
+    }
+    // making room puts the victim back
+    assert(str_cuckoo_remove(filter, "string 0") == 1);
+    assert(filter->hasVictim == 0 && filter->size == added - 1);
+    for (int i = 1; i < added; i++) {
+        snprintf(str, sizeof(str), "string %d", i);
+        assert(str_cuckoo_contains(filter, str) == 1);
+    }
+    str_cuckoo_free(filter);
+}
+
+// run all the above tests
+void string_cuckoo_filter_tests() {
+    printf("string_cuckoo_filter_test_1: ");
+    string_cuckoo_filter_test_1();
+    printf("passed\n");
+
+    printf("string_cuckoo_filter_test_2: ");
+    string_cuckoo_filter_test_2();
+    printf("passed\n");
+
+    printf("string_cuckoo_filter_test_3: ");
+    string_cuckoo_filter_test_3();
+    printf("passed\n");
+}
@@ -4,7 +4,11 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "../model/string_hash_set.h"
+#include "../model/int_hash.h"
+#include "../model/hash_simd.h"
 
 // test #1
 void string_hash_set_test_1() {
@@ -199,6 +203,430 @@ void string_hash_set_test_9() {
     str_hashset_free(map);
 }
 
+// string test 10 - remove / add churn must re-use the freed slots
+void string_hash_set_test_10() {
+    // small map
+    StringHashSet* map = str_hashset_create(100);
+    int initialAllocated = map->allocatedSize;
+    char str[256];
+    // keep a window of 50 live strings while moving through 10000 strings
+    for (int i = 0; i < 10000; i++) {
+        generate_test_string(str, i);
+        assert(str_hashset_add(map, str) == 1); // must add
+        if (i >= 50) {
+            generate_test_string(str, i - 50);
+            assert(str_hashset_remove(map, str) == 1); // must remove the oldest
+        }
+    }
+    assert(50 == map->size); // only the window is left
+    assert(map->allocatedSize == initialAllocated); // and the map never had to grow
+    for (int i = 0; i < 10000; i++) {
+        generate_test_string(str, i);
+        assert(str_hashset_contains(map, str) == (i >= 10000 - 50)); // only the window exists
+    }
+    // de-alloc
+    str_hashset_free(map);
+}
+
+// string test 11 - the map shrinks again once most strings are removed
+void string_hash_set_test_11() {
+    // small map
+    StringHashSet* map = str_hashset_create(10);
+    char str[256];
+    for (int i = 0; i < 10000; i++) {
+        generate_test_string(str, i);
+        assert(str_hashset_add(map, str) == 1); // must add
+    }
+    int grownSize = map->allocatedSize;
+    for (int i = 0; i < 9990; i++) {
+        generate_test_string(str, i);
+        assert(str_hashset_remove(map, str) == 1); // must remove
+    }
+    assert(10 == map->size);
+    assert(map->allocatedSize < grownSize / 100); // memory was given back
+    for (int i = 9990; i < 10000; i++) {
+        generate_test_string(str, i);
+        assert(str_hashset_contains(map, str) == 1); // the rest must still be there
+    }
+    // de-alloc
+    str_hashset_free(map);
+}
+
+// string test 12 - incremental resizing keeps every string reachable while the old and new tables coexist
+void string_hash_set_test_12() {
+    StringHashSet* map = str_hashset_create(10);
+    str_hashset_set_incremental_resize(map, 2); // migrate 2 chains per operation
+    char str[256];
+    int sawResize = 0;
+    for (int i = 0; i < 100000; i++) {
+        generate_test_string(str, i);
+        assert(str_hashset_add(map, str) == 1); // must add
+        assert(str_hashset_add(map, str) == 0); // exactly once
+        if (map->resizeTo != NULL) sawResize = 1;
+    }
+    assert(sawResize == 1); // the resizes were done a bit at a time
+    assert(100000 == map->size);
+    for (int i = 0; i < 99990; i++) {
+        generate_test_string(str, i);
+        assert(str_hashset_remove(map, str) == 1); // must remove
+    }
+    assert(10 == map->size);
+    for (int i = 0; i < 100000; i++) {
+        generate_test_string(str, i);
+        assert(str_hashset_contains(map, str) == (i >= 99990)); // only the last 10
+    }
+    // de-alloc
+    str_hashset_free(map);
+}
+
+// string test 13 - slices, pre-computed hashes and the plain API all name the same string
+void string_hash_set_test_13() {
+    StringHashSet* map = str_hashset_create(10);
+    StringHashSet* other = str_hashset_create(10);
+    const char* url = "https://dataset.rock.co.nz/gov-docs-1/file-1.txt?page=2";
+    assert(str_hashset_add_n(map, url, 48) == 1); // without the query string
+    assert(str_hashset_contains(map, "https://dataset.rock.co.nz/gov-docs-1/file-1.txt") == 1);
+    assert(str_hashset_contains(map, url) == 0);
+    assert(str_hashset_add_n(map, url, 0) == 0); // empty slice
+    // one hash used in two sets
+    uint64_t hash = str_hashset_hash(url, strlen(url));
+    assert(str_hashset_add_hashed(map, hash) == 1);
+    assert(str_hashset_add_hashed(other, hash) == 1);
+    assert(str_hashset_contains(map, url) == 1);
+    assert(str_hashset_contains_n(other, url, strlen(url)) == 1);
+    assert(str_hashset_remove_hashed(other, hash) == 1);
+    assert(str_hashset_contains_hashed(other, hash) == 0);
+    assert(str_hashset_remove_n(map, url, 48) == 1);
+    assert(map->size == 1);
+    // strings that only differ in length or trailing bytes hash differently
+    assert(str_hashset_hash("abc", 3) != str_hashset_hash("abc\0", 4));
+    assert(str_hashset_hash("abcdefgh", 8) != str_hashset_hash("abcdefgi", 8));
+    // de-alloc
+    str_hashset_free(map);
+    str_hashset_free(other);
+}
+
+// string test 14 - batched contains gives the same answers as one at a time
+void string_hash_set_test_14() {
+    StringHashSet* map = str_hashset_create(10);
+    static char buffers[1000][256];
+    static const char* strs[1000];
+    static int found[1000];
+    for (int i = 0; i < 1000; i++) {
+        generate_test_string(buffers[i], i);
+        strs[i] = buffers[i];
+        if (i % 4 == 0)
+            assert(str_hashset_add(map, strs[i]) == 1);
+    }
+    strs[1] = NULL; // never in the set
+    strs[2] = "";
+    assert(str_hashset_contains_many(map, strs, 1000, found) == 250);
+    for (int i = 0; i < 1000; i++)
+        assert(found[i] == (i % 4 == 0));
+    // de-alloc
+    str_hashset_free(map);
+}
+
+// string test 15 - a saved set opens as a read-only set with the same contents
+void string_hash_set_test_15() {
+    const char* path = "str_hashset_snapshot_test.bin";
+    StringHashSet* map = str_hashset_create(10);
+    char str[256];
+    for (int i = 0; i < 10000; i++) {
+        generate_test_string(str, i);
+        str_hashset_add(map, str);
+    }
+    assert(str_hashset_save(map, path) == 1);
+    StringHashSet* loaded = str_hashset_open_mmap(path);
+    assert(loaded != NULL);
+    assert(loaded->size == 10000);
+    assert(str_hashset_verify(loaded) == 1);
+    for (int i = 0; i < 20000; i++) {
+        generate_test_string(str, i);
+        assert(str_hashset_contains(loaded, str) == (i < 10000));
+    }
+    assert(str_hashset_add(loaded, "new") == 0); // read-only
+    generate_test_string(str, 0);
+    assert(str_hashset_remove(loaded, str) == 0);
+    assert(str_hashset_open_mmap("does-not-exist.bin") == NULL);
+    // de-alloc
+    str_hashset_free(loaded);
+    str_hashset_free(map);
+    remove(path);
+}
+
+// test #16 - a built set holds the same as adding the strings one by one, with any number of threads
+void string_hash_set_test_16() {
+    int n = 20000;
+    char (*buffer)[256] = malloc(n * sizeof(*buffer));
+    const char** strs = malloc(n * sizeof(char*));
+    for (int i = 0; i < n; i++) {
+        generate_test_string(buffer[i], i % 15000); // some strings twice
+        strs[i] = buffer[i];
+    }
+    strs[7] = NULL; // skipped
+    strs[8] = "";
+    int threadCounts[3] = {1, 4, 16};
+    for (int t = 0; t < 3; t++) {
+        StringHashSet* map = str_hashset_build(strs, n, threadCounts[t]);
+        assert(map != NULL);
+        assert(map->size == 15000); // strings 7 and 8 are still in there as strs[15007] and strs[15008]
+        char str[256];
+        for (int i = 0; i < 30000; i++) {
+            generate_test_string(str, i);
+            assert(str_hashset_contains(map, str) == (i < 15000));
+        }
+        assert(str_hashset_contains(map, "") == 0);
+        assert(str_hashset_add(map, "new") == 1 && str_hashset_contains(map, "new") == 1);
+        assert(str_hashset_remove(map, strs[100]) == 1 && str_hashset_contains(map, strs[100]) == 0);
+        str_hashset_free(map);
+    }
+    free(strs);
+    free(buffer);
+}
+
+// test #17 - growing and clearing with several threads keeps every string reachable
+void string_hash_set_test_17() {
+    StringHashSet* map = str_hashset_create(10);
+    str_hashset_set_parallel_resize(map, 3, 64); // even small tables go parallel
+    char str[256];
+    for (int i = 0; i < 50000; i++) {
+        generate_test_string(str, i);
+        assert(str_hashset_add(map, str) == 1);
+    }
+    for (int i = 0; i < 60000; i++) {
+        generate_test_string(str, i);
+        assert(str_hashset_contains(map, str) == (i < 50000));
+    }
+    str_hashset_clear(map);
+    generate_test_string(str, 1);
+    assert(map->size == 0 && str_hashset_contains(map, str) == 0);
+    str_hashset_free(map);
+}
+
+// test #18 - with fast clear a clear keeps the table and every bucket written before it counts as empty
+void string_hash_set_test_18() {
+    StringHashSet* map = str_hashset_create(10);
+    str_hashset_set_fast_clear(map, 1);
+    char str[256];
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 3000; i++) {
+            generate_test_string(str, i + round);
+            str_hashset_add(map, str);
+        }
+        int allocatedSize = map->allocatedSize;
+        str_hashset_clear(map);
+        assert(map->size == 0 && map->allocatedSize == allocatedSize);
+        for (int i = 0; i < 3000; i++) {
+            generate_test_string(str, i + round);
+            assert(str_hashset_contains(map, str) == 0);
+        }
+    }
+    map->generation = INT_HASH_MAX_GENERATION; // the next clear wraps around
+    assert(str_hashset_add(map, "one") == 1);
+    str_hashset_clear(map);
+    assert(map->generation == 1 && str_hashset_contains(map, "one") == 0);
+    assert(str_hashset_add(map, "two") == 1 && str_hashset_remove(map, "two") == 1);
+    assert(str_hashset_add(map, "three") == 1);
+    str_hashset_set_fast_clear(map, 0);
+    assert(str_hashset_contains(map, "three") == 1 && str_hashset_contains(map, "two") == 0);
+    str_hashset_free(map);
+}
+
+// counts the hashes a visitor is called with that are in the set (context), as thread 1 of 2
+void string_hash_set_test_visit(uint64_t hash, void* context, int thread) {
+    StringHashSet** sets = (StringHashSet**)context;
+    assert(str_hashset_contains_hashed(sets[0], hash) == 1);
+    if (thread == 1)
+        str_hashset_add_hashed(sets[1], hash);
+}
+
+// test #19 - iterating returns the hash of every string still in the set
+void string_hash_set_test_19() {
+    StringHashSet* map = str_hashset_create(10);
+    char str[256];
+    for (int i = 0; i < 2000; i++) {
+        generate_test_string(str, i);
+        str_hashset_add(map, str);
+    }
+    for (int i = 0; i < 1000; i++) {
+        generate_test_string(str, i);
+        str_hashset_remove(map, str);
+    }
+    int cursor = 0, count = 0;
+    uint64_t hash;
+    while (str_hashset_next(map, &cursor, &hash)) {
+        assert(str_hashset_contains_hashed(map, hash) == 1);
+        count++;
+    }
+    assert(count == map->size);
+    // copy the second half of the set (thread 1's chunk) into another set
+    StringHashSet* sets[2] = {map, str_hashset_create(10)};
+    str_hashset_for_each(map, string_hash_set_test_visit, sets);
+    assert(sets[1]->size == 0);
+    str_hashset_for_each_parallel(map, 2, string_hash_set_test_visit, sets);
+    assert(sets[1]->size == map->size - map->size / 2);
+    str_hashset_free(sets[1]);
+    str_hashset_free(map);
+}
+
+// test #20 - 128 bit fingerprints: add / contains / remove through growing, shrinking and incremental resizing
+void string_hash_set_test_20() {
+    StringHashSet* map = str_hashset_create_fingerprinted(10, STRING_HASHSET_FINGERPRINT_128, NULL);
+    assert(map != NULL && map->hashHigh != NULL);
+    assert(str_hashset_create_fingerprinted(10, 96, NULL) == NULL);
+    char str[256];
+    for (int step = 0; step <= 4; step += 4) {
+        str_hashset_set_incremental_resize(map, step);
+        for (int i = 0; i < 20000; i++) {
+            generate_test_string(str, i);
+            assert(str_hashset_add(map, str) == 1);
+        }
+        for (int i = 0; i < 20000; i += 2) {
+            generate_test_string(str, i);
+            assert(str_hashset_remove(map, str) == 1);
+        }
+        for (int i = 0; i < 21000; i++) {
+            generate_test_string(str, i);
+            assert(str_hashset_contains(map, str) == (i < 20000 && i % 2 == 1));
+        }
+        str_hashset_clear(map);
+    }
+    // the low 64 bits are the 64 bit hash, the 64 bit *_hashed fns. don't work on a 128 bit set
+    uint64_t high;
+    uint64_t hash = str_hashset_hash128("fingerprint", 11, &high);
+    assert(hash == str_hashset_hash("fingerprint", 11) && high != hash);
+    assert(str_hashset_add_hashed(map, hash) == 0 && str_hashset_add_hashed128(map, hash, high) == 1);
+    assert(str_hashset_contains(map, "fingerprint") == 1);
+    assert(str_hashset_contains_hashed128(map, hash, high ^ 1) == 0); // every bit counts
+    assert(str_hashset_remove_hashed128(map, hash, high ^ 1) == 0);
+    assert(str_hashset_remove_hashed128(map, hash, high) == 1);
+    assert(str_hashset_save(map, "/tmp/never_saved.bin") == 0);
+    str_hashset_free(map);
+}
+
+// test #21 - exact checking counts the strings the set took for others and the rate to expect
+void string_hash_set_test_21() {
+    StringHashSet* map = str_hashset_create(10);
+    str_hashset_set_exact_check(map, 1);
+    char str[256];
+    for (int i = 0; i < 5000; i++) {
+        generate_test_string(str, i);
+        assert(str_hashset_add(map, str) == 1);
+        assert(str_hashset_add(map, str) == 0); // really in the set, not a false positive
+    }
+    double expected = 1;
+    assert(str_hashset_false_positive_rate(map, &expected) == 0 && map->exactMisses == 5000);
+    assert(expected > 0 && expected < 1e-15);
+    // a fingerprint added without its string: the set takes "planted" for a string it holds
+    assert(str_hashset_add_hashed(map, str_hashset_hash("planted", 7)) == 1);
+    assert(str_hashset_contains(map, "planted") == 1);
+    assert(str_hashset_add(map, "planted") == 0);
+    assert(map->falsePositives == 2 && map->exactMisses == 5002);
+    assert(str_hashset_false_positive_rate(map, NULL) == 2.0 / 5002);
+    assert(str_hashset_remove(map, "planted") == 1); // now it is in the set for real
+    assert(str_hashset_remove(map, "planted") == 0 && map->falsePositives == 2);
+    str_hashset_clear(map);
+    generate_test_string(str, 1);
+    assert(str_hashset_contains(map, str) == 0 && map->falsePositives == 2 && map->exactMisses == 5004);
+    str_hashset_free(map);
+}
+
+// test #22 - stats of a 128 bit set with fast clear: the buckets of old generations are empty chains
+void string_hash_set_test_22() {
+    StringHashSet* map = str_hashset_create_fingerprinted(4096, STRING_HASHSET_FINGERPRINT_128, NULL);
+    str_hashset_set_fast_clear(map, 1);
+    char str[256];
+    for (int i = 0; i < 3000; i++) {
+        generate_test_string(str, i);
+        str_hashset_add(map, str);
+    }
+    str_hashset_clear(map);
+    static char batch[100][256];
+    const char* strs[100];
+    int found[100];
+    for (int i = 0; i < 100; i++) {
+        generate_test_string(batch[i], i);
+        assert(str_hashset_add(map, batch[i]) == 1);
+        strs[i] = batch[i];
+    }
+    assert(str_hashset_contains_many(map, strs, 100, found) == 100);
+    HashStats stats;
+    str_hashset_stats(map, &stats);
+    assert(stats.size == 100 && stats.slots == map->allocatedSize);
+    // first[], intHash1[], intHash2[], next[], generations[] and the high 64 bits
+    assert(stats.memory == sizeof(StringHashSet) + (size_t)map->allocatedSize * (5 * sizeof(int) + sizeof(uint64_t)));
+    assert(stats.chains[0] >= map->allocatedSize - 100 && stats.longestChain >= 1);
+    long entries = 0;
+    for (int n = 1; n < HASH_STATS_CHAINS; n++)
+        entries += (long)n * stats.chains[n];
+    assert(entries == 100);
+    if (stats.enabled) {
+        assert(stats.calls[HASH_STATS_ADD] == 3100 && stats.calls[HASH_STATS_CONTAINS] == 100);
+        assert(stats.averageProbe[HASH_STATS_CONTAINS] >= 1.0 && stats.grows == 0); // it never had to grow
+    }
+    str_hashset_free(map);
+}
+
+// test #23 - every bulk lookup kernel the cpu has agrees with str_hashset_contains(), empty strings included
+void string_hash_set_test_23() {
+    static char storage[3000][24];
+    const char* strs[3000];
+    int found[3000];
+    for (int i = 0; i < 3000; i++) {
+        snprintf(storage[i], sizeof(storage[i]), i % 10 == 9 ? "" : "str-%d", i);
+        strs[i] = storage[i];
+    }
+    strs[5] = NULL;
+    for (int level = HASH_SIMD_SCALAR; level <= HASH_SIMD_AVX512; level++) {
+        if (hash_simd_set_level(level) != level)
+            break; // the cpu can't
+        StringHashSet* map = str_hashset_create(1024);
+        for (int i = 0; i < 3000; i += 3)
+            str_hashset_add(map, strs[i]);
+        for (int count = 1; count <= 3000; count += count < 40 ? 1 : 499) {
+            int hits = str_hashset_contains_many(map, strs, count, found);
+            int expected = 0;
+            for (int i = 0; i < count; i++) {
+                assert(found[i] == str_hashset_contains(map, strs[i]));
+                expected += found[i];
+            }
+            assert(hits == expected);
+        }
+        str_hashset_free(map);
+    }
+    hash_simd_set_level(-1);
+}
+
+// test #24 - adds while an incremental shrink migrates can outgrow the smaller table, it then grows instead
+void string_hash_set_test_24() {
+    int n = 65536;
+    char str[32];
+    StringHashSet* set = str_hashset_create(16);
+    str_hashset_set_incremental_resize(set, 1);
+    for (int i = 0; i < n; i++) {
+        snprintf(str, sizeof(str), "string %d", i);
+        str_hashset_add(set, str);
+    }
+    while (set->resizeTo != NULL) // finish the last grow
+        str_hashset_contains(set, "string 0");
+    int removed = 0;
+    while (set->resizeTo == NULL) { // until a shrink starts
+        snprintf(str, sizeof(str), "string %d", removed++);
+        assert(str_hashset_remove(set, str) == 1);
+    }
+    for (int i = n; i < 2 * n; i++) {
+        snprintf(str, sizeof(str), "string %d", i);
+        assert(str_hashset_add(set, str) == 1);
+    }
+    assert(set->size == n - removed + n);
+    for (int i = 0; i < 2 * n; i++) {
+        snprintf(str, sizeof(str), "string %d", i);
+        assert(str_hashset_contains(set, str) == (i >= removed));
+    }
+    str_hashset_free(set);
+}
+
 // run all the above tests
 void string_hash_set_tests() {
     printf("string_hash_set_test_1: ");
@@ -236,5 +664,64 @@ void string_hash_set_tests() {
     printf("string_hash_set_test_9: ");
     string_hash_set_test_9();
     printf("passed\n");
-}
 
+    printf("string_hash_set_test_10: ");
+    string_hash_set_test_10();
+    printf("passed\n");
+
+    printf("string_hash_set_test_11: ");
+    string_hash_set_test_11();
+    printf("passed\n");
+
+    printf("string_hash_set_test_12: ");
+    string_hash_set_test_12();
+    printf("passed\n");
+
+    printf("string_hash_set_test_13: ");
+    string_hash_set_test_13();
+    printf("passed\n");
+
+    printf("string_hash_set_test_14: ");
+    string_hash_set_test_14();
+    printf("passed\n");
+
+    printf("string_hash_set_test_15: ");
+    string_hash_set_test_15();
+    printf("passed\n");
+
+    printf("string_hash_set_test_16: ");
+    string_hash_set_test_16();
+    printf("passed\n");
+
+    printf("string_hash_set_test_17: ");
+    string_hash_set_test_17();
+    printf("passed\n");
+
+    printf("string_hash_set_test_18: ");
+    string_hash_set_test_18();
+    printf("passed\n");
+
+    printf("string_hash_set_test_19: ");
+    string_hash_set_test_19();
+    printf("passed\n");
+
+    printf("string_hash_set_test_20: ");
+    string_hash_set_test_20();
+    printf("passed\n");
+
+    printf("string_hash_set_test_21: ");
+    string_hash_set_test_21();
+    printf("passed\n");
+
+    printf("string_hash_set_test_22: ");
+    string_hash_set_test_22();
+    printf("passed\n");
+
+    printf("string_hash_set_test_23: ");
+    string_hash_set_test_23();
+    printf("passed\n");
+
+    printf("string_hash_set_test_24: ");
+    string_hash_set_test_24();
+    printf("passed\n");
+}
@@ -0,0 +1,95 @@
+//
+// Created by rock on 10/16/26.
+//
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../model/string_interner.h"
+#include "../model/string_hash_set.h"
+
+// test #1 - ids are dense and stable, and turn back into their strings
+void string_interner_test_1() {
+    StringInterner* interner = str_interner_create(10);
+    assert(str_interner_intern(interner, "hello", 5) == 0);
+    assert(str_interner_intern(interner, "world", 5) == 1);
+    assert(str_interner_intern(interner, "hello", 5) == 0); // seen before
+    assert(str_interner_intern(interner, "hello world", 5) == 0); // only the first len bytes count
+    assert(str_interner_intern(interner, "", 0) == 2);
+    assert(str_interner_intern(interner, "a\0b", 3) == 3); // any bytes, '\0' included
+    assert(str_interner_intern(interner, "a", 1) == 4);
+    assert(interner->size == 5);
+    size_t len = 0;
+    const char* str = str_interner_lookup(interner, 1, &len);
+    assert(len == 5 && strcmp(str, "world") == 0);
+    str = str_interner_lookup(interner, 3, &len);
+    assert(len == 3 && memcmp(str, "a\0b", 4) == 0);
+    assert(strcmp(str_interner_lookup(interner, 2, NULL), "") == 0);
+    assert(str_interner_lookup(interner, 5, &len) == NULL && str_interner_lookup(interner, -1, &len) == NULL);
+    assert(str_interner_find(interner, "world", 5) == 1 && str_interner_find(interner, "word", 4) == -1);
+    str_interner_free(interner);
+}
+
+// test #2 - many strings: the index grows and the strings don't move
+void string_interner_test_2() {
+    StringInterner* interner = str_interner_create(16);
+    char str[64];
+    static const char* first[200000];
+    for (int i = 0; i < 200000; i++) {
+        int len = snprintf(str, sizeof(str), "token-%d", i);
+        assert(str_interner_intern(interner, str, len) == i);
+        first[i] = str_interner_lookup(interner, i, NULL);
+    }
+    assert(interner->size == 200000 && interner->allocatedSize == 262144);
+    for (int i = 0; i < 200000; i++) {
+        int len = snprintf(str, sizeof(str), "token-%d", i);
+        assert(str_interner_intern(interner, str, len) == i);
+        size_t found = 0;
+        assert(str_interner_lookup(interner, i, &found) == first[i] && found == (size_t)len);
+        assert(strcmp(first[i], str) == 0);
+    }
+    assert(interner->chunk != NULL && interner->chunk->previous != NULL); // more than one chunk
+    str_interner_free(interner);
+}
+
+// test #3 - strings with the same hash are told apart by their bytes, long strings get a chunk of their own
+void string_interner_test_3() {
+    StringInterner* interner = str_interner_create(10);
+    assert(str_interner_intern(interner, "apple", 5) == 0);
+    // pretend "apple" has the hash of "pear" (a 64 bit collision)
+    interner->entries[0].hash = str_hashset_hash("pear", 4);
+    int firstIndex = (int)((uint32_t)interner->entries[0].hash & (uint32_t)(interner->allocatedSize - 1));
+    interner->first[firstIndex] = 0;
+    interner->entries[0].next = -1;
+    assert(str_interner_intern(interner, "pear", 4) == 1);
+    assert(str_interner_find(interner, "pear", 4) == 1 && strcmp(str_interner_lookup(interner, 1, NULL), "pear") == 0);
+
+    size_t longLen = 3 * STRING_INTERNER_CHUNK_SIZE;
+    char* longStr = malloc(longLen);
+    memset(longStr, 'x', longLen);
+    StringInternerChunk* current = interner->chunk;
+    assert(str_interner_intern(interner, longStr, longLen) == 2);
+    assert(interner->chunk == current); // the small strings keep filling the same chunk
+    assert(str_interner_intern(interner, longStr, longLen) == 2);
+    assert(str_interner_intern(interner, "plum", 4) == 3);
+    size_t len = 0;
+    assert(memcmp(str_interner_lookup(interner, 2, &len), longStr, longLen) == 0 && len == longLen);
+    free(longStr);
+    str_interner_free(interner);
+}
+
+// run all the above tests
+void string_interner_tests() {
+    printf("string_interner_test_1: ");
+    string_interner_test_1();
+    printf("passed\n");
+
+    printf("string_interner_test_2: ");
+    string_interner_test_2();
+    printf("passed\n");
+
+    printf("string_interner_test_3: ");
+    string_interner_test_3();
+    printf("passed\n");
+}